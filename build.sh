@@ -14,7 +14,7 @@ LLVM_CONFIG=${LLVM_CONFIG:-llvm-config}
 LLVM_CONFIG_LD_FLAGS=$(${LLVM_CONFIG} --ldflags)
 LLVM_CONFIG_INCLUDE_DIR=$(${LLVM_CONFIG} --includedir)
 LLVM_CONFIG_SYSTEM_LIBS=$(${LLVM_CONFIG} --system-libs)
-LLVM_CONFIG_CORE_LIBS=$(${LLVM_CONFIG} --libs core)
+LLVM_CONFIG_CORE_LIBS=$(${LLVM_CONFIG} --libs core bitreader bitwriter linker passes)
 
 mkdir -p build
 
@@ -54,10 +54,10 @@ build() {
 
   # Link
   echo "Linking: ${CC} -o ${OUTPUT} ${OBJS[*]} ${COMPILE_FLAGS} \
-    ${LLVM_CONFIG_LD_FLAGS} ${LLVM_CONFIG_SYSTEM_LIBS} ${LLVM_CONFIG_CORE_LIBS} \
+    ${LLVM_CONFIG_LD_FLAGS} ${LLVM_CONFIG_SYSTEM_LIBS} ${LLVM_CONFIG_CORE_LIBS} -lpthread \
     -I${LLVM_CONFIG_INCLUDE_DIR}"
   ${CC} -o ${OUTPUT} ${OBJS[*]} ${COMPILE_FLAGS} \
-    ${LLVM_CONFIG_LD_FLAGS} ${LLVM_CONFIG_SYSTEM_LIBS} ${LLVM_CONFIG_CORE_LIBS} \
+    ${LLVM_CONFIG_LD_FLAGS} ${LLVM_CONFIG_SYSTEM_LIBS} ${LLVM_CONFIG_CORE_LIBS} -lpthread \
     -I${LLVM_CONFIG_INCLUDE_DIR}
 }
 
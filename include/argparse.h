@@ -18,8 +18,14 @@ enum ParseMode {
   PM_StoreTrue,
 
   // This argument is optional and can store a single value. If it is
-  // provided, it is stored as a string.
+  // provided, it is stored as a string. The value can also be given inline
+  // with the long name as `-name=value` or `--name=value`.
   PM_Optional,
+
+  // Any positional arguments after the required ones are accumulated in a
+  // vector. The default value for this parsed argument is a vector of size 0.
+  // Only one argument can use this mode.
+  PM_RemainingPositional,
 };
 
 struct Argument {
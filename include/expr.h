@@ -13,6 +13,7 @@ typedef enum {
   EK_DeclRef,
   EK_PrettyFunction,
   EK_Int,
+  EK_Float,
   EK_Bool,  // true/false
   EK_String,
   EK_Char,
@@ -23,6 +24,8 @@ typedef enum {
   EK_Cast,
   EK_FunctionParam,
   EK_StmtExpr,
+  EK_ConvertVector,  // __builtin_convertvector
+  EK_AddrOfLabel,    // &&label
 } ExprKind;
 
 struct Expr;
@@ -51,6 +54,18 @@ typedef struct {
 void cast_construct(Cast* cast, Expr* base, Type* to,
                     const SourceLocation* loc);
 
+// This is an element-wise conversion between vector types with the same
+// number of elements. It's different from a cast between vector types, which
+// is a bitcast.
+typedef struct {
+  Expr expr;
+  Expr* base;
+  Type* to;
+} ConvertVector;
+
+void convert_vector_construct(ConvertVector* convert, Expr* base, Type* to,
+                              const SourceLocation* loc);
+
 typedef struct {
   Expr expr;
   void* expr_or_type;
@@ -131,6 +146,10 @@ static inline bool is_logical_binop(BinOpKind kind) {
   return kind == BOK_LogicalOr || kind == BOK_LogicalAnd;
 }
 
+static inline bool is_comparison_binop(BinOpKind kind) {
+  return BOK_Eq <= kind && kind <= BOK_Ge;
+}
+
 static inline bool is_assign_binop(BinOpKind kind) {
   return BOK_AssignFirst <= kind && kind <= BOK_AssignLast;
 }
@@ -192,6 +211,17 @@ typedef struct {
 void int_construct(Int* i, uint64_t val, BuiltinTypeKind kind,
                    const SourceLocation* loc);
 
+// The value is kept as written, without the suffix, and converted when lowered
+// so no precision is lost parsing it.
+typedef struct {
+  Expr expr;
+  char* val;
+  BuiltinType type;
+} Float;
+
+void float_construct(Float* f, const char* val, size_t len,
+                     BuiltinTypeKind kind, const SourceLocation* loc);
+
 typedef struct {
   Expr expr;
   char* val;
@@ -201,7 +231,8 @@ void string_literal_construct(StringLiteral* s, const char* val, size_t len,
                               const SourceLocation* loc);
 
 typedef struct {
-  char* name;  // Optional.
+  char* name;   // Optional. Set for `.name = expr` designators.
+  Expr* index;  // Optional. Set for `[index] = expr` designators.
   Expr* expr;
 } InitializerListElem;
 
@@ -265,4 +296,14 @@ typedef struct {
 void stmt_expr_construct(StmtExpr* se, struct CompoundStmt* stmt,
                          const SourceLocation* loc);
 
+// GCC's labels as values. This evaluates to a `void*` which can only be used
+// by a computed goto in the same function.
+typedef struct {
+  Expr expr;
+  char* label;
+} AddrOfLabel;
+
+void addr_of_label_construct(AddrOfLabel* addr, const char* label,
+                             const SourceLocation* loc);
+
 #endif  // EXPR_H_
@@ -29,7 +29,8 @@ typedef enum {
   TK_Const = TK_QualifiersFirst,
   TK_Volatile,
   TK_Restrict,
-  TK_QualifiersLast = TK_Restrict,
+  TK_Atomic,
+  TK_QualifiersLast = TK_Atomic,
 
   // Storage specifiers
   TK_StorageClassSpecifiersFirst,
@@ -68,7 +69,7 @@ typedef enum {
 
   // Assignment ops
   TK_Assign,        // =
-  TK_MulAssign,     // *-
+  TK_MulAssign,     // *=
   TK_DivAssign,     // /=
   TK_ModAssign,     // %=
   TK_AddAssign,     // +=
@@ -95,6 +96,7 @@ typedef enum {
   TK_Switch,
   TK_Break,
   TK_Continue,
+  TK_Goto,
   TK_Case,
   TK_Default,
   TK_True,  // TODO: I believe these are macros instead of actual keywords.
@@ -111,6 +113,7 @@ typedef enum {
 
   // Literals
   TK_IntLiteral,
+  TK_FloatLiteral,
   TK_StringLiteral,
   TK_CharLiteral,
 
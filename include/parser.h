@@ -15,6 +15,11 @@ typedef struct {
   Token lookahead;
   bool has_lookahead;
 
+  // The token after `lookahead`. This is only needed to tell labels apart
+  // from expressions starting with an identifier.
+  Token second_lookahead;
+  bool has_second_lookahead;
+
   // Needed for distinguishing between "(" <expr> ")" and "(" <type> ")".
   // See https://en.wikipedia.org/wiki/Lexer_hack
   // This is really only used as a set rather than a map.
@@ -34,6 +39,10 @@ Token parser_pop_token(Parser* parser);
 // parser_pop_token should destroy it.
 const Token* parser_peek_token(Parser* parser);
 
+// Peek the token after the next token. The same rules for destroying the token
+// apply.
+const Token* parser_peek_second_token(Parser* parser);
+
 bool next_token_is(Parser* parser, TokenKind kind);
 void parser_skip_next_token(Parser* parser);
 void parser_consume_token(Parser* parser, TokenKind kind);
@@ -76,7 +85,9 @@ typedef struct {
 Type* parse_type_for_declaration(Parser* parser, char** name,
                                  FoundStorageClasses* storage);
 
-// TODO: Don't handle attributes for now. Just consume them.
+// Parse an `__attribute__((...))` into `attrs`. `attrs` is optional. If it's
+// not provided, the attribute is just consumed.
+void parser_parse_attribute(Parser* parser, DeclAttributes* attrs);
 void parser_consume_attribute(Parser* parser);
 void parser_consume_asm_label(Parser* parser);
 void parser_consume_pragma(Parser* parser);
@@ -93,7 +104,7 @@ EnumType* parse_enum_type(Parser* parser);
 
 Type* parse_specifiers_and_qualifiers_and_storage(Parser* parser,
                                                   FoundStorageClasses* storage,
-                                                  bool* found_inline);
+                                                  DeclAttributes* attrs);
 Type* parse_pointers_and_qualifiers(Parser* parser, Type* base);
 Type* parse_declarator_maybe_type_suffix(Parser* parser, Type* outer_ty,
                                          Type*** type_usage_addr);
@@ -1,9 +1,11 @@
 #ifndef SEMA_H_
 #define SEMA_H_
 
+#include <pthread.h>
 #include <stdint.h>
 
 #include "expr.h"
+#include "stmt.h"
 #include "top-level-node.h"
 #include "tree-map.h"
 #include "type.h"
@@ -56,15 +58,92 @@ typedef struct {
   BuiltinType bt_Bool;
 
   PointerType str_ty;
+  PointerType void_ptr_ty;  // The type of `&&label`.
 
-  GlobalVariable builtin_trap;
+  // The type of the predefined `__ATOMIC_*` memory order constants.
+  EnumType memory_order_ty;
+
+  // Declarations of the `__builtin_*` functions that codegen lowers itself.
+  // This is a vector of GlobalVariable pointers owned by Sema.
+  vector builtins;
 
   // This is a vector of all types that Sema needs to create on the fly via
   // the address of operator. This is a vector of pointers to
   // NonOwningPointerTypes.
   vector address_of_storage;
+
+  // Codegen can run on multiple threads which all share the same Sema. This
+  // guards `address_of_storage` since Sema appends to it after semantic
+  // analysis.
+  pthread_mutex_t address_of_storage_lock;
+
+  // This is a vector of all vector types Sema needs to create on the fly for
+  // expressions like vector comparisons whose type may not be spelled anywhere
+  // in the source. This is a vector of pointers to VectorTypes.
+  vector vector_type_storage;
+  pthread_mutex_t vector_type_storage_lock;
+
+  // Map of resolved StructTypes to their StructLayouts, which are computed
+  // the first time they're needed.
+  TreeMap struct_layouts;
+  pthread_mutex_t struct_layouts_lock;
 } Sema;
 
+// The `__atomic_*`, `__sync_*`, and `__c11_atomic_*` builtins are generic over
+// the type their first argument points to, so Sema types calls to them
+// specially rather than declaring them.
+typedef enum {
+  ABK_Load,
+  ABK_Store,
+  ABK_Exchange,
+  ABK_CompareExchange,      // Returns true if the exchange happened.
+  ABK_BoolCompareAndSwap,   // Returns true if the swap happened.
+  ABK_ValCompareAndSwap,    // Returns the old value.
+  ABK_FetchOp,              // Returns the old value.
+  ABK_OpFetch,              // Returns the new value.
+  ABK_ThreadFence,
+  ABK_SignalFence,
+} AtomicBuiltinKind;
+
+typedef enum {
+  AO_Add,
+  AO_Sub,
+  AO_And,
+  AO_Or,
+  AO_Xor,
+  AO_Nand,
+} AtomicOp;
+
+// These match the values of the `__ATOMIC_*` constants.
+typedef enum {
+  MO_Relaxed,
+  MO_Consume,
+  MO_Acquire,
+  MO_Release,
+  MO_AcqRel,
+  MO_SeqCst,
+} MemoryOrder;
+
+typedef struct {
+  AtomicBuiltinKind kind;
+  AtomicOp op;  // Only used for ABK_FetchOp and ABK_OpFetch.
+
+  // The number of arguments before any memory order arguments.
+  size_t num_args;
+
+  // The __sync builtins take no memory order arguments and instead always use
+  // `order`. ABK_CompareExchange takes 2 memory orders. Everything else takes
+  // one.
+  bool has_memory_order;
+  MemoryOrder order;
+
+  // For ABK_CompareExchange. The GCC builtin takes `weak` as an argument.
+  bool has_weak_arg;
+  bool is_weak;
+} AtomicBuiltin;
+
+bool sema_get_atomic_builtin(const char* name, AtomicBuiltin* builtin);
+
 void sema_construct(Sema* sema);
 void sema_destroy(Sema* sema);
 
@@ -82,6 +161,12 @@ const ArrayType* sema_get_array_type(const Sema* sema, const Type* type,
                                      const TreeMap* local_ctx);
 const Type* sema_get_pointee(const Sema* sema, const Type* type,
                              const TreeMap* local_ctx);
+const VectorType* sema_get_vector_type(const Sema* sema, const Type* type,
+                                       const TreeMap* local_ctx);
+size_t sema_get_vector_length(Sema* sema, const VectorType* vec,
+                              const TreeMap* local_ctx);
+const VectorType* sema_get_vector_type_of(Sema* sema, BuiltinTypeKind kind,
+                                          size_t len);
 const StructType* sema_get_struct_type(const Sema* sema, const Type* type,
                                        const TreeMap* local_ctx);
 const Type* sema_get_type_of_expr_in_ctx(Sema* sema, const Expr* expr,
@@ -134,9 +219,12 @@ bool sema_is_array_type(const Sema* sema, const Type* type,
                         const TreeMap* local_ctx);
 bool sema_is_struct_type(const Sema* sema, const Type* type,
                          const TreeMap* local_ctx);
+bool sema_is_vector_type(const Sema* sema, const Type* type,
+                         const TreeMap* local_ctx);
 bool sema_is_pointer_to(const Sema* sema, const Type* type, TypeKind kind,
                         const TreeMap* local_ctx);
 bool sema_is_unsigned_integral_type(const Sema* sema, const Type* type);
+bool sema_is_floating_point_type(const Sema* sema, const Type* type);
 bool sema_is_function_or_function_ptr(Sema* sema, const Type* ty,
                                       const TreeMap* local_ctx);
 
@@ -148,6 +236,8 @@ size_t sema_eval_sizeof_array(Sema*, const ArrayType*,
                               const TreeMap* local_ctx);
 size_t sema_eval_alignof_array(Sema*, const ArrayType*,
                                const TreeMap* local_ctx);
+size_t sema_eval_sizeof_vector(Sema*, const VectorType*,
+                               const TreeMap* local_ctx);
 size_t sema_eval_alignof_members(Sema* sema, const vector* members,
                                  const TreeMap* local_ctx);
 size_t sema_eval_sizeof_struct_type(Sema* sema, const StructType* type,
@@ -155,6 +245,31 @@ size_t sema_eval_sizeof_struct_type(Sema* sema, const StructType* type,
 size_t sema_eval_sizeof_union_type(Sema* sema, const UnionType* type,
                                    const TreeMap* local_ctx);
 
+// Where a struct member lives in memory.
+typedef struct {
+  size_t offset;  // In bytes. For bitfields, this is the byte holding the
+                  // first bit of the bitfield.
+
+  // These are only used for bitfields. `bit_offset` is counted from the least
+  // significant bit of the byte at `offset`.
+  bool is_bitfield;
+  size_t bit_offset;
+  size_t bit_width;
+} MemberLayout;
+
+typedef struct {
+  MemberLayout* members;  // One for each member of the struct.
+  size_t size;
+  size_t align;
+} StructLayout;
+
+// Lay out the members of a struct following the SysV ABI. Bitfields are
+// packed into storage units of their declared type and never straddle a
+// boundary of that unit unless the struct is packed. The layout is owned by
+// Sema.
+const StructLayout* sema_get_struct_layout(Sema* sema, const StructType* type,
+                                           const TreeMap* local_ctx);
+
 bool sema_struct_or_union_components_are_compatible(
     Sema* sema, const char* lhs_name, const vector* lhs_members,
     const char* rhs_name, const vector* rhs_members, bool ignore_quals,
@@ -168,6 +283,13 @@ bool sema_types_are_compatible_ignore_quals(Sema* sema, const Type* lhs,
 void sema_verify_static_assert_condition(Sema* sema, const Expr* cond,
                                          const TreeMap* local_ctx);
 
+// Check `ret` can be lowered to a `musttail` call from a function of type
+// `caller`. The returned expression must be a call to a function whose
+// parameter and return types match those of the caller.
+void sema_verify_musttail_return(Sema* sema, const FunctionType* caller,
+                                 const ReturnStmt* ret,
+                                 const TreeMap* local_ctx);
+
 typedef enum {
   // TODO: Add the other expression result kinds.
   RK_Boolean,
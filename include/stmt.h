@@ -17,6 +17,9 @@ typedef enum {
   SK_SwitchStmt,
   SK_BreakStmt,
   SK_ContinueStmt,
+  SK_LabelStmt,
+  SK_GotoStmt,
+  SK_IndirectGotoStmt,  // goto *ptr;
 } StatementKind;
 
 struct Statement;
@@ -58,6 +61,32 @@ typedef struct {
 
 void break_stmt_construct(BreakStmt* stmt, const SourceLocation* loc);
 
+typedef struct {
+  Statement base;
+  char* name;
+  Statement* stmt;  // Optional. NULL for a label at the end of a block.
+} LabelStmt;
+
+void label_stmt_construct(LabelStmt* stmt, const char* name, Statement* body,
+                          const SourceLocation* loc);
+
+typedef struct {
+  Statement base;
+  char* label;
+} GotoStmt;
+
+void goto_stmt_construct(GotoStmt* stmt, const char* label,
+                         const SourceLocation* loc);
+
+// GCC's computed goto. `target` is an address taken with `&&label`.
+typedef struct {
+  Statement base;
+  Expr* target;
+} IndirectGotoStmt;
+
+void indirect_goto_stmt_construct(IndirectGotoStmt* stmt, Expr* target,
+                                  const SourceLocation* loc);
+
 struct IfStmt {
   Statement base;
   Expr* cond;  // Required only for the first If. All chained Ifs through the
@@ -128,6 +157,10 @@ void compound_stmt_construct(CompoundStmt* stmt, vector body,
 typedef struct {
   Statement base;
   Expr* expr;  // Optional. NULL means returning void.
+
+  // Set by `__attribute__((musttail))`. The returned expression must then be
+  // a call to a function with the same signature as the caller.
+  bool musttail;
 } ReturnStmt;
 
 void return_stmt_construct(ReturnStmt* stmt, Expr* expr,
@@ -85,11 +85,62 @@ typedef struct {
 void static_assert_construct(StaticAssert* sa, Expr* expr,
                              const SourceLocation* loc);
 
+// https://gcc.gnu.org/onlinedocs/gcc/Common-Variable-Attributes.html#index-tls_005fmodel-variable-attribute
+//
+// These are ordered from the most general to the most efficient model.
+typedef enum {
+  TLS_Default,  // The model is chosen from the linkage of the variable.
+  TLS_GlobalDynamic,
+  TLS_LocalDynamic,
+  TLS_InitialExec,
+  TLS_LocalExec,
+} TLSModel;
+
+// Parse a model name like `initial-exec`. Returns false if the name is not a
+// TLS model.
+bool tls_model_from_name(const char* name, TLSModel* model);
+
+// Attributes given to a declaration through `inline` and
+// `__attribute__((...))`. Attributes the compiler doesn't use are dropped by
+// the parser.
+typedef struct {
+  unsigned int inline_ : 1;
+  unsigned int always_inline : 1;
+  unsigned int noinline : 1;
+  unsigned int hot : 1;
+  unsigned int cold : 1;
+  unsigned int flatten : 1;
+  unsigned int pure : 1;
+  unsigned int const_ : 1;
+  unsigned int noreturn : 1;
+  unsigned int malloc_ : 1;
+  unsigned int returns_nonnull : 1;
+  unsigned int packed : 1;
+  unsigned int musttail : 1;  // A statement attribute on `return`.
+
+  // `nonnull` without arguments applies to every pointer parameter. Otherwise,
+  // bit i of `nonnull_args` is set if parameter i + 1 was listed.
+  unsigned int nonnull_all : 1;
+  uint64_t nonnull_args;
+
+  Expr* aligned;  // Optional. The argument of `aligned(N)`.
+
+  // Optional. The arguments of `vector_size(N)` and `ext_vector_type(N)`.
+  Expr* vector_size;
+  Expr* ext_vector_type;
+
+  TLSModel tls_model;  // From `tls_model("...")`.
+} DeclAttributes;
+
+void decl_attributes_construct(DeclAttributes* attrs);
+void decl_attributes_destroy(DeclAttributes* attrs);
+
 typedef struct {
   TopLevelNode node;
   char* name;
   Type* type;
   Expr* initializer;  // Optional.
+  DeclAttributes attrs;
 
   bool is_extern;  // false implies `static`.
   bool is_thread_local;
@@ -136,6 +187,7 @@ typedef struct {
   Type* type;
   CompoundStmt* body;
   bool is_extern;  // false implies this is `static`.
+  DeclAttributes attrs;
 } FunctionDefinition;
 
 void function_definition_construct(FunctionDefinition* f, const char* name,
@@ -44,6 +44,10 @@ void tree_map_clone(TreeMap* dst, const TreeMap* src);
 
 void string_tree_map_construct(TreeMap* map);
 
+// Keys are compared by address and are not copied or destroyed by the map.
+// Iteration order is unspecified.
+void pointer_tree_map_construct(TreeMap* map);
+
 void RunTreeMapTests();
 
 #endif  // TREE_MAP_H_
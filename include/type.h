@@ -15,6 +15,7 @@ typedef enum {
   TK_PointerType,
   TK_ArrayType,
   TK_FunctionType,
+  TK_VectorType,  // From the `vector_size` or `ext_vector_type` attributes
 
   // This is a special type used for lazy replacements of types in the AST.
   // This does not reflect an C types.
@@ -36,9 +37,11 @@ typedef struct {
 static const int kConstShift = 0;
 static const int kVolatileShift = 1;
 static const int kRestrictShift = 2;
+static const int kAtomicShift = 3;
 static const int kConstMask = 1 << kConstShift;
 static const int kVolatileMask = 1 << kVolatileShift;
 static const int kRestrictMask = 1 << kRestrictShift;
+static const int kAtomicMask = 1 << kAtomicShift;
 
 typedef uint8_t Qualifiers;
 
@@ -48,6 +51,7 @@ struct Type {
   // bit 0: const
   // bit 1: volatile
   // bit 2: restrict
+  // bit 3: _Atomic
   Qualifiers qualifiers;
 
   struct Expr* align;  // NULL indicates the default target alignment should be
@@ -77,6 +81,9 @@ static inline bool type_is_volatile(Type* type) {
 static inline bool type_is_restrict(Type* type) {
   return (bool)(type->qualifiers & kRestrictMask);
 }
+static inline bool type_is_atomic(const Type* type) {
+  return (bool)(type->qualifiers & kAtomicMask);
+}
 
 typedef struct {
   Type type;
@@ -122,6 +129,7 @@ bool is_pointer_to(const Type* type, TypeKind pointee);
 bool is_array_type(const Type* type);
 bool is_integral_type(const Type* type);
 bool is_unsigned_integral_type(const Type* type);
+bool is_floating_point_type(const Type* type);
 static inline bool is_void_type(const Type* type) {
   return is_builtin_type(type, BTK_Void);
 }
@@ -130,6 +138,7 @@ static inline bool is_bool_type(const Type* type) {
 }
 
 unsigned get_integral_rank(const BuiltinType* bt);
+unsigned get_floating_point_rank(const BuiltinType* bt);
 
 typedef struct {
   Type* type;
@@ -211,6 +220,21 @@ typedef struct {
 void array_type_construct(ArrayType* arr, Type* elem_type, struct Expr* size);
 ArrayType* create_array_of(Type* elem, struct Expr* size);
 
+// https://gcc.gnu.org/onlinedocs/gcc/Vector-Extensions.html
+// https://clang.llvm.org/docs/LanguageExtensions.html#vectors-and-extended-vectors
+typedef struct {
+  Type type;
+  Type* elem_type;
+
+  // For `vector_size` this is the size of the vector in bytes. For
+  // `ext_vector_type` this is the number of elements.
+  struct Expr* size;
+  bool is_ext_vector;
+} VectorType;
+
+void vector_type_construct(VectorType* vec, Type* elem_type, struct Expr* size,
+                           bool is_ext_vector);
+
 typedef struct {
   Type type;
   Type* pointee;
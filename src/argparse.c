@@ -13,6 +13,37 @@ static bool matches_long_name(const void* it, void* arg) {
   return strcmp(((const struct Argument*)it)->long_name, arg) == 0;
 }
 
+// Find the argument for `arg` if it is in the form
+//
+//   -name=value
+//
+// or `--name=value` where `name` is a long name. This is the form used by
+// options like `-march=`. `val` is set to the part after the `=`. Returns
+// `args_end` if there is no such argument.
+static const struct Argument* find_arg_with_inline_value(
+    const struct Argument* args, const struct Argument* args_end,
+    const char* arg, const char** val) {
+  const char* name = &arg[1];
+  if (name[0] == '-')
+    name = &name[1];
+
+  size_t len = strcspn(name, "=");
+  if (name[len] != '=')
+    return args_end;
+
+  for (const struct Argument* it = args; it != args_end; ++it) {
+    if (strncmp(it->long_name, name, len) == 0 && it->long_name[len] == 0) {
+      *val = &name[len + 1];
+      return it;
+    }
+  }
+  return args_end;
+}
+
+static bool is_remaining_positional(const void* it, void* arg) {
+  return ((const struct Argument*)it)->mode == PM_RemainingPositional;
+}
+
 static const struct Argument* get_nth_pos_arg(size_t num_args,
                                               const struct Argument* args,
                                               size_t n) {
@@ -78,7 +109,8 @@ void parse_args(size_t num_args, const struct Argument* args,
         }
         break;
       }
-      case PM_Multiple: {
+      case PM_Multiple:
+      case PM_RemainingPositional: {
         if (!tree_map_get(parsed_args, it->long_name, NULL)) {
           struct ParsedArgument* parsed_arg =
               malloc(sizeof(struct ParsedArgument));
@@ -98,11 +130,20 @@ void parse_args(size_t num_args, const struct Argument* args,
     if (arg[0] == '-') {
       // Optional argument.
 
-      const struct Argument* found_arg;
-      if (arg[1] != '-') {
-        char short_name = arg[1];
+      const char* inline_val = NULL;
+      const struct Argument* found_arg =
+          find_arg_with_inline_value(args, args_end, arg, &inline_val);
+      if (found_arg != args_end) {
+        // The value was given inline with the argument.
+      } else if (arg[1] != '-') {
+        // Long names can also follow a single dash, like `-ffast-math`.
         found_arg = find_if(args, args_end, sizeof(struct Argument),
-                            matches_short_name, &short_name);
+                            matches_long_name, (void*)&arg[1]);
+        if (found_arg == args_end) {
+          char short_name = arg[1];
+          found_arg = find_if(args, args_end, sizeof(struct Argument),
+                              matches_short_name, &short_name);
+        }
         ASSERT_MSG(found_arg != args_end, "Unknown argument '%s'", arg);
       } else {
         const char* long_name = &arg[2];
@@ -113,10 +154,14 @@ void parse_args(size_t num_args, const struct Argument* args,
 
       switch (found_arg->mode) {
         case PM_RequiredPositional:
+        case PM_RemainingPositional:
           UNREACHABLE_MSG(
               "Required positional argument should not be handled in the "
               "optional argument cases");
         case PM_StoreTrue: {
+          ASSERT_MSG(!inline_val, "Argument '%s' does not take a value",
+                     found_arg->long_name);
+
           // This already has a default value set prior.
           struct ParsedArgument* parsed_arg = NULL;
           tree_map_get(parsed_args, found_arg->long_name, &parsed_arg);
@@ -132,7 +177,13 @@ void parse_args(size_t num_args, const struct Argument* args,
           ASSERT_MSG(!tree_map_get(parsed_args, found_arg->long_name, NULL),
                      "Duplicate optional argument '%s' was already provided.",
                      found_arg->long_name);
-          const char* val = get_next_string_argument_and_advance(&i, argv);
+          const char* val;
+          if (inline_val) {
+            val = inline_val;
+            i += 1;
+          } else {
+            val = get_next_string_argument_and_advance(&i, argv);
+          }
 
           struct ParsedArgument* parsed_arg =
               malloc(sizeof(struct ParsedArgument));
@@ -149,7 +200,12 @@ void parse_args(size_t num_args, const struct Argument* args,
                      found_arg->long_name);
 
           const char** storage = vector_append_storage(parsed_arg->value);
-          *storage = get_next_string_argument_and_advance(&i, argv);
+          if (inline_val) {
+            *storage = inline_val;
+            i += 1;
+          } else {
+            *storage = get_next_string_argument_and_advance(&i, argv);
+          }
           break;
         }
       }
@@ -157,14 +213,30 @@ void parse_args(size_t num_args, const struct Argument* args,
       // Positional argument.
       const struct Argument* pos_arg =
           get_nth_pos_arg(num_args, args, num_parsed_pos_args);
-      assert(pos_arg);
-      ++num_parsed_pos_args;
+      if (pos_arg) {
+        ++num_parsed_pos_args;
 
-      struct ParsedArgument* parsed_arg = malloc(sizeof(struct ParsedArgument));
-      parsed_arg->kind = PAK_String;
-      parsed_arg->value = (void*)arg;
+        struct ParsedArgument* parsed_arg =
+            malloc(sizeof(struct ParsedArgument));
+        parsed_arg->kind = PAK_String;
+        parsed_arg->value = (void*)arg;
 
-      tree_map_set(parsed_args, pos_arg->long_name, parsed_arg);
+        tree_map_set(parsed_args, pos_arg->long_name, parsed_arg);
+      } else {
+        // All the required positional arguments were already provided.
+        pos_arg = find_if(args, args_end, sizeof(struct Argument),
+                          is_remaining_positional, NULL);
+        ASSERT_MSG(pos_arg != args_end, "Unexpected positional argument '%s'",
+                   arg);
+
+        // This already has a default value set prior.
+        struct ParsedArgument* parsed_arg = NULL;
+        tree_map_get(parsed_args, pos_arg->long_name, &parsed_arg);
+        assert(parsed_arg);
+
+        const char** storage = vector_append_storage(parsed_arg->value);
+        *storage = arg;
+      }
 
       i += 1;
     }
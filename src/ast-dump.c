@@ -140,6 +140,16 @@ static void dump_type(const Type* type, int leading_padding,
       leading_padding--;
       break;
     }
+    case TK_VectorType: {
+      const VectorType* vec = (const VectorType*)type;
+      printf("VectorType is_ext_vector:%d\n", vec->is_ext_vector);
+      leading_padding++;
+
+      dump_type(vec->elem_type, leading_padding, "elem_type: ");
+
+      leading_padding--;
+      break;
+    }
     case TK_ReplacementSentinelType:
       UNREACHABLE_MSG("This type should not be handled here.");
   }
@@ -177,6 +187,9 @@ static void dump_expr(const Expr* expr, int leading_padding,
     case EK_Int: {
       UNREACHABLE_MSG("TODO: Handle this");
     }
+    case EK_Float: {
+      UNREACHABLE_MSG("TODO: Handle this");
+    }
     case EK_BinOp: {
       UNREACHABLE_MSG("TODO: Handle this");
     }
@@ -200,6 +213,10 @@ static void dump_expr(const Expr* expr, int leading_padding,
       UNREACHABLE_MSG("TODO: Handle this");
     case EK_StmtExpr:
       UNREACHABLE_MSG("TODO: Handle this");
+    case EK_ConvertVector:
+      UNREACHABLE_MSG("TODO: Handle this");
+    case EK_AddrOfLabel:
+      UNREACHABLE_MSG("TODO: Handle this");
   }
 }
 
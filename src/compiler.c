@@ -1,11 +1,16 @@
 #include <assert.h>
 #include <ctype.h>
 #include <llvm-c/Analysis.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/DebugInfo.h>
+#include <llvm-c/Linker.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/TargetMachine.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 #include <llvm-c/Types.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -263,24 +268,732 @@ bool preprocessor_input_stream_eof(InputStream* input) {
 /// End Input Stream Implementation
 ///
 
+///
+/// Start SSA Construction Implementation
+///
+
+// Locals whose address is never taken do not need stack slots. Instead, we
+// track the value each one holds at the end of every basic block and build SSA
+// form (with phis) on the fly while the function is emitted. This follows
+// "Simple and Efficient Construction of Static Single Assignment Form" by
+// Braun et al.
+//
+// A block is "sealed" once all of its predecessors are known. Reading a
+// variable in a block that is not sealed yet creates an incomplete phi which
+// gets its operands when the block is sealed.
+
+typedef struct {
+  const char* name;  // Not owned.
+  LLVMTypeRef llvm_type;
+
+  // Map of LLVMBasicBlockRef to the LLVMValueRef this variable holds at the
+  // end of that block.
+  TreeMap defs;
+} SSAVariable;
+
+typedef struct {
+  LLVMBasicBlockRef bb;  // NULL once the phi has been given its operands.
+  SSAVariable* var;
+  LLVMValueRef phi;
+} IncompletePhi;
+
+typedef struct {
+  // Names of locals whose address is taken anywhere in the function. This is
+  // conservative with respect to shadowing, but any local with one of these
+  // names will always get an alloca.
+  TreeMap address_taken;
+
+  vector vars;     // Vector of owned SSAVariable pointers.
+  TreeMap var_set;  // Set of the SSAVariable pointers in `vars`.
+
+  TreeMap sealed;          // Set of LLVMBasicBlockRefs.
+  vector incomplete_phis;  // Vector of IncompletePhis.
+
+  // Trivial phis are replaced as soon as they are found, but they are only
+  // erased once the whole function is emitted since `defs` and callers may
+  // still refer to them. `replaced` maps each of them to its replacement.
+  TreeMap replaced;
+  vector removed_phis;  // Vector of LLVMValueRefs.
+
+  LLVMBuilderRef phi_builder;
+} SSABuilder;
+
+void ssa_builder_construct(SSABuilder* ssa, LLVMContextRef ctx) {
+  string_tree_map_construct(&ssa->address_taken);
+  vector_construct(&ssa->vars, sizeof(SSAVariable*), alignof(SSAVariable*));
+  pointer_tree_map_construct(&ssa->var_set);
+  pointer_tree_map_construct(&ssa->sealed);
+  vector_construct(&ssa->incomplete_phis, sizeof(IncompletePhi),
+                   alignof(IncompletePhi));
+  pointer_tree_map_construct(&ssa->replaced);
+  vector_construct(&ssa->removed_phis, sizeof(LLVMValueRef),
+                   alignof(LLVMValueRef));
+  ssa->phi_builder = LLVMCreateBuilderInContext(ctx);
+}
+
+void ssa_builder_destroy(SSABuilder* ssa) {
+  for (size_t i = 0; i < ssa->vars.size; ++i) {
+    SSAVariable* var = *(SSAVariable**)vector_at(&ssa->vars, i);
+    tree_map_destroy(&var->defs);
+    free(var);
+  }
+  vector_destroy(&ssa->vars);
+  tree_map_destroy(&ssa->address_taken);
+  tree_map_destroy(&ssa->var_set);
+  tree_map_destroy(&ssa->sealed);
+  vector_destroy(&ssa->incomplete_phis);
+  tree_map_destroy(&ssa->replaced);
+  vector_destroy(&ssa->removed_phis);
+  LLVMDisposeBuilder(ssa->phi_builder);
+}
+
+SSAVariable* ssa_create_variable(SSABuilder* ssa, const char* name,
+                                 LLVMTypeRef llvm_type) {
+  SSAVariable* var = malloc(sizeof(SSAVariable));
+  var->name = name;
+  var->llvm_type = llvm_type;
+  pointer_tree_map_construct(&var->defs);
+
+  SSAVariable** storage = vector_append_storage(&ssa->vars);
+  *storage = var;
+  tree_map_set(&ssa->var_set, var, var);
+  return var;
+}
+
+bool ssa_is_variable(const SSABuilder* ssa, const void* val) {
+  return tree_map_has(&ssa->var_set, val);
+}
+
+void ssa_write_variable(SSAVariable* var, LLVMBasicBlockRef bb,
+                        LLVMValueRef val) {
+  tree_map_set(&var->defs, bb, val);
+}
+
+static LLVMValueRef ssa_resolve(const SSABuilder* ssa, LLVMValueRef val) {
+  void* replacement;
+  while (tree_map_get(&ssa->replaced, val, &replacement))
+    val = replacement;
+  return val;
+}
+
+// Returns a vector of the LLVMBasicBlockRefs that branch to `bb`. A block that
+// branches to `bb` more than once appears more than once.
+static vector get_predecessors(LLVMBasicBlockRef bb) {
+  vector preds;
+  vector_construct(&preds, sizeof(LLVMBasicBlockRef),
+                   alignof(LLVMBasicBlockRef));
+  for (LLVMUseRef use = LLVMGetFirstUse(LLVMBasicBlockAsValue(bb)); use;
+       use = LLVMGetNextUse(use)) {
+    LLVMValueRef user = LLVMGetUser(use);
+    if (!LLVMIsATerminatorInst(user))
+      continue;
+    LLVMBasicBlockRef* storage = vector_append_storage(&preds);
+    *storage = LLVMGetInstructionParent(user);
+  }
+  return preds;
+}
+
+static LLVMValueRef ssa_build_phi(SSABuilder* ssa, SSAVariable* var,
+                                  LLVMBasicBlockRef bb) {
+  LLVMValueRef first = LLVMGetFirstInstruction(bb);
+  if (first)
+    LLVMPositionBuilder(ssa->phi_builder, bb, first);
+  else
+    LLVMPositionBuilderAtEnd(ssa->phi_builder, bb);
+  return LLVMBuildPhi(ssa->phi_builder, var->llvm_type, var->name);
+}
+
+// If `phi` only merges one value (besides itself), replace it with that value
+// and return the replacement. Otherwise, return `phi`.
+static LLVMValueRef ssa_try_remove_trivial_phi(SSABuilder* ssa,
+                                               LLVMValueRef phi) {
+  LLVMValueRef same = NULL;
+  unsigned num_incoming = LLVMCountIncoming(phi);
+  for (unsigned i = 0; i < num_incoming; ++i) {
+    LLVMValueRef op = LLVMGetIncomingValue(phi, i);
+    if (op == same || op == phi)
+      continue;
+    if (same)
+      return phi;
+    same = op;
+  }
+
+  // The phi is unreachable or only references itself.
+  if (!same)
+    same = LLVMGetUndef(LLVMTypeOf(phi));
+
+  vector users;
+  vector_construct(&users, sizeof(LLVMValueRef), alignof(LLVMValueRef));
+  for (LLVMUseRef use = LLVMGetFirstUse(phi); use; use = LLVMGetNextUse(use)) {
+    LLVMValueRef user = LLVMGetUser(use);
+    if (user == phi)
+      continue;
+    LLVMValueRef* storage = vector_append_storage(&users);
+    *storage = user;
+  }
+
+  LLVMReplaceAllUsesWith(phi, same);
+  tree_map_set(&ssa->replaced, phi, same);
+  LLVMValueRef* storage = vector_append_storage(&ssa->removed_phis);
+  *storage = phi;
+
+  // Removing this phi may have made other phis that used it trivial.
+  for (size_t i = 0; i < users.size; ++i) {
+    LLVMValueRef user = *(LLVMValueRef*)vector_at(&users, i);
+    if (LLVMIsAPHINode(user) && !tree_map_has(&ssa->replaced, user))
+      ssa_try_remove_trivial_phi(ssa, user);
+  }
+
+  vector_destroy(&users);
+
+  return same;
+}
+
+LLVMValueRef ssa_read_variable(SSABuilder* ssa, SSAVariable* var,
+                               LLVMBasicBlockRef bb);
+
+static LLVMValueRef ssa_add_phi_operands(SSABuilder* ssa, SSAVariable* var,
+                                         LLVMValueRef phi) {
+  vector preds = get_predecessors(LLVMGetInstructionParent(phi));
+  for (size_t i = 0; i < preds.size; ++i) {
+    LLVMBasicBlockRef pred = *(LLVMBasicBlockRef*)vector_at(&preds, i);
+    LLVMValueRef incoming = ssa_read_variable(ssa, var, pred);
+    LLVMAddIncoming(phi, &incoming, &pred, 1);
+  }
+  vector_destroy(&preds);
+  return ssa_try_remove_trivial_phi(ssa, phi);
+}
+
+static LLVMValueRef ssa_read_variable_recursive(SSABuilder* ssa,
+                                                SSAVariable* var,
+                                                LLVMBasicBlockRef bb) {
+  LLVMValueRef val;
+  if (!tree_map_has(&ssa->sealed, bb)) {
+    // Not all predecessors are known yet.
+    val = ssa_build_phi(ssa, var, bb);
+    IncompletePhi* incomplete = vector_append_storage(&ssa->incomplete_phis);
+    incomplete->bb = bb;
+    incomplete->var = var;
+    incomplete->phi = val;
+  } else {
+    vector preds = get_predecessors(bb);
+    if (preds.size == 0) {
+      // Either the entry block or unreachable. The variable is uninitialized.
+      val = LLVMGetUndef(var->llvm_type);
+    } else if (preds.size == 1) {
+      val = ssa_read_variable(ssa, var,
+                              *(LLVMBasicBlockRef*)vector_at(&preds, 0));
+    } else {
+      // Write the phi first to break cycles through loops.
+      val = ssa_build_phi(ssa, var, bb);
+      ssa_write_variable(var, bb, val);
+      val = ssa_add_phi_operands(ssa, var, val);
+    }
+    vector_destroy(&preds);
+  }
+  ssa_write_variable(var, bb, val);
+  return val;
+}
+
+// Get the value `var` holds at the end of what has been emitted so far in `bb`.
+LLVMValueRef ssa_read_variable(SSABuilder* ssa, SSAVariable* var,
+                               LLVMBasicBlockRef bb) {
+  void* val;
+  if (tree_map_get(&var->defs, bb, &val))
+    return ssa_resolve(ssa, val);
+  return ssa_resolve(ssa, ssa_read_variable_recursive(ssa, var, bb));
+}
+
+// This should be called once every block that branches to `bb` has been
+// terminated.
+void ssa_seal_block(SSABuilder* ssa, LLVMBasicBlockRef bb) {
+  // Adding operands can create new incomplete phis in other blocks, so the
+  // vector can grow while we iterate.
+  for (size_t i = 0; i < ssa->incomplete_phis.size; ++i) {
+    IncompletePhi* incomplete = vector_at(&ssa->incomplete_phis, i);
+    if (incomplete->bb != bb)
+      continue;
+    incomplete->bb = NULL;
+    SSAVariable* var = incomplete->var;
+    LLVMValueRef phi = incomplete->phi;
+    ssa_add_phi_operands(ssa, var, phi);
+  }
+  tree_map_set(&ssa->sealed, bb, bb);
+}
+
+// Seal any remaining blocks and erase the phis that were found to be trivial.
+void ssa_finalize_function(SSABuilder* ssa, LLVMValueRef fn) {
+  for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(fn); bb;
+       bb = LLVMGetNextBasicBlock(bb)) {
+    if (!tree_map_has(&ssa->sealed, bb))
+      ssa_seal_block(ssa, bb);
+  }
+
+  // A removed phi can still have uses if it was held onto while it was being
+  // replaced, so make sure those point to the final replacement.
+  for (size_t i = 0; i < ssa->removed_phis.size; ++i) {
+    LLVMValueRef phi = *(LLVMValueRef*)vector_at(&ssa->removed_phis, i);
+    if (LLVMGetFirstUse(phi))
+      LLVMReplaceAllUsesWith(phi, ssa_resolve(ssa, phi));
+  }
+  for (size_t i = 0; i < ssa->removed_phis.size; ++i) {
+    LLVMValueRef phi = *(LLVMValueRef*)vector_at(&ssa->removed_phis, i);
+    LLVMInstructionEraseFromParent(phi);
+  }
+}
+
+static void collect_address_taken_locals_in_stmt(const Statement* stmt,
+                                                 TreeMap* names);
+
+// Find the names of all locals that have their address taken in this
+// expression.
+static void collect_address_taken_locals_in_expr(const Expr* expr,
+                                                 TreeMap* names) {
+  switch (expr->vtable->kind) {
+    case EK_UnOp: {
+      const UnOp* unop = (const UnOp*)expr;
+      if (unop->op == UOK_AddrOf &&
+          unop->subexpr->vtable->kind == EK_DeclRef) {
+        tree_map_set(names, ((const DeclRef*)unop->subexpr)->name, NULL);
+      }
+      collect_address_taken_locals_in_expr(unop->subexpr, names);
+      return;
+    }
+    case EK_BinOp: {
+      const BinOp* binop = (const BinOp*)expr;
+      collect_address_taken_locals_in_expr(binop->lhs, names);
+      collect_address_taken_locals_in_expr(binop->rhs, names);
+      return;
+    }
+    case EK_Conditional: {
+      const Conditional* conditional = (const Conditional*)expr;
+      collect_address_taken_locals_in_expr(conditional->cond, names);
+      collect_address_taken_locals_in_expr(conditional->true_expr, names);
+      collect_address_taken_locals_in_expr(conditional->false_expr, names);
+      return;
+    }
+    case EK_InitializerList: {
+      const InitializerList* init = (const InitializerList*)expr;
+      for (size_t i = 0; i < init->elems.size; ++i) {
+        const InitializerListElem* elem = vector_at(&init->elems, i);
+        collect_address_taken_locals_in_expr(elem->expr, names);
+      }
+      return;
+    }
+    case EK_Index: {
+      const Index* index = (const Index*)expr;
+      collect_address_taken_locals_in_expr(index->base, names);
+      collect_address_taken_locals_in_expr(index->idx, names);
+      return;
+    }
+    case EK_MemberAccess:
+      collect_address_taken_locals_in_expr(((const MemberAccess*)expr)->base,
+                                           names);
+      return;
+    case EK_Call: {
+      const Call* call = (const Call*)expr;
+      collect_address_taken_locals_in_expr(call->base, names);
+      for (size_t i = 0; i < call->args.size; ++i) {
+        const Expr* arg = *(const Expr**)vector_at(&call->args, i);
+        collect_address_taken_locals_in_expr(arg, names);
+      }
+      return;
+    }
+    case EK_Cast:
+      collect_address_taken_locals_in_expr(((const Cast*)expr)->base, names);
+      return;
+    case EK_ConvertVector:
+      collect_address_taken_locals_in_expr(((const ConvertVector*)expr)->base,
+                                           names);
+      return;
+    case EK_StmtExpr: {
+      const StmtExpr* stmt_expr = (const StmtExpr*)expr;
+      if (stmt_expr->stmt)
+        collect_address_taken_locals_in_stmt(&stmt_expr->stmt->base, names);
+      return;
+    }
+    default:
+      // SizeOf and AlignOf operands are never evaluated and the remaining
+      // expressions have no subexpressions.
+      return;
+  }
+}
+
+static void collect_address_taken_locals_in_stmts(const vector* stmts,
+                                                  TreeMap* names) {
+  for (size_t i = 0; i < stmts->size; ++i) {
+    const Statement* stmt = *(const Statement**)vector_at(stmts, i);
+    collect_address_taken_locals_in_stmt(stmt, names);
+  }
+}
+
+// Find the names of all locals that have their address taken in this
+// statement.
+static void collect_address_taken_locals_in_stmt(const Statement* stmt,
+                                                 TreeMap* names) {
+  switch (stmt->vtable->kind) {
+    case SK_ExprStmt:
+      collect_address_taken_locals_in_expr(((const ExprStmt*)stmt)->expr,
+                                           names);
+      return;
+    case SK_IfStmt: {
+      const IfStmt* if_stmt = (const IfStmt*)stmt;
+      if (if_stmt->cond)
+        collect_address_taken_locals_in_expr(if_stmt->cond, names);
+      if (if_stmt->body)
+        collect_address_taken_locals_in_stmt(if_stmt->body, names);
+      if (if_stmt->else_stmt)
+        collect_address_taken_locals_in_stmt(if_stmt->else_stmt, names);
+      return;
+    }
+    case SK_CompoundStmt:
+      collect_address_taken_locals_in_stmts(&((const CompoundStmt*)stmt)->body,
+                                            names);
+      return;
+    case SK_ReturnStmt: {
+      const ReturnStmt* ret = (const ReturnStmt*)stmt;
+      if (ret->expr)
+        collect_address_taken_locals_in_expr(ret->expr, names);
+      return;
+    }
+    case SK_Declaration: {
+      const Declaration* decl = (const Declaration*)stmt;
+      if (decl->initializer)
+        collect_address_taken_locals_in_expr(decl->initializer, names);
+      return;
+    }
+    case SK_ForStmt: {
+      const ForStmt* for_stmt = (const ForStmt*)stmt;
+      if (for_stmt->init)
+        collect_address_taken_locals_in_stmt(for_stmt->init, names);
+      if (for_stmt->cond)
+        collect_address_taken_locals_in_expr(for_stmt->cond, names);
+      if (for_stmt->iter)
+        collect_address_taken_locals_in_expr(for_stmt->iter, names);
+      if (for_stmt->body)
+        collect_address_taken_locals_in_stmt(for_stmt->body, names);
+      return;
+    }
+    case SK_WhileStmt: {
+      const WhileStmt* while_stmt = (const WhileStmt*)stmt;
+      collect_address_taken_locals_in_expr(while_stmt->cond, names);
+      if (while_stmt->body)
+        collect_address_taken_locals_in_stmt(while_stmt->body, names);
+      return;
+    }
+    case SK_SwitchStmt: {
+      const SwitchStmt* switch_stmt = (const SwitchStmt*)stmt;
+      collect_address_taken_locals_in_expr(switch_stmt->cond, names);
+      for (size_t i = 0; i < switch_stmt->cases.size; ++i) {
+        const SwitchCase* switch_case = vector_at(&switch_stmt->cases, i);
+        collect_address_taken_locals_in_expr(switch_case->cond, names);
+        collect_address_taken_locals_in_stmts(&switch_case->stmts, names);
+      }
+      if (switch_stmt->default_stmts)
+        collect_address_taken_locals_in_stmts(switch_stmt->default_stmts,
+                                              names);
+      return;
+    }
+    case SK_LabelStmt: {
+      const LabelStmt* label_stmt = (const LabelStmt*)stmt;
+      if (label_stmt->stmt)
+        collect_address_taken_locals_in_stmt(label_stmt->stmt, names);
+      return;
+    }
+    case SK_IndirectGotoStmt:
+      collect_address_taken_locals_in_expr(
+          ((const IndirectGotoStmt*)stmt)->target, names);
+      return;
+    case SK_BreakStmt:
+    case SK_ContinueStmt:
+    case SK_GotoStmt:
+      return;
+  }
+}
+
+///
+/// End SSA Construction Implementation
+///
+
 ///
 /// Start Compiler Implementation
 ///
 
+// When a multiply and an add may be fused into one fused multiply-add, which
+// rounds only once. From -ffp-contract.
+typedef enum {
+  FPC_Off,   // Never.
+  FPC_On,    // Within a single expression, as C allows.
+  FPC_Fast,  // Across statements also. This needs -ffast-math since LLVM has
+             // no C API for the `contract` flag on instructions.
+} FPContract;
+
+// The processor and features code is generated for. These are attached to each
+// function definition so they still apply after modules are linked together.
+typedef struct {
+  const char* cpu;
+  const char* tune_cpu;  // Optional.
+  const char* features;
+
+  // Position independent code can be linked into shared libraries. With
+  // -fno-pic this is LLVMRelocStatic. With -fpie, the code is position
+  // independent but only linked into executables, so its symbols can't be
+  // preempted by other modules.
+  LLVMRelocMode reloc_model;
+  bool pie;
+
+  // With -fno-plt, calls to functions defined in other modules load the
+  // address from the GOT instead of going through a PLT stub.
+  bool no_plt;
+
+  // With -fvisibility=hidden, symbols defined here are not exported from the
+  // shared library or executable they're linked into.
+  bool hidden_visibility;
+
+  // From -ftls-model. Thread-local variables use at least this model unless
+  // they have a `tls_model` attribute.
+  TLSModel tls_model;
+
+  // Floating point semantics. -ffast-math allows transformations that ignore
+  // NaNs, infinities, signed zeros and rounding differences. With
+  // -fno-math-errno, math functions are assumed not to set errno.
+  bool fast_math;
+  FPContract fp_contract;
+  bool math_errno;
+
+  // Loads and stores are tagged with the types they access for type-based
+  // alias analysis. -fno-strict-aliasing turns this off for code which
+  // accesses objects through pointers to incompatible types.
+  bool strict_aliasing;
+} TargetOptions;
+
+// Options for profile guided optimization. At most one of these is set.
+typedef struct {
+  // With -fprofile-generate, functions count how often they and their branches
+  // run and append the counts to this file when the program exits.
+  const char* generate_path;  // Optional.
+
+  // With -fprofile-use, the counts read from such a file. This is a map of
+  // profile names to vectors of uint64_t counters.
+  const TreeMap* counts;  // Optional.
+} ProfileOptions;
+
+// A restrict-qualified pointer declared in the body of the function being
+// compiled. Accesses through it get a noalias scope of their own.
+typedef struct {
+  const Type* decl_type;  // Identifies the declaration.
+  const char* name;
+
+  // Set once the function is compiled. These are the !alias.scope and
+  // !noalias lists of accesses through this pointer.
+  LLVMValueRef alias_scope;
+  LLVMValueRef noalias;
+} RestrictLocal;
+
+// A pointer used only to access memory through a RestrictLocal.
+typedef struct {
+  LLVMValueRef ptr;
+  size_t local;  // Index into `restrict_locals`.
+} RestrictAccess;
+
+// A label in the function being compiled. Its block is created by whichever of
+// its definition, a `goto` or `&&label` comes first.
+typedef struct {
+  LLVMBasicBlockRef bb;
+  bool defined;
+  bool address_taken;
+} Label;
+
+// A function whose counters are written out by the profile writer.
+typedef struct {
+  char* name;  // The profile name. This is owned by the InstrumentedFunction.
+  LLVMValueRef counters;
+  size_t num_counters;
+} InstrumentedFunction;
+
+// An alloca for a local declared directly in a compound statement. Its
+// lifetime ends when the compound statement is left.
+typedef struct {
+  LLVMValueRef alloca;
+  size_t size;  // The size of the alloca rounded up to its alignment.
+} ScopedAlloca;
+
+// The stack space a function needs for its locals, for -fstack-usage.
+typedef struct {
+  const FunctionDefinition* f;
+
+  // The most bytes of locals live at once. This is the space needed when
+  // locals whose lifetimes do not overlap share stack slots.
+  size_t max_live_size;
+
+  // The bytes of all locals, each in its own stack slot.
+  size_t total_size;
+} StackUsage;
+
+// The classes the x86-64 SysV psABI sorts each eightbyte of an argument or
+// return value into.
+typedef enum {
+  AC_NoClass,
+  AC_Integer,
+  AC_SSE,
+  AC_SSEUp,
+  AC_Memory,
+} ABIClass;
+
+// How a C argument or return value is passed as LLVM parameters.
+typedef enum {
+  AK_Direct,    // As one parameter of its own LLVM type.
+  AK_Coerce,    // As one parameter for each eightbyte passed in registers.
+  AK_Indirect,  // Through a pointer. `byval` for arguments, `sret` for returns.
+  AK_Ignore,    // Not at all. This is for `void` and empty structs.
+} ABIArgKind;
+
+typedef struct {
+  ABIArgKind kind;
+
+  // For AK_Coerce, the integer or SSE types of the low and high eightbytes.
+  // `hi` is NULL if only one eightbyte is passed.
+  LLVMTypeRef lo;
+  LLVMTypeRef hi;
+
+  unsigned param;  // The first LLVM parameter of an argument.
+  const Type* type;
+} ABIArgInfo;
+
+// The lowering of a function type to LLVM following the psABI.
+typedef struct {
+  ABIArgInfo ret;
+  vector args;  // vector of ABIArgInfos, one for each positional argument.
+
+  // Registers left for arguments after the ones already classified.
+  unsigned free_int_regs;
+  unsigned free_sse_regs;
+  unsigned num_params;
+} FunctionABI;
+
 typedef struct {
   // The compiler does not own the Sema or the module. It only modifies them.
   LLVMModuleRef mod;
+  LLVMContextRef ctx;  // The context of `mod`.
   Sema* sema;
   LLVMDIBuilderRef dibuilder;
   LLVMMetadataRef dicu;
   LLVMMetadataRef difile;
+  const TargetOptions* target;
+  const ProfileOptions* profile;
+
+  // Set while compiling a function with the `flatten` attribute.
+  bool flatten_calls;
+
+  // Restrict pointers declared directly in the body of the current function
+  // and the accesses made through them. A body runs once per call, so two such
+  // pointers never access the same object. Pointers in nested blocks are left
+  // out since those blocks can run many times, like loop bodies.
+  const Statement* function_body;
+  const Statement* current_block;  // The innermost compound or for statement.
+  vector restrict_locals;          // vector of RestrictLocals.
+  vector restrict_accesses;        // vector of RestrictAccesses.
+
+  // Profiling state for the function currently being compiled. Each function
+  // has an entry counter followed by a pair of counters per conditional branch
+  // for how often the branch runs and how often it's taken.
+  size_t num_profile_counters;
+  LLVMValueRef profile_counters;  // Placeholder for the counters array.
+  vector profiled_branches;       // vector of LLVMValueRefs.
+
+  // vector of InstrumentedFunctions.
+  vector instrumented_functions;
+
+  // SSA state for the function currently being compiled. This is NULL outside
+  // of function definitions.
+  SSABuilder* ssa;
+
+  // Labels of the function currently being compiled. Gotos can jump to a label
+  // from anywhere in the function, so label blocks are only sealed once the
+  // whole function is emitted. Every `goto *ptr` can jump to any label whose
+  // address is taken, so the destinations of the `indirectbr`s are also only
+  // added then.
+  LLVMValueRef current_function;
+  TreeMap labels;         // Map of label names to owned Label pointers.
+  vector indirect_gotos;  // vector of `indirectbr` LLVMValueRefs.
+
+  // Calls whose results are returned right away by the function currently
+  // being compiled. They are only marked `tail` once the whole function is
+  // emitted and known to have no allocas a callee could refer to.
+  const FunctionType* current_function_type;
+  vector tail_calls;  // vector of call LLVMValueRefs.
+
+  // How the function currently being compiled returns its value.
+  ABIArgInfo current_return;
+
+  // Lifetime state of the function currently being compiled. Locals declared
+  // directly in a compound statement get `llvm.lifetime.start` where they are
+  // declared and `llvm.lifetime.end` where the statement is left, so locals
+  // of disjoint scopes can share stack slots. Markers are not emitted in
+  // functions with labels since a goto could jump past a lifetime start.
+  bool emit_lifetime_markers;
+  bool in_scope_declaration;  // Set while compiling such a declaration.
+  vector scoped_allocas;      // vector of ScopedAllocas of enclosing scopes.
+  size_t live_stack_size;     // Bytes of allocas live at this point.
+  size_t max_stack_size;      // Most bytes of allocas live at any point.
+  size_t total_stack_size;    // Bytes of all allocas.
+
+  // Where to record a StackUsage for each function compiled. NULL without
+  // -fstack-usage.
+  vector* stack_usages;
+
+  // Map of string contents to the constant globals holding them, so identical
+  // string literals in the module share one constant.
+  TreeMap string_literals;
+
+  // Map of canonical Types to the LLVMTypeRefs they lower to in `mod`.
+  TreeMap llvm_types;
+
+  // Map of resolved StructTypes to their LLVMStructLayouts in `mod`.
+  TreeMap struct_layouts;
 } Compiler;
 
 void compiler_construct(Compiler* compiler, LLVMModuleRef mod, Sema* sema,
-                        LLVMDIBuilderRef dibuilder) {
+                        LLVMDIBuilderRef dibuilder, const TargetOptions* target,
+                        const ProfileOptions* profile) {
   compiler->mod = mod;
+  compiler->ctx = LLVMGetModuleContext(mod);
   compiler->sema = sema;
   compiler->dibuilder = dibuilder;
+  compiler->target = target;
+  compiler->profile = profile;
+  compiler->flatten_calls = false;
+  compiler->function_body = NULL;
+  compiler->current_block = NULL;
+  vector_construct(&compiler->restrict_locals, sizeof(RestrictLocal),
+                   alignof(RestrictLocal));
+  vector_construct(&compiler->restrict_accesses, sizeof(RestrictAccess),
+                   alignof(RestrictAccess));
+  compiler->num_profile_counters = 0;
+  compiler->profile_counters = NULL;
+  vector_construct(&compiler->profiled_branches, sizeof(LLVMValueRef),
+                   alignof(LLVMValueRef));
+  vector_construct(&compiler->instrumented_functions,
+                   sizeof(InstrumentedFunction), alignof(InstrumentedFunction));
+  compiler->ssa = NULL;
+  compiler->current_function = NULL;
+  string_tree_map_construct(&compiler->labels);
+  vector_construct(&compiler->indirect_gotos, sizeof(LLVMValueRef),
+                   alignof(LLVMValueRef));
+  compiler->current_function_type = NULL;
+  compiler->current_return.kind = AK_Direct;
+  vector_construct(&compiler->tail_calls, sizeof(LLVMValueRef),
+                   alignof(LLVMValueRef));
+  compiler->emit_lifetime_markers = false;
+  compiler->in_scope_declaration = false;
+  vector_construct(&compiler->scoped_allocas, sizeof(ScopedAlloca),
+                   alignof(ScopedAlloca));
+  compiler->live_stack_size = 0;
+  compiler->max_stack_size = 0;
+  compiler->stack_usages = NULL;
+  string_tree_map_construct(&compiler->string_literals);
+  pointer_tree_map_construct(&compiler->llvm_types);
+  pointer_tree_map_construct(&compiler->struct_layouts);
   size_t len;
   const char* name = LLVMGetSourceFileName(mod, &len);
   compiler->difile = LLVMDIBuilderCreateFile(dibuilder, name, len, "", 0);
@@ -291,2157 +1004,7174 @@ void compiler_construct(Compiler* compiler, LLVMModuleRef mod, Sema* sema,
       /*SplitNameLen=*/0, LLVMDWARFEmissionFull, /*DWOId=*/0,
       /*SplitDebugInlining=*/0, /*DebugInfoForProfiling=*/0, /*SysRoot=*/"",
       /*SysRootLen=*/0, /*SDK=*/"", /*SDKLen=*/0);
-}
 
-void compiler_destroy(Compiler* compiler) {}
+  // Without this, the debug info would be dropped when reading the module
+  // back from bitcode.
+  const char* debug_info_version = "Debug Info Version";
+  LLVMAddModuleFlag(
+      mod, LLVMModuleFlagBehaviorWarning, debug_info_version,
+      strlen(debug_info_version),
+      LLVMValueAsMetadata(LLVMConstInt(LLVMInt32TypeInContext(compiler->ctx),
+                                       LLVMDebugMetadataVersion(),
+                                       /*IsSigned=*/0)));
+}
 
-LLVMTypeRef get_llvm_type(Compiler* compiler, const Type* type,
-                          const TreeMap* local_ctx);
+static void destroy_llvm_struct_layout_callback(const void* key, void* value,
+                                                void* arg);
+
+void compiler_destroy(Compiler* compiler) {
+  tree_map_iterate(&compiler->struct_layouts,
+                   destroy_llvm_struct_layout_callback, NULL);
+  tree_map_destroy(&compiler->struct_layouts);
+  tree_map_destroy(&compiler->llvm_types);
+  tree_map_destroy(&compiler->string_literals);
+  tree_map_destroy(&compiler->labels);
+  vector_destroy(&compiler->indirect_gotos);
+  vector_destroy(&compiler->tail_calls);
+  vector_destroy(&compiler->scoped_allocas);
+  vector_destroy(&compiler->restrict_locals);
+  vector_destroy(&compiler->restrict_accesses);
+  vector_destroy(&compiler->profiled_branches);
+  for (size_t i = 0; i < compiler->instrumented_functions.size; ++i) {
+    InstrumentedFunction* f = vector_at(&compiler->instrumented_functions, i);
+    free(f->name);
+  }
+  vector_destroy(&compiler->instrumented_functions);
+}
 
-LLVMTypeRef get_llvm_struct_type(Compiler* compiler, const StructType* st,
-                                 const TreeMap* local_ctx) {
-  st = sema_resolve_struct_type(compiler->sema, st);
+// Get the constant global holding the NUL-terminated `str`. The global is
+// private, `constant` and `unnamed_addr` with no extra alignment, so the
+// backend places it in a mergeable string section (.rodata.str1.1) where the
+// linker also merges it with identical strings from other objects.
+static LLVMValueRef get_string_literal(Compiler* compiler, const char* str) {
+  LLVMValueRef glob;
+  if (tree_map_get(&compiler->string_literals, str, &glob))
+    return glob;
+
+  LLVMValueRef seq =
+      LLVMConstStringInContext(compiler->ctx, str, (unsigned)strlen(str),
+                               /*DontNullTerminate=*/false);
+  glob = LLVMAddGlobal(compiler->mod, LLVMTypeOf(seq), ".str");
+  LLVMSetInitializer(glob, seq);
+  LLVMSetGlobalConstant(glob, 1);
+  LLVMSetLinkage(glob, LLVMPrivateLinkage);
+  LLVMSetUnnamedAddress(glob, LLVMGlobalUnnamedAddr);
+  LLVMSetAlignment(glob, 1);
+  tree_map_set(&compiler->string_literals, str, glob);
+  return glob;
+}
 
-  void* llvm_struct;
+static Label* get_label(Compiler* compiler, const char* name) {
+  Label* label;
+  if (tree_map_get(&compiler->labels, name, &label))
+    return label;
+
+  label = malloc(sizeof(Label));
+  label->bb = LLVMAppendBasicBlockInContext(
+      compiler->ctx, compiler->current_function, name);
+  label->defined = false;
+  label->address_taken = false;
+  tree_map_set(&compiler->labels, name, label);
+  return label;
+}
 
-  // First see if we already made one.
-  if (st->name) {
-    if ((llvm_struct = LLVMGetTypeByName(compiler->mod, st->name)))
-      return llvm_struct;
+static void finish_label(const void* name, void* val, void* arg) {
+  Compiler* compiler = arg;
+  Label* label = val;
+  ASSERT_MSG(label->defined, "Use of undeclared label '%s'",
+             (const char*)name);
+
+  if (label->address_taken) {
+    for (size_t i = 0; i < compiler->indirect_gotos.size; ++i) {
+      LLVMValueRef indirect_goto =
+          *(LLVMValueRef*)vector_at(&compiler->indirect_gotos, i);
+      LLVMAddDestination(indirect_goto, label->bb);
+    }
   }
 
-  assert(st->members);
+  free(label);
+}
 
-  // Doesn't exits. Create the struct body.
-  vector elems;
-  vector_construct(&elems, sizeof(LLVMTypeRef), alignof(LLVMTypeRef));
-  for (size_t i = 0; i < st->members->size; ++i) {
-    Member* member = vector_at(st->members, i);
-    LLVMTypeRef* storage = vector_append_storage(&elems);
-    *storage = get_llvm_type(compiler, member->type, local_ctx);
+// Remember `val` if it is a call whose result is about to be returned. A
+// `musttail` call is marked right away since the caller promised it does not
+// pass anything on its own stack.
+static void add_tail_call_candidate(Compiler* compiler, LLVMBuilderRef builder,
+                                    LLVMValueRef val, bool musttail) {
+  bool is_call =
+      LLVMIsACallInst(val) &&
+      LLVMGetLastInstruction(LLVMGetInsertBlock(builder)) == val &&
+      !LLVMIsAInlineAsm(LLVMGetCalledValue(val));
+  if (!is_call) {
+    ASSERT_MSG(!musttail, "'musttail' call was not lowered to a call");
+    return;
   }
 
-  if (st->name) {
-    llvm_struct =
-        LLVMStructCreateNamed(LLVMGetModuleContext(compiler->mod), st->name);
-    LLVMStructSetBody(llvm_struct, elems.data, (unsigned)elems.size,
-                      st->packed);
-  } else {
-    llvm_struct = LLVMStructType(elems.data, (unsigned)elems.size, st->packed);
+  if (musttail) {
+#if LLVM_VERSION_MAJOR >= 18
+    LLVMSetTailCallKind(val, LLVMTailCallKindMustTail);
+#else
+    // The C API can only request `musttail` from LLVM 18 on. Sema already
+    // checked the signatures, so a `tail` call is lowered the same way by
+    // the backend here.
+    LLVMSetTailCall(val, 1);
+#endif
+    return;
   }
 
-  vector_destroy(&elems);
-
-  return llvm_struct;
+  LLVMValueRef* storage = vector_append_storage(&compiler->tail_calls);
+  *storage = val;
 }
 
-LLVMTypeRef get_llvm_union_type(Compiler* compiler, const UnionType* ut,
-                                const TreeMap* local_ctx) {
-  ut = sema_resolve_union_type(compiler->sema, ut);
-
-  void* llvm_union;
+static bool function_has_allocas(LLVMValueRef func) {
+  for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb;
+       bb = LLVMGetNextBasicBlock(bb)) {
+    for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst;
+         inst = LLVMGetNextInstruction(inst)) {
+      if (LLVMGetInstructionOpcode(inst) == LLVMAlloca)
+        return true;
+    }
+  }
+  return false;
+}
 
-  // First see if we already made one.
-  if (ut->name) {
-    if ((llvm_union = LLVMGetTypeByName(compiler->mod, ut->name)))
-      return llvm_union;
+// Calls in tail position can reuse the caller's frame if no pointer into that
+// frame can reach the callee. Without escape analysis, that is only known
+// when the caller has no allocas at all.
+static void finish_tail_calls(Compiler* compiler, LLVMValueRef func) {
+  if (!function_has_allocas(func)) {
+    for (size_t i = 0; i < compiler->tail_calls.size; ++i) {
+      LLVMValueRef* call = vector_at(&compiler->tail_calls, i);
+      LLVMSetTailCall(*call, 1);
+    }
   }
+  compiler->tail_calls.size = 0;
+}
 
-  assert(ut->members);
+// Check every label used was defined and give each `indirectbr` its
+// destinations. This must be done before the label blocks are sealed.
+static void finish_labels(Compiler* compiler) {
+  tree_map_iterate(&compiler->labels, finish_label, compiler);
+  tree_map_clear(&compiler->labels);
+  compiler->indirect_gotos.size = 0;
+}
 
-  // Doesn't exits. Create the struct body which only consists of the largest
-  // union member.
-  LLVMTypeRef member = get_llvm_type(
-      compiler,
-      sema_get_largest_union_member(compiler->sema, ut, local_ctx)->type,
-      local_ctx);
+LLVMTypeRef get_llvm_type(Compiler* compiler, const Type* type,
+                          const TreeMap* local_ctx);
 
-  if (ut->name) {
-    llvm_union =
-        LLVMStructCreateNamed(LLVMGetModuleContext(compiler->mod), ut->name);
-    LLVMStructSetBody(llvm_union, &member, /*ElementCount=*/1, ut->packed);
-  } else {
-    llvm_union = LLVMStructType(&member, /*ElementCount=*/1, ut->packed);
+// Where a struct member lives in the LLVM struct type.
+typedef struct {
+  unsigned field;  // Index of the LLVM struct field holding the member.
+
+  // For bitfields, the width of the field holding it in bytes and the bit
+  // offset of the bitfield from the start of that field. `storage_size` is 0
+  // for other members.
+  unsigned storage_size;
+  unsigned bit_offset;
+} MemberField;
+
+// The LLVM representation of a struct. LLVM lays out the fields of a struct
+// from their types, which only agrees with sema for structs without bitfields
+// or layout attributes. Other structs are emitted as packed LLVM structs with
+// explicit padding, where bitfields sharing bytes are merged into one byte
+// array field.
+typedef struct {
+  const StructLayout* layout;
+  vector fields;          // The LLVMTypeRefs of the fields.
+  MemberField* members;  // One for each member of the struct.
+  bool is_packed;
+
+  // The TBAA type node of the struct. NULL until it's first needed.
+  LLVMMetadataRef tbaa;
+} LLVMStructLayout;
+
+static bool layout_matches_llvm(Compiler* compiler, const StructLayout* layout,
+                                const vector* fields, bool packed) {
+  for (size_t i = 0; i < fields->size; ++i) {
+    if (layout->members[i].is_bitfield)
+      return false;
   }
 
-  return llvm_union;
+  LLVMTypeRef llvm_struct = LLVMStructTypeInContext(
+      compiler->ctx, fields->data, (unsigned)fields->size, packed);
+  LLVMTargetDataRef data_layout = LLVMGetModuleDataLayout(compiler->mod);
+  if (LLVMABISizeOfType(data_layout, llvm_struct) != layout->size ||
+      LLVMABIAlignmentOfType(data_layout, llvm_struct) != layout->align)
+    return false;
+  for (size_t i = 0; i < fields->size; ++i) {
+    if (LLVMOffsetOfElement(data_layout, llvm_struct, (unsigned)i) !=
+        layout->members[i].offset)
+      return false;
+  }
+  return true;
 }
 
-LLVMTypeRef get_opaque_ptr(Compiler* compiler) {
-  return LLVMPointerTypeInContext(LLVMGetModuleContext(compiler->mod),
-                                  /*AddressSpace=*/0);
+static void append_padding(Compiler* compiler, vector* fields, size_t size) {
+  LLVMTypeRef* storage = vector_append_storage(fields);
+  *storage =
+      LLVMArrayType(LLVMInt8TypeInContext(compiler->ctx), (unsigned)size);
 }
 
-LLVMTypeRef get_llvm_array_type(Compiler* compiler, const ArrayType* at,
-                                const TreeMap* local_ctx) {
-  if (!at->size)
-    return get_opaque_ptr(compiler);
+static void compute_llvm_struct_layout(Compiler* compiler,
+                                       const StructType* st,
+                                       LLVMStructLayout* llvm_layout,
+                                       const TreeMap* local_ctx) {
+  const StructLayout* layout =
+      sema_get_struct_layout(compiler->sema, st, local_ctx);
+  llvm_layout->layout = layout;
+  llvm_layout->tbaa = NULL;
+
+  size_t num_members = st->members->size;
+  llvm_layout->members = calloc(num_members, sizeof(MemberField));
+  vector_construct(&llvm_layout->fields, sizeof(LLVMTypeRef),
+                   alignof(LLVMTypeRef));
+  for (size_t i = 0; i < num_members; ++i) {
+    Member* member = vector_at(st->members, i);
+    LLVMTypeRef* storage = vector_append_storage(&llvm_layout->fields);
+    *storage = get_llvm_type(compiler, member->type, local_ctx);
+    llvm_layout->members[i].field = (unsigned)i;
+  }
 
-  ConstExprResult size =
-      sema_eval_expr_in_ctx(compiler->sema, at->size, local_ctx);
-  LLVMTypeRef elem = get_llvm_type(compiler, at->elem_type, local_ctx);
-  switch (size.result_kind) {
-    case RK_UnsignedLongLong:
-      return LLVMArrayType(elem, (unsigned)size.result.ull);
-    case RK_Int:
-      return LLVMArrayType(elem, (unsigned)size.result.i);
-    case RK_Boolean:
-      return LLVMArrayType(elem, (unsigned)size.result.b);
+  llvm_layout->is_packed = st->packed;
+  if (layout_matches_llvm(compiler, layout, &llvm_layout->fields, st->packed))
+    return;
+
+  vector member_tys = llvm_layout->fields;
+  vector_construct(&llvm_layout->fields, sizeof(LLVMTypeRef),
+                   alignof(LLVMTypeRef));
+  llvm_layout->is_packed = true;
+
+  // `end` is the end of the last field in bytes. `run_start` is the start of
+  // the field for the bitfields laid out last if there is one.
+  size_t end = 0;
+  bool in_run = false;
+  size_t run_start = 0;
+  size_t run_field = 0;
+  for (size_t i = 0; i < num_members; ++i) {
+    const MemberLayout* member_layout = &layout->members[i];
+    MemberField* member_field = &llvm_layout->members[i];
+
+    if (member_layout->is_bitfield && member_layout->bit_width == 0)
+      continue;
+
+    // A bitfield starting in the last byte of the previous bitfields shares
+    // their field.
+    if (member_layout->is_bitfield && in_run &&
+        member_layout->offset < end) {
+      size_t bits = member_layout->bit_offset + member_layout->bit_width;
+      size_t member_end =
+          member_layout->offset + align_up(bits, kCharBit) / kCharBit;
+      if (member_end > end)
+        end = member_end;
+      member_field->field = (unsigned)run_field;
+      member_field->bit_offset = (unsigned)(
+          (member_layout->offset - run_start) * kCharBit +
+          member_layout->bit_offset);
+      continue;
+    }
+
+    if (in_run) {
+      LLVMTypeRef* run = vector_at(&llvm_layout->fields, run_field);
+      *run = LLVMArrayType(LLVMInt8TypeInContext(compiler->ctx),
+                           (unsigned)(end - run_start));
+      in_run = false;
+    }
+
+    if (member_layout->offset > end)
+      append_padding(compiler, &llvm_layout->fields,
+                     member_layout->offset - end);
+
+    member_field->field = (unsigned)llvm_layout->fields.size;
+    LLVMTypeRef* storage = vector_append_storage(&llvm_layout->fields);
+    if (member_layout->is_bitfield) {
+      // The type of this field is known once all the bitfields in it are.
+      size_t bits = member_layout->bit_offset + member_layout->bit_width;
+      end = member_layout->offset + align_up(bits, kCharBit) / kCharBit;
+      in_run = true;
+      run_start = member_layout->offset;
+      run_field = member_field->field;
+      member_field->bit_offset = (unsigned)member_layout->bit_offset;
+    } else {
+      *storage = *(LLVMTypeRef*)vector_at(&member_tys, i);
+      end = member_layout->offset +
+            (size_t)LLVMABISizeOfType(LLVMGetModuleDataLayout(compiler->mod),
+                                      *storage);
+    }
   }
-}
 
-LLVMTypeRef get_llvm_function_type(Compiler* compiler, const FunctionType* ft,
-                                   const TreeMap* local_ctx) {
-  LLVMTypeRef ret = get_llvm_type(compiler, ft->return_type, local_ctx);
+  if (in_run) {
+    LLVMTypeRef* run = vector_at(&llvm_layout->fields, run_field);
+    *run = LLVMArrayType(LLVMInt8TypeInContext(compiler->ctx),
+                         (unsigned)(end - run_start));
+  }
 
-  vector params;
-  vector_construct(&params, sizeof(LLVMTypeRef), alignof(LLVMTypeRef));
-  for (size_t i = 0; i < ft->pos_args.size; ++i) {
-    Type* arg_ty = ((FunctionArg*)vector_at(&ft->pos_args, i))->type;
-    if (is_void_type(arg_ty))
+  if (layout->size > end)
+    append_padding(compiler, &llvm_layout->fields, layout->size - end);
+
+  // The storage size of each bitfield is the size of the field holding it.
+  for (size_t i = 0; i < num_members; ++i) {
+    const MemberLayout* member_layout = &layout->members[i];
+    if (!member_layout->is_bitfield || member_layout->bit_width == 0)
       continue;
-    LLVMTypeRef* storage = vector_append_storage(&params);
-    *storage = get_llvm_type(compiler, arg_ty, local_ctx);
+    MemberField* member_field = &llvm_layout->members[i];
+    LLVMTypeRef run = *(LLVMTypeRef*)vector_at(&llvm_layout->fields,
+                                               member_field->field);
+    member_field->storage_size = LLVMGetArrayLength(run);
   }
 
-  LLVMTypeRef res = LLVMFunctionType(ret, params.data, (unsigned)params.size,
-                                     ft->has_var_args);
+  vector_destroy(&member_tys);
+}
 
-  vector_destroy(&params);
+static void destroy_llvm_struct_layout_callback(const void* key, void* value,
+                                                void* arg) {
+  LLVMStructLayout* llvm_layout = value;
+  vector_destroy(&llvm_layout->fields);
+  free(llvm_layout->members);
+  free(llvm_layout);
+}
 
-  return res;
+// Get the LLVMStructLayout of `st`. It's computed the first time it's needed
+// and owned by the compiler.
+static LLVMStructLayout* get_llvm_struct_layout(Compiler* compiler,
+                                                const StructType* st,
+                                                const TreeMap* local_ctx) {
+  st = sema_resolve_struct_type(compiler->sema, st);
+  void* found;
+  if (tree_map_get(&compiler->struct_layouts, st, &found))
+    return found;
+
+  LLVMStructLayout* llvm_layout = malloc(sizeof(LLVMStructLayout));
+  compute_llvm_struct_layout(compiler, st, llvm_layout, local_ctx);
+  tree_map_set(&compiler->struct_layouts, st, llvm_layout);
+  return llvm_layout;
 }
 
-LLVMTypeRef get_llvm_builtin_type(Compiler* compiler, const BuiltinType* bt);
+// Get the index of the LLVM struct field holding the `idx`th member of `st`.
+static unsigned get_struct_member_field(Compiler* compiler,
+                                        const StructType* st, size_t idx,
+                                        const TreeMap* local_ctx) {
+  const LLVMStructLayout* llvm_layout =
+      get_llvm_struct_layout(compiler, st, local_ctx);
+  return llvm_layout->members[idx].field;
+}
 
-static LLVMTypeRef get_builtin_va_list(Compiler* compiler) {
-  // TODO: This is a target-dependent type. It should have different
-  // implementations per target.
-  //
-  // https://refspecs.linuxbase.org/elf/x86_64-abi-0.21.pdf
-  //
-  // On x86-64, this is
-  //
-  //   typedef struct {
-  //     unsigned int gp_offset;
-  //     unsigned int fp_offset;
-  //     void *overflow_arg_area;
-  //     void *reg_save_area;
-  //   } va_list[1];
-  //
-  LLVMTypeRef ui =
-      get_llvm_builtin_type(compiler, &compiler->sema->bt_UnsignedInt);
-  LLVMTypeRef vp = get_opaque_ptr(compiler);
-  LLVMTypeRef elems[] = {ui, ui, vp, vp};
-  return LLVMStructType(elems, /*ElementCount=*/4, /*Packed=*/0);
+///
+/// Start Type-Based Alias Analysis
+///
+/// https://llvm.org/docs/LangRef.html#tbaa-metadata
+///
+/// Under C's effective type rules, accesses of incompatible types can't alias
+/// except through character types. Scalar types get a node under "omnipotent
+/// char", which aliases everything. Struct nodes list the types and offsets
+/// of their members so that accesses of different members don't alias either.
+///
+
+static LLVMValueRef get_i64_metadata_const(Compiler* compiler, size_t val) {
+  return LLVMConstInt(LLVMInt64TypeInContext(compiler->ctx), val,
+                      /*IsSigned=*/0);
 }
 
-LLVMTypeRef get_llvm_builtin_type(Compiler* compiler, const BuiltinType* bt) {
-  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
-  switch (bt->kind) {
-    case BTK_Char:
-    case BTK_SignedChar:
-    case BTK_UnsignedChar:
-    case BTK_Short:
-    case BTK_UnsignedShort:
-    case BTK_Int:
-    case BTK_UnsignedInt:
-    case BTK_Long:
-    case BTK_UnsignedLong:
-    case BTK_LongLong:
-    case BTK_UnsignedLongLong: {
-      size_t size = builtin_type_get_size(bt);
-      assert(size);
-      return LLVMIntType((unsigned)(size * kCharBit));
-    }
-    case BTK_Float:
-      return LLVMFloatTypeInContext(ctx);
-    case BTK_Double:
-      return LLVMDoubleTypeInContext(ctx);
-    case BTK_LongDouble:
-    case BTK_Float128:
-      return LLVMFP128TypeInContext(ctx);
-    case BTK_Void:
-      return LLVMVoidType();
-    case BTK_Bool:
-      return LLVMIntType(kCharBit);
-    case BTK_ComplexFloat: {
-      LLVMTypeRef elems[] = {LLVMFloatTypeInContext(ctx),
-                             LLVMFloatTypeInContext(ctx)};
-      return LLVMStructType(elems, /*ElementCount=*/2, /*Packed=*/0);
-    }
-    case BTK_ComplexDouble: {
-      LLVMTypeRef elems[] = {LLVMDoubleTypeInContext(ctx),
-                             LLVMDoubleTypeInContext(ctx)};
-      return LLVMStructType(elems, /*ElementCount=*/2, /*Packed=*/0);
-    }
-    case BTK_ComplexLongDouble: {
-      LLVMTypeRef elems[] = {LLVMFP128TypeInContext(ctx),
-                             LLVMFP128TypeInContext(ctx)};
-      return LLVMStructType(elems, /*ElementCount=*/2, /*Packed=*/0);
-    }
-    case BTK_BuiltinVAList:
-      return get_builtin_va_list(compiler);
-  }
+static void append_metadata(vector* ops, LLVMMetadataRef op) {
+  LLVMMetadataRef* storage = vector_append_storage(ops);
+  *storage = op;
 }
 
-LLVMTypeRef get_llvm_type(Compiler* compiler, const Type* type,
-                          const TreeMap* local_ctx) {
+// Scalar type nodes are !{!"name", !parent, i64 0}.
+static LLVMMetadataRef get_tbaa_scalar_node(Compiler* compiler,
+                                            const char* name,
+                                            LLVMMetadataRef parent) {
+  LLVMMetadataRef ops[] = {
+      LLVMMDStringInContext2(compiler->ctx, name, strlen(name)), parent,
+      LLVMValueAsMetadata(get_i64_metadata_const(compiler, 0))};
+  return LLVMMDNodeInContext2(compiler->ctx, ops, 3);
+}
+
+static LLVMMetadataRef get_tbaa_char(Compiler* compiler) {
+  const char* root_name = "Simple C/C++ TBAA";
+  LLVMMetadataRef root_ops[] = {
+      LLVMMDStringInContext2(compiler->ctx, root_name, strlen(root_name))};
+  LLVMMetadataRef root = LLVMMDNodeInContext2(compiler->ctx, root_ops, 1);
+  return get_tbaa_scalar_node(compiler, "omnipotent char", root);
+}
+
+// Get the TBAA node of a scalar type. Returns NULL if `type` isn't a scalar.
+// The signed and unsigned versions of an integer type may alias, so they
+// share a node.
+static LLVMMetadataRef get_tbaa_scalar_type(Compiler* compiler,
+                                            const Type* type) {
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  if (type->vtable->kind == TK_EnumType) {
+    type = &sema_get_integral_type_for_enum(compiler->sema,
+                                            (const EnumType*)type)
+                ->type;
+  }
+
+  const char* name;
   switch (type->vtable->kind) {
-    case TK_BuiltinType:
-      return get_llvm_builtin_type(compiler, (const BuiltinType*)type);
-    case TK_EnumType: {
-      const BuiltinType* repr = sema_get_integral_type_for_enum(
-          compiler->sema, (const EnumType*)type);
-      return get_llvm_type(compiler, &repr->type, local_ctx);
-    }
-    case TK_NamedType:
-      return get_llvm_type(
-          compiler,
-          sema_resolve_named_type(compiler->sema, (const NamedType*)type),
-          local_ctx);
-    case TK_StructType:
-      return get_llvm_struct_type(compiler, (const StructType*)type, local_ctx);
-    case TK_UnionType:
-      return get_llvm_union_type(compiler, (const UnionType*)type, local_ctx);
     case TK_PointerType:
-      return get_opaque_ptr(compiler);
-    case TK_ArrayType:
-      return get_llvm_array_type(compiler, (const ArrayType*)type, local_ctx);
-    case TK_FunctionType:
-      return get_llvm_function_type(compiler, (const FunctionType*)type,
-                                    local_ctx);
-    case TK_ReplacementSentinelType:
-      UNREACHABLE_MSG("This type should not be handled here.");
+      name = "any pointer";
+      break;
+    case TK_BuiltinType:
+      switch (((const BuiltinType*)type)->kind) {
+        case BTK_Char:
+        case BTK_SignedChar:
+        case BTK_UnsignedChar:
+          return get_tbaa_char(compiler);
+        case BTK_Bool:
+          name = "_Bool";
+          break;
+        case BTK_Short:
+        case BTK_UnsignedShort:
+          name = "short";
+          break;
+        case BTK_Int:
+        case BTK_UnsignedInt:
+          name = "int";
+          break;
+        case BTK_Long:
+        case BTK_UnsignedLong:
+          name = "long";
+          break;
+        case BTK_LongLong:
+        case BTK_UnsignedLongLong:
+          name = "long long";
+          break;
+        case BTK_Float:
+          name = "float";
+          break;
+        case BTK_Double:
+          name = "double";
+          break;
+        case BTK_LongDouble:
+          name = "long double";
+          break;
+        case BTK_Float128:
+          name = "__float128";
+          break;
+        default:
+          return NULL;
+      }
+      break;
+    default:
+      return NULL;
   }
+  return get_tbaa_scalar_node(compiler, name, get_tbaa_char(compiler));
 }
 
-LLVMValueRef compile_expr(Compiler* compiler, LLVMBuilderRef builder,
-                          const Expr* expr, TreeMap* local_ctx,
-                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                          LLVMBasicBlockRef cont_bb);
+static LLVMMetadataRef get_tbaa_member_type(Compiler* compiler,
+                                            const Type* type,
+                                            const TreeMap* local_ctx);
 
-LLVMTypeRef get_llvm_type_of_expr_global_ctx(Compiler* compiler,
-                                             const Expr* expr);
+// Struct type nodes are !{!"name", !member type, i64 offset, ...} with the
+// members in order of their offsets. Bitfields are left out since they're
+// accessed through the field holding them.
+static LLVMMetadataRef get_tbaa_struct_type(Compiler* compiler,
+                                            const StructType* st,
+                                            const TreeMap* local_ctx) {
+  st = sema_resolve_struct_type(compiler->sema, st);
+  LLVMStructLayout* llvm_layout =
+      get_llvm_struct_layout(compiler, st, local_ctx);
+  if (llvm_layout->tbaa)
+    return llvm_layout->tbaa;
+  const StructLayout* layout = llvm_layout->layout;
+
+  const char* name = "";
+  if (st->name)
+    name = st->name;
+
+  vector ops;
+  vector_construct(&ops, sizeof(LLVMMetadataRef), alignof(LLVMMetadataRef));
+  append_metadata(&ops,
+                  LLVMMDStringInContext2(compiler->ctx, name, strlen(name)));
+  for (size_t i = 0; i < st->members->size; ++i) {
+    const MemberLayout* member_layout = &layout->members[i];
+    if (member_layout->is_bitfield)
+      continue;
 
-LLVMValueRef maybe_compile_constant_implicit_cast(Compiler* compiler,
-                                                  const Expr* expr,
-                                                  const Type* to_ty,
-                                                  const TreeMap* local_ctx);
+    const Member* member = vector_at(st->members, i);
+    append_metadata(&ops,
+                    get_tbaa_member_type(compiler, member->type, local_ctx));
+    append_metadata(&ops, LLVMValueAsMetadata(get_i64_metadata_const(
+                              compiler, member_layout->offset)));
+  }
 
-LLVMValueRef get_named_global(Compiler* compiler, const char* name) {
-  // If not in the local scope, check the global scope.
-  //
-  // TODO: How come there's no wrapper for Module::getNamedValue?
-  // Without it, I need to explicitly call the individual getters for
-  // functions, global variables, adn aliases.
-  LLVMValueRef val = LLVMGetNamedGlobal(compiler->mod, name);
+  llvm_layout->tbaa = LLVMMDNodeInContext2(compiler->ctx, ops.data,
+                                          ops.size);
+  vector_destroy(&ops);
+  return llvm_layout->tbaa;
+}
 
-  if (!val)
-    val = LLVMGetNamedFunction(compiler->mod, name);
+// Get the TBAA node of a struct member. Arrays are accessed through their
+// elements. Union members are not told apart, so they alias anything.
+static LLVMMetadataRef get_tbaa_member_type(Compiler* compiler,
+                                            const Type* type,
+                                            const TreeMap* local_ctx) {
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  if (type->vtable->kind == TK_StructType)
+    return get_tbaa_struct_type(compiler, (const StructType*)type, local_ctx);
+  if (type->vtable->kind == TK_ArrayType) {
+    return get_tbaa_member_type(compiler, ((const ArrayType*)type)->elem_type,
+                                local_ctx);
+  }
 
-  if (!val) {
-    // Maybe an enum?
-    void* res;
-    if (tree_map_get(&compiler->sema->enum_values, name, &res)) {
-      EnumType* enum_ty = NULL;
-      tree_map_get(&compiler->sema->enum_names, name, (void*)&enum_ty);
-      assert(enum_ty);
+  LLVMMetadataRef scalar = get_tbaa_scalar_type(compiler, type);
+  if (scalar)
+    return scalar;
+  return get_tbaa_char(compiler);
+}
 
-      TreeMap dummy_ctx;
-      string_tree_map_construct(&dummy_ctx);
-      LLVMTypeRef llvm_ty = get_llvm_type(compiler, &enum_ty->type, &dummy_ctx);
-      tree_map_destroy(&dummy_ctx);
+// Access tags are !{!base type, !access type, i64 offset}, where the access
+// type is a scalar found at `offset` in the base type.
+static LLVMValueRef get_tbaa_access_tag(Compiler* compiler,
+                                        LLVMMetadataRef base,
+                                        LLVMMetadataRef access,
+                                        size_t offset) {
+  LLVMMetadataRef ops[] = {
+      base, access,
+      LLVMValueAsMetadata(get_i64_metadata_const(compiler, offset))};
+  return LLVMMetadataAsValue(compiler->ctx,
+                             LLVMMDNodeInContext2(compiler->ctx, ops, 3));
+}
 
-      return LLVMConstInt(llvm_ty, (unsigned long long)res,
-                          /*IsSigned=*/1);
+static void set_tbaa(Compiler* compiler, LLVMValueRef inst, LLVMValueRef tag) {
+  LLVMSetMetadata(inst, LLVMGetMDKindIDInContext(compiler->ctx, "tbaa", 4),
+                  tag);
+}
+
+// Tag a load or store of a scalar `type`. Other types are left untagged since
+// they may be accessed through members of any type.
+static void set_scalar_tbaa(Compiler* compiler, LLVMValueRef inst,
+                            const Type* type) {
+  if (!compiler->target->strict_aliasing)
+    return;
+  LLVMMetadataRef scalar = get_tbaa_scalar_type(compiler, type);
+  if (scalar)
+    set_tbaa(compiler, inst, get_tbaa_access_tag(compiler, scalar, scalar, 0));
+}
+
+///
+/// End Type-Based Alias Analysis
+///
+
+// How the memory of an lvalue is accessed when its type alone doesn't say.
+// Bitfields are loaded and stored through the whole field holding them, and
+// members of packed structs may be misaligned.
+typedef struct {
+  unsigned align;  // 0 if the alignment of the type is used.
+
+  // An integer as wide as the field holding a bitfield. This is NULL if the
+  // lvalue is not a bitfield.
+  LLVMTypeRef storage_ty;
+  unsigned bit_offset;
+  unsigned bit_width;
+  bool is_signed;
+
+  // The struct-path TBAA tag of a scalar member. This is NULL for other
+  // lvalues or without strict aliasing.
+  LLVMValueRef tbaa;
+} LValueAccess;
+
+static bool is_signed_bitfield_type(Compiler* compiler, const Type* type) {
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  if (type->vtable->kind == TK_EnumType) {
+    type = &sema_get_integral_type_for_enum(compiler->sema,
+                                            (const EnumType*)type)
+                ->type;
+  }
+  return !is_bool_type(type) && !is_unsigned_integral_type(type);
+}
+
+// Get how the `idx`th member of `st` is accessed. The member of a struct with
+// an explicit layout is only as aligned as its offset in the struct allows.
+static void get_struct_member_access(Compiler* compiler, const StructType* st,
+                                     size_t idx, LValueAccess* access,
+                                     const TreeMap* local_ctx) {
+  st = sema_resolve_struct_type(compiler->sema, st);
+  const LLVMStructLayout* llvm_layout =
+      get_llvm_struct_layout(compiler, st, local_ctx);
+
+  const MemberLayout* member_layout = &llvm_layout->layout->members[idx];
+  const MemberField* member_field = &llvm_layout->members[idx];
+  const Member* member = struct_get_nth_member(st, idx);
+
+  size_t align = llvm_layout->layout->align;
+  for (; member_layout->offset % align;)
+    align = align / 2;
+
+  memset(access, 0, sizeof(LValueAccess));
+  if (member_layout->is_bitfield) {
+    access->align = (unsigned)align;
+    access->storage_ty = LLVMIntTypeInContext(
+        compiler->ctx, member_field->storage_size * kCharBit);
+    access->bit_offset = member_field->bit_offset;
+    access->bit_width = (unsigned)member_layout->bit_width;
+    access->is_signed = is_signed_bitfield_type(compiler, member->type);
+  } else if (llvm_layout->is_packed &&
+             align < sema_eval_alignof_type(compiler->sema, member->type,
+                                            local_ctx)) {
+    access->align = (unsigned)align;
+  }
+
+  if (!member_layout->is_bitfield && compiler->target->strict_aliasing) {
+    LLVMMetadataRef scalar = get_tbaa_scalar_type(compiler, member->type);
+    if (scalar) {
+      access->tbaa = get_tbaa_access_tag(
+          compiler, get_tbaa_struct_type(compiler, st, local_ctx), scalar,
+          member_layout->offset);
     }
   }
+}
 
-  return val;
+LLVMTypeRef get_llvm_struct_type(Compiler* compiler, const StructType* st,
+                                 const TreeMap* local_ctx) {
+  st = sema_resolve_struct_type(compiler->sema, st);
+
+  void* llvm_struct;
+
+  // First see if we already made one.
+  if (st->name) {
+    if ((llvm_struct = LLVMGetTypeByName(compiler->mod, st->name)))
+      return llvm_struct;
+  }
+
+  assert(st->members);
+
+  // Doesn't exits. Create the struct body.
+  const LLVMStructLayout* llvm_layout =
+      get_llvm_struct_layout(compiler, st, local_ctx);
+  const vector* elems = &llvm_layout->fields;
+
+  if (st->name) {
+    llvm_struct =
+        LLVMStructCreateNamed(LLVMGetModuleContext(compiler->mod), st->name);
+    LLVMStructSetBody(llvm_struct, elems->data, (unsigned)elems->size,
+                      llvm_layout->is_packed);
+  } else {
+    llvm_struct = LLVMStructTypeInContext(compiler->ctx, elems->data,
+                                          (unsigned)elems->size,
+                                          llvm_layout->is_packed);
+  }
+
+  return llvm_struct;
 }
 
-LLVMTypeRef get_llvm_type_of_expr(Compiler* compiler, const Expr* expr,
-                                  const TreeMap* local_ctx);
+LLVMTypeRef get_llvm_union_type(Compiler* compiler, const UnionType* ut,
+                                const TreeMap* local_ctx) {
+  ut = sema_resolve_union_type(compiler->sema, ut);
 
-LLVMValueRef compile_constant_expr(Compiler* compiler, const Expr* expr,
-                                   const Type* to_ty,
-                                   const TreeMap* local_ctx) {
-  switch (expr->vtable->kind) {
-    case EK_DeclRef: {
-      const DeclRef* decl = (const DeclRef*)expr;
-      LLVMValueRef glob = get_named_global(compiler, decl->name);
-      assert(glob);
-      return glob;
-    }
-    case EK_SizeOf: {
-      ConstExprResult res = sema_eval_sizeof_in_ctx(
-          compiler->sema, (const SizeOf*)expr, local_ctx);
-      assert(res.result_kind == RK_UnsignedLongLong);
-      LLVMTypeRef llvm_type = get_llvm_type_of_expr_global_ctx(compiler, expr);
-      return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
-    }
-    case EK_String: {
-      const StringLiteral* s = (const StringLiteral*)expr;
-      LLVMValueRef seq = LLVMConstString(s->val, (unsigned)strlen(s->val),
-                                         /*DontNullTerminate=*/false);
-      if (is_array_type(to_ty))
-        return seq;
+  void* llvm_union;
 
-      // Need to construct a string pointer manually.
-      LLVMValueRef glob = LLVMAddGlobal(compiler->mod, LLVMTypeOf(seq), "");
-      LLVMSetInitializer(glob, seq);
-      return glob;
-    }
-    case EK_Char: {
-      const Type* type =
-          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
-      assert(type->vtable->kind == TK_BuiltinType);
-      bool is_signed = !is_unsigned_integral_type(type);
-      LLVMTypeRef llvm_type = get_llvm_type_of_expr_global_ctx(compiler, expr);
-      return LLVMConstInt(llvm_type, (unsigned)((const Char*)expr)->val,
-                          is_signed);
-    }
-    case EK_Int: {
-      const Type* type =
-          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
-      assert(type->vtable->kind == TK_BuiltinType);
-      bool is_signed = !is_unsigned_integral_type(type);
-      LLVMTypeRef llvm_type = get_llvm_type_of_expr_global_ctx(compiler, expr);
-      return LLVMConstInt(llvm_type, ((const Int*)expr)->val, is_signed);
-    }
-    case EK_BinOp: {
-      LLVMTypeRef llvm_type = get_llvm_type_of_expr(compiler, expr, local_ctx);
-      ConstExprResult res =
-          sema_eval_expr_in_ctx(compiler->sema, expr, local_ctx);
-      switch (res.result_kind) {
-        case RK_Boolean:
-          return LLVMConstInt(llvm_type, res.result.b, /*IsSigned=*/0);
-        case RK_Int:
-          return LLVMConstInt(llvm_type, (unsigned long long)res.result.i,
-                              /*IsSigned=*/1);
-        case RK_UnsignedLongLong:
-          return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
-      }
-    }
-    case EK_Cast: {
-      const Cast* cast = (const Cast*)expr;
-      const Type* from_ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, cast->base, local_ctx);
-      const Type* to_ty = cast->to;
-
-      LLVMValueRef from =
-          compile_constant_expr(compiler, cast->base, to_ty, local_ctx);
+  // First see if we already made one.
+  if (ut->name) {
+    if ((llvm_union = LLVMGetTypeByName(compiler->mod, ut->name)))
+      return llvm_union;
+  }
 
-      if (sema_types_are_compatible(compiler->sema, from_ty, to_ty, local_ctx))
-        return from;
+  assert(ut->members);
 
-      if (is_integral_type(from_ty) && is_pointer_type(to_ty))
-        return LLVMConstIntToPtr(from,
-                                 get_llvm_type(compiler, to_ty, local_ctx));
+  // Doesn't exits. Create the struct body which only consists of the largest
+  // union member.
+  LLVMTypeRef member = get_llvm_type(
+      compiler,
+      sema_get_largest_union_member(compiler->sema, ut, local_ctx)->type,
+      local_ctx);
 
-      UNREACHABLE_MSG("TODO: Unhandled constant cast conversion");
-    }
-    case EK_InitializerList: {
-      const InitializerList* init = (const InitializerList*)expr;
+  if (ut->name) {
+    llvm_union =
+        LLVMStructCreateNamed(LLVMGetModuleContext(compiler->mod), ut->name);
+    LLVMStructSetBody(llvm_union, &member, /*ElementCount=*/1, ut->packed);
+  } else {
+    llvm_union = LLVMStructTypeInContext(compiler->ctx, &member,
+                                         /*ElementCount=*/1, ut->packed);
+  }
 
-      LLVMValueRef res;
-      bool is_array_ty = sema_is_array_type(compiler->sema, to_ty, local_ctx);
+  return llvm_union;
+}
 
-      LLVMValueRef* constants = malloc(sizeof(LLVMValueRef) * init->elems.size);
-      for (size_t i = 0; i < init->elems.size; ++i) {
-        const InitializerListElem* elem = vector_at(&init->elems, i);
-        if (elem->expr->vtable->kind == EK_InitializerList) {
-          if (is_array_ty) {
-            const ArrayType* arr_ty =
-                sema_get_array_type(compiler->sema, to_ty, local_ctx);
-            constants[i] = maybe_compile_constant_implicit_cast(
-                compiler, elem->expr, arr_ty->elem_type, local_ctx);
-          } else {
-            const StructType* struct_ty =
-                sema_get_struct_type(compiler->sema, to_ty, local_ctx);
-            const Member* member_ty = struct_get_nth_member(struct_ty, i);
-            constants[i] = maybe_compile_constant_implicit_cast(
-                compiler, elem->expr, member_ty->type, local_ctx);
-          }
-        } else {
-          const Type* elem_ty = sema_get_type_of_expr_in_ctx(
-              compiler->sema, elem->expr, local_ctx);
-          constants[i] = maybe_compile_constant_implicit_cast(
-              compiler, elem->expr, elem_ty, local_ctx);
-        }
-      }
+LLVMTypeRef get_opaque_ptr(Compiler* compiler) {
+  return LLVMPointerTypeInContext(LLVMGetModuleContext(compiler->mod),
+                                  /*AddressSpace=*/0);
+}
 
-      if (is_array_ty) {
-        const ArrayType* arr_ty =
-            sema_get_array_type(compiler->sema, to_ty, local_ctx);
-        res = LLVMConstArray(
-            get_llvm_type(compiler, arr_ty->elem_type, local_ctx), constants,
-            (unsigned)init->elems.size);
-      } else {
-        assert(sema_is_struct_type(compiler->sema, to_ty, local_ctx));
-        res = LLVMConstStruct(constants, (unsigned)init->elems.size,
-                              /*Packed=*/0);
-      }
-      free(constants);
+LLVMTypeRef get_llvm_array_type(Compiler* compiler, const ArrayType* at,
+                                const TreeMap* local_ctx) {
+  if (!at->size)
+    return get_opaque_ptr(compiler);
 
-      return res;
-    }
-    case EK_UnOp: {
-      const UnOp* unop = (const UnOp*)expr;
-      switch (unop->op) {
-        case UOK_AddrOf:
-          return compile_constant_expr(compiler, unop->subexpr, to_ty,
-                                       local_ctx);
-        default:
-          UNREACHABLE_MSG(
-              "TODO: Implement IR constant expr evaluation for unop expr op %d",
-              unop->op);
-      }
-    }
-    default:
-      UNREACHABLE_MSG(
-          "TODO: Implement IR constant expr evaluation for expr kind %d",
-          expr->vtable->kind);
+  ConstExprResult size =
+      sema_eval_expr_in_ctx(compiler->sema, at->size, local_ctx);
+  LLVMTypeRef elem = get_llvm_type(compiler, at->elem_type, local_ctx);
+  switch (size.result_kind) {
+    case RK_UnsignedLongLong:
+      return LLVMArrayType(elem, (unsigned)size.result.ull);
+    case RK_Int:
+      return LLVMArrayType(elem, (unsigned)size.result.i);
+    case RK_Boolean:
+      return LLVMArrayType(elem, (unsigned)size.result.b);
   }
 }
 
-LLVMValueRef maybe_compile_constant_implicit_cast(Compiler* compiler,
-                                                  const Expr* expr,
-                                                  const Type* to_ty,
-                                                  const TreeMap* local_ctx) {
-  LLVMValueRef from = compile_constant_expr(compiler, expr, to_ty, local_ctx);
-
-  // We cannot disambiguate if an initializer list is for an array or struct.
-  // They should not be treated like normal expressions, so just use the
-  // destination type in this case.
-  const Type* from_ty =
-      expr->vtable->kind == EK_InitializerList
-          ? to_ty
-          : sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+///
+/// Start x86-64 SysV ABI Lowering
+///
+/// https://gitlab.com/x86-psABIs/x86-64-ABI
+///
+/// LLVM passes first-class aggregates as if each of their fields was a
+/// separate argument, which doesn't match the psABI. Structs, unions and
+/// complex values are instead classified here and passed in up to two
+/// registers, one for each eightbyte, or in memory.
+///
 
-  from_ty = sema_resolve_maybe_named_type(compiler->sema, from_ty);
-  to_ty = sema_resolve_maybe_named_type(compiler->sema, to_ty);
+// Merge the class of a scalar into the class of the eightbyte holding it.
+static ABIClass merge_abi_classes(ABIClass a, ABIClass b) {
+  if (a == b || b == AC_NoClass)
+    return a;
+  if (a == AC_NoClass)
+    return b;
+  if (a == AC_Memory || b == AC_Memory)
+    return AC_Memory;
+  if (a == AC_Integer || b == AC_Integer)
+    return AC_Integer;
+  return AC_SSE;
+}
 
-  if (sema_types_are_compatible_ignore_quals(compiler->sema, from_ty, to_ty,
-                                             local_ctx))
-    return from;
+// One eightbyte of an aggregate being classified.
+typedef struct {
+  ABIClass cls;
 
-  if (from_ty->vtable->kind == TK_EnumType) {
-    from_ty = &sema_get_integral_type_for_enum(compiler->sema,
-                                               (const EnumType*)from_ty)
-                   ->type;
-  }
-  if (to_ty->vtable->kind == TK_EnumType) {
-    to_ty =
-        &sema_get_integral_type_for_enum(compiler->sema, (const EnumType*)to_ty)
-             ->type;
-  }
+  // The end of the last scalar in the eightbyte, in bytes from the start of
+  // the aggregate. An SSE eightbyte with only a float is passed as a float.
+  size_t data_end;
 
-  if (is_integral_type(from_ty) && is_integral_type(to_ty)) {
-    unsigned long long from_val = LLVMConstIntGetZExtValue(from);
-    LLVMTypeRef llvm_to_ty = get_llvm_type(compiler, to_ty, local_ctx);
-    bool is_signed = !is_unsigned_integral_type(to_ty);
-    return LLVMConstInt(llvm_to_ty, from_val, is_signed);
-  }
+  // Whether an SSE eightbyte holds a double rather than a pair of floats.
+  bool has_double;
+} Eightbyte;
 
-  UNREACHABLE_MSG(
-      "TODO: Unhandled implicit constant cast conversion:\n"
-      "lhs: %d %d (%s) %p\n"
-      "rhs: %d %d (%s) %p\n",
-      from_ty->vtable->kind, from_ty->qualifiers,
-      (from_ty->vtable->kind == TK_StructType
-           ? ((const StructType*)from_ty)->name
-           : ""),
-      from_ty, to_ty->vtable->kind, to_ty->qualifiers,
-      (to_ty->vtable->kind == TK_StructType ? ((const StructType*)to_ty)->name
-                                            : ""),
-      to_ty);
+typedef struct {
+  Eightbyte* eightbytes;  // The two eightbytes of the aggregate.
+
+  // A 16 byte vector filling the aggregate. It's passed in one SSE register.
+  LLVMTypeRef vector_type;
+} Eightbytes;
+
+// Add a scalar of `size` bytes at `offset` to the eightbyte holding it.
+// Returns false if the scalar straddles two eightbytes, which only happens in
+// packed structs and leaves the aggregate in memory.
+static bool classify_scalar(Eightbytes* eb, size_t offset, size_t size,
+                            ABIClass cls) {
+  size_t i = offset / 8;
+  if (i > 1 || (offset + size - 1) / 8 != i)
+    return false;
+  Eightbyte* eightbyte = &eb->eightbytes[i];
+  eightbyte->cls = merge_abi_classes(eightbyte->cls, cls);
+  if (offset + size > eightbyte->data_end)
+    eightbyte->data_end = offset + size;
+  return true;
 }
 
-static bool should_use_icmp(LLVMTypeRef type) {
-  switch (LLVMGetTypeKind(type)) {
-    case LLVMIntegerTypeKind:
-    case LLVMPointerTypeKind:
-      return true;
-    default:
-      return false;
-  }
+static bool classify_double(Eightbytes* eb, size_t offset) {
+  if (!classify_scalar(eb, offset, 8, AC_SSE))
+    return false;
+  eb->eightbytes[offset / 8].has_double = true;
+  return true;
 }
 
-// NOTE: This always returns an i1.
-LLVMValueRef compile_to_bool(Compiler* compiler, LLVMBuilderRef builder,
-                             const Expr* expr, TreeMap* local_ctx,
-                             TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                             LLVMBasicBlockRef cont_bb) {
-  const Type* type =
-      sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+// Classify the scalars of `type`, found at `offset` in the aggregate being
+// classified. Returns false if the aggregate must be passed in memory.
+static bool classify_eightbytes(Compiler* compiler, const Type* type,
+                                size_t offset, Eightbytes* eb,
+                                const TreeMap* local_ctx) {
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  size_t size = sema_eval_sizeof_type(compiler->sema, type, local_ctx);
+  if (size == 0)
+    return true;
 
-  if (type->vtable->kind == TK_NamedType)
-    type = sema_resolve_named_type(compiler->sema, (const NamedType*)type);
+  // Unaligned members of packed structs leave the aggregate in memory.
+  if (offset % sema_eval_alignof_type(compiler->sema, type, local_ctx))
+    return false;
 
   switch (type->vtable->kind) {
     case TK_BuiltinType:
-    case TK_PointerType:
+      switch (((const BuiltinType*)type)->kind) {
+        case BTK_Float:
+          return classify_scalar(eb, offset, 4, AC_SSE);
+        case BTK_Double:
+          return classify_double(eb, offset);
+        case BTK_ComplexFloat:
+          return classify_scalar(eb, offset, 4, AC_SSE) &&
+                 classify_scalar(eb, offset + 4, 4, AC_SSE);
+        case BTK_ComplexDouble:
+          return classify_double(eb, offset) &&
+                 classify_double(eb, offset + 8);
+        case BTK_LongDouble:
+        case BTK_Float128:
+        case BTK_ComplexLongDouble:
+        case BTK_BuiltinVAList:
+        case BTK_Void:
+          return false;
+        default:
+          return classify_scalar(eb, offset, size, AC_Integer);
+      }
     case TK_EnumType:
+    case TK_PointerType:
+      return classify_scalar(eb, offset, size, AC_Integer);
     case TK_ArrayType: {
-      // Easiest (but not always correct) way is to compare against zero.
-      LLVMValueRef val = compile_expr(compiler, builder, expr, local_ctx,
-                                      local_allocas, break_bb, cont_bb);
-      LLVMTypeRef type = LLVMTypeOf(val);
-      LLVMValueRef zero = LLVMConstNull(type);
-      if (should_use_icmp(type)) {
-        return LLVMBuildICmp(builder, LLVMIntNE, val, zero, "to_bool");
-      } else {
-        return LLVMBuildFCmp(builder, LLVMRealUNE, val, zero, "to_bool");
+      const Type* elem_ty = ((const ArrayType*)type)->elem_type;
+      size_t elem_size =
+          sema_eval_sizeof_type(compiler->sema, elem_ty, local_ctx);
+      for (size_t elem = 0; elem < size; elem += elem_size) {
+        if (!classify_eightbytes(compiler, elem_ty, offset + elem, eb,
+                                 local_ctx))
+          return false;
+      }
+      return true;
+    }
+    case TK_StructType: {
+      const StructType* st =
+          sema_resolve_struct_type(compiler->sema, (const StructType*)type);
+      const StructLayout* layout =
+          sema_get_struct_layout(compiler->sema, st, local_ctx);
+      bool in_registers = true;
+      for (size_t i = 0; i < st->members->size && in_registers; ++i) {
+        const Member* member = vector_at(st->members, i);
+        const MemberLayout* member_layout = &layout->members[i];
+        size_t member_offset = offset + member_layout->offset;
+        if (!member_layout->is_bitfield) {
+          in_registers = classify_eightbytes(compiler, member->type,
+                                             member_offset, eb, local_ctx);
+        } else if (member->name && member_layout->bit_width) {
+          // Unnamed bitfields don't affect the classification.
+          size_t bits = member_layout->bit_offset + member_layout->bit_width;
+          in_registers =
+              classify_scalar(eb, member_offset,
+                              align_up(bits, kCharBit) / kCharBit, AC_Integer);
+        }
+      }
+      return in_registers;
+    }
+    case TK_UnionType: {
+      const UnionType* ut =
+          sema_resolve_union_type(compiler->sema, (const UnionType*)type);
+      for (size_t i = 0; i < ut->members->size; ++i) {
+        const Member* member = vector_at(ut->members, i);
+        if (!classify_eightbytes(compiler, member->type, offset, eb,
+                                 local_ctx))
+          return false;
       }
+      return true;
     }
+    case TK_VectorType:
+      if (size == 16 && offset == 0) {
+        eb->vector_type = get_llvm_type(compiler, type, local_ctx);
+        return classify_scalar(eb, 0, 8, AC_SSE) &&
+               classify_scalar(eb, 8, 8, AC_SSEUp);
+      }
+      if (size < 8)
+        return classify_scalar(eb, offset, size, AC_SSE);
+      return size == 8 && classify_double(eb, offset);
+    default:
+      return false;
+  }
+}
+
+// Structs, unions and complex values are passed the way the psABI classifies
+// them. Other types are passed as their LLVM types.
+static bool is_abi_aggregate(Compiler* compiler, const Type* type) {
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  switch (type->vtable->kind) {
     case TK_StructType:
     case TK_UnionType:
-    case TK_NamedType:
-    case TK_FunctionType:
-    case TK_ReplacementSentinelType:
-      UNREACHABLE_MSG("Cannot convert this type to bool %d",
-                      type->vtable->kind);
+      return true;
+    case TK_BuiltinType:
+      return is_builtin_type(type, BTK_ComplexFloat) ||
+             is_builtin_type(type, BTK_ComplexDouble) ||
+             is_builtin_type(type, BTK_ComplexLongDouble);
+    default:
+      return false;
   }
 }
 
-LLVMValueRef compile_lvalue_ptr(Compiler* compiler, LLVMBuilderRef builder,
-                                const Expr* expr, TreeMap* local_ctx,
-                                TreeMap* local_allocas,
-                                LLVMBasicBlockRef break_bb,
-                                LLVMBasicBlockRef cont_bb);
+// Classify an aggregate of `type`. If it's passed in registers, the number of
+// integer and SSE registers it takes are set in `needed_int` and `needed_sse`.
+static void classify_aggregate(Compiler* compiler, const Type* type,
+                               const TreeMap* local_ctx, ABIArgInfo* info,
+                               unsigned* needed_int, unsigned* needed_sse) {
+  *needed_int = 0;
+  *needed_sse = 0;
+  info->lo = NULL;
+  info->hi = NULL;
+
+  size_t size = sema_eval_sizeof_type(compiler->sema, type, local_ctx);
+  if (size == 0) {
+    info->kind = AK_Ignore;
+    return;
+  }
 
-LLVMValueRef compile_unop_lvalue_ptr(Compiler* compiler, LLVMBuilderRef builder,
-                                     const UnOp* expr, TreeMap* local_ctx,
-                                     TreeMap* local_allocas,
-                                     LLVMBasicBlockRef break_bb,
-                                     LLVMBasicBlockRef cont_bb) {
-  switch (expr->op) {
-    case UOK_Deref: {
-      return compile_expr(compiler, builder, expr->subexpr, local_ctx,
-                          local_allocas, break_bb, cont_bb);
+  Eightbyte eightbytes[2];
+  memset(eightbytes, 0, sizeof(eightbytes));
+  Eightbytes eb;
+  eb.eightbytes = eightbytes;
+  eb.vector_type = NULL;
+  info->kind = AK_Indirect;
+  if (size > 16 || !classify_eightbytes(compiler, type, 0, &eb, local_ctx))
+    return;
+  if (eightbytes[0].cls == AC_Memory || eightbytes[1].cls == AC_Memory)
+    return;
+
+  info->kind = AK_Coerce;
+  if (eb.vector_type && eightbytes[0].cls == AC_SSE &&
+      eightbytes[1].cls == AC_SSEUp) {
+    info->lo = eb.vector_type;
+    *needed_sse = 1;
+    return;
+  }
+
+  LLVMContextRef ctx = compiler->ctx;
+  for (size_t i = 0; i * 8 < size; ++i) {
+    size_t start = i * 8;
+    const Eightbyte* eightbyte = &eightbytes[i];
+    if (i == 1 && eightbyte->cls == AC_NoClass)
+      break;  // The second eightbyte is only padding.
+
+    LLVMTypeRef coerce;
+    if (eightbyte->cls == AC_SSE || eightbyte->cls == AC_SSEUp) {
+      *needed_sse = *needed_sse + 1;
+      if (eightbyte->data_end - start <= 4)
+        coerce = LLVMFloatTypeInContext(ctx);
+      else if (eightbyte->has_double)
+        coerce = LLVMDoubleTypeInContext(ctx);
+      else
+        coerce = LLVMVectorType(LLVMFloatTypeInContext(ctx), 2);
+    } else {
+      // The last eightbyte is passed as an integer of the bytes left.
+      *needed_int = *needed_int + 1;
+      size_t bytes = size - start;
+      if (bytes > 8)
+        bytes = 8;
+      coerce = LLVMIntTypeInContext(ctx, (unsigned)(bytes * kCharBit));
     }
-    default:
-      UNREACHABLE_MSG("TODO: Implement compile_unop_lvalue_ptr for this op %d",
-                      expr->op);
+
+    if (i == 0)
+      info->lo = coerce;
+    else
+      info->hi = coerce;
   }
 }
 
-unsigned get_llvm_ptr_size_in_bytes(const Compiler* compiler) {
-  LLVMTargetDataRef data_layout = LLVMGetModuleDataLayout(compiler->mod);
-  unsigned size = LLVMPointerSize(data_layout);
-  assert(size);
-  return size;
-}
+// Classify an argument of `type` and take the registers and LLVM parameters
+// it's passed in from `abi`. An aggregate is passed on the stack if there are
+// not enough registers left for all of it.
+static void classify_argument(Compiler* compiler, const Type* type,
+                              const TreeMap* local_ctx, FunctionABI* abi,
+                              ABIArgInfo* info) {
+  info->param = abi->num_params;
+  info->type = type;
+  info->lo = NULL;
+  info->hi = NULL;
+  if (is_void_type(type)) {
+    info->kind = AK_Ignore;
+    return;
+  }
 
-unsigned get_llvm_ptr_size_in_bits(const Compiler* compiler) {
-  return get_llvm_ptr_size_in_bytes(compiler) * kCharBit;
-}
+  if (!is_abi_aggregate(compiler, type)) {
+    info->kind = AK_Direct;
+    abi->num_params += 1;
+    const Type* resolved = sema_resolve_maybe_named_type(compiler->sema, type);
+    if (resolved->vtable->kind == TK_VectorType ||
+        is_floating_point_type(resolved)) {
+      if (abi->free_sse_regs)
+        abi->free_sse_regs = abi->free_sse_regs - 1;
+    } else if (abi->free_int_regs) {
+      abi->free_int_regs = abi->free_int_regs - 1;
+    }
+    return;
+  }
 
-LLVMTypeRef get_llvm_ptr_as_int(const Compiler* compiler) {
-  return LLVMIntType(get_llvm_ptr_size_in_bits(compiler));
+  unsigned needed_int;
+  unsigned needed_sse;
+  classify_aggregate(compiler, type, local_ctx, info, &needed_int,
+                     &needed_sse);
+  if (info->kind == AK_Coerce && (needed_int > abi->free_int_regs ||
+                                  needed_sse > abi->free_sse_regs)) {
+    info->kind = AK_Indirect;
+    info->lo = NULL;
+    info->hi = NULL;
+  }
+
+  if (info->kind == AK_Coerce) {
+    abi->free_int_regs = abi->free_int_regs - needed_int;
+    abi->free_sse_regs = abi->free_sse_regs - needed_sse;
+    abi->num_params += 1;
+    if (info->hi)
+      abi->num_params += 1;
+  } else if (info->kind == AK_Indirect) {
+    abi->num_params += 1;
+  }
 }
 
-// This is a wrapper for whenever we would load/store an LLVMValueRef but we
-// need to take into account alignment of the original type.
+// Classify the return value and positional arguments of `ft`. `abi->args`
+// must be destroyed by the caller.
+static void get_function_abi(Compiler* compiler, const FunctionType* ft,
+                             const TreeMap* local_ctx, FunctionABI* abi) {
+  abi->free_int_regs = 6;
+  abi->free_sse_regs = 8;
+  abi->num_params = 0;
+
+  ABIArgInfo* ret = &abi->ret;
+  ret->kind = AK_Direct;
+  ret->lo = NULL;
+  ret->hi = NULL;
+  ret->param = 0;
+  ret->type = ft->return_type;
+  if (is_abi_aggregate(compiler, ft->return_type)) {
+    // Return values always fit in the return registers.
+    unsigned needed_int;
+    unsigned needed_sse;
+    classify_aggregate(compiler, ft->return_type, local_ctx, ret, &needed_int,
+                       &needed_sse);
+
+    // The `sret` pointer is passed as a hidden first argument.
+    if (ret->kind == AK_Indirect) {
+      abi->free_int_regs = 5;
+      abi->num_params = 1;
+    }
+  }
+
+  vector_construct(&abi->args, sizeof(ABIArgInfo), alignof(ABIArgInfo));
+  for (size_t i = 0; i < ft->pos_args.size; ++i) {
+    const FunctionArg* arg = vector_at(&ft->pos_args, i);
+    ABIArgInfo* info = vector_append_storage(&abi->args);
+    classify_argument(compiler, arg->type, local_ctx, abi, info);
+  }
+}
+
+// The LLVM type an AK_Coerce value is returned as.
+static LLVMTypeRef get_coerced_type(Compiler* compiler,
+                                    const ABIArgInfo* info) {
+  if (!info->hi)
+    return info->lo;
+  LLVMTypeRef elems[] = {info->lo, info->hi};
+  return LLVMStructTypeInContext(compiler->ctx, elems, /*ElementCount=*/2,
+                                 /*Packed=*/0);
+}
+
+static void append_llvm_type(vector* types, LLVMTypeRef type) {
+  LLVMTypeRef* storage = vector_append_storage(types);
+  *storage = type;
+}
+
+///
+/// End x86-64 SysV ABI Lowering
+///
+
+LLVMTypeRef get_llvm_function_type(Compiler* compiler, const FunctionType* ft,
+                                   const TreeMap* local_ctx) {
+  FunctionABI abi;
+  get_function_abi(compiler, ft, local_ctx, &abi);
+
+  LLVMTypeRef ret = LLVMVoidTypeInContext(compiler->ctx);
+  if (abi.ret.kind == AK_Direct)
+    ret = get_llvm_type(compiler, ft->return_type, local_ctx);
+  else if (abi.ret.kind == AK_Coerce)
+    ret = get_coerced_type(compiler, &abi.ret);
+
+  vector params;
+  vector_construct(&params, sizeof(LLVMTypeRef), alignof(LLVMTypeRef));
+  if (abi.ret.kind == AK_Indirect)
+    append_llvm_type(&params, get_opaque_ptr(compiler));
+
+  for (size_t i = 0; i < ft->pos_args.size; ++i) {
+    const FunctionArg* arg = vector_at(&ft->pos_args, i);
+    const ABIArgInfo* info = vector_at(&abi.args, i);
+    switch (info->kind) {
+      case AK_Direct:
+        append_llvm_type(&params,
+                         get_llvm_type(compiler, arg->type, local_ctx));
+        break;
+      case AK_Coerce:
+        append_llvm_type(&params, info->lo);
+        if (info->hi)
+          append_llvm_type(&params, info->hi);
+        break;
+      case AK_Indirect:
+        append_llvm_type(&params, get_opaque_ptr(compiler));
+        break;
+      case AK_Ignore:
+        break;
+    }
+  }
+
+  LLVMTypeRef res = LLVMFunctionType(ret, params.data, (unsigned)params.size,
+                                     ft->has_var_args);
+
+  vector_destroy(&params);
+  vector_destroy(&abi.args);
+
+  return res;
+}
+
+LLVMTypeRef get_llvm_builtin_type(Compiler* compiler, const BuiltinType* bt);
+
+static LLVMTypeRef get_builtin_va_list(Compiler* compiler) {
+  // TODO: This is a target-dependent type. It should have different
+  // implementations per target.
+  //
+  // https://refspecs.linuxbase.org/elf/x86_64-abi-0.21.pdf
+  //
+  // On x86-64, this is
+  //
+  //   typedef struct {
+  //     unsigned int gp_offset;
+  //     unsigned int fp_offset;
+  //     void *overflow_arg_area;
+  //     void *reg_save_area;
+  //   } va_list[1];
+  //
+  LLVMTypeRef ui =
+      get_llvm_builtin_type(compiler, &compiler->sema->bt_UnsignedInt);
+  LLVMTypeRef vp = get_opaque_ptr(compiler);
+  LLVMTypeRef elems[] = {ui, ui, vp, vp};
+  return LLVMStructTypeInContext(compiler->ctx, elems, /*ElementCount=*/4,
+                                 /*Packed=*/0);
+}
+
+LLVMTypeRef get_llvm_builtin_type(Compiler* compiler, const BuiltinType* bt) {
+  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+  switch (bt->kind) {
+    case BTK_Char:
+    case BTK_SignedChar:
+    case BTK_UnsignedChar:
+    case BTK_Short:
+    case BTK_UnsignedShort:
+    case BTK_Int:
+    case BTK_UnsignedInt:
+    case BTK_Long:
+    case BTK_UnsignedLong:
+    case BTK_LongLong:
+    case BTK_UnsignedLongLong: {
+      size_t size = builtin_type_get_size(bt);
+      assert(size);
+      return LLVMIntTypeInContext(compiler->ctx, (unsigned)(size * kCharBit));
+    }
+    case BTK_Float:
+      return LLVMFloatTypeInContext(ctx);
+    case BTK_Double:
+      return LLVMDoubleTypeInContext(ctx);
+    case BTK_LongDouble:
+    case BTK_Float128:
+      return LLVMFP128TypeInContext(ctx);
+    case BTK_Void:
+      return LLVMVoidTypeInContext(compiler->ctx);
+    case BTK_Bool:
+      return LLVMIntTypeInContext(compiler->ctx, kCharBit);
+    case BTK_ComplexFloat: {
+      LLVMTypeRef elems[] = {LLVMFloatTypeInContext(ctx),
+                             LLVMFloatTypeInContext(ctx)};
+      return LLVMStructTypeInContext(compiler->ctx, elems, /*ElementCount=*/2,
+                                     /*Packed=*/0);
+    }
+    case BTK_ComplexDouble: {
+      LLVMTypeRef elems[] = {LLVMDoubleTypeInContext(ctx),
+                             LLVMDoubleTypeInContext(ctx)};
+      return LLVMStructTypeInContext(compiler->ctx, elems, /*ElementCount=*/2,
+                                     /*Packed=*/0);
+    }
+    case BTK_ComplexLongDouble: {
+      LLVMTypeRef elems[] = {LLVMFP128TypeInContext(ctx),
+                             LLVMFP128TypeInContext(ctx)};
+      return LLVMStructTypeInContext(compiler->ctx, elems, /*ElementCount=*/2,
+                                     /*Packed=*/0);
+    }
+    case BTK_BuiltinVAList:
+      return get_builtin_va_list(compiler);
+  }
+}
+
+static LLVMTypeRef lower_llvm_type(Compiler* compiler, const Type* type,
+                                   const TreeMap* local_ctx) {
+  switch (type->vtable->kind) {
+    case TK_BuiltinType:
+      return get_llvm_builtin_type(compiler, (const BuiltinType*)type);
+    case TK_EnumType: {
+      const BuiltinType* repr = sema_get_integral_type_for_enum(
+          compiler->sema, (const EnumType*)type);
+      return get_llvm_type(compiler, &repr->type, local_ctx);
+    }
+    case TK_NamedType:
+      return get_llvm_type(
+          compiler,
+          sema_resolve_named_type(compiler->sema, (const NamedType*)type),
+          local_ctx);
+    case TK_StructType:
+      return get_llvm_struct_type(compiler, (const StructType*)type, local_ctx);
+    case TK_UnionType:
+      return get_llvm_union_type(compiler, (const UnionType*)type, local_ctx);
+    case TK_PointerType:
+      return get_opaque_ptr(compiler);
+    case TK_ArrayType:
+      return get_llvm_array_type(compiler, (const ArrayType*)type, local_ctx);
+    case TK_FunctionType:
+      return get_llvm_function_type(compiler, (const FunctionType*)type,
+                                    local_ctx);
+    case TK_VectorType: {
+      const VectorType* vec = (const VectorType*)type;
+      size_t len = sema_get_vector_length(compiler->sema, vec, local_ctx);
+      return LLVMVectorType(get_llvm_type(compiler, vec->elem_type, local_ctx),
+                            (unsigned)len);
+    }
+    case TK_ReplacementSentinelType:
+      UNREACHABLE_MSG("This type should not be handled here.");
+  }
+}
+
+// Different Types can lower to the same LLVM type, so resolve them first to
+// avoid caching the same lowering under many keys.
+static const Type* get_canonical_type(Compiler* compiler, const Type* type) {
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  switch (type->vtable->kind) {
+    case TK_StructType:
+      return &sema_resolve_struct_type(compiler->sema, (const StructType*)type)
+                  ->type;
+    case TK_UnionType:
+      return &sema_resolve_union_type(compiler->sema, (const UnionType*)type)
+                  ->type;
+    case TK_EnumType:
+      return &sema_get_integral_type_for_enum(compiler->sema,
+                                              (const EnumType*)type)
+                  ->type;
+    default:
+      return type;
+  }
+}
+
+LLVMTypeRef get_llvm_type(Compiler* compiler, const Type* type,
+                          const TreeMap* local_ctx) {
+  type = get_canonical_type(compiler, type);
+
+  void* llvm_type;
+  if (tree_map_get(&compiler->llvm_types, type, &llvm_type))
+    return llvm_type;
+
+  llvm_type = lower_llvm_type(compiler, type, local_ctx);
+  tree_map_set(&compiler->llvm_types, type, llvm_type);
+  return llvm_type;
+}
+
+LLVMValueRef compile_expr(Compiler* compiler, LLVMBuilderRef builder,
+                          const Expr* expr, TreeMap* local_ctx,
+                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                          LLVMBasicBlockRef cont_bb);
+
+LLVMTypeRef get_llvm_type_of_expr_global_ctx(Compiler* compiler,
+                                             const Expr* expr);
+
+LLVMValueRef maybe_compile_constant_implicit_cast(Compiler* compiler,
+                                                  const Expr* expr,
+                                                  const Type* to_ty,
+                                                  const TreeMap* local_ctx);
+
+LLVMValueRef get_named_global(Compiler* compiler, const char* name) {
+  // If not in the local scope, check the global scope.
+  //
+  // TODO: How come there's no wrapper for Module::getNamedValue?
+  // Without it, I need to explicitly call the individual getters for
+  // functions, global variables, adn aliases.
+  LLVMValueRef val = LLVMGetNamedGlobal(compiler->mod, name);
+
+  if (!val)
+    val = LLVMGetNamedFunction(compiler->mod, name);
+
+  if (!val) {
+    // Maybe an enum?
+    void* res;
+    if (tree_map_get(&compiler->sema->enum_values, name, &res)) {
+      EnumType* enum_ty = NULL;
+      tree_map_get(&compiler->sema->enum_names, name, (void*)&enum_ty);
+      assert(enum_ty);
+
+      TreeMap dummy_ctx;
+      string_tree_map_construct(&dummy_ctx);
+      LLVMTypeRef llvm_ty = get_llvm_type(compiler, &enum_ty->type, &dummy_ctx);
+      tree_map_destroy(&dummy_ctx);
+
+      return LLVMConstInt(llvm_ty, (unsigned long long)res,
+                          /*IsSigned=*/1);
+    }
+  }
+
+  return val;
+}
+
+static LLVMAttributeRef create_enum_attribute(Compiler* compiler,
+                                              const char* kind, uint64_t val) {
+  unsigned kind_id = LLVMGetEnumAttributeKindForName(kind, strlen(kind));
+  assert(kind_id);
+  return LLVMCreateEnumAttribute(compiler->ctx, kind_id, val);
+}
+
+// Mark LLVM parameter `param` of the function or call `val` as the pointer an
+// aggregate is passed or returned through. `kind` is "sret" or "byval".
+static void add_indirect_attributes(Compiler* compiler, LLVMValueRef val,
+                                    const ABIArgInfo* info, const char* kind,
+                                    const TreeMap* local_ctx) {
+  unsigned kind_id = LLVMGetEnumAttributeKindForName(kind, strlen(kind));
+  assert(kind_id);
+  size_t align = sema_eval_alignof_type(compiler->sema, info->type, local_ctx);
+  if (strcmp(kind, "byval") == 0 && align < 8)
+    align = 8;  // Arguments on the stack take whole eightbytes.
+
+  LLVMAttributeRef attrs[] = {
+      LLVMCreateTypeAttribute(compiler->ctx, kind_id,
+                              get_llvm_type(compiler, info->type, local_ctx)),
+      create_enum_attribute(compiler, "align", align)};
+
+  // Parameter attributes are indexed starting at 1.
+  LLVMAttributeIndex idx = info->param + 1;
+  for (size_t i = 0; i < 2; ++i) {
+    if (LLVMIsACallInst(val))
+      LLVMAddCallSiteAttribute(val, idx, attrs[i]);
+    else
+      LLVMAddAttributeAtIndex(val, idx, attrs[i]);
+  }
+}
+
+// Add the `sret` and `byval` attributes of `abi` to the function or call
+// `val`.
+static void add_abi_attributes(Compiler* compiler, LLVMValueRef val,
+                               const FunctionABI* abi,
+                               const TreeMap* local_ctx) {
+  if (abi->ret.kind == AK_Indirect)
+    add_indirect_attributes(compiler, val, &abi->ret, "sret", local_ctx);
+  for (size_t i = 0; i < abi->args.size; ++i) {
+    const ABIArgInfo* info = vector_at(&abi->args, i);
+    if (info->kind == AK_Indirect)
+      add_indirect_attributes(compiler, val, info, "byval", local_ctx);
+  }
+}
+
+LLVMTypeRef get_llvm_type_of_expr(Compiler* compiler, const Expr* expr,
+                                  const TreeMap* local_ctx);
+
+size_t get_constant_array_length(Compiler* compiler, const ArrayType* arr_ty,
+                                 const TreeMap* local_ctx) {
+  assert(arr_ty->size);
+  ConstExprResult res =
+      sema_eval_expr_in_ctx(compiler->sema, arr_ty->size, local_ctx);
+  return result_to_u64(&res);
+}
+
+// Trailing zeros of at least this many elements are emitted as a separate
+// zeroinitializer rather than spelled out element by element.
+static const size_t kMinZeroTailLength = 8;
+
+// Given a constant for the first `len` of `n` elements of type `elem_ty`, make
+// a constant for all `n` elements where the remaining ones are zero. If the
+// zero tail is long enough, the result is an unnamed struct of the data and a
+// zeroinitializer which has the same layout as the full array.
+static LLVMValueRef append_zero_tail(Compiler* compiler, LLVMValueRef data,
+                                     LLVMTypeRef elem_ty, size_t len,
+                                     size_t n) {
+  if (len == n)
+    return data;
+
+  LLVMValueRef parts[] = {
+      data, LLVMConstNull(LLVMArrayType(elem_ty, (unsigned)(n - len)))};
+  return LLVMConstStructInContext(compiler->ctx, parts, /*Count=*/2,
+                                  /*Packed=*/0);
+}
+
+// Make a constant array from integer values. This avoids creating an
+// LLVMValueRef per element where possible.
+static LLVMValueRef build_constant_int_array(Compiler* compiler,
+                                             LLVMTypeRef elem_ty,
+                                             const uint64_t* vals, size_t n) {
+  size_t num_nonzero = n;
+  while (num_nonzero > 0 && vals[num_nonzero - 1] == 0) --num_nonzero;
+
+  if (num_nonzero == 0)
+    return LLVMConstNull(LLVMArrayType(elem_ty, (unsigned)n));
+
+  size_t len = n;
+  if (n - num_nonzero >= kMinZeroTailLength)
+    len = num_nonzero;
+
+  LLVMValueRef data;
+  if (LLVMGetIntTypeWidth(elem_ty) == kCharBit) {
+    // Byte arrays can be made directly from the raw data.
+    char* bytes = malloc(sizeof(char) * len);
+    for (size_t i = 0; i < len; ++i) bytes[i] = (char)vals[i];
+    data = LLVMConstStringInContext(compiler->ctx, bytes, (unsigned)len,
+                                    /*DontNullTerminate=*/true);
+    free(bytes);
+  } else {
+    // LLVM turns an array of ConstantInts into a ConstantDataArray.
+    LLVMValueRef* elems = malloc(sizeof(LLVMValueRef) * len);
+    for (size_t i = 0; i < len; ++i)
+      elems[i] = LLVMConstInt(elem_ty, vals[i], /*IsSigned=*/0);
+    data = LLVMConstArray(elem_ty, elems, (unsigned)len);
+    free(elems);
+  }
+
+  return append_zero_tail(compiler, data, elem_ty, len, n);
+}
+
+// Get the index of each element in an array initializer list. Elements
+// without a designator follow the previous element.
+static size_t* get_array_initializer_indices(Compiler* compiler,
+                                             const InitializerList* init,
+                                             const TreeMap* local_ctx,
+                                             size_t* max_len) {
+  size_t* indices = malloc(sizeof(size_t) * init->elems.size);
+  size_t idx = 0;
+  *max_len = 0;
+  for (size_t i = 0; i < init->elems.size; ++i) {
+    const InitializerListElem* elem = vector_at(&init->elems, i);
+    if (elem->index) {
+      ConstExprResult res =
+          sema_eval_expr_in_ctx(compiler->sema, elem->index, local_ctx);
+      idx = result_to_u64(&res);
+    }
+    indices[i] = idx;
+    ++idx;
+    if (idx > *max_len)
+      *max_len = idx;
+  }
+  return indices;
+}
+
+// Integer element initializers which are plain literals can be read straight
+// from the AST. Everything else goes through the regular constant lowering.
+// Returns false if the element is not a constant integer.
+static bool get_constant_int_initializer(Compiler* compiler, const Expr* expr,
+                                         const Type* elem_ty,
+                                         const TreeMap* local_ctx,
+                                         uint64_t* val) {
+  switch (expr->vtable->kind) {
+    case EK_Int:
+      *val = ((const Int*)expr)->val;
+      return true;
+    case EK_Char:
+      *val = (uint64_t)((const Char*)expr)->val;
+      return true;
+    default: {
+      LLVMValueRef c = maybe_compile_constant_implicit_cast(compiler, expr,
+                                                            elem_ty, local_ctx);
+      if (!LLVMIsAConstantInt(c))
+        return false;
+      // The value is already converted to the element type, so sign extend
+      // it for signed elements to keep the 64-bit pattern consistent with
+      // the literal cases above.
+      *val = is_unsigned_integral_type(elem_ty)
+                 ? LLVMConstIntGetZExtValue(c)
+                 : (uint64_t)LLVMConstIntGetSExtValue(c);
+      return true;
+    }
+  }
+}
+
+LLVMValueRef compile_constant_array_initializer(Compiler* compiler,
+                                                const InitializerList* init,
+                                                const ArrayType* arr_ty,
+                                                const TreeMap* local_ctx) {
+  size_t max_len;
+  size_t* indices =
+      get_array_initializer_indices(compiler, init, local_ctx, &max_len);
+  size_t n = arr_ty->size
+                 ? get_constant_array_length(compiler, arr_ty, local_ctx)
+                 : max_len;
+  ASSERT_MSG(max_len <= n, "Excess elements in array initializer");
+
+  LLVMTypeRef llvm_elem_ty =
+      get_llvm_type(compiler, arr_ty->elem_type, local_ctx);
+  LLVMValueRef res = NULL;
+
+  if (LLVMGetTypeKind(llvm_elem_ty) == LLVMIntegerTypeKind) {
+    uint64_t* vals = calloc(n, sizeof(uint64_t));
+    bool all_ints = true;
+    for (size_t i = 0; i < init->elems.size && all_ints; ++i) {
+      const InitializerListElem* elem = vector_at(&init->elems, i);
+      all_ints =
+          get_constant_int_initializer(compiler, elem->expr, arr_ty->elem_type,
+                                       local_ctx, &vals[indices[i]]);
+    }
+    if (all_ints)
+      res = build_constant_int_array(compiler, llvm_elem_ty, vals, n);
+    free(vals);
+  }
+
+  if (!res) {
+    // Elements that are not explicitly initialized are left NULL and zeroed
+    // below.
+    LLVMValueRef* vals = calloc(n, sizeof(LLVMValueRef));
+    for (size_t i = 0; i < init->elems.size; ++i) {
+      const InitializerListElem* elem = vector_at(&init->elems, i);
+      vals[indices[i]] = maybe_compile_constant_implicit_cast(
+          compiler, elem->expr, arr_ty->elem_type, local_ctx);
+    }
+
+    size_t num_nonzero = n;
+    while (num_nonzero > 0 && (!vals[num_nonzero - 1] ||
+                               LLVMIsNull(vals[num_nonzero - 1])))
+      --num_nonzero;
+
+    size_t len = n;
+    if (n - num_nonzero >= kMinZeroTailLength)
+      len = num_nonzero;
+
+    // Nested aggregates with zero tails have their own unnamed types, in which
+    // case this needs to be a struct rather than an array.
+    bool same_types = true;
+    for (size_t i = 0; i < len; ++i) {
+      if (!vals[i])
+        vals[i] = LLVMConstNull(llvm_elem_ty);
+      else if (LLVMTypeOf(vals[i]) != llvm_elem_ty)
+        same_types = false;
+    }
+
+    LLVMValueRef data;
+    if (same_types) {
+      data = LLVMConstArray(llvm_elem_ty, vals, (unsigned)len);
+    } else {
+      data = LLVMConstStructInContext(compiler->ctx, vals, (unsigned)len,
+                                      /*Packed=*/0);
+    }
+    res = append_zero_tail(compiler, data, llvm_elem_ty, len, n);
+    free(vals);
+  }
+
+  free(indices);
+  return res;
+}
+
+// Elements that are not explicitly initialized are zeroed.
+static LLVMValueRef compile_constant_vector_initializer(
+    Compiler* compiler, const InitializerList* init, const VectorType* vec_ty,
+    const TreeMap* local_ctx) {
+  size_t max_len;
+  size_t* indices =
+      get_array_initializer_indices(compiler, init, local_ctx, &max_len);
+  size_t n = sema_get_vector_length(compiler->sema, vec_ty, local_ctx);
+  ASSERT_MSG(max_len <= n, "Excess elements in vector initializer");
+
+  LLVMValueRef zero =
+      LLVMConstNull(get_llvm_type(compiler, vec_ty->elem_type, local_ctx));
+  LLVMValueRef* vals = malloc(sizeof(LLVMValueRef) * n);
+  for (size_t i = 0; i < n; ++i)
+    vals[i] = zero;
+
+  for (size_t i = 0; i < init->elems.size; ++i) {
+    const InitializerListElem* elem = vector_at(&init->elems, i);
+    vals[indices[i]] = maybe_compile_constant_implicit_cast(
+        compiler, elem->expr, vec_ty->elem_type, local_ctx);
+  }
+
+  LLVMValueRef res = LLVMConstVector(vals, (unsigned)n);
+  free(vals);
+  free(indices);
+  return res;
+}
+
+// Unnamed members are skipped by positional initializers.
+static size_t skip_unnamed_members(const StructType* st, size_t idx) {
+  for (; idx < st->members->size;) {
+    const Member* member = struct_get_nth_member(st, idx);
+    if (member->name)
+      break;
+    ++idx;
+  }
+  return idx;
+}
+
+// Set the bits of the bitfield described by `access` in the bytes of the field
+// holding it.
+static void set_constant_bitfield(Compiler* compiler, unsigned char* bytes,
+                                  const LValueAccess* access,
+                                  const Expr* init, const TreeMap* local_ctx) {
+  ConstExprResult res = sema_eval_expr_in_ctx(compiler->sema, init, local_ctx);
+  uint64_t val;
+  if (res.result_kind == RK_Int)
+    val = (uint64_t)(int64_t)res.result.i;  // Keep the two's complement bits.
+  else
+    val = result_to_u64(&res);
+  for (unsigned i = 0; i < access->bit_width; ++i) {
+    if (!((val >> i) & 1))
+      continue;
+    unsigned bit = access->bit_offset + i;
+    bytes[bit / kCharBit] |= (unsigned char)(1 << (bit % kCharBit));
+  }
+}
+
+LLVMValueRef compile_constant_struct_initializer(Compiler* compiler,
+                                                 const InitializerList* init,
+                                                 const StructType* struct_ty,
+                                                 const TreeMap* local_ctx) {
+  struct_ty = sema_resolve_struct_type(compiler->sema, struct_ty);
+  size_t num_members = struct_ty->members->size;
+
+  const LLVMStructLayout* llvm_layout =
+      get_llvm_struct_layout(compiler, struct_ty, local_ctx);
+  size_t num_fields = llvm_layout->fields.size;
+
+  // Fields that are not explicitly initialized are left NULL and zeroed
+  // below. Bitfields are collected into the bytes of their fields.
+  LLVMValueRef* vals = calloc(num_fields, sizeof(LLVMValueRef));
+  unsigned char** field_bytes = calloc(num_fields, sizeof(unsigned char*));
+  size_t idx = 0;
+  for (size_t i = 0; i < init->elems.size; ++i) {
+    const InitializerListElem* elem = vector_at(&init->elems, i);
+    if (elem->name)
+      struct_get_member(struct_ty, elem->name, &idx);
+    else
+      idx = skip_unnamed_members(struct_ty, idx);
+    ASSERT_MSG(idx < num_members, "Excess elements in struct initializer");
+
+    const Member* member = struct_get_nth_member(struct_ty, idx);
+    unsigned field = llvm_layout->members[idx].field;
+    if (llvm_layout->layout->members[idx].is_bitfield) {
+      LValueAccess access;
+      get_struct_member_access(compiler, struct_ty, idx, &access, local_ctx);
+      if (!field_bytes[field]) {
+        field_bytes[field] =
+            calloc(llvm_layout->members[idx].storage_size, sizeof(char));
+      }
+      set_constant_bitfield(compiler, field_bytes[field], &access, elem->expr,
+                            local_ctx);
+    } else {
+      vals[field] = maybe_compile_constant_implicit_cast(
+          compiler, elem->expr, member->type, local_ctx);
+    }
+    ++idx;
+  }
+
+  // Nested aggregates with zero tails have their own unnamed types, in which
+  // case this can't use the named struct type.
+  LLVMTypeRef llvm_struct_ty =
+      get_llvm_type(compiler, &struct_ty->type, local_ctx);
+  LLVMTypeRef i8 = LLVMInt8TypeInContext(compiler->ctx);
+  bool same_types = true;
+  for (size_t i = 0; i < num_fields; ++i) {
+    LLVMTypeRef field_ty =
+        LLVMStructGetTypeAtIndex(llvm_struct_ty, (unsigned)i);
+    if (field_bytes[i]) {
+      unsigned len = LLVMGetArrayLength(field_ty);
+      LLVMValueRef* bytes = malloc(sizeof(LLVMValueRef) * len);
+      for (unsigned j = 0; j < len; ++j)
+        bytes[j] = LLVMConstInt(i8, field_bytes[i][j], /*signed=*/0);
+      vals[i] = LLVMConstArray(i8, bytes, len);
+      free(bytes);
+      free(field_bytes[i]);
+    }
+    if (!vals[i])
+      vals[i] = LLVMConstNull(field_ty);
+    else if (LLVMTypeOf(vals[i]) != field_ty)
+      same_types = false;
+  }
+
+  LLVMValueRef res;
+  if (same_types) {
+    res = LLVMConstNamedStruct(llvm_struct_ty, vals, (unsigned)num_fields);
+  } else {
+    res = LLVMConstStructInContext(compiler->ctx, vals, (unsigned)num_fields,
+                                   llvm_layout->is_packed);
+  }
+  free(vals);
+  free(field_bytes);
+  return res;
+}
+
+LLVMValueRef compile_constant_expr(Compiler* compiler, const Expr* expr,
+                                   const Type* to_ty,
+                                   const TreeMap* local_ctx) {
+  switch (expr->vtable->kind) {
+    case EK_AddrOfLabel: {
+      ASSERT_MSG(compiler->current_function,
+                 "%zu:%zu: Label addresses can only be taken in a function",
+                 source_location_line(&expr->loc),
+                 source_location_col(&expr->loc));
+      Label* label = get_label(compiler, ((const AddrOfLabel*)expr)->label);
+      label->address_taken = true;
+      return LLVMBlockAddress(compiler->current_function, label->bb);
+    }
+    case EK_DeclRef: {
+      const DeclRef* decl = (const DeclRef*)expr;
+      LLVMValueRef glob = get_named_global(compiler, decl->name);
+      assert(glob);
+      return glob;
+    }
+    case EK_SizeOf: {
+      ConstExprResult res = sema_eval_sizeof_in_ctx(
+          compiler->sema, (const SizeOf*)expr, local_ctx);
+      assert(res.result_kind == RK_UnsignedLongLong);
+      LLVMTypeRef llvm_type = get_llvm_type_of_expr_global_ctx(compiler, expr);
+      return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
+    }
+    case EK_String: {
+      const StringLiteral* s = (const StringLiteral*)expr;
+      const ArrayType* arr_ty =
+          sema_get_array_type(compiler->sema, to_ty, local_ctx);
+      if (arr_ty && arr_ty->size) {
+        // The string fills the start of the array and the rest is zeroed.
+        size_t len = get_constant_array_length(compiler, arr_ty, local_ctx);
+        char* chars = calloc(len, sizeof(char));
+        strncpy(chars, s->val, len);
+        LLVMValueRef seq =
+            LLVMConstStringInContext(compiler->ctx, chars, (unsigned)len,
+                                     /*DontNullTerminate=*/true);
+        free(chars);
+        return seq;
+      }
+
+      if (arr_ty) {
+        return LLVMConstStringInContext(compiler->ctx, s->val,
+                                        (unsigned)strlen(s->val),
+                                        /*DontNullTerminate=*/false);
+      }
+
+      return get_string_literal(compiler, s->val);
+    }
+    case EK_Char: {
+      const Type* type =
+          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+      assert(type->vtable->kind == TK_BuiltinType);
+      bool is_signed = !is_unsigned_integral_type(type);
+      LLVMTypeRef llvm_type = get_llvm_type_of_expr_global_ctx(compiler, expr);
+      return LLVMConstInt(llvm_type, (unsigned)((const Char*)expr)->val,
+                          is_signed);
+    }
+    case EK_Int: {
+      const Type* type =
+          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+      assert(type->vtable->kind == TK_BuiltinType);
+      bool is_signed = !is_unsigned_integral_type(type);
+      LLVMTypeRef llvm_type = get_llvm_type_of_expr_global_ctx(compiler, expr);
+      return LLVMConstInt(llvm_type, ((const Int*)expr)->val, is_signed);
+    }
+    case EK_Float: {
+      LLVMTypeRef llvm_type = get_llvm_type_of_expr_global_ctx(compiler, expr);
+      return LLVMConstRealOfString(llvm_type, ((const Float*)expr)->val);
+    }
+    case EK_BinOp: {
+      LLVMTypeRef llvm_type = get_llvm_type_of_expr(compiler, expr, local_ctx);
+      ConstExprResult res =
+          sema_eval_expr_in_ctx(compiler->sema, expr, local_ctx);
+      switch (res.result_kind) {
+        case RK_Boolean:
+          return LLVMConstInt(llvm_type, res.result.b, /*IsSigned=*/0);
+        case RK_Int:
+          return LLVMConstInt(llvm_type, (unsigned long long)res.result.i,
+                              /*IsSigned=*/1);
+        case RK_UnsignedLongLong:
+          return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
+      }
+    }
+    case EK_Cast: {
+      const Cast* cast = (const Cast*)expr;
+      const Type* from_ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, cast->base, local_ctx);
+      const Type* to_ty = cast->to;
+
+      LLVMValueRef from =
+          compile_constant_expr(compiler, cast->base, to_ty, local_ctx);
+
+      if (sema_types_are_compatible(compiler->sema, from_ty, to_ty, local_ctx))
+        return from;
+
+      if (is_integral_type(from_ty) && is_pointer_type(to_ty))
+        return LLVMConstIntToPtr(from,
+                                 get_llvm_type(compiler, to_ty, local_ctx));
+
+      UNREACHABLE_MSG("TODO: Unhandled constant cast conversion");
+    }
+    case EK_InitializerList: {
+      const InitializerList* init = (const InitializerList*)expr;
+      const ArrayType* arr_ty =
+          sema_get_array_type(compiler->sema, to_ty, local_ctx);
+      if (arr_ty)
+        return compile_constant_array_initializer(compiler, init, arr_ty,
+                                                  local_ctx);
+
+      const VectorType* vec_ty =
+          sema_get_vector_type(compiler->sema, to_ty, local_ctx);
+      if (vec_ty)
+        return compile_constant_vector_initializer(compiler, init, vec_ty,
+                                                   local_ctx);
+
+      const StructType* struct_ty =
+          sema_get_struct_type(compiler->sema, to_ty, local_ctx);
+      assert(struct_ty);
+      return compile_constant_struct_initializer(compiler, init, struct_ty,
+                                                 local_ctx);
+    }
+    case EK_UnOp: {
+      const UnOp* unop = (const UnOp*)expr;
+      switch (unop->op) {
+        case UOK_AddrOf:
+          return compile_constant_expr(compiler, unop->subexpr, to_ty,
+                                       local_ctx);
+        case UOK_Negate: {
+          LLVMValueRef sub =
+              compile_constant_expr(compiler, unop->subexpr, to_ty, local_ctx);
+          if (LLVMIsAConstantFP(sub))
+            return LLVMConstFNeg(sub);
+          return LLVMConstNeg(sub);
+        }
+        default:
+          UNREACHABLE_MSG(
+              "TODO: Implement IR constant expr evaluation for unop expr op %d",
+              unop->op);
+      }
+    }
+    default:
+      UNREACHABLE_MSG(
+          "TODO: Implement IR constant expr evaluation for expr kind %d",
+          expr->vtable->kind);
+  }
+}
+
+LLVMValueRef maybe_compile_constant_implicit_cast(Compiler* compiler,
+                                                  const Expr* expr,
+                                                  const Type* to_ty,
+                                                  const TreeMap* local_ctx) {
+  LLVMValueRef from = compile_constant_expr(compiler, expr, to_ty, local_ctx);
+
+  // We cannot disambiguate if an initializer list is for an array or struct.
+  // They should not be treated like normal expressions, so just use the
+  // destination type in this case. The same goes for strings initializing
+  // arrays which are compiled directly to the array type.
+  bool is_array_init = expr->vtable->kind == EK_InitializerList ||
+                       (expr->vtable->kind == EK_String &&
+                        sema_is_array_type(compiler->sema, to_ty, local_ctx));
+  const Type* from_ty =
+      is_array_init
+          ? to_ty
+          : sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+
+  from_ty = sema_resolve_maybe_named_type(compiler->sema, from_ty);
+  to_ty = sema_resolve_maybe_named_type(compiler->sema, to_ty);
+
+  if (sema_types_are_compatible_ignore_quals(compiler->sema, from_ty, to_ty,
+                                             local_ctx))
+    return from;
+
+  if (from_ty->vtable->kind == TK_EnumType) {
+    from_ty = &sema_get_integral_type_for_enum(compiler->sema,
+                                               (const EnumType*)from_ty)
+                   ->type;
+  }
+  if (to_ty->vtable->kind == TK_EnumType) {
+    to_ty =
+        &sema_get_integral_type_for_enum(compiler->sema, (const EnumType*)to_ty)
+             ->type;
+  }
+
+  // All pointers are opaque, so arrays and functions decaying to pointers and
+  // pointer to pointer conversions need no extra work.
+  if (is_pointer_type(to_ty) &&
+      (is_pointer_type(from_ty) || is_array_type(from_ty) ||
+       from_ty->vtable->kind == TK_FunctionType))
+    return from;
+
+  if (is_integral_type(from_ty) && is_pointer_type(to_ty))
+    return LLVMConstIntToPtr(from, get_llvm_type(compiler, to_ty, local_ctx));
+
+  if (is_integral_type(from_ty) && is_integral_type(to_ty)) {
+    // Widening follows the signedness of the source. LLVMConstInt truncates
+    // the 64-bit value to the destination width, so narrowing needs nothing.
+    unsigned long long from_val =
+        is_unsigned_integral_type(from_ty)
+            ? LLVMConstIntGetZExtValue(from)
+            : (unsigned long long)LLVMConstIntGetSExtValue(from);
+    LLVMTypeRef llvm_to_ty = get_llvm_type(compiler, to_ty, local_ctx);
+    return LLVMConstInt(llvm_to_ty, from_val, /*SignExtend=*/0);
+  }
+
+  if (is_floating_point_type(to_ty)) {
+    LLVMTypeRef llvm_to_ty = get_llvm_type(compiler, to_ty, local_ctx);
+    if (is_floating_point_type(from_ty))
+      return LLVMConstFPCast(from, llvm_to_ty);
+    if (is_unsigned_integral_type(from_ty))
+      return LLVMConstUIToFP(from, llvm_to_ty);
+    if (is_integral_type(from_ty))
+      return LLVMConstSIToFP(from, llvm_to_ty);
+  }
+
+  if (is_floating_point_type(from_ty) && is_integral_type(to_ty)) {
+    LLVMTypeRef llvm_to_ty = get_llvm_type(compiler, to_ty, local_ctx);
+    if (is_unsigned_integral_type(to_ty))
+      return LLVMConstFPToUI(from, llvm_to_ty);
+    return LLVMConstFPToSI(from, llvm_to_ty);
+  }
+
+  UNREACHABLE_MSG(
+      "TODO: Unhandled implicit constant cast conversion:\n"
+      "lhs: %d %d (%s) %p\n"
+      "rhs: %d %d (%s) %p\n",
+      from_ty->vtable->kind, from_ty->qualifiers,
+      (from_ty->vtable->kind == TK_StructType
+           ? ((const StructType*)from_ty)->name
+           : ""),
+      from_ty, to_ty->vtable->kind, to_ty->qualifiers,
+      (to_ty->vtable->kind == TK_StructType ? ((const StructType*)to_ty)->name
+                                            : ""),
+      to_ty);
+}
+
+static bool should_use_icmp(LLVMTypeRef type) {
+  switch (LLVMGetTypeKind(type)) {
+    case LLVMIntegerTypeKind:
+    case LLVMPointerTypeKind:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// True for floating point types and vectors of them.
+static bool is_llvm_fp_type(LLVMTypeRef type) {
+  if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+    type = LLVMGetElementType(type);
+
+  switch (LLVMGetTypeKind(type)) {
+    case LLVMHalfTypeKind:
+    case LLVMBFloatTypeKind:
+    case LLVMFloatTypeKind:
+    case LLVMDoubleTypeKind:
+    case LLVMX86_FP80TypeKind:
+    case LLVMFP128TypeKind:
+    case LLVMPPC_FP128TypeKind:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// NOTE: This always returns an i1.
+LLVMValueRef compile_to_bool(Compiler* compiler, LLVMBuilderRef builder,
+                             const Expr* expr, TreeMap* local_ctx,
+                             TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                             LLVMBasicBlockRef cont_bb) {
+  const Type* type =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+
+  if (type->vtable->kind == TK_NamedType)
+    type = sema_resolve_named_type(compiler->sema, (const NamedType*)type);
+
+  switch (type->vtable->kind) {
+    case TK_BuiltinType:
+    case TK_PointerType:
+    case TK_EnumType:
+    case TK_ArrayType: {
+      // Easiest (but not always correct) way is to compare against zero.
+      LLVMValueRef val = compile_expr(compiler, builder, expr, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
+      LLVMTypeRef type = LLVMTypeOf(val);
+      LLVMValueRef zero = LLVMConstNull(type);
+      if (should_use_icmp(type)) {
+        return LLVMBuildICmp(builder, LLVMIntNE, val, zero, "to_bool");
+      } else {
+        return LLVMBuildFCmp(builder, LLVMRealUNE, val, zero, "to_bool");
+      }
+    }
+    case TK_StructType:
+    case TK_UnionType:
+    case TK_NamedType:
+    case TK_FunctionType:
+    case TK_VectorType:
+    case TK_ReplacementSentinelType:
+      UNREACHABLE_MSG("Cannot convert this type to bool %d",
+                      type->vtable->kind);
+  }
+}
+
+LLVMValueRef compile_lvalue_ptr(Compiler* compiler, LLVMBuilderRef builder,
+                                const Expr* expr, TreeMap* local_ctx,
+                                TreeMap* local_allocas,
+                                LLVMBasicBlockRef break_bb,
+                                LLVMBasicBlockRef cont_bb);
+
+LLVMValueRef compile_unop_lvalue_ptr(Compiler* compiler, LLVMBuilderRef builder,
+                                     const UnOp* expr, TreeMap* local_ctx,
+                                     TreeMap* local_allocas,
+                                     LLVMBasicBlockRef break_bb,
+                                     LLVMBasicBlockRef cont_bb) {
+  switch (expr->op) {
+    case UOK_Deref: {
+      return compile_expr(compiler, builder, expr->subexpr, local_ctx,
+                          local_allocas, break_bb, cont_bb);
+    }
+    default:
+      UNREACHABLE_MSG("TODO: Implement compile_unop_lvalue_ptr for this op %d",
+                      expr->op);
+  }
+}
+
+unsigned get_llvm_ptr_size_in_bytes(const Compiler* compiler) {
+  LLVMTargetDataRef data_layout = LLVMGetModuleDataLayout(compiler->mod);
+  unsigned size = LLVMPointerSize(data_layout);
+  assert(size);
+  return size;
+}
+
+unsigned get_llvm_ptr_size_in_bits(const Compiler* compiler) {
+  return get_llvm_ptr_size_in_bytes(compiler) * kCharBit;
+}
+
+LLVMTypeRef get_llvm_ptr_as_int(const Compiler* compiler) {
+  return LLVMIntTypeInContext(compiler->ctx,
+                              get_llvm_ptr_size_in_bits(compiler));
+}
+
+// Plain accesses to `_Atomic` objects are sequentially consistent.
+static bool is_atomic_type(Compiler* compiler, const Type* type) {
+  if (type_is_atomic(type))
+    return true;
+  return type_is_atomic(sema_resolve_maybe_named_type(compiler->sema, type));
+}
+
+// This is a wrapper for whenever we would load/store an LLVMValueRef but we
+// need to take into account alignment of the original type.
 static LLVMValueRef get_aligned_load(Compiler* compiler, LLVMBuilderRef builder,
                                      const Type* type, LLVMValueRef ptr,
                                      const char* name,
                                      const TreeMap* local_ctx) {
   LLVMTypeRef llvm_type = get_llvm_type(compiler, type, local_ctx);
-  LLVMValueRef load = LLVMBuildLoad2(builder, llvm_type, ptr, name);
+  LLVMValueRef load = LLVMBuildLoad2(builder, llvm_type, ptr, name);
+  set_scalar_tbaa(compiler, load, type);
+
+  if (type->align) {
+    size_t alignment = sema_eval_alignof_type(compiler->sema, type, local_ctx);
+    LLVMSetAlignment(load, (unsigned)alignment);
+  }
+
+  if (is_atomic_type(compiler, type))
+    LLVMSetOrdering(load, LLVMAtomicOrderingSequentiallyConsistent);
+
+  return load;
+}
+
+static LLVMValueRef get_aligned_store(Compiler* compiler,
+                                      LLVMBuilderRef builder, const Type* type,
+                                      LLVMValueRef val, LLVMValueRef ptr,
+                                      const TreeMap* local_ctx) {
+  LLVMValueRef store = LLVMBuildStore(builder, val, ptr);
+  set_scalar_tbaa(compiler, store, type);
+
+  if (type->align) {
+    size_t alignment = sema_eval_alignof_type(compiler->sema, type, local_ctx);
+    LLVMSetAlignment(store, (unsigned)alignment);
+  }
+
+  if (is_atomic_type(compiler, type))
+    LLVMSetOrdering(store, LLVMAtomicOrderingSequentiallyConsistent);
+
+  return store;
+}
+
+// Structs with explicit layouts are packed in LLVM, so the alignment of their
+// objects, or arrays of them, comes from sema.
+static bool is_packed_llvm_struct(LLVMTypeRef type) {
+  for (; LLVMGetTypeKind(type) == LLVMArrayTypeKind;)
+    type = LLVMGetElementType(type);
+  return LLVMGetTypeKind(type) == LLVMStructTypeKind &&
+         LLVMIsPackedStruct(type);
+}
+
+// Objects whose alignment LLVM cannot infer from their type: those declared
+// with `alignas` or `aligned(N)`, and those of explicit-layout structs.
+static bool has_explicit_alignment(const Type* type, LLVMTypeRef llvm_type) {
+  return type->align || is_packed_llvm_struct(llvm_type);
+}
+
+static LLVMValueRef get_aligned_alloca(Compiler* compiler,
+                                       LLVMBuilderRef builder, const Type* type,
+                                       LLVMTypeRef llvm_type, const char* name,
+                                       const TreeMap* local_ctx) {
+  LLVMValueRef alloca = LLVMBuildAlloca(builder, llvm_type, name);
+
+  if (has_explicit_alignment(type, llvm_type)) {
+    size_t alignment = sema_eval_alignof_type(compiler->sema, type, local_ctx);
+    LLVMSetAlignment(alloca, (unsigned)alignment);
+  }
+
+  return alloca;
+}
+
+// Locals of scalar types that never have their address taken are kept in SSA
+// registers rather than allocas.
+static bool is_promotable_local(Compiler* compiler, const char* name,
+                                const Type* type) {
+  if (tree_map_has(&compiler->ssa->address_taken, name))
+    return false;
+
+  // Volatile and atomic accesses must stay in memory.
+  if (type->qualifiers & (kVolatileMask | kAtomicMask))
+    return false;
+
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  if (type->qualifiers & (kVolatileMask | kAtomicMask))
+    return false;
+
+  switch (type->vtable->kind) {
+    case TK_PointerType:
+    case TK_EnumType:
+      return true;
+    case TK_BuiltinType:
+      return is_integral_type(type);
+    default:
+      return false;
+  }
+}
+
+// If `expr` refers to a local kept in SSA form, return its SSAVariable.
+// Otherwise, return NULL.
+static SSAVariable* get_promoted_local(Compiler* compiler, const Expr* expr,
+                                       const TreeMap* local_allocas) {
+  if (!compiler->ssa || expr->vtable->kind != EK_DeclRef)
+    return NULL;
+
+  void* val;
+  if (!tree_map_get(local_allocas, ((const DeclRef*)expr)->name, &val))
+    return NULL;
+
+  if (!ssa_is_variable(compiler->ssa, val))
+    return NULL;
+
+  return val;
+}
+
+// Get how `expr` is accessed if it's a member of a struct. Returns NULL
+// otherwise.
+static const LValueAccess* get_lvalue_access(Compiler* compiler,
+                                             const Expr* expr,
+                                             LValueAccess* access,
+                                             const TreeMap* local_ctx) {
+  if (expr->vtable->kind != EK_MemberAccess)
+    return NULL;
+
+  const MemberAccess* member_access = (const MemberAccess*)expr;
+  const StructType* base_ty = sema_get_struct_type_from_member_access(
+      compiler->sema, member_access, local_ctx);
+  size_t idx;
+  sema_get_struct_member(compiler->sema, base_ty, member_access->member, &idx);
+  get_struct_member_access(compiler, base_ty, idx, access, local_ctx);
+  return access;
+}
+
+// Extract the bitfield described by `access` from the field holding it.
+static LLVMValueRef build_bitfield_extract(Compiler* compiler,
+                                           LLVMBuilderRef builder,
+                                           const LValueAccess* access,
+                                           LLVMValueRef storage,
+                                           LLVMTypeRef type) {
+  // Move the bitfield to the top of the storage and then shift it back down
+  // to extend it.
+  unsigned storage_bits = LLVMGetIntTypeWidth(access->storage_ty);
+  unsigned high_bits =
+      storage_bits - (access->bit_offset + access->bit_width);
+  LLVMValueRef val = storage;
+  if (high_bits) {
+    val = LLVMBuildShl(
+        builder, val,
+        LLVMConstInt(access->storage_ty, high_bits, /*signed=*/0), "");
+  }
+  unsigned shift = storage_bits - access->bit_width;
+  if (shift) {
+    LLVMValueRef amount =
+        LLVMConstInt(access->storage_ty, shift, /*signed=*/0);
+    if (access->is_signed)
+      val = LLVMBuildAShr(builder, val, amount, "");
+    else
+      val = LLVMBuildLShr(builder, val, amount, "");
+  }
+  return LLVMBuildIntCast2(builder, val, type, access->is_signed, "");
+}
+
+// Replace the bitfield described by `access` in the field at `ptr` with `val`.
+static void build_bitfield_insert(Compiler* compiler, LLVMBuilderRef builder,
+                                  const LValueAccess* access, LLVMValueRef val,
+                                  LLVMValueRef ptr) {
+  LLVMTypeRef storage_ty = access->storage_ty;
+  unsigned storage_bits = LLVMGetIntTypeWidth(storage_ty);
+  LLVMValueRef offset =
+      LLVMConstInt(storage_ty, access->bit_offset, /*signed=*/0);
+  LLVMValueRef low_mask = LLVMBuildLShr(
+      builder, LLVMConstAllOnes(storage_ty),
+      LLVMConstInt(storage_ty, storage_bits - access->bit_width,
+                   /*signed=*/0),
+      "");
+  LLVMValueRef mask = LLVMBuildShl(builder, low_mask, offset, "");
+
+  LLVMValueRef bits = LLVMBuildIntCast2(builder, val, storage_ty,
+                                        /*IsSigned=*/0, "");
+  bits = LLVMBuildAnd(builder, bits, low_mask, "");
+  bits = LLVMBuildShl(builder, bits, offset, "");
+
+  LLVMValueRef old = LLVMBuildLoad2(builder, storage_ty, ptr, "");
+  LLVMSetAlignment(old, access->align);
+  LLVMValueRef cleared =
+      LLVMBuildAnd(builder, old, LLVMBuildNot(builder, mask, ""), "");
+  LLVMValueRef store =
+      LLVMBuildStore(builder, LLVMBuildOr(builder, cleared, bits, ""), ptr);
+  LLVMSetAlignment(store, access->align);
+}
+
+// Load the value of an lvalue which is either a promoted local `var` or the
+// memory at `ptr`. `access` is optional.
+static LLVMValueRef load_from_lvalue(Compiler* compiler, LLVMBuilderRef builder,
+                                     const Type* type, SSAVariable* var,
+                                     LLVMValueRef ptr,
+                                     const LValueAccess* access,
+                                     const TreeMap* local_ctx) {
+  if (var) {
+    return ssa_read_variable(compiler->ssa, var,
+                             LLVMGetInsertBlock(builder));
+  }
+
+  if (access && access->storage_ty) {
+    LLVMValueRef storage =
+        LLVMBuildLoad2(builder, access->storage_ty, ptr, "");
+    LLVMSetAlignment(storage, access->align);
+    return build_bitfield_extract(compiler, builder, access, storage,
+                                  get_llvm_type(compiler, type, local_ctx));
+  }
+
+  LLVMValueRef load =
+      get_aligned_load(compiler, builder, type, ptr, "", local_ctx);
+  if (access && access->align)
+    LLVMSetAlignment(load, access->align);
+  if (access && access->tbaa)
+    set_tbaa(compiler, load, access->tbaa);
+  return load;
+}
+
+// Store a value to an lvalue which is either a promoted local `var` or the
+// memory at `ptr`. `access` is optional.
+static void store_to_lvalue(Compiler* compiler, LLVMBuilderRef builder,
+                            const Type* type, LLVMValueRef val,
+                            SSAVariable* var, LLVMValueRef ptr,
+                            const LValueAccess* access,
+                            const TreeMap* local_ctx) {
+  if (var) {
+    ssa_write_variable(var, LLVMGetInsertBlock(builder), val);
+    return;
+  }
+
+  if (access && access->storage_ty) {
+    build_bitfield_insert(compiler, builder, access, val, ptr);
+    return;
+  }
+
+  LLVMValueRef store =
+      get_aligned_store(compiler, builder, type, val, ptr, local_ctx);
+  if (access && access->align)
+    LLVMSetAlignment(store, access->align);
+  if (access && access->tbaa)
+    set_tbaa(compiler, store, access->tbaa);
+}
+
+// Structs and unions are copied with memcpy rather than loaded and stored as
+// first-class values, which LLVM would otherwise split into one access per
+// member.
+static bool is_aggregate_type(const Compiler* compiler, const Type* type) {
+  type = sema_resolve_maybe_named_type(compiler->sema, type);
+  return type->vtable->kind == TK_StructType ||
+         type->vtable->kind == TK_UnionType;
+}
+
+// Returns true if compile_lvalue_ptr can get the address of `expr` without
+// materializing a temporary.
+static bool has_lvalue_ptr(Compiler* compiler, const Expr* expr,
+                           const TreeMap* local_allocas) {
+  switch (expr->vtable->kind) {
+    case EK_DeclRef:
+      return !get_promoted_local(compiler, expr, local_allocas);
+    case EK_MemberAccess: {
+      const MemberAccess* access = (const MemberAccess*)expr;
+      return access->is_arrow ||
+             has_lvalue_ptr(compiler, access->base, local_allocas);
+    }
+    case EK_Index:
+      return true;
+    case EK_UnOp:
+      return ((const UnOp*)expr)->op == UOK_Deref;
+    default:
+      return false;
+  }
+}
+
+// Copy an object of `type` from `src` to `dst` with the size and alignment
+// from sema's layout.
+static void build_aggregate_copy(Compiler* compiler, LLVMBuilderRef builder,
+                                 const Type* type, LLVMValueRef dst,
+                                 LLVMValueRef src, const TreeMap* local_ctx) {
+  size_t size = sema_eval_sizeof_type(compiler->sema, type, local_ctx);
+  size_t align = sema_eval_alignof_type(compiler->sema, type, local_ctx);
+  LLVMBuildMemCpy(builder, dst, (unsigned)align, src, (unsigned)align,
+                  LLVMConstInt(get_llvm_ptr_as_int(compiler), size,
+                               /*IsSigned=*/0));
+}
+
+// Returns true if `expr` assigns one aggregate lvalue to another, which can be
+// done with a single memcpy.
+static bool is_aggregate_assign(Compiler* compiler, const Expr* expr,
+                                const TreeMap* local_ctx,
+                                const TreeMap* local_allocas) {
+  if (expr->vtable->kind != EK_BinOp)
+    return false;
+
+  const BinOp* binop = (const BinOp*)expr;
+  if (binop->op != BOK_Assign)
+    return false;
+
+  const Type* lhs_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, binop->lhs, local_ctx);
+  return is_aggregate_type(compiler, lhs_ty) &&
+         has_lvalue_ptr(compiler, binop->rhs, local_allocas);
+}
+
+// Compile an assignment accepted by is_aggregate_assign. Returns the address
+// of the destination.
+static LLVMValueRef compile_aggregate_assign(
+    Compiler* compiler, LLVMBuilderRef builder, const BinOp* expr,
+    TreeMap* local_ctx, TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+    LLVMBasicBlockRef cont_bb) {
+  const Type* type =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr->lhs, local_ctx);
+  LLVMValueRef src = compile_lvalue_ptr(compiler, builder, expr->rhs, local_ctx,
+                                        local_allocas, break_bb, cont_bb);
+  LLVMValueRef dst = compile_lvalue_ptr(compiler, builder, expr->lhs, local_ctx,
+                                        local_allocas, break_bb, cont_bb);
+  build_aggregate_copy(compiler, builder, type, dst, src, local_ctx);
+  return dst;
+}
+
+static LLVMValueRef build_atomic_cmpxchg_loop(
+    Compiler* compiler, LLVMBuilderRef builder, BinOpKind op, LLVMValueRef ptr,
+    LLVMValueRef rhs, const Type* lhs_ty, const Type* common_ty,
+    bool common_is_unsigned, const TreeMap* local_ctx, LLVMValueRef* old_out);
+
+LLVMValueRef compile_unop(Compiler* compiler, LLVMBuilderRef builder,
+                          const UnOp* expr, TreeMap* local_ctx,
+                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                          LLVMBasicBlockRef cont_bb) {
+  switch (expr->op) {
+    case UOK_Not: {
+      // Result is always an i1.
+      LLVMValueRef to_bool =
+          compile_to_bool(compiler, builder, expr->subexpr, local_ctx,
+                          local_allocas, break_bb, cont_bb);
+      LLVMValueRef zero = LLVMConstNull(LLVMInt1TypeInContext(compiler->ctx));
+      LLVMValueRef res =
+          LLVMBuildICmp(builder, LLVMIntEQ, to_bool, zero, "not");
+      return LLVMBuildZExt(builder, res, LLVMInt8TypeInContext(compiler->ctx),
+                           "");
+    }
+    case UOK_BitNot: {
+      LLVMValueRef val =
+          compile_expr(compiler, builder, expr->subexpr, local_ctx,
+                       local_allocas, break_bb, cont_bb);
+      LLVMValueRef ones = LLVMConstAllOnes(LLVMTypeOf(val));
+      return LLVMBuildXor(builder, val, ones, "");
+    }
+    case UOK_PreDec:
+    case UOK_PostDec:
+    case UOK_PreInc:
+    case UOK_PostInc: {
+      bool is_pre = expr->op == UOK_PreInc || expr->op == UOK_PreDec;
+      bool is_inc = expr->op == UOK_PreInc || expr->op == UOK_PostInc;
+      const Type* sub_ty = sema_get_type_of_expr_in_ctx(
+          compiler->sema, expr->subexpr, local_ctx);
+      if (is_atomic_type(compiler, sub_ty) && is_integral_type(sub_ty)) {
+        LLVMValueRef ptr =
+            compile_lvalue_ptr(compiler, builder, expr->subexpr, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+        LLVMValueRef one = LLVMConstInt(
+            get_llvm_type(compiler, sub_ty, local_ctx), 1, /*signed=*/0);
+        LLVMAtomicRMWBinOp op = LLVMAtomicRMWBinOpSub;
+        if (is_inc)
+          op = LLVMAtomicRMWBinOpAdd;
+        LLVMValueRef old =
+            LLVMBuildAtomicRMW(builder, op, ptr, one,
+                               LLVMAtomicOrderingSequentiallyConsistent,
+                               /*singleThread=*/0);
+        if (!is_pre)
+          return old;
+        return is_inc ? LLVMBuildAdd(builder, old, one, "")
+                      : LLVMBuildSub(builder, old, one, "");
+      }
+      if (is_atomic_type(compiler, sub_ty) &&
+          sema_is_floating_point_type(compiler->sema, sub_ty)) {
+        LLVMValueRef ptr =
+            compile_lvalue_ptr(compiler, builder, expr->subexpr, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+        LLVMValueRef one =
+            LLVMConstReal(get_llvm_type(compiler, sub_ty, local_ctx), 1);
+        LLVMValueRef old;
+        LLVMValueRef res = build_atomic_cmpxchg_loop(
+            compiler, builder, is_inc ? BOK_AddAssign : BOK_SubAssign, ptr,
+            one, sub_ty, sub_ty, /*common_is_unsigned=*/false, local_ctx, &old);
+        if (is_pre)
+          return res;
+        return old;
+      }
+
+      SSAVariable* var =
+          get_promoted_local(compiler, expr->subexpr, local_allocas);
+      LLVMValueRef ptr = NULL;
+      if (!var) {
+        ptr = compile_lvalue_ptr(compiler, builder, expr->subexpr, local_ctx,
+                                 local_allocas, break_bb, cont_bb);
+      }
+      const Type* type = sema_get_type_of_expr_in_ctx(compiler->sema,
+                                                      expr->subexpr, local_ctx);
+      LLVMTypeRef llvm_type = get_llvm_type(compiler, type, local_ctx);
+      LValueAccess storage;
+      const LValueAccess* access =
+          get_lvalue_access(compiler, expr->subexpr, &storage, local_ctx);
+      LLVMValueRef val = load_from_lvalue(compiler, builder, type, var, ptr,
+                                          access, local_ctx);
+
+      LLVMValueRef one;
+      if (LLVMGetTypeKind(llvm_type) == LLVMPointerTypeKind) {
+        const Type* pointee = sema_get_pointee(compiler->sema, type, local_ctx);
+        size_t pointee_size =
+            sema_eval_sizeof_type(compiler->sema, pointee, local_ctx);
+
+        LLVMTypeRef int_ty = get_llvm_ptr_as_int(compiler);
+        one = LLVMConstInt(int_ty, pointee_size,
+                           /*signed=*/0);
+        val = LLVMBuildPtrToInt(builder, val, int_ty, "");
+      } else if (is_llvm_fp_type(llvm_type)) {
+        one = LLVMConstRealOfString(llvm_type, "1");
+      } else {
+        one = LLVMConstInt(llvm_type, 1, /*signed=*/0);
+      }
+
+      LLVMValueRef postop;
+      if (is_llvm_fp_type(llvm_type)) {
+        postop = is_inc ? LLVMBuildFAdd(builder, val, one, "")
+                        : LLVMBuildFSub(builder, val, one, "");
+      } else {
+        postop = is_inc ? LLVMBuildAdd(builder, val, one, "")
+                        : LLVMBuildSub(builder, val, one, "");
+      }
+
+      if (LLVMGetTypeKind(llvm_type) == LLVMPointerTypeKind)
+        postop = LLVMBuildIntToPtr(builder, postop, llvm_type, "");
+
+      store_to_lvalue(compiler, builder, type, postop, var, ptr, access,
+                      local_ctx);
+      return is_pre ? postop : val;
+    }
+    case UOK_Negate: {
+      LLVMValueRef val =
+          compile_expr(compiler, builder, expr->subexpr, local_ctx,
+                       local_allocas, break_bb, cont_bb);
+      if (is_llvm_fp_type(LLVMTypeOf(val)))
+        return LLVMBuildFNeg(builder, val, "");
+      LLVMValueRef zero = LLVMConstNull(LLVMTypeOf(val));
+      return LLVMBuildSub(builder, zero, val, "");
+    }
+    case UOK_AddrOf:
+      return compile_lvalue_ptr(compiler, builder, expr->subexpr, local_ctx,
+                                local_allocas, break_bb, cont_bb);
+    case UOK_Deref: {
+      LLVMValueRef ptr =
+          compile_lvalue_ptr(compiler, builder, &expr->expr, local_ctx,
+                             local_allocas, break_bb, cont_bb);
+      return get_aligned_load(
+          compiler, builder,
+          sema_get_type_of_expr_in_ctx(compiler->sema, &expr->expr, local_ctx),
+          ptr, "", local_ctx);
+    }
+    default:
+      UNREACHABLE_MSG("TODO: Implement compile_unop for this op %d", expr->op);
+  }
+}
+
+// Cast `val` to `llvm_to_ty` for a conversion from the arithmetic type
+// `from_ty` to `to_ty`. For vectors, these are the element types and the cast
+// applies to each element.
+static LLVMValueRef build_arithmetic_cast(Compiler* compiler,
+                                          LLVMBuilderRef builder,
+                                          LLVMValueRef val,
+                                          const Type* from_ty,
+                                          const Type* to_ty,
+                                          LLVMTypeRef llvm_to_ty) {
+  from_ty = sema_resolve_maybe_named_type(compiler->sema, from_ty);
+  to_ty = sema_resolve_maybe_named_type(compiler->sema, to_ty);
+  if (LLVMTypeOf(val) == llvm_to_ty)
+    return val;
+
+  bool from_is_fp = is_floating_point_type(from_ty);
+  bool to_is_fp = is_floating_point_type(to_ty);
+  if (from_is_fp && to_is_fp)
+    return LLVMBuildFPCast(builder, val, llvm_to_ty, "");
+  if (to_is_fp) {
+    if (is_unsigned_integral_type(from_ty))
+      return LLVMBuildUIToFP(builder, val, llvm_to_ty, "");
+    return LLVMBuildSIToFP(builder, val, llvm_to_ty, "");
+  }
+  if (from_is_fp) {
+    if (is_unsigned_integral_type(to_ty))
+      return LLVMBuildFPToUI(builder, val, llvm_to_ty, "");
+    return LLVMBuildFPToSI(builder, val, llvm_to_ty, "");
+  }
+  return LLVMBuildIntCast2(builder, val, llvm_to_ty,
+                           !is_unsigned_integral_type(from_ty), "");
+}
+
+// Convert `val` between integral and floating types. Enums are converted like
+// their underlying integral type.
+static LLVMValueRef build_arithmetic_conversion(Compiler* compiler,
+                                                LLVMBuilderRef builder,
+                                                LLVMValueRef val,
+                                                const Type* from_ty,
+                                                const Type* to_ty,
+                                                const TreeMap* local_ctx) {
+  return build_arithmetic_cast(compiler, builder, val, from_ty, to_ty,
+                               get_llvm_type(compiler, to_ty, local_ctx));
+}
+
+LLVMValueRef compile_implicit_cast(Compiler* compiler, LLVMBuilderRef builder,
+                                   const Expr* from, const Type* to,
+                                   TreeMap* local_ctx, TreeMap* local_allocas,
+                                   LLVMBasicBlockRef break_bb,
+                                   LLVMBasicBlockRef cont_bb) {
+  to = sema_resolve_maybe_named_type(compiler->sema, to);
+  if (is_builtin_type(to, BTK_Bool)) {
+    LLVMValueRef res = compile_to_bool(compiler, builder, from, local_ctx,
+                                       local_allocas, break_bb, cont_bb);
+    return LLVMBuildZExt(builder, res, LLVMInt8TypeInContext(compiler->ctx),
+                         "");
+  }
+
+  const Type* from_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, from, local_ctx);
+
+  // A scalar is converted to the element type and then splat to each element
+  // of the vector.
+  const VectorType* to_vec =
+      sema_get_vector_type(compiler->sema, to, local_ctx);
+  if (to_vec && !sema_is_vector_type(compiler->sema, from_ty, local_ctx)) {
+    LLVMValueRef elem =
+        compile_implicit_cast(compiler, builder, from, to_vec->elem_type,
+                              local_ctx, local_allocas, break_bb, cont_bb);
+    LLVMTypeRef llvm_vec_ty = get_llvm_type(compiler, to, local_ctx);
+    LLVMValueRef poison = LLVMGetPoison(llvm_vec_ty);
+    LLVMValueRef vec = LLVMBuildInsertElement(
+        builder, poison, elem,
+        LLVMConstNull(LLVMInt32TypeInContext(compiler->ctx)), "");
+    LLVMValueRef mask = LLVMConstNull(LLVMVectorType(
+        LLVMInt32TypeInContext(compiler->ctx), LLVMGetVectorSize(llvm_vec_ty)));
+    return LLVMBuildShuffleVector(builder, vec, poison, mask, "splat");
+  }
+
+  LLVMValueRef llvm_from;
+  if (sema_is_array_type(compiler->sema, from_ty, local_ctx)) {
+    // For an array type specifically, do not use compile_expr since it will
+    // load the array into an llvm array but we want to keep it as a pointer.
+    //
+    // TODO: Maybe come up with a better way for this rather than having this
+    // one check here.
+    llvm_from = compile_lvalue_ptr(compiler, builder, from, local_ctx,
+                                   local_allocas, break_bb, cont_bb);
+  } else {
+    llvm_from = compile_expr(compiler, builder, from, local_ctx, local_allocas,
+                             break_bb, cont_bb);
+  }
+
+  if (sema_types_are_compatible(compiler->sema, from_ty, to, local_ctx))
+    return llvm_from;
+
+  LLVMTypeRef llvm_to_ty = get_llvm_type(compiler, to, local_ctx);
+  LLVMTypeRef llvm_from_ty = LLVMTypeOf(llvm_from);
+
+  // Casts between vectors reinterpret the bits. Use __builtin_convertvector
+  // for an element-wise conversion.
+  if (LLVMGetTypeKind(llvm_from_ty) == LLVMVectorTypeKind) {
+    ASSERT_MSG(sema_eval_sizeof_type(compiler->sema, from_ty, local_ctx) ==
+                   sema_eval_sizeof_type(compiler->sema, to, local_ctx),
+               "Cannot cast between vectors of different sizes at %zu:%zu",
+               source_location_line(&from->loc),
+               source_location_col(&from->loc));
+    return LLVMBuildBitCast(builder, llvm_from, llvm_to_ty, "");
+  }
+
+  const Type* from_scalar_ty =
+      sema_resolve_maybe_named_type(compiler->sema, from_ty);
+  if (is_floating_point_type(to) ||
+      (is_floating_point_type(from_scalar_ty) && is_integral_type(to)))
+    return build_arithmetic_conversion(compiler, builder, llvm_from,
+                                       from_scalar_ty, to, local_ctx);
+
+  if (LLVMGetTypeKind(llvm_from_ty) == LLVMPointerTypeKind) {
+    if (LLVMGetTypeKind(llvm_to_ty) == LLVMPointerTypeKind)
+      return llvm_from;
+
+    if (LLVMGetTypeKind(llvm_to_ty) == LLVMIntegerTypeKind) {
+      // TODO: Check the size.
+      // unsigned int_width = LLVMGetIntTypeWidth(llvm_from_ty);
+      return LLVMBuildPtrToInt(builder, llvm_from, llvm_to_ty, "");
+    }
+  }
+
+  if (LLVMGetTypeKind(llvm_from_ty) == LLVMIntegerTypeKind) {
+    if (LLVMGetTypeKind(llvm_to_ty) == LLVMIntegerTypeKind) {
+      unsigned from_size = LLVMGetIntTypeWidth(llvm_from_ty);
+      unsigned to_size = LLVMGetIntTypeWidth(llvm_to_ty);
+      if (from_size == to_size)
+        return llvm_from;
+      else if (from_size > to_size)
+        return LLVMBuildTrunc(builder, llvm_from, llvm_to_ty, "");
+      else if (is_unsigned_integral_type(from_ty))
+        return LLVMBuildZExt(builder, llvm_from, llvm_to_ty, "");
+      else
+        return LLVMBuildSExt(builder, llvm_from, llvm_to_ty, "");
+    }
+
+    if (LLVMGetTypeKind(llvm_to_ty) == LLVMPointerTypeKind) {
+      unsigned from_size = LLVMGetIntTypeWidth(llvm_from_ty);
+      assert(from_size);
+
+      unsigned ptr_size = get_llvm_ptr_size_in_bits(compiler);
+
+      assert(from_size <= ptr_size);
+
+      if (from_size < ptr_size)
+        llvm_from = LLVMBuildZExt(
+            builder, llvm_from, LLVMIntTypeInContext(compiler->ctx, ptr_size),
+            "");
+
+      return LLVMBuildIntToPtr(builder, llvm_from, llvm_to_ty, "");
+    }
+  }
+
+  // If type-name is void, then expression is evaluated for its side-effects and
+  // its returned value is discarded, same as when expression is used on its
+  // own, as an expression statement.
+  if (is_builtin_type(to, BTK_Void))
+    return compile_expr(compiler, builder, from, local_ctx, local_allocas,
+                        break_bb, cont_bb);
+
+  printf("TODO: Handle this implicit cast for expression at %s:%zu:%zu\n",
+         source_location_filename(&from->loc), source_location_line(&from->loc),
+         source_location_col(&from->loc));
+  LLVMDumpValue(llvm_from);
+  printf("\n");
+  LLVMDumpType(llvm_to_ty);
+  printf("\n");
+  printf("function:\n");
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMDumpValue(fn);
+  __builtin_trap();
+}
+
+// The stack space taken by `alloca`, counting the padding needed to align it.
+static size_t get_alloca_size(Compiler* compiler, LLVMValueRef alloca) {
+  size_t size = LLVMABISizeOfType(LLVMGetModuleDataLayout(compiler->mod),
+                                  LLVMGetAllocatedType(alloca));
+  return align_up(size, LLVMGetAlignment(alloca));
+}
+
+// This creates an alloca in this function but ensures it's always at the start
+// of the function. Having an alloca in the middle of the function can cause
+// the stack pointer to keep decrementing if it's in a loop. `llvm_type` is the
+// type allocated for `type`, which differs from get_llvm_type for arrays whose
+// size comes from their initializer.
+LLVMValueRef build_alloca_at_func_start(Compiler* compiler,
+                                        LLVMBuilderRef builder,
+                                        const char* name, const Type* type,
+                                        LLVMTypeRef llvm_type,
+                                        const TreeMap* local_ctx) {
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMBasicBlockRef current_bb = LLVMGetInsertBlock(builder);
+  LLVMBasicBlockRef entry_bb = LLVMGetEntryBasicBlock(fn);
+
+  // Place builder at the start of the entry BB. If it's empty, place the
+  // builder at the end of the bb.
+  LLVMValueRef inst = LLVMGetFirstInstruction(entry_bb);
+  if (inst)
+    LLVMPositionBuilder(builder, entry_bb, inst);
+  else
+    LLVMPositionBuilderAtEnd(builder, entry_bb);
+
+  LLVMValueRef alloca =
+      get_aligned_alloca(compiler, builder, type, llvm_type, name, local_ctx);
+
+  LLVMPositionBuilderAtEnd(builder, current_bb);
+
+  size_t size = get_alloca_size(compiler, alloca);
+  compiler->total_stack_size += size;
+  compiler->live_stack_size += size;
+  if (compiler->live_stack_size > compiler->max_stack_size)
+    compiler->max_stack_size = compiler->live_stack_size;
+
+  return alloca;
+}
+
+// The memory an aggregate passed or returned following the psABI is copied
+// through.
+static LLVMValueRef build_abi_temporary(Compiler* compiler,
+                                        LLVMBuilderRef builder,
+                                        const char* name, const Type* type,
+                                        const TreeMap* local_ctx) {
+  return build_alloca_at_func_start(compiler, builder, name, type,
+                                    get_llvm_type(compiler, type, local_ctx),
+                                    local_ctx);
+}
+
+static LLVMValueRef get_second_eightbyte(Compiler* compiler,
+                                         LLVMBuilderRef builder,
+                                         LLVMValueRef ptr) {
+  LLVMValueRef offsets[] = {
+      LLVMConstInt(LLVMInt64TypeInContext(compiler->ctx), 8, /*IsSigned=*/0)};
+  return LLVMBuildInBoundsGEP2(builder, LLVMInt8TypeInContext(compiler->ctx),
+                               ptr, offsets, 1, "");
+}
+
+// Load the eightbytes of the aggregate of `info` at `ptr` as the types it is
+// coerced to. Returns how many were loaded into `vals`.
+static unsigned load_eightbytes(Compiler* compiler, LLVMBuilderRef builder,
+                                const ABIArgInfo* info, LLVMValueRef ptr,
+                                LLVMValueRef* vals, const TreeMap* local_ctx) {
+  size_t align = sema_eval_alignof_type(compiler->sema, info->type, local_ctx);
+  vals[0] = LLVMBuildLoad2(builder, info->lo, ptr, "");
+  LLVMSetAlignment(vals[0], (unsigned)align);
+  if (!info->hi)
+    return 1;
+
+  if (align > 8)
+    align = 8;
+  vals[1] = LLVMBuildLoad2(builder, info->hi,
+                           get_second_eightbyte(compiler, builder, ptr), "");
+  LLVMSetAlignment(vals[1], (unsigned)align);
+  return 2;
+}
+
+// Store the eightbytes of an aggregate received as the types of `info` to
+// `ptr`.
+static void store_eightbytes(Compiler* compiler, LLVMBuilderRef builder,
+                             const ABIArgInfo* info, LLVMValueRef* vals,
+                             LLVMValueRef ptr, const TreeMap* local_ctx) {
+  size_t align = sema_eval_alignof_type(compiler->sema, info->type, local_ctx);
+  LLVMSetAlignment(LLVMBuildStore(builder, vals[0], ptr), (unsigned)align);
+  if (!info->hi)
+    return;
+
+  if (align > 8)
+    align = 8;
+  LLVMValueRef second = get_second_eightbyte(compiler, builder, ptr);
+  LLVMSetAlignment(LLVMBuildStore(builder, vals[1], second), (unsigned)align);
+}
+
+static void increment_profile_counter(Compiler* compiler,
+                                      LLVMBuilderRef builder, size_t idx) {
+  LLVMTypeRef i64 = LLVMInt64TypeInContext(compiler->ctx);
+  LLVMValueRef offsets[] = {LLVMConstInt(i64, idx, /*IsSigned=*/0)};
+  LLVMValueRef ptr = LLVMBuildGEP2(builder, i64, compiler->profile_counters,
+                                   offsets, 1, "");
+  LLVMValueRef count = LLVMBuildLoad2(builder, i64, ptr, "");
+  LLVMValueRef one = LLVMConstInt(i64, 1, /*IsSigned=*/0);
+  LLVMBuildStore(builder, LLVMBuildAdd(builder, count, one, ""), ptr);
+}
+
+// Emit a conditional branch. With -fprofile-generate, this counts how often
+// the branch runs and how often it goes to `then_bb`, which must already be in
+// the function but still empty. With -fprofile-use, these counts become the
+// branch weights.
+static LLVMValueRef build_profiled_cond_br(Compiler* compiler,
+                                           LLVMBuilderRef builder,
+                                           LLVMValueRef cond,
+                                           LLVMBasicBlockRef then_bb,
+                                           LLVMBasicBlockRef else_bb) {
+  size_t idx = compiler->num_profile_counters;
+  compiler->num_profile_counters += 2;
+
+  if (compiler->profile_counters) {
+    increment_profile_counter(compiler, builder, idx);
+
+    LLVMBuilderRef then_builder = LLVMCreateBuilderInContext(compiler->ctx);
+    LLVMPositionBuilderAtEnd(then_builder, then_bb);
+    increment_profile_counter(compiler, then_builder, idx + 1);
+    LLVMDisposeBuilder(then_builder);
+  }
+
+  LLVMValueRef br = LLVMBuildCondBr(builder, cond, then_bb, else_bb);
+  LLVMValueRef* storage = vector_append_storage(&compiler->profiled_branches);
+  *storage = br;
+  return br;
+}
+
+LLVMValueRef compile_conditional(Compiler* compiler, LLVMBuilderRef builder,
+                                 const Conditional* expr, TreeMap* local_ctx,
+                                 TreeMap* local_allocas,
+                                 LLVMBasicBlockRef break_bb,
+                                 LLVMBasicBlockRef cont_bb) {
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+
+  LLVMValueRef cond = compile_to_bool(compiler, builder, expr->cond, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
+
+  assert(LLVMGetTypeKind(LLVMTypeOf(cond)) == LLVMIntegerTypeKind);
+  assert(LLVMGetIntTypeWidth(LLVMTypeOf(cond)) == 1);
+
+  // Create blocks for the then and else cases. Insert the 'if' block at the
+  // end of the function.
+  LLVMBasicBlockRef ifbb = LLVMAppendBasicBlockInContext(ctx, fn, "if");
+  LLVMBasicBlockRef elsebb = LLVMCreateBasicBlockInContext(ctx, "else");
+  LLVMBasicBlockRef mergebb = LLVMCreateBasicBlockInContext(ctx, "merge");
+
+  build_profiled_cond_br(compiler, builder, cond, ifbb, elsebb);
+  ssa_seal_block(compiler->ssa, ifbb);
+  ssa_seal_block(compiler->ssa, elsebb);
+
+  // Arms of different types are converted to their common type. Only
+  // conversions to a floating type need instructions.
+  const Type* common_ty = sema_get_common_arithmetic_type_of_exprs(
+      compiler->sema, expr->true_expr, expr->false_expr, local_ctx);
+  bool convert_arms = sema_is_floating_point_type(compiler->sema, common_ty);
+
+  // Emit if BB.
+  LLVMPositionBuilderAtEnd(builder, ifbb);
+  LLVMValueRef true_expr =
+      compile_expr(compiler, builder, expr->true_expr, local_ctx, local_allocas,
+                   break_bb, cont_bb);
+  if (convert_arms) {
+    true_expr = build_arithmetic_conversion(
+        compiler, builder, true_expr,
+        sema_get_type_of_expr_in_ctx(compiler->sema, expr->true_expr,
+                                     local_ctx),
+        common_ty, local_ctx);
+  }
+  LLVMBuildBr(builder, mergebb);
+  ifbb = LLVMGetInsertBlock(builder);  // Codegen of 'if' can change the current
+                                       // block, update ifbb for the PHI.
+
+  // Emit potential else BB.
+  LLVMAppendExistingBasicBlock(fn, elsebb);
+  LLVMPositionBuilderAtEnd(builder, elsebb);
+  LLVMValueRef false_expr =
+      compile_expr(compiler, builder, expr->false_expr, local_ctx,
+                   local_allocas, break_bb, cont_bb);
+  if (convert_arms) {
+    false_expr = build_arithmetic_conversion(
+        compiler, builder, false_expr,
+        sema_get_type_of_expr_in_ctx(compiler->sema, expr->false_expr,
+                                     local_ctx),
+        common_ty, local_ctx);
+  }
+  LLVMBuildBr(builder, mergebb);
+  elsebb =
+      LLVMGetInsertBlock(builder);  // Codegen of 'else' can change the current
+                                    // block, update ifbb for the PHI.
+
+  // Emit merge BB.
+  LLVMAppendExistingBasicBlock(fn, mergebb);
+  LLVMPositionBuilderAtEnd(builder, mergebb);
+  ssa_seal_block(compiler->ssa, mergebb);
+
+  LLVMValueRef phi =
+      LLVMBuildPhi(builder, get_llvm_type(compiler, common_ty, local_ctx), "");
+  LLVMValueRef incoming_vals[] = {true_expr, false_expr};
+  LLVMBasicBlockRef incoming_blocks[] = {ifbb, elsebb};
+  LLVMAddIncoming(phi, incoming_vals, incoming_blocks, 2);
+  return phi;
+}
+
+LLVMValueRef compile_logical_binop(Compiler* compiler, LLVMBuilderRef builder,
+                                   const Expr* lhs, const Expr* rhs,
+                                   BinOpKind op, TreeMap* local_ctx,
+                                   TreeMap* local_allocas,
+                                   LLVMBasicBlockRef break_bb,
+                                   LLVMBasicBlockRef cont_bb) {
+  // Account for short-circuit evaluation.
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+
+  LLVMValueRef lhs_val = compile_to_bool(compiler, builder, lhs, local_ctx,
+                                         local_allocas, break_bb, cont_bb);
+  LLVMBasicBlockRef current_bb = LLVMGetInsertBlock(builder);
+
+  LLVMBasicBlockRef eval_rhs_bb =
+      LLVMAppendBasicBlockInContext(ctx, fn, "sc_rhs");
+  LLVMBasicBlockRef res_bb = LLVMCreateBasicBlockInContext(ctx, "sc_res");
+
+  // The profile counts how often the rhs is evaluated.
+  switch (op) {
+    case BOK_LogicalAnd:
+      // Jump to the rhs if lsh is true. Otherwise go to the result bb.
+      build_profiled_cond_br(compiler, builder, lhs_val, eval_rhs_bb, res_bb);
+      break;
+    case BOK_LogicalOr:
+      // Jump to the res BB if true. Otherwise check rhs.
+      build_profiled_cond_br(compiler, builder,
+                             LLVMBuildNot(builder, lhs_val, ""), eval_rhs_bb,
+                             res_bb);
+      break;
+    default:
+      UNREACHABLE_MSG("Unhandled local operator %d", op);
+  }
+  ssa_seal_block(compiler->ssa, eval_rhs_bb);
+
+  // BB for evaluating RHS.
+  LLVMPositionBuilderAtEnd(builder, eval_rhs_bb);
+  LLVMValueRef rhs_val = compile_to_bool(compiler, builder, rhs, local_ctx,
+                                         local_allocas, break_bb, cont_bb);
+  rhs_val = LLVMBuildZExt(builder, rhs_val,
+                          LLVMInt8TypeInContext(compiler->ctx), "");
+  LLVMBuildBr(builder, res_bb);
+  eval_rhs_bb = LLVMGetInsertBlock(builder);
+
+  // Result BB.
+  LLVMAppendExistingBasicBlock(fn, res_bb);
+  LLVMPositionBuilderAtEnd(builder, res_bb);
+  ssa_seal_block(compiler->ssa, res_bb);
+
+  LLVMValueRef phi =
+      LLVMBuildPhi(builder, LLVMInt8TypeInContext(compiler->ctx), "");
+
+  LLVMValueRef default_val =
+      LLVMConstInt(LLVMInt8TypeInContext(compiler->ctx), op == BOK_LogicalOr,
+                   /*IsSigned=*/0);
+
+  LLVMValueRef incoming_vals[] = {
+      default_val,
+      rhs_val,
+  };
+  LLVMBasicBlockRef incoming_blocks[] = {current_bb, eval_rhs_bb};
+  LLVMAddIncoming(phi, incoming_vals, incoming_blocks, 2);
+
+  return phi;
+}
+
+static LLVMAtomicRMWBinOp get_atomic_rmw_op(AtomicOp op) {
+  switch (op) {
+    case AO_Add:
+      return LLVMAtomicRMWBinOpAdd;
+    case AO_Sub:
+      return LLVMAtomicRMWBinOpSub;
+    case AO_And:
+      return LLVMAtomicRMWBinOpAnd;
+    case AO_Or:
+      return LLVMAtomicRMWBinOpOr;
+    case AO_Xor:
+      return LLVMAtomicRMWBinOpXor;
+    case AO_Nand:
+      return LLVMAtomicRMWBinOpNand;
+  }
+}
+
+// atomicrmw returns the old value. Recompute the new value from it.
+static LLVMValueRef build_atomic_rmw_result(LLVMBuilderRef builder,
+                                            LLVMAtomicRMWBinOp op,
+                                            LLVMValueRef old,
+                                            LLVMValueRef val) {
+  switch (op) {
+    case LLVMAtomicRMWBinOpAdd:
+      return LLVMBuildAdd(builder, old, val, "");
+    case LLVMAtomicRMWBinOpSub:
+      return LLVMBuildSub(builder, old, val, "");
+    case LLVMAtomicRMWBinOpAnd:
+      return LLVMBuildAnd(builder, old, val, "");
+    case LLVMAtomicRMWBinOpOr:
+      return LLVMBuildOr(builder, old, val, "");
+    case LLVMAtomicRMWBinOpXor:
+      return LLVMBuildXor(builder, old, val, "");
+    case LLVMAtomicRMWBinOpNand:
+      return LLVMBuildNot(builder, LLVMBuildAnd(builder, old, val, ""), "");
+    default:
+      UNREACHABLE_MSG("Unhandled atomicrmw op %d", op);
+  }
+}
+
+// LLVMAtomicRMWBinOp values are all non-negative.
+static const int kNoAtomicRMWBinOp = -1;
+
+static int get_atomic_assign_op(BinOpKind op) {
+  switch (op) {
+    case BOK_AddAssign:
+      return LLVMAtomicRMWBinOpAdd;
+    case BOK_SubAssign:
+      return LLVMAtomicRMWBinOpSub;
+    case BOK_AndAssign:
+      return LLVMAtomicRMWBinOpAnd;
+    case BOK_OrAssign:
+      return LLVMAtomicRMWBinOpOr;
+    case BOK_XorAssign:
+      return LLVMAtomicRMWBinOpXor;
+    default:
+      return kNoAtomicRMWBinOp;
+  }
+}
+
+static LLVMValueRef build_intrinsic_call(Compiler* compiler,
+                                         LLVMBuilderRef builder,
+                                         const char* name,
+                                         LLVMTypeRef* param_types,
+                                         size_t num_param_types,
+                                         LLVMValueRef* args, size_t num_args);
+
+// The operator applied by a compound assignment, or BOK_Assign if `op` is not
+// an arithmetic compound assignment.
+static BinOpKind get_compound_assign_op(BinOpKind op) {
+  switch (op) {
+    case BOK_MulAssign:
+      return BOK_Mul;
+    case BOK_DivAssign:
+      return BOK_Div;
+    case BOK_ModAssign:
+      return BOK_Mod;
+    case BOK_AddAssign:
+      return BOK_Add;
+    case BOK_SubAssign:
+      return BOK_Sub;
+    case BOK_AndAssign:
+      return BOK_BitwiseAnd;
+    case BOK_OrAssign:
+      return BOK_BitwiseOr;
+    case BOK_XorAssign:
+      return BOK_Xor;
+    default:
+      return BOK_Assign;
+  }
+}
+
+static LLVMValueRef build_arithmetic_binop(LLVMBuilderRef builder,
+                                           BinOpKind op, LLVMValueRef lhs,
+                                           LLVMValueRef rhs, bool is_unsigned) {
+  bool is_fp = is_llvm_fp_type(LLVMTypeOf(lhs));
+  switch (op) {
+    case BOK_Add:
+      if (is_fp)
+        return LLVMBuildFAdd(builder, lhs, rhs, "");
+      return LLVMBuildAdd(builder, lhs, rhs, "");
+    case BOK_Sub:
+      if (is_fp)
+        return LLVMBuildFSub(builder, lhs, rhs, "");
+      return LLVMBuildSub(builder, lhs, rhs, "");
+    case BOK_Mul:
+      if (is_fp)
+        return LLVMBuildFMul(builder, lhs, rhs, "");
+      return LLVMBuildMul(builder, lhs, rhs, "");
+    case BOK_Div:
+      if (is_fp)
+        return LLVMBuildFDiv(builder, lhs, rhs, "");
+      if (is_unsigned)
+        return LLVMBuildUDiv(builder, lhs, rhs, "");
+      return LLVMBuildSDiv(builder, lhs, rhs, "");
+    case BOK_Mod:
+      if (is_unsigned)
+        return LLVMBuildURem(builder, lhs, rhs, "");
+      return LLVMBuildSRem(builder, lhs, rhs, "");
+    case BOK_BitwiseAnd:
+      return LLVMBuildAnd(builder, lhs, rhs, "");
+    case BOK_BitwiseOr:
+      return LLVMBuildOr(builder, lhs, rhs, "");
+    case BOK_Xor:
+      return LLVMBuildXor(builder, lhs, rhs, "");
+    default:
+      UNREACHABLE_MSG("Unhandled arithmetic binop %d", op);
+  }
+}
+
+// Apply the compound assignment `op` to `lhs_val`, the current value of the lhs
+// of type `lhs_ty`, and `rhs`, which is already converted to `common_ty`. The
+// operation is done in `common_ty` and the result converted back to `lhs_ty`.
+static LLVMValueRef build_compound_assign_result(
+    Compiler* compiler, LLVMBuilderRef builder, BinOpKind op,
+    LLVMValueRef lhs_val, LLVMValueRef rhs, const Type* lhs_ty,
+    const Type* common_ty, bool common_is_unsigned, const TreeMap* local_ctx) {
+  if (op == BOK_LShiftAssign)
+    return LLVMBuildShl(builder, lhs_val, rhs, "");
+  if (op == BOK_RShiftAssign)
+    return LLVMBuildAShr(builder, lhs_val, rhs, "");
+
+  lhs_val = build_arithmetic_conversion(compiler, builder, lhs_val, lhs_ty,
+                                        common_ty, local_ctx);
+  LLVMValueRef res = build_arithmetic_binop(
+      builder, get_compound_assign_op(op), lhs_val, rhs, common_is_unsigned);
+  return build_arithmetic_conversion(compiler, builder, res, common_ty, lhs_ty,
+                                     local_ctx);
+}
+
+// Atomically apply the compound assignment `op` to the object at `ptr` with a
+// compare-exchange loop, for the operations atomicrmw has no instruction for.
+// Floating point values are exchanged as integers of the same size since
+// cmpxchg only takes integers and pointers. Returns the new value. If `old_out`
+// is given, it's set to the value that was replaced.
+static LLVMValueRef build_atomic_cmpxchg_loop(
+    Compiler* compiler, LLVMBuilderRef builder, BinOpKind op, LLVMValueRef ptr,
+    LLVMValueRef rhs, const Type* lhs_ty, const Type* common_ty,
+    bool common_is_unsigned, const TreeMap* local_ctx,
+    LLVMValueRef* old_out) {
+  LLVMTypeRef llvm_ty = get_llvm_type(compiler, lhs_ty, local_ctx);
+  LLVMTypeRef bits_ty = llvm_ty;
+  if (is_llvm_fp_type(llvm_ty)) {
+    bits_ty = LLVMIntTypeInContext(
+        compiler->ctx,
+        (unsigned)LLVMSizeOfTypeInBits(LLVMGetModuleDataLayout(compiler->mod),
+                                       llvm_ty));
+  }
+
+  LLVMValueRef init = get_aligned_load(compiler, builder, lhs_ty, ptr, "",
+                                       local_ctx);
+  if (bits_ty != llvm_ty)
+    init = LLVMBuildBitCast(builder, init, bits_ty, "");
+  LLVMBasicBlockRef entry_bb = LLVMGetInsertBlock(builder);
+  LLVMValueRef fn = LLVMGetBasicBlockParent(entry_bb);
+  LLVMBasicBlockRef loop_bb =
+      LLVMAppendBasicBlockInContext(compiler->ctx, fn, "atomic_op");
+  LLVMBasicBlockRef done_bb =
+      LLVMAppendBasicBlockInContext(compiler->ctx, fn, "atomic_op_done");
+  LLVMBuildBr(builder, loop_bb);
+
+  LLVMPositionBuilderAtEnd(builder, loop_bb);
+  LLVMValueRef old_bits = LLVMBuildPhi(builder, bits_ty, "");
+  LLVMValueRef old = old_bits;
+  if (bits_ty != llvm_ty)
+    old = LLVMBuildBitCast(builder, old_bits, llvm_ty, "");
+  LLVMValueRef res =
+      build_compound_assign_result(compiler, builder, op, old, rhs, lhs_ty,
+                                   common_ty, common_is_unsigned, local_ctx);
+  LLVMValueRef res_bits = res;
+  if (bits_ty != llvm_ty)
+    res_bits = LLVMBuildBitCast(builder, res, bits_ty, "");
+  LLVMValueRef cmpxchg =
+      LLVMBuildAtomicCmpXchg(builder, ptr, old_bits, res_bits,
+                             LLVMAtomicOrderingSequentiallyConsistent,
+                             LLVMAtomicOrderingSequentiallyConsistent,
+                             /*singleThread=*/0);
+  LLVMValueRef found = LLVMBuildExtractValue(builder, cmpxchg, 0, "");
+  LLVMValueRef success = LLVMBuildExtractValue(builder, cmpxchg, 1, "");
+  LLVMBuildCondBr(builder, success, done_bb, loop_bb);
+
+  LLVMValueRef incoming_vals[] = {init, found};
+  LLVMBasicBlockRef incoming_blocks[] = {entry_bb, loop_bb};
+  LLVMAddIncoming(old_bits, incoming_vals, incoming_blocks, 2);
+  ssa_seal_block(compiler->ssa, loop_bb);
+
+  LLVMPositionBuilderAtEnd(builder, done_bb);
+  ssa_seal_block(compiler->ssa, done_bb);
+  if (old_out)
+    *old_out = old;
+  return res;
+}
+
+// Compound assignment to an `_Atomic` object is a single sequentially
+// consistent read-modify-write which evaluates to the new value. Integer
+// operations atomicrmw supports map to it directly, and everything else,
+// including floating point operations, goes through a compare-exchange loop.
+static LLVMValueRef compile_atomic_compound_assign(
+    Compiler* compiler, LLVMBuilderRef builder, const BinOp* expr,
+    const Type* lhs_ty, const Type* rhs_ty, TreeMap* local_ctx,
+    TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+    LLVMBasicBlockRef cont_bb) {
+  const Type* common_ty = lhs_ty;
+  if (get_compound_assign_op(expr->op) != BOK_Assign &&
+      (sema_is_floating_point_type(compiler->sema, lhs_ty) ||
+       sema_is_floating_point_type(compiler->sema, rhs_ty))) {
+    common_ty = sema_get_common_arithmetic_type(compiler->sema, lhs_ty, rhs_ty,
+                                                local_ctx);
+  }
+  LLVMValueRef rhs =
+      compile_implicit_cast(compiler, builder, expr->rhs, common_ty, local_ctx,
+                            local_allocas, break_bb, cont_bb);
+  LLVMValueRef ptr = compile_lvalue_ptr(compiler, builder, expr->lhs, local_ctx,
+                                        local_allocas, break_bb, cont_bb);
+
+  int rmw_op = kNoAtomicRMWBinOp;
+  if (is_integral_type(sema_resolve_maybe_named_type(compiler->sema, lhs_ty)))
+    rmw_op = get_atomic_assign_op(expr->op);
+  if (rmw_op != kNoAtomicRMWBinOp) {
+    LLVMAtomicRMWBinOp op = (LLVMAtomicRMWBinOp)rmw_op;
+    LLVMValueRef old =
+        LLVMBuildAtomicRMW(builder, op, ptr, rhs,
+                           LLVMAtomicOrderingSequentiallyConsistent,
+                           /*singleThread=*/0);
+    return build_atomic_rmw_result(builder, op, old, rhs);
+  }
+
+  return build_atomic_cmpxchg_loop(
+      compiler, builder, expr->op, ptr, rhs, lhs_ty, common_ty,
+      sema_is_unsigned_integral_type(compiler->sema, common_ty), local_ctx,
+      /*old_out=*/NULL);
+}
+
+// Floating point comparisons are ordered, so they are false if either operand
+// is a NaN, except for `!=` which is true.
+static LLVMValueRef build_comparison(LLVMBuilderRef builder, BinOpKind op,
+                                     LLVMValueRef lhs, LLVMValueRef rhs,
+                                     bool is_unsigned) {
+  if (is_llvm_fp_type(LLVMTypeOf(lhs))) {
+    LLVMRealPredicate pred;
+    switch (op) {
+      case BOK_Eq:
+        pred = LLVMRealOEQ;
+        break;
+      case BOK_Ne:
+        pred = LLVMRealUNE;
+        break;
+      case BOK_Lt:
+        pred = LLVMRealOLT;
+        break;
+      case BOK_Gt:
+        pred = LLVMRealOGT;
+        break;
+      case BOK_Le:
+        pred = LLVMRealOLE;
+        break;
+      case BOK_Ge:
+        pred = LLVMRealOGE;
+        break;
+      default:
+        UNREACHABLE_MSG("Unhandled comparison %d", op);
+    }
+    return LLVMBuildFCmp(builder, pred, lhs, rhs, "");
+  }
+
+  LLVMIntPredicate pred;
+  switch (op) {
+    case BOK_Eq:
+      pred = LLVMIntEQ;
+      break;
+    case BOK_Ne:
+      pred = LLVMIntNE;
+      break;
+    case BOK_Lt:
+      pred = is_unsigned ? LLVMIntULT : LLVMIntSLT;
+      break;
+    case BOK_Gt:
+      pred = is_unsigned ? LLVMIntUGT : LLVMIntSGT;
+      break;
+    case BOK_Le:
+      pred = is_unsigned ? LLVMIntULE : LLVMIntSLE;
+      break;
+    case BOK_Ge:
+      pred = is_unsigned ? LLVMIntUGE : LLVMIntSGE;
+      break;
+    default:
+      UNREACHABLE_MSG("Unhandled comparison %d", op);
+  }
+  return LLVMBuildICmp(builder, pred, lhs, rhs, "");
+}
+
+// Returns `expr` if it is a floating point multiply whose result has type `ty`.
+static const BinOp* get_fp_multiply(Compiler* compiler, const Expr* expr,
+                                    const Type* ty, const TreeMap* local_ctx) {
+  if (expr->vtable->kind != EK_BinOp || ((const BinOp*)expr)->op != BOK_Mul)
+    return NULL;
+
+  const Type* mul_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+  if (!sema_types_are_compatible_ignore_quals(compiler->sema, mul_ty, ty,
+                                              local_ctx))
+    return NULL;
+  return (const BinOp*)expr;
+}
+
+// With FP contraction, `a * b + c` and `a * b - c` in a single expression are
+// lowered to llvm.fmuladd, which becomes a fused multiply-add if the target has
+// one. The multiply is not rounded separately then. This includes compound
+// assignments like `sum += a * b`. Returns NULL if `expr` is not of this form.
+static LLVMValueRef maybe_compile_fmuladd(Compiler* compiler,
+                                          LLVMBuilderRef builder,
+                                          const BinOp* expr,
+                                          TreeMap* local_ctx,
+                                          TreeMap* local_allocas,
+                                          LLVMBasicBlockRef break_bb,
+                                          LLVMBasicBlockRef cont_bb) {
+  bool is_assign = expr->op == BOK_AddAssign || expr->op == BOK_SubAssign;
+  bool is_sub = expr->op == BOK_Sub || expr->op == BOK_SubAssign;
+  if (!is_assign && !is_sub && expr->op != BOK_Add)
+    return NULL;
+
+  const Type* ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, &expr->expr, local_ctx);
+  const VectorType* vec_ty =
+      sema_get_vector_type(compiler->sema, ty, local_ctx);
+  if (!sema_is_floating_point_type(compiler->sema,
+                                   vec_ty ? vec_ty->elem_type : ty) ||
+      is_atomic_type(compiler, ty))
+    return NULL;
+
+  // The multiply is the rhs of a compound assignment, and either operand
+  // otherwise.
+  const Expr* addend = expr->lhs;
+  const BinOp* mul = get_fp_multiply(compiler, expr->rhs, ty, local_ctx);
+  bool mul_is_lhs = false;
+  if (!mul && !is_assign) {
+    addend = expr->rhs;
+    mul = get_fp_multiply(compiler, expr->lhs, ty, local_ctx);
+    mul_is_lhs = true;
+  }
+  if (!mul)
+    return NULL;
+
+  LLVMValueRef a =
+      compile_implicit_cast(compiler, builder, mul->lhs, ty, local_ctx,
+                            local_allocas, break_bb, cont_bb);
+  LLVMValueRef b =
+      compile_implicit_cast(compiler, builder, mul->rhs, ty, local_ctx,
+                            local_allocas, break_bb, cont_bb);
+
+  SSAVariable* var = NULL;
+  LLVMValueRef ptr = NULL;
+  LValueAccess storage;
+  const LValueAccess* access = NULL;
+  LLVMValueRef c;
+  if (is_assign) {
+    var = get_promoted_local(compiler, expr->lhs, local_allocas);
+    if (!var) {
+      ptr = compile_lvalue_ptr(compiler, builder, expr->lhs, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+    }
+    access = get_lvalue_access(compiler, expr->lhs, &storage, local_ctx);
+    c = load_from_lvalue(compiler, builder, ty, var, ptr, access, local_ctx);
+  } else {
+    c = compile_implicit_cast(compiler, builder, addend, ty, local_ctx,
+                              local_allocas, break_bb, cont_bb);
+  }
+
+  // `a * b - c` is `a * b + -c` and `c - a * b` is `-a * b + c`.
+  if (is_sub && mul_is_lhs)
+    c = LLVMBuildFNeg(builder, c, "");
+  else if (is_sub)
+    a = LLVMBuildFNeg(builder, a, "");
+
+  LLVMTypeRef types[] = {LLVMTypeOf(a)};
+  LLVMValueRef args[] = {a, b, c};
+  LLVMValueRef res = build_intrinsic_call(compiler, builder, "llvm.fmuladd",
+                                          types, 1, args, 3);
+  if (is_assign)
+    store_to_lvalue(compiler, builder, ty, res, var, ptr, access, local_ctx);
+  return res;
+}
+
+LLVMValueRef compile_binop(Compiler* compiler, LLVMBuilderRef builder,
+                           const BinOp* expr, TreeMap* local_ctx,
+                           TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                           LLVMBasicBlockRef cont_bb) {
+  const Type* lhs_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr->lhs, local_ctx);
+  const Type* rhs_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr->rhs, local_ctx);
+  const Expr* maybe_ptr = NULL;
+  const Expr* offset;
+  const Type* maybe_ptr_ty;
+  if (sema_is_pointer_type(compiler->sema, lhs_ty, local_ctx)) {
+    maybe_ptr = expr->lhs;
+    maybe_ptr_ty = lhs_ty;
+    offset = expr->rhs;
+  } else if (sema_is_pointer_type(compiler->sema, rhs_ty, local_ctx)) {
+    maybe_ptr = expr->rhs;
+    maybe_ptr_ty = rhs_ty;
+    offset = expr->lhs;
+  }
+
+  if (is_atomic_type(compiler, lhs_ty) && is_assign_binop(expr->op) &&
+      expr->op != BOK_Assign) {
+    return compile_atomic_compound_assign(compiler, builder, expr, lhs_ty,
+                                          rhs_ty, local_ctx, local_allocas,
+                                          break_bb, cont_bb);
+  }
+
+  if (compiler->target->fp_contract != FPC_Off) {
+    LLVMValueRef fused =
+        maybe_compile_fmuladd(compiler, builder, expr, local_ctx,
+                              local_allocas, break_bb, cont_bb);
+    if (fused)
+      return fused;
+  }
+
+  bool can_be_used_for_ptr_arithmetic =
+      expr->op == BOK_Add || expr->op == BOK_Sub || expr->op == BOK_AddAssign ||
+      expr->op == BOK_SubAssign;
+
+  if (maybe_ptr && can_be_used_for_ptr_arithmetic) {
+    const Type* pointee_ty =
+        sema_get_pointee(compiler->sema, maybe_ptr_ty, local_ctx);
+    LLVMTypeRef llvm_base_ty = get_llvm_type(compiler, pointee_ty, local_ctx);
+
+    LLVMValueRef llvm_offset = compile_expr(
+        compiler, builder, offset, local_ctx, local_allocas, break_bb, cont_bb);
+
+    LLVMValueRef llvm_base;
+    LLVMValueRef ptr = NULL;
+    SSAVariable* var = NULL;
+    bool assign_op = expr->op == BOK_AddAssign || expr->op == BOK_SubAssign;
+    if (!assign_op) {
+      llvm_base = compile_expr(compiler, builder, maybe_ptr, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+    } else {
+      assert(maybe_ptr == expr->lhs);
+      assert(offset == expr->rhs);
+      var = get_promoted_local(compiler, maybe_ptr, local_allocas);
+      if (var) {
+        llvm_base = ssa_read_variable(compiler->ssa, var,
+                                      LLVMGetInsertBlock(builder));
+      } else {
+        ptr = compile_lvalue_ptr(compiler, builder, maybe_ptr, local_ctx,
+                                 local_allocas, break_bb, cont_bb);
+        llvm_base =
+            LLVMBuildLoad2(builder, get_opaque_ptr(compiler), ptr, "");
+      }
+    }
+
+    LLVMValueRef offsets[] = {llvm_offset};
+    LLVMValueRef gep =
+        LLVMBuildGEP2(builder, llvm_base_ty, llvm_base, offsets, 1, "");
+
+    if (assign_op) {
+      if (var)
+        ssa_write_variable(var, LLVMGetInsertBlock(builder), gep);
+      else
+        LLVMBuildStore(builder, gep, ptr);
+    }
+
+    return gep;
+  }
+
+  // FIXME: This currently evaluates all operands before doing the actual binop.
+  // This breaks the rules for short-circuit evaluation. For example, this will
+  // not be evaluated correctly:
+  //
+  //   bool b = ptr && *ptr;
+  //
+  // Even if `ptr` is NULL, the dereference will still occur. We need to keep
+  // track of sequence points.
+  //
+  LLVMValueRef lhs;
+  LLVMValueRef rhs;
+  SSAVariable* lhs_var = NULL;
+  LValueAccess lhs_storage;
+  const LValueAccess* lhs_access = NULL;
+  const Type* common_ty;
+  if (is_logical_binop(expr->op)) {
+    return compile_logical_binop(compiler, builder, expr->lhs, expr->rhs,
+                                 expr->op, local_ctx, local_allocas, break_bb,
+                                 cont_bb);
+  } else if (is_aggregate_assign(compiler, &expr->expr, local_ctx,
+                                 local_allocas)) {
+    LLVMValueRef dst =
+        compile_aggregate_assign(compiler, builder, expr, local_ctx,
+                                 local_allocas, break_bb, cont_bb);
+    return get_aligned_load(compiler, builder, lhs_ty, dst, "", local_ctx);
+  } else if (is_assign_binop(expr->op)) {
+    // Compound assignments involving a floating type are done in the common
+    // type, so `i *= 0.5` does not truncate the 0.5.
+    common_ty = lhs_ty;
+    if (get_compound_assign_op(expr->op) != BOK_Assign &&
+        (sema_is_floating_point_type(compiler->sema, lhs_ty) ||
+         sema_is_floating_point_type(compiler->sema, rhs_ty))) {
+      common_ty = sema_get_common_arithmetic_type(compiler->sema, lhs_ty,
+                                                  rhs_ty, local_ctx);
+    }
+    rhs = compile_implicit_cast(compiler, builder, expr->rhs, common_ty,
+                                local_ctx, local_allocas, break_bb, cont_bb);
+    lhs_var = get_promoted_local(compiler, expr->lhs, local_allocas);
+    if (lhs_var) {
+      lhs = NULL;
+    } else {
+      lhs = compile_lvalue_ptr(compiler, builder, expr->lhs, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+      lhs_access =
+          get_lvalue_access(compiler, expr->lhs, &lhs_storage, local_ctx);
+    }
+  } else if (expr->op == BOK_Eq || expr->op == BOK_Ne) {
+    if (sema_is_pointer_type(compiler->sema, lhs_ty, local_ctx) &&
+        sema_is_pointer_type(compiler->sema, rhs_ty, local_ctx)) {
+      // TODO: When comparing pointers, only pointers of to the same type can be
+      // compared. The only exception to this is void pointers. We should check
+      // that both operands are the same first before comparing. Here we just
+      // assume they are the same.
+      common_ty = lhs_ty;
+    } else {
+      common_ty = sema_get_common_arithmetic_type(compiler->sema, lhs_ty,
+                                                  rhs_ty, local_ctx);
+    }
+    lhs = compile_implicit_cast(compiler, builder, expr->lhs, common_ty,
+                                local_ctx, local_allocas, break_bb, cont_bb);
+    rhs = compile_implicit_cast(compiler, builder, expr->rhs, common_ty,
+                                local_ctx, local_allocas, break_bb, cont_bb);
+  } else {
+    common_ty = sema_get_common_arithmetic_type(compiler->sema, lhs_ty, rhs_ty,
+                                                local_ctx);
+    lhs = compile_implicit_cast(compiler, builder, expr->lhs, common_ty,
+                                local_ctx, local_allocas, break_bb, cont_bb);
+    rhs = compile_implicit_cast(compiler, builder, expr->rhs, common_ty,
+                                local_ctx, local_allocas, break_bb, cont_bb);
+  }
+
+  LLVMValueRef res;
+
+  // Operations on vectors are done on each element, so the signedness comes
+  // from the element type.
+  const VectorType* common_vec =
+      sema_get_vector_type(compiler->sema, common_ty, local_ctx);
+  bool common_is_unsigned = sema_is_unsigned_integral_type(
+      compiler->sema, common_vec ? common_vec->elem_type : common_ty);
+
+  switch (expr->op) {
+    case BOK_Comma:
+      res = rhs;
+      break;
+    case BOK_Eq:
+    case BOK_Ne:
+    case BOK_Lt:
+    case BOK_Gt:
+    case BOK_Le:
+    case BOK_Ge:
+      res = build_comparison(builder, expr->op, lhs, rhs, common_is_unsigned);
+      break;
+    case BOK_Add:
+    case BOK_Sub:
+    case BOK_Mul:
+    case BOK_Div:
+    case BOK_Mod:
+    case BOK_BitwiseAnd:
+    case BOK_BitwiseOr:
+    case BOK_Xor:
+      res = build_arithmetic_binop(builder, expr->op, lhs, rhs,
+                                   common_is_unsigned);
+      break;
+    case BOK_LogicalAnd:
+      res = LLVMBuildAnd(builder, lhs, rhs, "");
+      break;
+    case BOK_LogicalOr:
+      res = LLVMBuildOr(builder, lhs, rhs, "");
+      break;
+    case BOK_Assign:
+      store_to_lvalue(compiler, builder, common_ty, rhs, lhs_var, lhs,
+                      lhs_access, local_ctx);
+      res = rhs;
+      break;
+    case BOK_MulAssign:
+    case BOK_DivAssign:
+    case BOK_ModAssign:
+    case BOK_AddAssign:
+    case BOK_SubAssign:
+    case BOK_AndAssign:
+    case BOK_OrAssign:
+    case BOK_XorAssign: {
+      LLVMValueRef lhs_val = load_from_lvalue(
+          compiler, builder, lhs_ty, lhs_var, lhs, lhs_access, local_ctx);
+      res = build_compound_assign_result(compiler, builder, expr->op, lhs_val,
+                                         rhs, lhs_ty, common_ty,
+                                         common_is_unsigned, local_ctx);
+      store_to_lvalue(compiler, builder, lhs_ty, res, lhs_var, lhs,
+                      lhs_access, local_ctx);
+      break;
+    }
+    case BOK_LShift:
+    case BOK_RShift:
+    case BOK_LShiftAssign:
+    case BOK_RShiftAssign: {
+      bool is_assign =
+          expr->op == BOK_LShiftAssign || expr->op == BOK_RShiftAssign;
+      bool is_shl = expr->op == BOK_LShiftAssign || expr->op == BOK_LShift;
+      LLVMValueRef lhs_val = is_assign
+                                 ? load_from_lvalue(compiler, builder, lhs_ty,
+                                                    lhs_var, lhs, lhs_access,
+                                                    local_ctx)
+                                 : lhs;
+      if (is_shl) {
+        res = LLVMBuildShl(builder, lhs_val, rhs, "");
+      } else {
+        res = LLVMBuildAShr(builder, lhs_val, rhs, "");
+      }
+      if (is_assign) {
+        store_to_lvalue(compiler, builder, lhs_ty, res, lhs_var, lhs,
+                        lhs_access, local_ctx);
+      }
+      break;
+    }
+    default:
+      UNREACHABLE_MSG("TODO: Implement compile_binop for this op %d", expr->op);
+  }
+
+  const Type* res_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, &expr->expr, local_ctx);
+  if (is_bool_type(res_ty)) {
+    // Cast up any i1s to i8s since bools are always kCharBits.
+    res = LLVMBuildZExt(builder, res,
+                        LLVMIntTypeInContext(compiler->ctx, kCharBit), "");
+  } else if (is_comparison_binop(expr->op) &&
+             sema_is_vector_type(compiler->sema, res_ty, local_ctx)) {
+    // Each element of a vector comparison is either 0 or -1.
+    res = LLVMBuildSExt(builder, res,
+                        get_llvm_type(compiler, res_ty, local_ctx), "");
+  }
+
+  return res;
+}
+
+LLVMTypeRef get_llvm_type_of_expr(Compiler* compiler, const Expr* expr,
+                                  const TreeMap* local_ctx) {
+  const Type* ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+  return get_llvm_type(compiler, ty, local_ctx);
+}
+
+LLVMTypeRef get_llvm_type_of_expr_global_ctx(Compiler* compiler,
+                                             const Expr* expr) {
+  TreeMap local_ctx;
+  string_tree_map_construct(&local_ctx);
+  const Type* type =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr, &local_ctx);
+  LLVMTypeRef llvm_type = get_llvm_type(compiler, type, &local_ctx);
+  tree_map_destroy(&local_ctx);
+  return llvm_type;
+}
+
+// The type an argument passed through the `...` of a varargs function is
+// passed as. Variadic float arguments are promoted to double and integers
+// narrower than int are promoted to int.
+static const Type* get_variadic_arg_type(Compiler* compiler, const Expr* arg,
+                                         const TreeMap* local_ctx) {
+  const Type* arg_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, arg, local_ctx);
+  const Type* resolved_ty =
+      sema_resolve_maybe_named_type(compiler->sema, arg_ty);
+  if (is_builtin_type(resolved_ty, BTK_Float))
+    return &compiler->sema->bt_Double.type;
+  if (is_integral_type(resolved_ty) &&
+      sema_eval_sizeof_type(compiler->sema, resolved_ty, local_ctx) <
+          sema_eval_sizeof_type(compiler->sema, &compiler->sema->bt_Int.type,
+                                local_ctx))
+    return &compiler->sema->bt_Int.type;
+  return arg_ty;
+}
+
+// Returns a vector of LLVMValueRefs.
+// `args` is a vector of Expr* (the same as `Call::args`).
+// `func_args` is a vector of FunctionArg (same as `FunctionType::pos_args`).
+vector compile_call_args(Compiler* compiler, LLVMBuilderRef builder,
+                         const vector* args, const vector* func_args,
+                         TreeMap* local_ctx, TreeMap* local_allocas,
+                         LLVMBasicBlockRef break_bb,
+                         LLVMBasicBlockRef cont_bb) {
+  vector llvm_args;
+  vector_construct(&llvm_args, sizeof(LLVMValueRef), alignof(LLVMValueRef));
+  for (size_t i = 0; i < args->size; ++i) {
+    LLVMValueRef* storage = vector_append_storage(&llvm_args);
+    const Expr* arg = *(const Expr**)vector_at(args, i);
+
+    const Type* arg_ty;
+    if (i < func_args->size)
+      arg_ty = ((const FunctionArg*)vector_at(func_args, i))->type;
+    else
+      arg_ty = get_variadic_arg_type(compiler, arg, local_ctx);
+    *storage = compile_implicit_cast(compiler, builder, arg, arg_ty, local_ctx,
+                                     local_allocas, break_bb, cont_bb);
+  }
+  return llvm_args;
+}
+
+// Call the intrinsic `name`. Overloaded intrinsics are overloaded on
+// `param_types`.
+static LLVMValueRef build_intrinsic_call(Compiler* compiler,
+                                         LLVMBuilderRef builder,
+                                         const char* name,
+                                         LLVMTypeRef* param_types,
+                                         size_t num_param_types,
+                                         LLVMValueRef* args, size_t num_args) {
+  unsigned intrinsic_id = LLVMLookupIntrinsicID(name, strlen(name));
+  assert(intrinsic_id);
+  LLVMValueRef intrinsic = LLVMGetIntrinsicDeclaration(
+      compiler->mod, intrinsic_id, param_types, num_param_types);
+  LLVMTypeRef intrinsic_ty = LLVMIntrinsicGetType(
+      compiler->ctx, intrinsic_id, param_types, num_param_types);
+  return LLVMBuildCall2(builder, intrinsic_ty, intrinsic, args,
+                        (unsigned)num_args, "");
+}
+
+LLVMValueRef call_llvm_debugtrap(Compiler* compiler, LLVMBuilderRef builder) {
+  return build_intrinsic_call(compiler, builder, "llvm.debugtrap",
+                              /*param_types=*/NULL, 0, /*args=*/NULL, 0);
+}
+
+static unsigned long long get_builtin_constant_arg(LLVMValueRef arg,
+                                                   const char* builtin) {
+  ASSERT_MSG(LLVMIsAConstantInt(arg),
+             "Argument to '%s' must be an integer constant", builtin);
+  return LLVMConstIntGetZExtValue(arg);
+}
+
+// The indices of `__builtin_shufflevector` select elements from the
+// concatenation of both vectors. An index of -1 leaves the element undefined.
+static LLVMValueRef compile_shufflevector(Compiler* compiler,
+                                          LLVMBuilderRef builder,
+                                          const Call* call, TreeMap* local_ctx,
+                                          TreeMap* local_allocas,
+                                          LLVMBasicBlockRef break_bb,
+                                          LLVMBasicBlockRef cont_bb) {
+  const Expr* lhs = *(const Expr**)vector_at(&call->args, 0);
+  const Expr* rhs = *(const Expr**)vector_at(&call->args, 1);
+  ASSERT_MSG(
+      sema_types_are_compatible_ignore_quals(
+          compiler->sema,
+          sema_get_type_of_expr_in_ctx(compiler->sema, lhs, local_ctx),
+          sema_get_type_of_expr_in_ctx(compiler->sema, rhs, local_ctx),
+          local_ctx),
+      "__builtin_shufflevector expects vectors of the same type");
+
+  LLVMValueRef lhs_val = compile_expr(compiler, builder, lhs, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
+  LLVMValueRef rhs_val = compile_expr(compiler, builder, rhs, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
+
+  LLVMTypeRef i32 = LLVMInt32TypeInContext(compiler->ctx);
+  size_t len = call->args.size - 2;
+  size_t max_idx = 2 * (size_t)LLVMGetVectorSize(LLVMTypeOf(lhs_val));
+  LLVMValueRef* mask = malloc(sizeof(LLVMValueRef) * len);
+  for (size_t i = 0; i < len; ++i) {
+    const Expr* idx = *(const Expr**)vector_at(&call->args, i + 2);
+    ConstExprResult res = sema_eval_expr_in_ctx(compiler->sema, idx, local_ctx);
+    if (res.result_kind == RK_Int && res.result.i == -1) {
+      mask[i] = LLVMGetUndef(i32);
+    } else {
+      uint64_t val = result_to_u64(&res);
+      ASSERT_MSG(val < max_idx, "__builtin_shufflevector index out of range");
+      mask[i] = LLVMConstInt(i32, val, /*IsSigned=*/0);
+    }
+  }
+
+  LLVMValueRef res =
+      LLVMBuildShuffleVector(builder, lhs_val, rhs_val,
+                             LLVMConstVector(mask, (unsigned)len), "");
+  free(mask);
+  return res;
+}
+
+// Convert each element of a vector to the element type of the destination
+// vector.
+static LLVMValueRef compile_convert_vector(
+    Compiler* compiler, LLVMBuilderRef builder, const ConvertVector* convert,
+    TreeMap* local_ctx, TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+    LLVMBasicBlockRef cont_bb) {
+  const Type* from_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, convert->base, local_ctx);
+  const VectorType* from_vec =
+      sema_get_vector_type(compiler->sema, from_ty, local_ctx);
+  const VectorType* to_vec =
+      sema_get_vector_type(compiler->sema, convert->to, local_ctx);
+  ASSERT_MSG(from_vec && to_vec,
+             "__builtin_convertvector expects vector types at %zu:%zu",
+             source_location_line(&convert->expr.loc),
+             source_location_col(&convert->expr.loc));
+  ASSERT_MSG(sema_get_vector_length(compiler->sema, from_vec, local_ctx) ==
+                 sema_get_vector_length(compiler->sema, to_vec, local_ctx),
+             "__builtin_convertvector expects vectors with the same number of "
+             "elements at %zu:%zu",
+             source_location_line(&convert->expr.loc),
+             source_location_col(&convert->expr.loc));
+
+  LLVMValueRef val = compile_expr(compiler, builder, convert->base, local_ctx,
+                                  local_allocas, break_bb, cont_bb);
+  LLVMTypeRef llvm_to_ty = get_llvm_type(compiler, convert->to, local_ctx);
+  return build_arithmetic_cast(compiler, builder, val, from_vec->elem_type,
+                               to_vec->elem_type, llvm_to_ty);
+}
+
+static LLVMAtomicOrdering get_atomic_ordering(Compiler* compiler,
+                                              const Expr* order,
+                                              const TreeMap* local_ctx) {
+  ConstExprResult res =
+      sema_eval_expr_in_ctx(compiler->sema, order, local_ctx);
+  ASSERT_MSG(res.result_kind == RK_Int ||
+                 res.result_kind == RK_UnsignedLongLong,
+             "Memory orders must be integer constants at %zu:%zu",
+             source_location_line(&order->loc),
+             source_location_col(&order->loc));
+  switch ((MemoryOrder)result_to_u64(&res)) {
+    case MO_Relaxed:
+      return LLVMAtomicOrderingMonotonic;
+    case MO_Consume:
+      // Like clang, consume is treated as acquire.
+    case MO_Acquire:
+      return LLVMAtomicOrderingAcquire;
+    case MO_Release:
+      return LLVMAtomicOrderingRelease;
+    case MO_AcqRel:
+      return LLVMAtomicOrderingAcquireRelease;
+    case MO_SeqCst:
+      return LLVMAtomicOrderingSequentiallyConsistent;
+    default:
+      UNREACHABLE_MSG("Invalid memory order at %zu:%zu",
+                      source_location_line(&order->loc),
+                      source_location_col(&order->loc));
+  }
+}
+
+static LLVMAtomicOrdering get_builtin_atomic_ordering(
+    Compiler* compiler, const Call* call, const AtomicBuiltin* builtin,
+    size_t idx, const TreeMap* local_ctx) {
+  if (!builtin->has_memory_order) {
+    switch (builtin->order) {
+      case MO_Acquire:
+        return LLVMAtomicOrderingAcquire;
+      case MO_Release:
+        return LLVMAtomicOrderingRelease;
+      default:
+        return LLVMAtomicOrderingSequentiallyConsistent;
+    }
+  }
+  const Expr* order = *(const Expr**)vector_at(&call->args, idx);
+  return get_atomic_ordering(compiler, order, local_ctx);
+}
+
+// Lower the `__atomic_*`, `__sync_*`, and `__c11_atomic_*` builtins to LLVM
+// atomic instructions.
+static LLVMValueRef compile_atomic_builtin(
+    Compiler* compiler, LLVMBuilderRef builder, const Call* call,
+    const AtomicBuiltin* builtin, TreeMap* local_ctx, TreeMap* local_allocas,
+    LLVMBasicBlockRef break_bb, LLVMBasicBlockRef cont_bb) {
+  size_t num_orders = 0;
+  if (builtin->has_memory_order) {
+    num_orders = 1;
+    if (builtin->kind == ABK_CompareExchange)
+      num_orders = 2;
+  }
+  ASSERT_MSG(call->args.size == builtin->num_args + num_orders,
+             "Wrong number of arguments to atomic builtin at %zu:%zu",
+             source_location_line(&call->expr.loc),
+             source_location_col(&call->expr.loc));
+
+  LLVMAtomicOrdering order = get_builtin_atomic_ordering(
+      compiler, call, builtin, builtin->num_args, local_ctx);
+
+  if (builtin->kind == ABK_ThreadFence || builtin->kind == ABK_SignalFence) {
+    // A relaxed fence does nothing.
+    if (order == LLVMAtomicOrderingMonotonic)
+      return LLVMGetPoison(LLVMInt8TypeInContext(compiler->ctx));
+    return LLVMBuildFence(builder, order,
+                          builtin->kind == ABK_SignalFence, "");
+  }
+
+  const Expr* ptr_expr = *(const Expr**)vector_at(&call->args, 0);
+  const Type* ptr_ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, ptr_expr, local_ctx);
+  const Type* pointee = sema_get_pointee(compiler->sema, ptr_ty, local_ctx);
+  ASSERT_MSG(is_integral_type(pointee) ||
+                 sema_is_pointer_type(compiler->sema, pointee, local_ctx),
+             "Atomic builtins only support integer and pointer types at "
+             "%zu:%zu",
+             source_location_line(&call->expr.loc),
+             source_location_col(&call->expr.loc));
+  LLVMTypeRef llvm_pointee = get_llvm_type(compiler, pointee, local_ctx);
+  LLVMValueRef ptr = compile_expr(compiler, builder, ptr_expr, local_ctx,
+                                  local_allocas, break_bb, cont_bb);
+
+  // Values are implicitly converted to the type pointed to.
+  LLVMValueRef val = NULL;
+  if (builtin->num_args > 1) {
+    size_t val_idx = 2;
+    if (builtin->num_args == 2)
+      val_idx = 1;
+    const Expr* val_expr = *(const Expr**)vector_at(&call->args, val_idx);
+    val = compile_implicit_cast(compiler, builder, val_expr, pointee, local_ctx,
+                                local_allocas, break_bb, cont_bb);
+  }
+
+  switch (builtin->kind) {
+    case ABK_Load: {
+      ASSERT_MSG(order != LLVMAtomicOrderingRelease &&
+                     order != LLVMAtomicOrderingAcquireRelease,
+                 "Invalid memory order for atomic load at %zu:%zu",
+                 source_location_line(&call->expr.loc),
+                 source_location_col(&call->expr.loc));
+      LLVMValueRef load = LLVMBuildLoad2(builder, llvm_pointee, ptr, "");
+      LLVMSetOrdering(load, order);
+      return load;
+    }
+    case ABK_Store: {
+      ASSERT_MSG(order == LLVMAtomicOrderingMonotonic ||
+                     order == LLVMAtomicOrderingRelease ||
+                     order == LLVMAtomicOrderingSequentiallyConsistent,
+                 "Invalid memory order for atomic store at %zu:%zu",
+                 source_location_line(&call->expr.loc),
+                 source_location_col(&call->expr.loc));
+      // `__sync_lock_release` always stores 0.
+      if (!val)
+        val = LLVMConstNull(llvm_pointee);
+      LLVMValueRef store = LLVMBuildStore(builder, val, ptr);
+      LLVMSetOrdering(store, order);
+      return store;
+    }
+    case ABK_Exchange:
+      return LLVMBuildAtomicRMW(builder, LLVMAtomicRMWBinOpXchg, ptr, val,
+                                order, /*singleThread=*/0);
+    case ABK_FetchOp:
+    case ABK_OpFetch: {
+      ASSERT_MSG(is_integral_type(pointee),
+                 "Atomic arithmetic is only supported on integers at %zu:%zu",
+                 source_location_line(&call->expr.loc),
+                 source_location_col(&call->expr.loc));
+      LLVMAtomicRMWBinOp op = get_atomic_rmw_op(builtin->op);
+      LLVMValueRef old = LLVMBuildAtomicRMW(builder, op, ptr, val, order,
+                                            /*singleThread=*/0);
+      if (builtin->kind == ABK_FetchOp)
+        return old;
+      return build_atomic_rmw_result(builder, op, old, val);
+    }
+    case ABK_BoolCompareAndSwap:
+    case ABK_ValCompareAndSwap: {
+      const Expr* cmp_expr = *(const Expr**)vector_at(&call->args, 1);
+      LLVMValueRef cmp =
+          compile_implicit_cast(compiler, builder, cmp_expr, pointee, local_ctx,
+                                local_allocas, break_bb, cont_bb);
+      LLVMValueRef cmpxchg = LLVMBuildAtomicCmpXchg(
+          builder, ptr, cmp, val, order, order, /*singleThread=*/0);
+      if (builtin->kind == ABK_ValCompareAndSwap)
+        return LLVMBuildExtractValue(builder, cmpxchg, 0, "");
+      return LLVMBuildZExt(builder,
+                           LLVMBuildExtractValue(builder, cmpxchg, 1, ""),
+                           LLVMInt8TypeInContext(compiler->ctx), "");
+    }
+    case ABK_CompareExchange:
+      break;
+    case ABK_ThreadFence:
+    case ABK_SignalFence:
+      UNREACHABLE_MSG("Fences should have been handled");
+  }
+
+  // The failure order cannot include a release.
+  LLVMAtomicOrdering failure_order = get_builtin_atomic_ordering(
+      compiler, call, builtin, builtin->num_args + 1, local_ctx);
+  if (failure_order == LLVMAtomicOrderingRelease) {
+    failure_order = LLVMAtomicOrderingMonotonic;
+  } else if (failure_order == LLVMAtomicOrderingAcquireRelease) {
+    failure_order = LLVMAtomicOrderingAcquire;
+  }
+
+  bool is_weak = builtin->is_weak;
+  if (builtin->has_weak_arg) {
+    const Expr* weak = *(const Expr**)vector_at(&call->args, 3);
+    ConstExprResult res =
+        sema_eval_expr_in_ctx(compiler->sema, weak, local_ctx);
+    is_weak = result_to_u64(&res) != 0;
+  }
+
+  const Expr* expected_expr = *(const Expr**)vector_at(&call->args, 1);
+  LLVMValueRef expected_ptr =
+      compile_expr(compiler, builder, expected_expr, local_ctx, local_allocas,
+                   break_bb, cont_bb);
+  LLVMValueRef expected =
+      LLVMBuildLoad2(builder, llvm_pointee, expected_ptr, "");
+  LLVMValueRef cmpxchg =
+      LLVMBuildAtomicCmpXchg(builder, ptr, expected, val, order, failure_order,
+                             /*singleThread=*/0);
+  LLVMSetWeak(cmpxchg, is_weak);
+  LLVMValueRef success = LLVMBuildExtractValue(builder, cmpxchg, 1, "");
+
+  // On failure, the value that was found is written to `*expected`.
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMBasicBlockRef fail_bb =
+      LLVMAppendBasicBlockInContext(compiler->ctx, fn, "cmpxchg_fail");
+  LLVMBasicBlockRef cont =
+      LLVMAppendBasicBlockInContext(compiler->ctx, fn, "cmpxchg_cont");
+  LLVMBuildCondBr(builder, success, cont, fail_bb);
+  ssa_seal_block(compiler->ssa, fail_bb);
+
+  LLVMPositionBuilderAtEnd(builder, fail_bb);
+  LLVMBuildStore(builder, LLVMBuildExtractValue(builder, cmpxchg, 0, ""),
+                 expected_ptr);
+  LLVMBuildBr(builder, cont);
+
+  LLVMPositionBuilderAtEnd(builder, cont);
+  ssa_seal_block(compiler->ssa, cont);
+  return LLVMBuildZExt(builder, success, LLVMInt8TypeInContext(compiler->ctx),
+                       "");
+}
+
+// Lower a call to one of the builtins declared by sema. Returns NULL if the
+// callee isn't a builtin.
+static LLVMValueRef compile_builtin_call(Compiler* compiler,
+                                         LLVMBuilderRef builder,
+                                         const Call* call, TreeMap* local_ctx,
+                                         TreeMap* local_allocas,
+                                         LLVMBasicBlockRef break_bb,
+                                         LLVMBasicBlockRef cont_bb) {
+  if (call->base->vtable->kind != EK_DeclRef)
+    return NULL;
+
+  const char* name = ((const DeclRef*)call->base)->name;
+  AtomicBuiltin atomic;
+  if (sema_get_atomic_builtin(name, &atomic)) {
+    return compile_atomic_builtin(compiler, builder, call, &atomic, local_ctx,
+                                  local_allocas, break_bb, cont_bb);
+  }
+
+  // Without errno, the libm square roots can be lowered like the builtins.
+  if (!compiler->target->math_errno) {
+    if (strcmp(name, "sqrt") == 0)
+      name = "__builtin_sqrt";
+    else if (strcmp(name, "sqrtf") == 0)
+      name = "__builtin_sqrtf";
+  }
+
+  if (strncmp(name, "__builtin_", 10) != 0)
+    return NULL;
+
+  if (strcmp(name, "__builtin_trap") == 0)
+    return call_llvm_debugtrap(compiler, builder);
+
+  // Anything after this is dead. Statements stop at the terminator.
+  if (strcmp(name, "__builtin_unreachable") == 0)
+    return LLVMBuildUnreachable(builder);
+
+  if (strcmp(name, "__builtin_shufflevector") == 0)
+    return compile_shufflevector(compiler, builder, call, local_ctx,
+                                 local_allocas, break_bb, cont_bb);
+
+  const Type* ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, call->base, local_ctx);
+  const FunctionType* func_ty =
+      sema_get_function(compiler->sema, ty, local_ctx);
+  vector llvm_args =
+      compile_call_args(compiler, builder, &call->args, &func_ty->pos_args,
+                        local_ctx, local_allocas, break_bb, cont_bb);
+  LLVMValueRef* args = llvm_args.data;
+
+  LLVMContextRef ctx = compiler->ctx;
+  LLVMTypeRef i32 = LLVMInt32TypeInContext(ctx);
+  LLVMTypeRef ret_ty = get_llvm_type(compiler, func_ty->return_type, local_ctx);
+  LLVMValueRef res = NULL;
+  if (strcmp(name, "__builtin_expect") == 0) {
+    // This is lowered to branch weights by the optimization pipeline.
+    LLVMTypeRef types[] = {ret_ty};
+    res = build_intrinsic_call(compiler, builder, "llvm.expect", types, 1,
+                               args, 2);
+  } else if (strcmp(name, "__builtin_prefetch") == 0) {
+    // By default this is a read with maximal temporal locality.
+    unsigned long long rw = 0;
+    unsigned long long locality = 3;
+    if (llvm_args.size > 1)
+      rw = get_builtin_constant_arg(args[1], name);
+    if (llvm_args.size > 2)
+      locality = get_builtin_constant_arg(args[2], name);
+    ASSERT_MSG(rw <= 1 && locality <= 3, "Invalid argument to '%s'", name);
+
+    LLVMTypeRef types[] = {LLVMTypeOf(args[0])};
+    LLVMValueRef prefetch_args[] = {
+        args[0], LLVMConstInt(i32, rw, /*IsSigned=*/0),
+        LLVMConstInt(i32, locality, /*IsSigned=*/0),
+        // This is a data prefetch.
+        LLVMConstInt(i32, 1, /*IsSigned=*/0)};
+    res = build_intrinsic_call(compiler, builder, "llvm.prefetch", types, 1,
+                               prefetch_args, 4);
+  } else if (strcmp(name, "__builtin_assume_aligned") == 0) {
+    // Assume `(ptr - offset) & (align - 1) == 0` and return the pointer.
+    unsigned long long align = get_builtin_constant_arg(args[1], name);
+    ASSERT_MSG(align && !(align & (align - 1)),
+               "Alignment given to '%s' must be a power of 2", name);
+
+    LLVMTypeRef intptr_ty = get_llvm_ptr_as_int(compiler);
+    LLVMValueRef addr = LLVMBuildPtrToInt(builder, args[0], intptr_ty, "");
+    if (llvm_args.size > 2) {
+      LLVMValueRef offset = LLVMBuildIntCast2(builder, args[2], intptr_ty,
+                                              /*IsSigned=*/1, "");
+      addr = LLVMBuildSub(builder, addr, offset, "");
+    }
+    LLVMValueRef masked = LLVMBuildAnd(
+        builder, addr, LLVMConstInt(intptr_ty, align - 1, /*IsSigned=*/0), "");
+    LLVMValueRef is_aligned = LLVMBuildICmp(builder, LLVMIntEQ, masked,
+                                            LLVMConstNull(intptr_ty), "");
+    build_intrinsic_call(compiler, builder, "llvm.assume",
+                         /*param_types=*/NULL, 0, &is_aligned, 1);
+    res = args[0];
+  } else if (strcmp(name, "__builtin_memcpy") == 0) {
+    LLVMBuildMemCpy(builder, args[0], /*DstAlign=*/1, args[1],
+                    /*SrcAlign=*/1, args[2]);
+    res = args[0];
+  } else if (strcmp(name, "__builtin_memset") == 0) {
+    LLVMValueRef byte = LLVMBuildIntCast2(builder, args[1],
+                                          LLVMInt8TypeInContext(ctx),
+                                          /*IsSigned=*/0, "");
+    LLVMBuildMemSet(builder, args[0], byte, args[2], /*Align=*/1);
+    res = args[0];
+  } else if (strncmp(name, "__builtin_ctz", 13) == 0 ||
+             strncmp(name, "__builtin_clz", 13) == 0) {
+    // A zero argument is undefined for both of these.
+    const char* intrinsic = "llvm.ctlz";
+    if (strncmp(name, "__builtin_ctz", 13) == 0)
+      intrinsic = "llvm.cttz";
+    LLVMTypeRef types[] = {LLVMTypeOf(args[0])};
+    LLVMValueRef count_args[] = {
+        args[0], LLVMConstInt(LLVMInt1TypeInContext(ctx), 1, /*IsSigned=*/0)};
+    res = build_intrinsic_call(compiler, builder, intrinsic, types, 1,
+                               count_args, 2);
+    res = LLVMBuildIntCast2(builder, res, ret_ty, /*IsSigned=*/0, "");
+  } else if (strncmp(name, "__builtin_popcount", 18) == 0) {
+    LLVMTypeRef types[] = {LLVMTypeOf(args[0])};
+    res = build_intrinsic_call(compiler, builder, "llvm.ctpop", types, 1, args,
+                               1);
+    res = LLVMBuildIntCast2(builder, res, ret_ty, /*IsSigned=*/0, "");
+  } else if (strncmp(name, "__builtin_bswap", 15) == 0) {
+    LLVMTypeRef types[] = {ret_ty};
+    res = build_intrinsic_call(compiler, builder, "llvm.bswap", types, 1, args,
+                               1);
+  } else if (strncmp(name, "__builtin_sqrt", 14) == 0 &&
+             compiler->target->math_errno) {
+    // The libm call sets errno for negative arguments.
+    const char* libm_name = name + 10;
+    LLVMTypeRef libm_ty =
+        LLVMFunctionType(ret_ty, &ret_ty, /*ParamCount=*/1, /*IsVarArg=*/0);
+    LLVMValueRef libm_func = LLVMGetNamedFunction(compiler->mod, libm_name);
+    if (!libm_func)
+      libm_func = LLVMAddFunction(compiler->mod, libm_name, libm_ty);
+    res = LLVMBuildCall2(builder, libm_ty, libm_func, args, 1, "");
+  } else if (strncmp(name, "__builtin_sqrt", 14) == 0) {
+    LLVMTypeRef types[] = {ret_ty};
+    res = build_intrinsic_call(compiler, builder, "llvm.sqrt", types, 1, args,
+                               1);
+  } else if (strncmp(name, "__builtin_fabs", 14) == 0) {
+    LLVMTypeRef types[] = {ret_ty};
+    res = build_intrinsic_call(compiler, builder, "llvm.fabs", types, 1, args,
+                               1);
+  } else {
+    UNREACHABLE_MSG("Unhandled builtin '%s'", name);
+  }
+
+  vector_destroy(&llvm_args);
+  return res;
+}
+
+void compile_compound_statement(Compiler* compiler, LLVMBuilderRef builder,
+                                const CompoundStmt* compound,
+                                TreeMap* local_ctx, TreeMap* local_allocas,
+                                LLVMBasicBlockRef break_bb,
+                                LLVMBasicBlockRef cont_bb,
+                                LLVMValueRef* last_expr);
+
+// Returns the address of an object of `type` holding the value of `expr`.
+// Aggregate lvalues are used in place and anything else is copied to a
+// temporary.
+static LLVMValueRef compile_abi_arg_ptr(Compiler* compiler,
+                                        LLVMBuilderRef builder,
+                                        const Expr* expr, const Type* type,
+                                        TreeMap* local_ctx,
+                                        TreeMap* local_allocas,
+                                        LLVMBasicBlockRef break_bb,
+                                        LLVMBasicBlockRef cont_bb) {
+  if (is_aggregate_type(compiler, type) &&
+      has_lvalue_ptr(compiler, expr, local_allocas)) {
+    return compile_lvalue_ptr(compiler, builder, expr, local_ctx,
+                              local_allocas, break_bb, cont_bb);
+  }
+
+  LLVMValueRef val = compile_implicit_cast(
+      compiler, builder, expr, type, local_ctx, local_allocas, break_bb,
+      cont_bb);
+  LLVMValueRef tmp =
+      build_abi_temporary(compiler, builder, "abi.tmp", type, local_ctx);
+  get_aligned_store(compiler, builder, type, val, tmp, local_ctx);
+  return tmp;
+}
+
+static void append_llvm_value(vector* vals, LLVMValueRef val) {
+  LLVMValueRef* storage = vector_append_storage(vals);
+  *storage = val;
+}
+
+// Lower a call to a function that isn't a builtin. Arguments and the return
+// value are passed the way get_function_abi classifies them.
+static LLVMValueRef compile_call(Compiler* compiler, LLVMBuilderRef builder,
+                                 const Call* call, TreeMap* local_ctx,
+                                 TreeMap* local_allocas,
+                                 LLVMBasicBlockRef break_bb,
+                                 LLVMBasicBlockRef cont_bb) {
+  const Type* ty =
+      sema_get_type_of_expr_in_ctx(compiler->sema, call->base, local_ctx);
+  const FunctionType* func_ty =
+      sema_get_function(compiler->sema, ty, local_ctx);
+  LLVMTypeRef llvm_func_ty =
+      get_llvm_type(compiler, &func_ty->type, local_ctx);
+  LLVMValueRef llvm_func =
+      compile_expr(compiler, builder, call->base, local_ctx, local_allocas,
+                   break_bb, cont_bb);
+
+  FunctionABI abi;
+  get_function_abi(compiler, func_ty, local_ctx, &abi);
+
+  vector llvm_args;
+  vector_construct(&llvm_args, sizeof(LLVMValueRef), alignof(LLVMValueRef));
+
+  LLVMValueRef sret = NULL;
+  if (abi.ret.kind == AK_Indirect) {
+    sret = build_abi_temporary(compiler, builder, "sret",
+                               func_ty->return_type, local_ctx);
+    append_llvm_value(&llvm_args, sret);
+  }
+
+  for (size_t i = 0; i < call->args.size; ++i) {
+    const Expr* arg = *(const Expr**)vector_at(&call->args, i);
+    if (i >= func_ty->pos_args.size) {
+      // Variadic arguments are classified after the positional ones.
+      classify_argument(compiler,
+                        get_variadic_arg_type(compiler, arg, local_ctx),
+                        local_ctx, &abi, vector_append_storage(&abi.args));
+    }
+
+    const ABIArgInfo* info = vector_at(&abi.args, i);
+    switch (info->kind) {
+      case AK_Direct:
+        append_llvm_value(&llvm_args,
+                          compile_implicit_cast(compiler, builder, arg,
+                                                info->type, local_ctx,
+                                                local_allocas, break_bb,
+                                                cont_bb));
+        break;
+      case AK_Indirect:
+        // The callee gets its own copy through `byval`.
+        append_llvm_value(&llvm_args,
+                          compile_abi_arg_ptr(compiler, builder, arg,
+                                              info->type, local_ctx,
+                                              local_allocas, break_bb,
+                                              cont_bb));
+        break;
+      case AK_Coerce: {
+        LLVMValueRef ptr =
+            compile_abi_arg_ptr(compiler, builder, arg, info->type, local_ctx,
+                                local_allocas, break_bb, cont_bb);
+        LLVMValueRef vals[2];
+        unsigned num_vals =
+            load_eightbytes(compiler, builder, info, ptr, vals, local_ctx);
+        for (unsigned j = 0; j < num_vals; ++j)
+          append_llvm_value(&llvm_args, vals[j]);
+        break;
+      }
+      case AK_Ignore:
+        compile_expr(compiler, builder, arg, local_ctx, local_allocas,
+                     break_bb, cont_bb);
+        break;
+    }
+  }
+
+  LLVMValueRef res =
+      LLVMBuildCall2(builder, llvm_func_ty, llvm_func, llvm_args.data,
+                     (unsigned)llvm_args.size, "");
+  add_abi_attributes(compiler, res, &abi, local_ctx);
+
+  // Calls in a `flatten` function are inlined wherever possible.
+  if (compiler->flatten_calls) {
+    LLVMAddCallSiteAttribute(
+        res, LLVMAttributeFunctionIndex,
+        create_enum_attribute(compiler, "alwaysinline", /*val=*/0));
+  }
+
+  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMMetadataRef local_scope = LLVMGetSubprogram(fn);
+  assert(local_scope);
+
+  // TODO: Fill these in with correct values.
+  LLVMMetadataRef debug_loc = LLVMDIBuilderCreateDebugLocation(
+      ctx, (unsigned)source_location_line(&call->expr.loc),
+      (unsigned)source_location_col(&call->expr.loc), local_scope,
+      /*InlinedAt=*/NULL);
+  LLVMInstructionSetDebugLoc(res, debug_loc);
+
+  const Type* ret_ty = func_ty->return_type;
+  switch (abi.ret.kind) {
+    case AK_Direct:
+      break;
+    case AK_Indirect:
+      res = get_aligned_load(compiler, builder, ret_ty, sret, "", local_ctx);
+      break;
+    case AK_Coerce: {
+      LLVMValueRef vals[] = {res, NULL};
+      if (abi.ret.hi) {
+        vals[0] = LLVMBuildExtractValue(builder, res, 0, "");
+        vals[1] = LLVMBuildExtractValue(builder, res, 1, "");
+      }
+      LLVMValueRef tmp =
+          build_abi_temporary(compiler, builder, "coerce", ret_ty, local_ctx);
+      store_eightbytes(compiler, builder, &abi.ret, vals, tmp, local_ctx);
+      res = get_aligned_load(compiler, builder, ret_ty, tmp, "", local_ctx);
+      break;
+    }
+    case AK_Ignore:
+      res = LLVMGetUndef(get_llvm_type(compiler, ret_ty, local_ctx));
+      break;
+  }
+
+  vector_destroy(&llvm_args);
+  vector_destroy(&abi.args);
+
+  return res;
+}
+
+// Return the value of `expr` from the current function, whose return value is
+// not passed directly.
+static void compile_abi_return(Compiler* compiler, LLVMBuilderRef builder,
+                               const Expr* expr, TreeMap* local_ctx,
+                               TreeMap* local_allocas,
+                               LLVMBasicBlockRef break_bb,
+                               LLVMBasicBlockRef cont_bb) {
+  const ABIArgInfo* info = &compiler->current_return;
+  switch (info->kind) {
+    case AK_Direct:
+      UNREACHABLE_MSG("Direct return values are returned as is");
+    case AK_Indirect: {
+      LLVMValueRef sret = LLVMGetParam(compiler->current_function, 0);
+      if (has_lvalue_ptr(compiler, expr, local_allocas)) {
+        LLVMValueRef src =
+            compile_lvalue_ptr(compiler, builder, expr, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+        build_aggregate_copy(compiler, builder, info->type, sret, src,
+                             local_ctx);
+      } else {
+        LLVMValueRef val =
+            compile_implicit_cast(compiler, builder, expr, info->type,
+                                  local_ctx, local_allocas, break_bb, cont_bb);
+        get_aligned_store(compiler, builder, info->type, val, sret,
+                          local_ctx);
+      }
+      LLVMBuildRetVoid(builder);
+      return;
+    }
+    case AK_Coerce: {
+      LLVMValueRef ptr =
+          compile_abi_arg_ptr(compiler, builder, expr, info->type, local_ctx,
+                              local_allocas, break_bb, cont_bb);
+      LLVMValueRef vals[2];
+      if (load_eightbytes(compiler, builder, info, ptr, vals, local_ctx) == 1)
+        LLVMBuildRet(builder, vals[0]);
+      else
+        LLVMBuildAggregateRet(builder, vals, 2);
+      return;
+    }
+    case AK_Ignore:
+      compile_expr(compiler, builder, expr, local_ctx, local_allocas, break_bb,
+                   cont_bb);
+      LLVMBuildRetVoid(builder);
+      return;
+  }
+}
+
+// Compile an expression and return it.
+//
+// The only time this function returns NULL is for a StmtExpr which can evaluate
+// to void. All other cases should return a valid LLVMValueRef.
+//
+// BasicBlocks are propagated soley for proper handling of statement expressions
+// which still need to respect semantics for `break` and `continue`.
+LLVMValueRef compile_expr(Compiler* compiler, LLVMBuilderRef builder,
+                          const Expr* expr, TreeMap* local_ctx,
+                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                          LLVMBasicBlockRef cont_bb) {
+  const Type* type =
+      sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+  LLVMTypeRef llvm_type = get_llvm_type(compiler, type, local_ctx);
+  switch (expr->vtable->kind) {
+    case EK_String: {
+      const StringLiteral* s = (const StringLiteral*)expr;
+      return get_string_literal(compiler, s->val);
+    }
+    case EK_PrettyFunction: {
+      LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+      size_t size;
+      return get_string_literal(compiler, LLVMGetValueName2(fn, &size));
+    }
+    case EK_Int: {
+      const Int* i = (const Int*)expr;
+      bool has_sign = !is_unsigned_integral_type(&i->type.type);
+      assert(LLVMGetTypeKind(llvm_type) == LLVMIntegerTypeKind &&
+             LLVMGetIntTypeWidth(llvm_type) > 0);
+      return LLVMConstInt(llvm_type, i->val, has_sign);
+    }
+    case EK_Float:
+      return LLVMConstRealOfString(llvm_type, ((const Float*)expr)->val);
+    case EK_Bool: {
+      const Bool* b = (const Bool*)expr;
+      return LLVMConstInt(llvm_type, b->val, /*UsSugbed=*/false);
+    }
+    case EK_Char: {
+      const Char* c = (const Char*)expr;
+      assert(c->val >= 0);
+      return LLVMConstInt(llvm_type, (unsigned long long)c->val,
+                          /*UsSugbed=*/false);
+    }
+    case EK_SizeOf: {
+      ConstExprResult res = sema_eval_sizeof_in_ctx(
+          compiler->sema, (const SizeOf*)expr, local_ctx);
+      assert(res.result_kind == RK_UnsignedLongLong);
+      return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
+    }
+    case EK_AlignOf: {
+      ConstExprResult res = sema_eval_alignof_in_ctx(
+          compiler->sema, (const AlignOf*)expr, local_ctx);
+      assert(res.result_kind == RK_UnsignedLongLong);
+      return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
+    }
+    case EK_UnOp:
+      return compile_unop(compiler, builder, (const UnOp*)expr, local_ctx,
+                          local_allocas, break_bb, cont_bb);
+    case EK_BinOp:
+      return compile_binop(compiler, builder, (const BinOp*)expr, local_ctx,
+                           local_allocas, break_bb, cont_bb);
+    case EK_DeclRef: {
+      const DeclRef* decl = (const DeclRef*)expr;
 
-  if (type->align) {
-    size_t alignment = sema_eval_alignof_type(compiler->sema, type, local_ctx);
-    LLVMSetAlignment(load, (unsigned)alignment);
+      LLVMValueRef val = NULL;
+      bool is_func = LLVMGetTypeKind(llvm_type) == LLVMFunctionTypeKind;
+      if (is_func && !tree_map_get(local_allocas, decl->name, (void*)&val)) {
+        LLVMValueRef val = LLVMGetNamedFunction(compiler->mod, decl->name);
+        assert(val);
+        return val;
+      }
+
+      const Type* decl_ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+      if (decl_ty->vtable->kind == TK_EnumType) {
+        void* enum_val;
+        if (tree_map_get(&compiler->sema->enum_values, decl->name, &enum_val)) {
+          LLVMTypeRef enum_ty =
+              get_llvm_type_of_expr(compiler, expr, local_ctx);
+          return LLVMConstInt(enum_ty, (uintptr_t)enum_val, /*signed=*/1);
+        }
+
+        UNREACHABLE_MSG("Couldn't find value for enum member '%s'", decl->name);
+      }
+
+      SSAVariable* var = get_promoted_local(compiler, expr, local_allocas);
+      if (var) {
+        return ssa_read_variable(compiler->ssa, var,
+                                 LLVMGetInsertBlock(builder));
+      }
+
+      val = compile_lvalue_ptr(compiler, builder, expr, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+
+      if (sema_is_array_type(compiler->sema, decl_ty, local_ctx))
+        return val;
+
+      return get_aligned_load(compiler, builder, type, val, "", local_ctx);
+    }
+    case EK_Call: {
+      const Call* call = (const Call*)expr;
+      LLVMValueRef builtin = compile_builtin_call(
+          compiler, builder, call, local_ctx, local_allocas, break_bb, cont_bb);
+      if (builtin)
+        return builtin;
+      return compile_call(compiler, builder, call, local_ctx, local_allocas,
+                          break_bb, cont_bb);
+    }
+    case EK_MemberAccess: {
+      const MemberAccess* access = (const MemberAccess*)expr;
+      const StructType* base_ty = sema_get_struct_type_from_member_access(
+          compiler->sema, access, local_ctx);
+      size_t offset;
+      const Member* member = sema_get_struct_member(compiler->sema, base_ty,
+                                                    access->member, &offset);
+
+      LLVMValueRef ptr;
+      if (access->is_arrow) {
+        ptr = compile_expr(compiler, builder, access->base, local_ctx,
+                           local_allocas, break_bb, cont_bb);
+        LLVMTypeRef llvm_base_ty =
+            get_llvm_type(compiler, &base_ty->type, local_ctx);
+        LLVMValueRef llvm_offset = LLVMConstInt(
+            LLVMInt32TypeInContext(compiler->ctx),
+            get_struct_member_field(compiler, base_ty, offset, local_ctx),
+            /*signed=*/0);
+        LLVMValueRef offsets[] = {
+            LLVMConstNull(LLVMInt32TypeInContext(compiler->ctx)), llvm_offset};
+        ptr = LLVMBuildGEP2(builder, llvm_base_ty, ptr, offsets, 2, "");
+      } else {
+        ptr = compile_lvalue_ptr(compiler, builder, expr, local_ctx,
+                                 local_allocas, break_bb, cont_bb);
+      }
+      LValueAccess member_access;
+      get_struct_member_access(compiler, base_ty, offset, &member_access,
+                               local_ctx);
+      return load_from_lvalue(compiler, builder, member->type, /*var=*/NULL,
+                              ptr, &member_access, local_ctx);
+    }
+    case EK_Conditional: {
+      const Conditional* conditional = (const Conditional*)expr;
+      return compile_conditional(compiler, builder, conditional, local_ctx,
+                                 local_allocas, break_bb, cont_bb);
+    }
+    case EK_Cast: {
+      const Cast* cast = (const Cast*)expr;
+      return compile_implicit_cast(compiler, builder, cast->base, cast->to,
+                                   local_ctx, local_allocas, break_bb, cont_bb);
+    }
+    case EK_ConvertVector:
+      return compile_convert_vector(compiler, builder,
+                                    (const ConvertVector*)expr, local_ctx,
+                                    local_allocas, break_bb, cont_bb);
+    case EK_Index: {
+      const Index* index = (const Index*)expr;
+      const Type* base_ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, index->base, local_ctx);
+      if (sema_is_vector_type(compiler->sema, base_ty, local_ctx)) {
+        // The vector may not be in memory, so extract the element directly.
+        LLVMValueRef vec =
+            compile_expr(compiler, builder, index->base, local_ctx,
+                         local_allocas, break_bb, cont_bb);
+        LLVMValueRef idx =
+            compile_expr(compiler, builder, index->idx, local_ctx,
+                         local_allocas, break_bb, cont_bb);
+        return LLVMBuildExtractElement(builder, vec, idx, "");
+      }
+
+      LLVMValueRef ptr = compile_lvalue_ptr(compiler, builder, expr, local_ctx,
+                                            local_allocas, break_bb, cont_bb);
+      const Type* ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+      return get_aligned_load(compiler, builder, ty, ptr, "", local_ctx);
+    }
+    case EK_StmtExpr: {
+      const StmtExpr* stmt_expr = (const StmtExpr*)expr;
+      if (!stmt_expr->stmt)
+        return NULL;
+
+      assert(stmt_expr->stmt->body.size > 0);
+      LLVMValueRef expr = NULL;
+      compile_compound_statement(compiler, builder, stmt_expr->stmt, local_ctx,
+                                 local_allocas, break_bb, cont_bb, &expr);
+      return expr;
+    }
+    case EK_AddrOfLabel:
+      return compile_constant_expr(compiler, expr, type, local_ctx);
+    default:
+      UNREACHABLE_MSG("TODO: Implement compile_expr for this expr %d",
+                      expr->vtable->kind);
   }
+}
+
+void compile_statement(Compiler* compiler, LLVMBuilderRef builder,
+                       const Statement* stmt, TreeMap* local_ctx,
+                       TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                       LLVMBasicBlockRef cont_bb, LLVMValueRef* last_expr);
+
+void compile_if_statement(Compiler* compiler, LLVMBuilderRef builder,
+                          const IfStmt* stmt, TreeMap* local_ctx,
+                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                          LLVMBasicBlockRef cont_bb) {
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+  LLVMValueRef cond = compile_to_bool(compiler, builder, stmt->cond, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
+
+  assert(LLVMGetTypeKind(LLVMTypeOf(cond)) == LLVMIntegerTypeKind);
+  assert(LLVMGetIntTypeWidth(LLVMTypeOf(cond)) == 1);
+
+  // Create blocks for the then and else cases. Insert the 'if' block at the
+  // end of the function.
+  LLVMBasicBlockRef ifbb = LLVMAppendBasicBlockInContext(ctx, fn, "if");
+  LLVMBasicBlockRef elsebb = LLVMCreateBasicBlockInContext(ctx, "else");
+  LLVMBasicBlockRef mergebb = LLVMCreateBasicBlockInContext(ctx, "merge");
 
-  return load;
-}
+  build_profiled_cond_br(compiler, builder, cond, ifbb, elsebb);
+  ssa_seal_block(compiler->ssa, ifbb);
+  ssa_seal_block(compiler->ssa, elsebb);
 
-static void get_aligned_store(Compiler* compiler, LLVMBuilderRef builder,
-                              const Type* type, LLVMValueRef val,
-                              LLVMValueRef ptr, const TreeMap* local_ctx) {
-  LLVMValueRef store = LLVMBuildStore(builder, val, ptr);
+  // Emit if BB.
+  LLVMPositionBuilderAtEnd(builder, ifbb);
 
-  if (type->align) {
-    size_t alignment = sema_eval_alignof_type(compiler->sema, type, local_ctx);
-    LLVMSetAlignment(store, (unsigned)alignment);
-  }
-}
+  if (stmt->body) {
+    TreeMap local_ctx_cpy;
+    TreeMap local_allocas_cpy;
+    string_tree_map_construct(&local_ctx_cpy);
+    string_tree_map_construct(&local_allocas_cpy);
+    tree_map_clone(&local_ctx_cpy, local_ctx);
+    tree_map_clone(&local_allocas_cpy, local_allocas);
 
-static LLVMValueRef get_aligned_alloca(Compiler* compiler,
-                                       LLVMBuilderRef builder, const Type* type,
-                                       const char* name,
-                                       const TreeMap* local_ctx) {
-  LLVMTypeRef llvm_type = get_llvm_type(compiler, type, local_ctx);
-  LLVMValueRef alloca = LLVMBuildAlloca(builder, llvm_type, name);
+    compile_statement(compiler, builder, stmt->body, &local_ctx_cpy,
+                      &local_allocas_cpy, break_bb, cont_bb,
+                      /*last_expr=*/NULL);
 
-  if (type->align) {
-    size_t alignment = sema_eval_alignof_type(compiler->sema, type, local_ctx);
-    LLVMSetAlignment(alloca, (unsigned)alignment);
+    tree_map_destroy(&local_ctx_cpy);
+    tree_map_destroy(&local_allocas_cpy);
   }
 
-  return alloca;
-}
+  LLVMBasicBlockRef last_bb = LLVMGetInsertBlock(builder);
+  LLVMValueRef last = LLVMGetLastInstruction(last_bb);
+  bool all_branches_terminate = true;
+  if (!last || !LLVMIsATerminatorInst(last)) {
+    LLVMBuildBr(builder, mergebb);
+    all_branches_terminate = false;
+  }
 
-LLVMValueRef compile_unop(Compiler* compiler, LLVMBuilderRef builder,
-                          const UnOp* expr, TreeMap* local_ctx,
-                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                          LLVMBasicBlockRef cont_bb) {
-  switch (expr->op) {
-    case UOK_Not: {
-      // Result is always an i1.
-      LLVMValueRef to_bool =
-          compile_to_bool(compiler, builder, expr->subexpr, local_ctx,
-                          local_allocas, break_bb, cont_bb);
-      LLVMValueRef zero = LLVMConstNull(LLVMInt1Type());
-      LLVMValueRef res =
-          LLVMBuildICmp(builder, LLVMIntEQ, to_bool, zero, "not");
-      return LLVMBuildZExt(builder, res, LLVMInt8Type(), "");
+  // Emit potential else BB.
+  LLVMAppendExistingBasicBlock(fn, elsebb);
+  LLVMPositionBuilderAtEnd(builder, elsebb);
+  if (stmt->else_stmt) {
+    {
+      TreeMap local_ctx_cpy;
+      TreeMap local_allocas_cpy;
+      string_tree_map_construct(&local_ctx_cpy);
+      string_tree_map_construct(&local_allocas_cpy);
+      tree_map_clone(&local_ctx_cpy, local_ctx);
+      tree_map_clone(&local_allocas_cpy, local_allocas);
+
+      compile_statement(compiler, builder, stmt->else_stmt, local_ctx,
+                        local_allocas, break_bb, cont_bb, /*last_expr=*/NULL);
+
+      tree_map_destroy(&local_ctx_cpy);
+      tree_map_destroy(&local_allocas_cpy);
     }
-    case UOK_BitNot: {
-      LLVMValueRef val =
-          compile_expr(compiler, builder, expr->subexpr, local_ctx,
-                       local_allocas, break_bb, cont_bb);
-      LLVMValueRef ones = LLVMConstAllOnes(LLVMTypeOf(val));
-      return LLVMBuildXor(builder, val, ones, "");
+
+    LLVMBasicBlockRef last_bb = LLVMGetInsertBlock(builder);
+    LLVMValueRef last = LLVMGetLastInstruction(last_bb);
+    if (!last || !LLVMIsATerminatorInst(last)) {
+      LLVMBuildBr(builder, mergebb);
+      all_branches_terminate = false;
     }
-    case UOK_PreDec:
-    case UOK_PostDec:
-    case UOK_PreInc:
-    case UOK_PostInc: {
-      bool is_pre = expr->op == UOK_PreInc || expr->op == UOK_PreDec;
-      bool is_inc = expr->op == UOK_PreInc || expr->op == UOK_PostInc;
-      LLVMValueRef ptr =
-          compile_lvalue_ptr(compiler, builder, expr->subexpr, local_ctx,
-                             local_allocas, break_bb, cont_bb);
-      const Type* type = sema_get_type_of_expr_in_ctx(compiler->sema,
-                                                      expr->subexpr, local_ctx);
-      LLVMTypeRef llvm_type = get_llvm_type(compiler, type, local_ctx);
-      LLVMValueRef val =
-          get_aligned_load(compiler, builder, type, ptr, "", local_ctx);
+  } else {
+    LLVMBuildBr(builder, mergebb);
+    all_branches_terminate = false;
+  }
 
-      LLVMValueRef one;
-      if (LLVMGetTypeKind(llvm_type) == LLVMPointerTypeKind) {
-        const Type* pointee = sema_get_pointee(compiler->sema, type, local_ctx);
-        size_t pointee_size =
-            sema_eval_sizeof_type(compiler->sema, pointee, local_ctx);
+  if (!all_branches_terminate) {
+    // Emit merge BB.
+    LLVMAppendExistingBasicBlock(fn, mergebb);
+    LLVMPositionBuilderAtEnd(builder, mergebb);
+    ssa_seal_block(compiler->ssa, mergebb);
+  } else {
+    // For some reason, there's no function for just deleting a BB. The delete
+    // function both removes a block from a function and deletes it.
+    LLVMAppendExistingBasicBlock(fn, mergebb);
+    LLVMDeleteBasicBlock(mergebb);
+  }
+}
 
-        LLVMTypeRef int_ty = get_llvm_ptr_as_int(compiler);
-        one = LLVMConstInt(int_ty, pointee_size,
-                           /*signed=*/0);
-        val = LLVMBuildPtrToInt(builder, val, int_ty, "");
-      } else {
-        one = LLVMConstInt(llvm_type, 1, /*signed=*/0);
-      }
+bool last_instruction_is_terminator(LLVMBuilderRef builder) {
+  LLVMBasicBlockRef last_bb = LLVMGetInsertBlock(builder);
+  LLVMValueRef last = LLVMGetLastInstruction(last_bb);
+  return last && LLVMIsATerminatorInst(last);
+}
 
-      LLVMValueRef postop = is_inc ? LLVMBuildAdd(builder, val, one, "")
-                                   : LLVMBuildSub(builder, val, one, "");
+static void maybe_add_restrict_local(Compiler* compiler,
+                                     const Declaration* decl,
+                                     const TreeMap* local_ctx) {
+  if (compiler->current_block != compiler->function_body ||
+      !(decl->type->qualifiers & kRestrictMask) ||
+      !sema_is_pointer_type(compiler->sema, decl->type, local_ctx)) {
+    return;
+  }
 
-      if (LLVMGetTypeKind(llvm_type) == LLVMPointerTypeKind)
-        postop = LLVMBuildIntToPtr(builder, postop, llvm_type, "");
+  RestrictLocal* local = vector_append_storage(&compiler->restrict_locals);
+  local->decl_type = decl->type;
+  local->name = decl->name;
+  local->alias_scope = NULL;
+  local->noalias = NULL;
+}
 
-      get_aligned_store(compiler, builder, type, postop, ptr, local_ctx);
-      return is_pre ? postop : val;
-    }
-    case UOK_Negate: {
-      LLVMValueRef val =
-          compile_expr(compiler, builder, expr->subexpr, local_ctx,
-                       local_allocas, break_bb, cont_bb);
-      LLVMValueRef zero = LLVMConstNull(LLVMTypeOf(val));
-      return LLVMBuildSub(builder, zero, val, "");
-    }
-    case UOK_AddrOf:
-      return compile_lvalue_ptr(compiler, builder, expr->subexpr, local_ctx,
-                                local_allocas, break_bb, cont_bb);
-    case UOK_Deref: {
-      LLVMValueRef ptr =
-          compile_expr(compiler, builder, expr->subexpr, local_ctx,
-                       local_allocas, break_bb, cont_bb);
-      return get_aligned_load(
-          compiler, builder,
-          sema_get_type_of_expr_in_ctx(compiler->sema, &expr->expr, local_ctx),
-          ptr, "", local_ctx);
-    }
-    default:
-      UNREACHABLE_MSG("TODO: Implement compile_unop for this op %d", expr->op);
-  }
+// Create a distinct metadata node whose first operand refers to itself, like
+// the alias scopes and domains clang emits.
+static LLVMMetadataRef create_self_referential_node(Compiler* compiler,
+                                                    LLVMMetadataRef* ops,
+                                                    size_t num_ops) {
+  LLVMMetadataRef temp = LLVMTemporaryMDNode(compiler->ctx, NULL, 0);
+  ops[0] = temp;
+  LLVMMetadataRef node = LLVMMDNodeInContext2(compiler->ctx, ops, num_ops);
+  LLVMMetadataReplaceAllUsesWith(temp, node);
+  return node;
 }
 
-LLVMValueRef compile_implicit_cast(Compiler* compiler, LLVMBuilderRef builder,
-                                   const Expr* from, const Type* to,
-                                   TreeMap* local_ctx, TreeMap* local_allocas,
-                                   LLVMBasicBlockRef break_bb,
-                                   LLVMBasicBlockRef cont_bb) {
-  to = sema_resolve_maybe_named_type(compiler->sema, to);
-  if (is_builtin_type(to, BTK_Bool)) {
-    LLVMValueRef res = compile_to_bool(compiler, builder, from, local_ctx,
-                                       local_allocas, break_bb, cont_bb);
-    return LLVMBuildZExt(builder, res, LLVMInt8Type(), "");
+// Give each RestrictLocal of `func` its own alias scope and mark the accesses
+// through it as not aliasing accesses through any other RestrictLocal.
+static void add_restrict_scope_metadata(Compiler* compiler, LLVMValueRef func,
+                                        const char* func_name) {
+  vector* locals = &compiler->restrict_locals;
+  vector* accesses = &compiler->restrict_accesses;
+  if (locals->size < 2 || !accesses->size) {
+    locals->size = 0;
+    accesses->size = 0;
+    return;
   }
 
-  const Type* from_ty =
-      sema_get_type_of_expr_in_ctx(compiler->sema, from, local_ctx);
+  LLVMContextRef ctx = compiler->ctx;
+  LLVMMetadataRef domain_ops[] = {
+      NULL, LLVMMDStringInContext2(ctx, func_name, strlen(func_name))};
+  LLVMMetadataRef domain =
+      create_self_referential_node(compiler, domain_ops, 2);
+
+  vector scopes;
+  vector_construct(&scopes, sizeof(LLVMMetadataRef), alignof(LLVMMetadataRef));
+  for (size_t i = 0; i < locals->size; ++i) {
+    const RestrictLocal* local = vector_at(locals, i);
+    string name;
+    string_construct(&name);
+    string_append(&name, func_name);
+    string_append(&name, ": ");
+    string_append(&name, local->name);
+    LLVMMetadataRef scope_ops[] = {
+        NULL, domain, LLVMMDStringInContext2(ctx, name.data, name.size)};
+    LLVMMetadataRef* scope = vector_append_storage(&scopes);
+    *scope = create_self_referential_node(compiler, scope_ops, 3);
+    string_destroy(&name);
+  }
 
-  LLVMValueRef llvm_from;
-  if (sema_is_array_type(compiler->sema, from_ty, local_ctx)) {
-    // For an array type specifically, do not use compile_expr since it will
-    // load the array into an llvm array but we want to keep it as a pointer.
-    //
-    // TODO: Maybe come up with a better way for this rather than having this
-    // one check here.
-    llvm_from = compile_lvalue_ptr(compiler, builder, from, local_ctx,
-                                   local_allocas, break_bb, cont_bb);
-  } else {
-    llvm_from = compile_expr(compiler, builder, from, local_ctx, local_allocas,
-                             break_bb, cont_bb);
+  // Accesses through a RestrictLocal are in its scope and don't alias any
+  // access in the other scopes.
+  vector others;
+  vector_construct(&others, sizeof(LLVMMetadataRef), alignof(LLVMMetadataRef));
+  for (size_t i = 0; i < locals->size; ++i) {
+    RestrictLocal* local = vector_at(locals, i);
+    LLVMMetadataRef* scope = vector_at(&scopes, i);
+    local->alias_scope =
+        LLVMMetadataAsValue(ctx, LLVMMDNodeInContext2(ctx, scope, 1));
+
+    others.size = 0;
+    for (size_t j = 0; j < scopes.size; ++j) {
+      if (j == i)
+        continue;
+      LLVMMetadataRef* other = vector_append_storage(&others);
+      *other = *(LLVMMetadataRef*)vector_at(&scopes, j);
+    }
+    local->noalias = LLVMMetadataAsValue(
+        ctx, LLVMMDNodeInContext2(ctx, others.data, others.size));
+  }
+  vector_destroy(&others);
+  vector_destroy(&scopes);
+
+  unsigned scope_kind = LLVMGetMDKindIDInContext(ctx, "alias.scope", 11);
+  unsigned noalias_kind = LLVMGetMDKindIDInContext(ctx, "noalias", 7);
+  for (size_t i = 0; i < accesses->size; ++i) {
+    const RestrictAccess* access = vector_at(accesses, i);
+    const RestrictLocal* local = vector_at(locals, access->local);
+    for (LLVMUseRef use = LLVMGetFirstUse(access->ptr); use;
+         use = LLVMGetNextUse(use)) {
+      LLVMValueRef user = LLVMGetUser(use);
+      bool is_access =
+          (LLVMIsALoadInst(user) && LLVMGetOperand(user, 0) == access->ptr) ||
+          (LLVMIsAStoreInst(user) && LLVMGetOperand(user, 1) == access->ptr);
+      if (!is_access)
+        continue;
+      LLVMSetMetadata(user, scope_kind, local->alias_scope);
+      LLVMSetMetadata(user, noalias_kind, local->noalias);
+    }
   }
 
-  if (sema_types_are_compatible(compiler->sema, from_ty, to, local_ctx))
-    return llvm_from;
+  locals->size = 0;
+  accesses->size = 0;
+}
 
-  LLVMTypeRef llvm_to_ty = get_llvm_type(compiler, to, local_ctx);
-  LLVMTypeRef llvm_from_ty = LLVMTypeOf(llvm_from);
+void compile_for_statement(Compiler* compiler, LLVMBuilderRef builder,
+                           const ForStmt* stmt, TreeMap* local_ctx,
+                           TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                           LLVMBasicBlockRef cont_bb) {
+  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
 
-  if (LLVMGetTypeKind(llvm_from_ty) == LLVMPointerTypeKind) {
-    if (LLVMGetTypeKind(llvm_to_ty) == LLVMPointerTypeKind)
-      return llvm_from;
+  // Scope local to the loop.
+  TreeMap local_ctx_cpy;
+  TreeMap local_allocas_cpy;
+  string_tree_map_construct(&local_ctx_cpy);
+  string_tree_map_construct(&local_allocas_cpy);
+  tree_map_clone(&local_ctx_cpy, local_ctx);
+  tree_map_clone(&local_allocas_cpy, local_allocas);
 
-    if (LLVMGetTypeKind(llvm_to_ty) == LLVMIntegerTypeKind) {
-      // TODO: Check the size.
-      // unsigned int_width = LLVMGetIntTypeWidth(llvm_from_ty);
-      return LLVMBuildPtrToInt(builder, llvm_from, llvm_to_ty, "");
-    }
+  // Emit the initializer if any.
+  if (stmt->init) {
+    const Statement* outer_block = compiler->current_block;
+    compiler->current_block = &stmt->base;
+    compile_statement(compiler, builder, stmt->init, &local_ctx_cpy,
+                      &local_allocas_cpy, break_bb, cont_bb,
+                      /*last_expr=*/NULL);
+    compiler->current_block = outer_block;
   }
 
-  if (LLVMGetTypeKind(llvm_from_ty) == LLVMIntegerTypeKind) {
-    if (LLVMGetTypeKind(llvm_to_ty) == LLVMIntegerTypeKind) {
-      unsigned from_size = LLVMGetIntTypeWidth(llvm_from_ty);
-      unsigned to_size = LLVMGetIntTypeWidth(llvm_to_ty);
-      if (from_size == to_size)
-        return llvm_from;
-      else if (from_size > to_size)
-        return LLVMBuildTrunc(builder, llvm_from, llvm_to_ty, "");
-      else if (is_unsigned_integral_type(from_ty))
-        return LLVMBuildZExt(builder, llvm_from, llvm_to_ty, "");
-      else
-        return LLVMBuildSExt(builder, llvm_from, llvm_to_ty, "");
-    }
-
-    if (LLVMGetTypeKind(llvm_to_ty) == LLVMPointerTypeKind) {
-      unsigned from_size = LLVMGetIntTypeWidth(llvm_from_ty);
-      assert(from_size);
+  LLVMBasicBlockRef for_start =
+      LLVMAppendBasicBlockInContext(ctx, fn, "for_start");
+  LLVMBuildBr(builder, for_start);
+  LLVMPositionBuilderAtEnd(builder, for_start);
 
-      unsigned ptr_size = get_llvm_ptr_size_in_bits(compiler);
+  LLVMBasicBlockRef for_end = LLVMCreateBasicBlockInContext(ctx, "for_end");
+  LLVMBasicBlockRef for_iter = LLVMCreateBasicBlockInContext(ctx, "for_iter");
 
-      assert(from_size <= ptr_size);
+  // Check the condition if any.
+  if (stmt->cond) {
+    LLVMValueRef cond =
+        compile_to_bool(compiler, builder, stmt->cond, &local_ctx_cpy,
+                        &local_allocas_cpy, break_bb, cont_bb);
+    LLVMBasicBlockRef for_body = LLVMCreateBasicBlockInContext(ctx, "for_body");
+    LLVMAppendExistingBasicBlock(fn, for_body);
+    build_profiled_cond_br(compiler, builder, cond, for_body, for_end);
+    ssa_seal_block(compiler->ssa, for_body);
 
-      if (from_size < ptr_size)
-        llvm_from =
-            LLVMBuildZExt(builder, llvm_from, LLVMIntType(ptr_size), "");
+    LLVMPositionBuilderAtEnd(builder, for_body);
+  }
 
-      return LLVMBuildIntToPtr(builder, llvm_from, llvm_to_ty, "");
-    }
+  // Now emit the body.
+  if (stmt->body) {
+    compile_statement(compiler, builder, stmt->body, &local_ctx_cpy,
+                      &local_allocas_cpy, for_end, for_iter,
+                      /*last_expr=*/NULL);
   }
 
-  // If type-name is void, then expression is evaluated for its side-effects and
-  // its returned value is discarded, same as when expression is used on its
-  // own, as an expression statement.
-  if (is_builtin_type(to, BTK_Void))
-    return compile_expr(compiler, builder, from, local_ctx, local_allocas,
-                        break_bb, cont_bb);
-
-  printf("TODO: Handle this implicit cast for expression at %s:%zu:%zu\n",
-         source_location_filename(&from->loc), source_location_line(&from->loc),
-         source_location_col(&from->loc));
-  LLVMDumpValue(llvm_from);
-  printf("\n");
-  LLVMDumpType(llvm_to_ty);
-  printf("\n");
-  printf("function:\n");
-  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-  LLVMDumpValue(fn);
-  __builtin_trap();
-}
+  // Branch to the iterator.
+  if (!last_instruction_is_terminator(builder))
+    LLVMBuildBr(builder, for_iter);
 
-// This creates an alloca in this function but ensures it's always at the start
-// of the function. Having an alloca in the middle of the function can cause
-// the stack pointer to keep decrementing if it's in a loop.
-LLVMValueRef build_alloca_at_func_start(Compiler* compiler,
-                                        LLVMBuilderRef builder,
-                                        const char* name, const Type* type,
-                                        const TreeMap* local_ctx) {
-  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-  LLVMBasicBlockRef current_bb = LLVMGetInsertBlock(builder);
-  LLVMBasicBlockRef entry_bb = LLVMGetEntryBasicBlock(fn);
+  LLVMAppendExistingBasicBlock(fn, for_iter);
+  LLVMPositionBuilderAtEnd(builder, for_iter);
+  ssa_seal_block(compiler->ssa, for_iter);
 
-  // Place builder at the start of the entry BB. If it's empty, place the
-  // builder at the end of the bb.
-  LLVMValueRef inst = LLVMGetFirstInstruction(entry_bb);
-  if (inst)
-    LLVMPositionBuilder(builder, entry_bb, inst);
-  else
-    LLVMPositionBuilderAtEnd(builder, entry_bb);
+  // Then do the iter.
+  if (stmt->iter) {
+    compile_expr(compiler, builder, stmt->iter, &local_ctx_cpy,
+                 &local_allocas_cpy, break_bb, cont_bb);
+  }
 
-  LLVMValueRef alloca =
-      get_aligned_alloca(compiler, builder, type, name, local_ctx);
+  // And branch back to the start.
+  if (!last_instruction_is_terminator(builder))
+    LLVMBuildBr(builder, for_start);
+  ssa_seal_block(compiler->ssa, for_start);
 
-  LLVMPositionBuilderAtEnd(builder, current_bb);
+  // End of for loop.
+  LLVMAppendExistingBasicBlock(fn, for_end);
+  LLVMPositionBuilderAtEnd(builder, for_end);
+  ssa_seal_block(compiler->ssa, for_end);
 
-  return alloca;
+  tree_map_destroy(&local_ctx_cpy);
+  tree_map_destroy(&local_allocas_cpy);
 }
 
-LLVMValueRef compile_conditional(Compiler* compiler, LLVMBuilderRef builder,
-                                 const Conditional* expr, TreeMap* local_ctx,
-                                 TreeMap* local_allocas,
-                                 LLVMBasicBlockRef break_bb,
-                                 LLVMBasicBlockRef cont_bb) {
+void compile_while_statement(Compiler* compiler, LLVMBuilderRef builder,
+                             const WhileStmt* stmt, TreeMap* local_ctx,
+                             TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                             LLVMBasicBlockRef cont_bb) {
   LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
   LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
 
-  LLVMValueRef cond = compile_to_bool(compiler, builder, expr->cond, local_ctx,
-                                      local_allocas, break_bb, cont_bb);
+  // Scope local to the loop.
+  TreeMap local_ctx_cpy;
+  TreeMap local_allocas_cpy;
+  string_tree_map_construct(&local_ctx_cpy);
+  string_tree_map_construct(&local_allocas_cpy);
+  tree_map_clone(&local_ctx_cpy, local_ctx);
+  tree_map_clone(&local_allocas_cpy, local_allocas);
 
-  assert(LLVMGetTypeKind(LLVMTypeOf(cond)) == LLVMIntegerTypeKind);
-  assert(LLVMGetIntTypeWidth(LLVMTypeOf(cond)) == 1);
+  LLVMBasicBlockRef while_start =
+      LLVMAppendBasicBlockInContext(ctx, fn, "while_start");
+  LLVMBuildBr(builder, while_start);
+  LLVMPositionBuilderAtEnd(builder, while_start);
 
-  // Create blocks for the then and else cases. Insert the 'if' block at the
-  // end of the function.
-  LLVMBasicBlockRef ifbb = LLVMAppendBasicBlockInContext(ctx, fn, "if");
-  LLVMBasicBlockRef elsebb = LLVMCreateBasicBlockInContext(ctx, "else");
-  LLVMBasicBlockRef mergebb = LLVMCreateBasicBlockInContext(ctx, "merge");
+  LLVMBasicBlockRef while_end = LLVMCreateBasicBlockInContext(ctx, "while_end");
 
-  LLVMBuildCondBr(builder, cond, ifbb, elsebb);
+  // Check the condition.
+  LLVMValueRef cond =
+      compile_to_bool(compiler, builder, stmt->cond, &local_ctx_cpy,
+                      &local_allocas_cpy, break_bb, cont_bb);
+  LLVMBasicBlockRef while_body =
+      LLVMCreateBasicBlockInContext(ctx, "while_body");
+  LLVMAppendExistingBasicBlock(fn, while_body);
+  build_profiled_cond_br(compiler, builder, cond, while_body, while_end);
+  ssa_seal_block(compiler->ssa, while_body);
 
-  // Emit if BB.
-  LLVMPositionBuilderAtEnd(builder, ifbb);
-  LLVMValueRef true_expr =
-      compile_expr(compiler, builder, expr->true_expr, local_ctx, local_allocas,
-                   break_bb, cont_bb);
-  LLVMBuildBr(builder, mergebb);
-  ifbb = LLVMGetInsertBlock(builder);  // Codegen of 'if' can change the current
-                                       // block, update ifbb for the PHI.
+  LLVMPositionBuilderAtEnd(builder, while_body);
 
-  // Emit potential else BB.
-  LLVMAppendExistingBasicBlock(fn, elsebb);
-  LLVMPositionBuilderAtEnd(builder, elsebb);
-  LLVMValueRef false_expr =
-      compile_expr(compiler, builder, expr->false_expr, local_ctx,
-                   local_allocas, break_bb, cont_bb);
-  LLVMBuildBr(builder, mergebb);
-  elsebb =
-      LLVMGetInsertBlock(builder);  // Codegen of 'else' can change the current
-                                    // block, update ifbb for the PHI.
+  // Now emit the body.
+  if (stmt->body) {
+    compile_statement(compiler, builder, stmt->body, &local_ctx_cpy,
+                      &local_allocas_cpy, while_end, while_start,
+                      /*last_expr=*/NULL);
+  }
 
-  // Emit merge BB.
-  LLVMAppendExistingBasicBlock(fn, mergebb);
-  LLVMPositionBuilderAtEnd(builder, mergebb);
+  // And branch back to the start.
+  if (!last_instruction_is_terminator(builder))
+    LLVMBuildBr(builder, while_start);
+  ssa_seal_block(compiler->ssa, while_start);
 
-  const Type* common_ty = sema_get_common_arithmetic_type_of_exprs(
-      compiler->sema, expr->true_expr, expr->false_expr, local_ctx);
-  LLVMValueRef phi =
-      LLVMBuildPhi(builder, get_llvm_type(compiler, common_ty, local_ctx), "");
-  LLVMValueRef incoming_vals[] = {true_expr, false_expr};
-  LLVMBasicBlockRef incoming_blocks[] = {ifbb, elsebb};
-  LLVMAddIncoming(phi, incoming_vals, incoming_blocks, 2);
-  return phi;
+  // End of while loop.
+  LLVMAppendExistingBasicBlock(fn, while_end);
+  LLVMPositionBuilderAtEnd(builder, while_end);
+  ssa_seal_block(compiler->ssa, while_end);
+
+  tree_map_destroy(&local_ctx_cpy);
+  tree_map_destroy(&local_allocas_cpy);
 }
 
-LLVMValueRef compile_logical_binop(Compiler* compiler, LLVMBuilderRef builder,
-                                   const Expr* lhs, const Expr* rhs,
-                                   BinOpKind op, TreeMap* local_ctx,
-                                   TreeMap* local_allocas,
-                                   LLVMBasicBlockRef break_bb,
-                                   LLVMBasicBlockRef cont_bb) {
-  // Account for short-circuit evaluation.
+// TODO: This should just be a switch instruction!!!
+void compile_switch_statement(Compiler* compiler, LLVMBuilderRef builder,
+                              const SwitchStmt* stmt, TreeMap* local_ctx,
+                              TreeMap* local_allocas,
+                              LLVMBasicBlockRef break_bb,
+                              LLVMBasicBlockRef cont_bb) {
   LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
   LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
 
-  LLVMValueRef lhs_val = compile_to_bool(compiler, builder, lhs, local_ctx,
-                                         local_allocas, break_bb, cont_bb);
-  LLVMBasicBlockRef current_bb = LLVMGetInsertBlock(builder);
-
-  LLVMBasicBlockRef eval_rhs_bb =
-      LLVMAppendBasicBlockInContext(ctx, fn, "sc_rhs");
-  LLVMBasicBlockRef res_bb = LLVMCreateBasicBlockInContext(ctx, "sc_res");
-
-  switch (op) {
-    case BOK_LogicalAnd:
-      // Jump to the rhs if lsh is true. Otherwise go to the result bb.
-      LLVMBuildCondBr(builder, lhs_val, eval_rhs_bb, res_bb);
-      break;
-    case BOK_LogicalOr:
-      // Jump to the res BB if true. Otherwise check rhs.
-      LLVMBuildCondBr(builder, lhs_val, res_bb, eval_rhs_bb);
-      break;
-    default:
-      UNREACHABLE_MSG("Unhandled local operator %d", op);
-  }
-
-  // BB for evaluating RHS.
-  LLVMPositionBuilderAtEnd(builder, eval_rhs_bb);
-  LLVMValueRef rhs_val = compile_to_bool(compiler, builder, rhs, local_ctx,
-                                         local_allocas, break_bb, cont_bb);
-  rhs_val = LLVMBuildZExt(builder, rhs_val, LLVMInt8Type(), "");
-  LLVMBuildBr(builder, res_bb);
-  eval_rhs_bb = LLVMGetInsertBlock(builder);
-
-  // Result BB.
-  LLVMAppendExistingBasicBlock(fn, res_bb);
-  LLVMPositionBuilderAtEnd(builder, res_bb);
+  LLVMValueRef check = compile_expr(compiler, builder, stmt->cond, local_ctx,
+                                    local_allocas, break_bb, cont_bb);
 
-  LLVMValueRef phi = LLVMBuildPhi(builder, LLVMInt8Type(), "");
+  LLVMBasicBlockRef end_bb = LLVMCreateBasicBlockInContext(ctx, "switch_end");
 
-  LLVMValueRef default_val =
-      LLVMConstInt(LLVMInt8Type(), op == BOK_LogicalOr, /*IsSigned=*/0);
+  LLVMValueRef should_fallthrough =
+      LLVMConstNull(LLVMInt1TypeInContext(compiler->ctx));
 
-  LLVMValueRef incoming_vals[] = {
-      default_val,
-      rhs_val,
-  };
-  LLVMBasicBlockRef incoming_blocks[] = {current_bb, eval_rhs_bb};
-  LLVMAddIncoming(phi, incoming_vals, incoming_blocks, 2);
+  for (size_t i = 0; i < stmt->cases.size; ++i) {
+    const SwitchCase* switch_case = vector_at(&stmt->cases, i);
 
-  return phi;
-}
+    LLVMBasicBlockRef case_bb = LLVMAppendBasicBlockInContext(ctx, fn, "case");
+    LLVMBasicBlockRef next_bb = LLVMCreateBasicBlockInContext(ctx, "next");
 
-LLVMValueRef compile_binop(Compiler* compiler, LLVMBuilderRef builder,
-                           const BinOp* expr, TreeMap* local_ctx,
-                           TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                           LLVMBasicBlockRef cont_bb) {
-  const Type* lhs_ty =
-      sema_get_type_of_expr_in_ctx(compiler->sema, expr->lhs, local_ctx);
-  const Type* rhs_ty =
-      sema_get_type_of_expr_in_ctx(compiler->sema, expr->rhs, local_ctx);
-  const Expr* maybe_ptr = NULL;
-  const Expr* offset;
-  const Type* maybe_ptr_ty;
-  if (sema_is_pointer_type(compiler->sema, lhs_ty, local_ctx)) {
-    maybe_ptr = expr->lhs;
-    maybe_ptr_ty = lhs_ty;
-    offset = expr->rhs;
-  } else if (sema_is_pointer_type(compiler->sema, rhs_ty, local_ctx)) {
-    maybe_ptr = expr->rhs;
-    maybe_ptr_ty = rhs_ty;
-    offset = expr->lhs;
-  }
+    const Type* common_ty = sema_get_common_arithmetic_type_of_exprs(
+        compiler->sema, stmt->cond, switch_case->cond, local_ctx);
 
-  bool can_be_used_for_ptr_arithmetic =
-      expr->op == BOK_Add || expr->op == BOK_Sub || expr->op == BOK_AddAssign ||
-      expr->op == BOK_SubAssign;
+    LLVMValueRef case_val =
+        compile_implicit_cast(compiler, builder, switch_case->cond, common_ty,
+                              local_ctx, local_allocas, break_bb, cont_bb);
+    LLVMValueRef cond = LLVMBuildICmp(builder, LLVMIntEQ, check, case_val, "");
+    should_fallthrough = LLVMBuildOr(builder, cond, should_fallthrough, "");
+    build_profiled_cond_br(compiler, builder, should_fallthrough, case_bb,
+                           next_bb);
+    ssa_seal_block(compiler->ssa, case_bb);
 
-  if (maybe_ptr && can_be_used_for_ptr_arithmetic) {
-    const Type* pointee_ty =
-        sema_get_pointee(compiler->sema, maybe_ptr_ty, local_ctx);
-    LLVMTypeRef llvm_base_ty = get_llvm_type(compiler, pointee_ty, local_ctx);
+    LLVMPositionBuilderAtEnd(builder, case_bb);
 
-    LLVMValueRef llvm_offset = compile_expr(
-        compiler, builder, offset, local_ctx, local_allocas, break_bb, cont_bb);
+    bool last_stmt_terminates = false;
+    for (size_t j = 0; j < switch_case->stmts.size; ++j) {
+      Statement** case_stmt = vector_at(&switch_case->stmts, j);
+      compile_statement(compiler, builder, *case_stmt, local_ctx, local_allocas,
+                        end_bb, cont_bb, /*last_expr=*/NULL);
 
-    LLVMValueRef llvm_base;
-    LLVMValueRef ptr;
-    bool assign_op = expr->op == BOK_AddAssign || expr->op == BOK_SubAssign;
-    if (!assign_op) {
-      llvm_base = compile_expr(compiler, builder, maybe_ptr, local_ctx,
-                               local_allocas, break_bb, cont_bb);
-    } else {
-      assert(maybe_ptr == expr->lhs);
-      assert(offset == expr->rhs);
-      ptr = compile_lvalue_ptr(compiler, builder, maybe_ptr, local_ctx,
-                               local_allocas, break_bb, cont_bb);
-      llvm_base = LLVMBuildLoad2(builder, get_opaque_ptr(compiler), ptr, "");
+      if ((last_stmt_terminates = last_instruction_is_terminator(builder)))
+        break;
     }
 
-    LLVMValueRef offsets[] = {llvm_offset};
-    LLVMValueRef gep =
-        LLVMBuildGEP2(builder, llvm_base_ty, llvm_base, offsets, 1, "");
-
-    if (assign_op)
-      LLVMBuildStore(builder, gep, ptr);
+    if (!last_stmt_terminates)
+      LLVMBuildBr(builder, next_bb);
 
-    return gep;
+    LLVMAppendExistingBasicBlock(fn, next_bb);
+    LLVMPositionBuilderAtEnd(builder, next_bb);
+    ssa_seal_block(compiler->ssa, next_bb);
   }
 
-  // FIXME: This currently evaluates all operands before doing the actual binop.
-  // This breaks the rules for short-circuit evaluation. For example, this will
-  // not be evaluated correctly:
-  //
-  //   bool b = ptr && *ptr;
-  //
-  // Even if `ptr` is NULL, the dereference will still occur. We need to keep
-  // track of sequence points.
-  //
-  LLVMValueRef lhs;
-  LLVMValueRef rhs;
-  const Type* common_ty;
-  if (is_logical_binop(expr->op)) {
-    return compile_logical_binop(compiler, builder, expr->lhs, expr->rhs,
-                                 expr->op, local_ctx, local_allocas, break_bb,
-                                 cont_bb);
-  } else if (is_assign_binop(expr->op)) {
-    rhs = compile_implicit_cast(compiler, builder, expr->rhs, lhs_ty, local_ctx,
-                                local_allocas, break_bb, cont_bb);
-    lhs = compile_lvalue_ptr(compiler, builder, expr->lhs, local_ctx,
-                             local_allocas, break_bb, cont_bb);
-    common_ty = lhs_ty;
-  } else if (expr->op == BOK_Eq || expr->op == BOK_Ne) {
-    if (sema_is_pointer_type(compiler->sema, lhs_ty, local_ctx) &&
-        sema_is_pointer_type(compiler->sema, rhs_ty, local_ctx)) {
-      // TODO: When comparing pointers, only pointers of to the same type can be
-      // compared. The only exception to this is void pointers. We should check
-      // that both operands are the same first before comparing. Here we just
-      // assume they are the same.
-      common_ty = lhs_ty;
-    } else {
-      common_ty = sema_get_common_arithmetic_type(compiler->sema, lhs_ty,
-                                                  rhs_ty, local_ctx);
+  // FIXME: This will not work if the default is *not* the last block.
+  if (stmt->default_stmts) {
+    for (size_t i = 0; i < stmt->default_stmts->size; ++i) {
+      Statement** default_stmt = vector_at(stmt->default_stmts, i);
+      compile_statement(compiler, builder, *default_stmt, local_ctx,
+                        local_allocas, end_bb, cont_bb, /*last_expr=*/NULL);
+
+      if (last_instruction_is_terminator(builder))
+        break;
     }
-    lhs = compile_implicit_cast(compiler, builder, expr->lhs, common_ty,
-                                local_ctx, local_allocas, break_bb, cont_bb);
-    rhs = compile_implicit_cast(compiler, builder, expr->rhs, common_ty,
-                                local_ctx, local_allocas, break_bb, cont_bb);
-  } else {
-    common_ty = sema_get_common_arithmetic_type(compiler->sema, lhs_ty, rhs_ty,
-                                                local_ctx);
-    lhs = compile_implicit_cast(compiler, builder, expr->lhs, common_ty,
-                                local_ctx, local_allocas, break_bb, cont_bb);
-    rhs = compile_implicit_cast(compiler, builder, expr->rhs, common_ty,
-                                local_ctx, local_allocas, break_bb, cont_bb);
   }
 
-  LLVMValueRef res;
+  if (!last_instruction_is_terminator(builder))
+    LLVMBuildBr(builder, end_bb);
 
-  bool common_is_unsigned =
-      sema_is_unsigned_integral_type(compiler->sema, common_ty);
+  LLVMAppendExistingBasicBlock(fn, end_bb);
+  LLVMPositionBuilderAtEnd(builder, end_bb);
+  ssa_seal_block(compiler->ssa, end_bb);
+}
 
-  switch (expr->op) {
-    case BOK_Comma:
-      res = rhs;
-      break;
-    case BOK_Lt: {
-      LLVMIntPredicate op = common_is_unsigned ? LLVMIntULT : LLVMIntSLT;
-      res = LLVMBuildICmp(builder, op, lhs, rhs, "");
-      break;
-    }
-    case BOK_Gt: {
-      LLVMIntPredicate op = common_is_unsigned ? LLVMIntUGT : LLVMIntSGT;
-      res = LLVMBuildICmp(builder, op, lhs, rhs, "");
-      break;
-    }
-    case BOK_Le: {
-      LLVMIntPredicate op = common_is_unsigned ? LLVMIntULE : LLVMIntSLE;
-      res = LLVMBuildICmp(builder, op, lhs, rhs, "");
-      break;
-    }
-    case BOK_Ge: {
-      LLVMIntPredicate op = common_is_unsigned ? LLVMIntUGE : LLVMIntSGE;
-      res = LLVMBuildICmp(builder, op, lhs, rhs, "");
-      break;
+// Returns true if `stmt` is or contains a label which a goto can jump to.
+static bool stmt_has_label(const Statement* stmt) {
+  switch (stmt->vtable->kind) {
+    case SK_LabelStmt:
+      return true;
+    case SK_CompoundStmt: {
+      const vector* body = &((const CompoundStmt*)stmt)->body;
+      for (size_t i = 0; i < body->size; ++i) {
+        if (stmt_has_label(*(const Statement**)vector_at(body, i)))
+          return true;
+      }
+      return false;
     }
-    case BOK_Ne:
-      res = LLVMBuildICmp(builder, LLVMIntNE, lhs, rhs, "");
-      break;
-    case BOK_Eq:
-      res = LLVMBuildICmp(builder, LLVMIntEQ, lhs, rhs, "");
-      break;
-    case BOK_Mod:
-      if (common_is_unsigned)
-        res = LLVMBuildURem(builder, lhs, rhs, "");
-      else
-        res = LLVMBuildSRem(builder, lhs, rhs, "");
-      break;
-    case BOK_Add:
-      res = LLVMBuildAdd(builder, lhs, rhs, "");
-      break;
-    case BOK_Sub:
-      res = LLVMBuildSub(builder, lhs, rhs, "");
-      break;
-    case BOK_Mul:
-      res = LLVMBuildMul(builder, lhs, rhs, "");
-      break;
-    case BOK_Div:
-      if (common_is_unsigned)
-        res = LLVMBuildUDiv(builder, lhs, rhs, "");
-      else
-        res = LLVMBuildSDiv(builder, lhs, rhs, "");
-      break;
-    case BOK_BitwiseAnd:
-      res = LLVMBuildAnd(builder, lhs, rhs, "");
-      break;
-    case BOK_BitwiseOr:
-      res = LLVMBuildOr(builder, lhs, rhs, "");
-      break;
-    case BOK_LogicalAnd:
-      res = LLVMBuildAnd(builder, lhs, rhs, "");
-      break;
-    case BOK_LogicalOr:
-      res = LLVMBuildOr(builder, lhs, rhs, "");
-      break;
-    case BOK_Assign:
-      get_aligned_store(compiler, builder, common_ty, rhs, lhs, local_ctx);
-      res = rhs;
-      break;
-    case BOK_AddAssign: {
-      LLVMValueRef lhs_val =
-          get_aligned_load(compiler, builder, common_ty, lhs, "", local_ctx);
-      res = LLVMBuildAdd(builder, lhs_val, rhs, "");
-      get_aligned_store(compiler, builder, common_ty, res, lhs, local_ctx);
-      break;
+    case SK_IfStmt: {
+      const IfStmt* if_stmt = (const IfStmt*)stmt;
+      return (if_stmt->body && stmt_has_label(if_stmt->body)) ||
+             (if_stmt->else_stmt && stmt_has_label(if_stmt->else_stmt));
     }
-    case BOK_OrAssign: {
-      LLVMValueRef lhs_val =
-          get_aligned_load(compiler, builder, common_ty, lhs, "", local_ctx);
-      res = LLVMBuildOr(builder, lhs_val, rhs, "");
-      get_aligned_store(compiler, builder, common_ty, res, lhs, local_ctx);
-      break;
+    case SK_WhileStmt: {
+      const WhileStmt* while_stmt = (const WhileStmt*)stmt;
+      return while_stmt->body && stmt_has_label(while_stmt->body);
     }
-    case BOK_LShift:
-    case BOK_RShift:
-    case BOK_LShiftAssign:
-    case BOK_RShiftAssign: {
-      bool is_assign =
-          expr->op == BOK_LShiftAssign || expr->op == BOK_RShiftAssign;
-      bool is_shl = expr->op == BOK_LShiftAssign || expr->op == BOK_LShift;
-      LLVMValueRef lhs_val =
-          is_assign
-              ? get_aligned_load(compiler, builder, lhs_ty, lhs, "", local_ctx)
-              : lhs;
-      if (is_shl) {
-        res = LLVMBuildShl(builder, lhs_val, rhs, "");
-      } else {
-        res = LLVMBuildAShr(builder, lhs_val, rhs, "");
-      }
-      if (is_assign)
-        get_aligned_store(compiler, builder, lhs_ty, res, lhs, local_ctx);
-      break;
+    case SK_ForStmt: {
+      const ForStmt* for_stmt = (const ForStmt*)stmt;
+      return for_stmt->body && stmt_has_label(for_stmt->body);
     }
     default:
-      UNREACHABLE_MSG("TODO: Implement compile_binop for this op %d", expr->op);
+      // Labels in switch cases can only be reached from code emitted before
+      // the switch's terminator, so those are not searched.
+      return false;
   }
+}
 
-  const Type* res_ty =
-      sema_get_type_of_expr_in_ctx(compiler->sema, &expr->expr, local_ctx);
-  if (is_bool_type(res_ty)) {
-    // Cast up any i1s to i8s since bools are always kCharBits.
-    res = LLVMBuildZExt(builder, res, LLVMIntType(kCharBit), "");
-  }
+// Continue emitting code in a new block with no predecessors.
+static void position_at_unreachable_block(Compiler* compiler,
+                                          LLVMBuilderRef builder) {
+  LLVMBasicBlockRef bb = LLVMAppendBasicBlockInContext(
+      compiler->ctx, compiler->current_function, "unreachable");
+  LLVMPositionBuilderAtEnd(builder, bb);
+  ssa_seal_block(compiler->ssa, bb);
+}
 
-  return res;
+// Call `llvm.lifetime.start` or `llvm.lifetime.end` for all of `alloca`.
+static void build_lifetime_marker(Compiler* compiler, LLVMBuilderRef builder,
+                                  const char* intrinsic, LLVMValueRef alloca) {
+  LLVMTypeRef ptr_ty = LLVMTypeOf(alloca);
+  size_t size = LLVMABISizeOfType(LLVMGetModuleDataLayout(compiler->mod),
+                                  LLVMGetAllocatedType(alloca));
+  LLVMValueRef args[] = {
+      LLVMConstInt(LLVMInt64TypeInContext(compiler->ctx), size,
+                   /*IsSigned=*/0),
+      alloca};
+  build_intrinsic_call(compiler, builder, intrinsic, &ptr_ty, 1, args, 2);
 }
 
-LLVMTypeRef get_llvm_type_of_expr(Compiler* compiler, const Expr* expr,
-                                  const TreeMap* local_ctx) {
-  const Type* ty =
-      sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
-  return get_llvm_type(compiler, ty, local_ctx);
+// Start the lifetime of `alloca`, the storage of a local being declared, if it
+// is declared directly in a compound statement. Its lifetime then ends with
+// that statement.
+static void start_local_lifetime(Compiler* compiler, LLVMBuilderRef builder,
+                                 LLVMValueRef alloca) {
+  bool scoped = compiler->in_scope_declaration;
+  compiler->in_scope_declaration = false;
+  if (!scoped || !compiler->emit_lifetime_markers)
+    return;
+
+  build_lifetime_marker(compiler, builder, "llvm.lifetime.start", alloca);
+  ScopedAlloca* scoped_alloca =
+      vector_append_storage(&compiler->scoped_allocas);
+  scoped_alloca->alloca = alloca;
+  scoped_alloca->size = get_alloca_size(compiler, alloca);
 }
 
-LLVMTypeRef get_llvm_type_of_expr_global_ctx(Compiler* compiler,
-                                             const Expr* expr) {
-  TreeMap local_ctx;
-  string_tree_map_construct(&local_ctx);
-  const Type* type =
-      sema_get_type_of_expr_in_ctx(compiler->sema, expr, &local_ctx);
-  LLVMTypeRef llvm_type = get_llvm_type(compiler, type, &local_ctx);
-  tree_map_destroy(&local_ctx);
-  return llvm_type;
+// End the lifetimes of the locals declared in the scope being left, which are
+// the scoped allocas after the first `scope_start`. A scope left through a
+// jump has no end markers, so its locals stay live until the function returns.
+// That is only less compact, never wrong.
+static void end_scope_lifetimes(Compiler* compiler, LLVMBuilderRef builder,
+                                size_t scope_start) {
+  bool reachable = !last_instruction_is_terminator(builder);
+  for (size_t i = compiler->scoped_allocas.size; i > scope_start; --i) {
+    ScopedAlloca* scoped_alloca = vector_at(&compiler->scoped_allocas, i - 1);
+    compiler->live_stack_size =
+        compiler->live_stack_size - scoped_alloca->size;
+    if (reachable) {
+      build_lifetime_marker(compiler, builder, "llvm.lifetime.end",
+                            scoped_alloca->alloca);
+    }
+  }
+  compiler->scoped_allocas.size = scope_start;
 }
 
-// Returns a vector of LLVMValueRefs.
-// `args` is a vector of Expr* (the same as `Call::args`).
-// `func_args` is a vector of FunctionArg (same as `FunctionType::pos_args`).
-vector compile_call_args(Compiler* compiler, LLVMBuilderRef builder,
-                         const vector* args, const vector* func_args,
-                         TreeMap* local_ctx, TreeMap* local_allocas,
-                         LLVMBasicBlockRef break_bb,
-                         LLVMBasicBlockRef cont_bb) {
-  vector llvm_args;
-  vector_construct(&llvm_args, sizeof(LLVMValueRef), alignof(LLVMValueRef));
-  for (size_t i = 0; i < args->size; ++i) {
-    LLVMValueRef* storage = vector_append_storage(&llvm_args);
-    const Expr* arg = *(const Expr**)vector_at(args, i);
+static bool stmts_contain_label(const vector* stmts);
 
-    if (i < func_args->size) {
-      const FunctionArg* func_arg_ty = vector_at(func_args, i);
-      *storage =
-          compile_implicit_cast(compiler, builder, arg, func_arg_ty->type,
-                                local_ctx, local_allocas, break_bb, cont_bb);
-    } else {
-      // This should be a varargs function.
-      const Type* arg_ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, arg, local_ctx);
-      *storage =
-          compile_implicit_cast(compiler, builder, arg, arg_ty, local_ctx,
-                                local_allocas, break_bb, cont_bb);
+// Whether `stmt` has a label anywhere within it.
+static bool stmt_contains_label(const Statement* stmt) {
+  switch (stmt->vtable->kind) {
+    case SK_LabelStmt:
+      return true;
+    case SK_CompoundStmt:
+      return stmts_contain_label(&((const CompoundStmt*)stmt)->body);
+    case SK_IfStmt: {
+      const IfStmt* if_stmt = (const IfStmt*)stmt;
+      return (if_stmt->body && stmt_contains_label(if_stmt->body)) ||
+             (if_stmt->else_stmt && stmt_contains_label(if_stmt->else_stmt));
+    }
+    case SK_WhileStmt: {
+      const WhileStmt* while_stmt = (const WhileStmt*)stmt;
+      return while_stmt->body && stmt_contains_label(while_stmt->body);
     }
+    case SK_ForStmt: {
+      const ForStmt* for_stmt = (const ForStmt*)stmt;
+      return for_stmt->body && stmt_contains_label(for_stmt->body);
+    }
+    case SK_SwitchStmt: {
+      const SwitchStmt* switch_stmt = (const SwitchStmt*)stmt;
+      for (size_t i = 0; i < switch_stmt->cases.size; ++i) {
+        const SwitchCase* switch_case = vector_at(&switch_stmt->cases, i);
+        if (stmts_contain_label(&switch_case->stmts))
+          return true;
+      }
+      return switch_stmt->default_stmts &&
+             stmts_contain_label(switch_stmt->default_stmts);
+    }
+    default:
+      return false;
   }
-  return llvm_args;
 }
 
-LLVMValueRef call_llvm_debugtrap(Compiler* compiler, LLVMBuilderRef builder) {
-  // FIXME: We should be able to do `sizeof(name)`.
-  const char* name = "llvm.debugtrap";
-  unsigned intrinsic_id = LLVMLookupIntrinsicID(name, 14);
-  LLVMValueRef intrinsic = LLVMGetIntrinsicDeclaration(
-      compiler->mod, intrinsic_id, /*ParamTypes=*/NULL,
-      /*ParamCount=*/0);
-  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
-  LLVMTypeRef intrinsic_ty = LLVMIntrinsicGetType(
-      ctx, intrinsic_id, /*ParamTypes=*/NULL, /*ParamCount=*/0);
-  return LLVMBuildCall2(builder, intrinsic_ty, intrinsic,
-                        /*Args=*/NULL, /*NumArgs=*/0, "");
+static bool stmts_contain_label(const vector* stmts) {
+  for (size_t i = 0; i < stmts->size; ++i) {
+    if (stmt_contains_label(*(const Statement**)vector_at(stmts, i)))
+      return true;
+  }
+  return false;
 }
 
+// Compile a compound statement. If the body is not empty and the last statement
+// is an expression statement and `last_expr` is provided, set `last_expr` to
+// the resulting LLVMValueRef that expression compiles to.
 void compile_compound_statement(Compiler* compiler, LLVMBuilderRef builder,
                                 const CompoundStmt* compound,
                                 TreeMap* local_ctx, TreeMap* local_allocas,
                                 LLVMBasicBlockRef break_bb,
                                 LLVMBasicBlockRef cont_bb,
-                                LLVMValueRef* last_expr);
+                                LLVMValueRef* last_expr) {
+  TreeMap local_ctx_cpy;
+  TreeMap local_allocas_cpy;
+  string_tree_map_construct(&local_ctx_cpy);
+  string_tree_map_construct(&local_allocas_cpy);
+  tree_map_clone(&local_ctx_cpy, local_ctx);
+  tree_map_clone(&local_allocas_cpy, local_allocas);
 
-// Compile an expression and return it.
-//
-// The only time this function returns NULL is for a StmtExpr which can evaluate
-// to void. All other cases should return a valid LLVMValueRef.
-//
-// BasicBlocks are propagated soley for proper handling of statement expressions
-// which still need to respect semantics for `break` and `continue`.
-LLVMValueRef compile_expr(Compiler* compiler, LLVMBuilderRef builder,
-                          const Expr* expr, TreeMap* local_ctx,
-                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                          LLVMBasicBlockRef cont_bb) {
-  const Type* type =
-      sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
-  LLVMTypeRef llvm_type = get_llvm_type(compiler, type, local_ctx);
-  switch (expr->vtable->kind) {
-    case EK_String: {
-      const StringLiteral* s = (const StringLiteral*)expr;
-      return LLVMBuildGlobalString(builder, s->val, "");
-    }
-    case EK_PrettyFunction: {
-      LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-      size_t size;
-      return LLVMBuildGlobalString(builder, LLVMGetValueName2(fn, &size), "");
+  const Statement* outer_block = compiler->current_block;
+  compiler->current_block = &compound->base;
+  size_t scope_start = compiler->scoped_allocas.size;
+  for (size_t i = 0; i < compound->body.size; ++i) {
+    Statement* stmt = *(Statement**)vector_at(&compound->body, i);
+    if (last_instruction_is_terminator(builder)) {
+      // Anything after a terminator can only be reached through a label.
+      if (!stmt_has_label(stmt))
+        continue;
+      if (stmt->vtable->kind != SK_LabelStmt)
+        position_at_unreachable_block(compiler, builder);
     }
-    case EK_Int: {
-      const Int* i = (const Int*)expr;
-      bool has_sign = !is_unsigned_integral_type(&i->type.type);
-      assert(LLVMGetTypeKind(llvm_type) == LLVMIntegerTypeKind &&
-             LLVMGetIntTypeWidth(llvm_type) > 0);
-      return LLVMConstInt(llvm_type, i->val, has_sign);
+    compiler->in_scope_declaration = stmt->vtable->kind == SK_Declaration;
+    compile_statement(compiler, builder, stmt, &local_ctx_cpy,
+                      &local_allocas_cpy, break_bb, cont_bb, last_expr);
+  }
+  end_scope_lifetimes(compiler, builder, scope_start);
+  compiler->current_block = outer_block;
+
+  tree_map_destroy(&local_ctx_cpy);
+  tree_map_destroy(&local_allocas_cpy);
+  return;
+}
+
+// Local aggregate initializers which are entirely constant and need more than
+// this many stores after zeroing are instead copied from a private constant
+// global.
+static const size_t kMaxLocalInitializerStores = 6;
+
+static bool is_zero_initializer(const Expr* init) {
+  switch (init->vtable->kind) {
+    case EK_Int:
+      return ((const Int*)init)->val == 0;
+    case EK_Char:
+      return ((const Char*)init)->val == 0;
+    case EK_Cast:
+      return is_zero_initializer(((const Cast*)init)->base);
+    default:
+      return false;
+  }
+}
+
+// Count the stores needed for `init` when the object is zeroed beforehand.
+static size_t count_initializer_stores(const Expr* init) {
+  size_t count = 0;
+  if (init->vtable->kind != EK_InitializerList) {
+    if (!is_zero_initializer(init))
+      ++count;
+    return count;
+  }
+
+  const InitializerList* list = (const InitializerList*)init;
+  for (size_t i = 0; i < list->elems.size; ++i) {
+    const InitializerListElem* elem = vector_at(&list->elems, i);
+    count += count_initializer_stores(elem->expr);
+  }
+  return count;
+}
+
+// Returns true if `init` for an object of `type` can be lowered with
+// compile_constant_expr.
+static bool is_constant_initializer(Compiler* compiler, const Expr* init,
+                                    const Type* type,
+                                    const TreeMap* local_ctx) {
+  switch (init->vtable->kind) {
+    case EK_Int:
+    case EK_Float:
+    case EK_Char:
+    case EK_SizeOf:
+    case EK_String:
+    case EK_AddrOfLabel:
+      return true;
+    case EK_Cast: {
+      const Cast* cast = (const Cast*)init;
+      return cast->base->vtable->kind == EK_Int &&
+             sema_is_pointer_type(compiler->sema, cast->to, local_ctx);
     }
-    case EK_Bool: {
-      const Bool* b = (const Bool*)expr;
-      return LLVMConstInt(llvm_type, b->val, /*UsSugbed=*/false);
+    case EK_UnOp: {
+      const UnOp* unop = (const UnOp*)init;
+      return unop->op == UOK_Negate &&
+             (unop->subexpr->vtable->kind == EK_Int ||
+              unop->subexpr->vtable->kind == EK_Float);
     }
-    case EK_Char: {
-      const Char* c = (const Char*)expr;
-      assert(c->val >= 0);
-      return LLVMConstInt(llvm_type, (unsigned long long)c->val,
-                          /*UsSugbed=*/false);
+    case EK_InitializerList:
+      break;
+    default:
+      return false;
+  }
+
+  const InitializerList* list = (const InitializerList*)init;
+  const ArrayType* arr_ty =
+      sema_get_array_type(compiler->sema, type, local_ctx);
+  if (arr_ty) {
+    for (size_t i = 0; i < list->elems.size; ++i) {
+      const InitializerListElem* elem = vector_at(&list->elems, i);
+      if (!is_constant_initializer(compiler, elem->expr, arr_ty->elem_type,
+                                   local_ctx))
+        return false;
     }
-    case EK_SizeOf: {
-      ConstExprResult res = sema_eval_sizeof_in_ctx(
-          compiler->sema, (const SizeOf*)expr, local_ctx);
-      assert(res.result_kind == RK_UnsignedLongLong);
-      return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
+    return true;
+  }
+
+  const StructType* struct_ty =
+      sema_get_struct_type(compiler->sema, type, local_ctx);
+  if (!struct_ty)
+    return false;
+
+  struct_ty = sema_resolve_struct_type(compiler->sema, struct_ty);
+  size_t idx = 0;
+  for (size_t i = 0; i < list->elems.size; ++i) {
+    const InitializerListElem* elem = vector_at(&list->elems, i);
+    if (elem->name)
+      struct_get_member(struct_ty, elem->name, &idx);
+    else
+      idx = skip_unnamed_members(struct_ty, idx);
+
+    const Member* member = struct_get_nth_member(struct_ty, idx);
+    if (!is_constant_initializer(compiler, elem->expr, member->type,
+                                 local_ctx))
+      return false;
+    ++idx;
+  }
+  return true;
+}
+
+static void compile_local_initializer(
+    Compiler* compiler, LLVMBuilderRef builder, const Type* type,
+    LLVMValueRef ptr, const Expr* init, TreeMap* local_ctx,
+    TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+    LLVMBasicBlockRef cont_bb);
+
+// Store each element of `init` into the already zeroed object of `type` at
+// `ptr`.
+static void compile_local_initializer_list(
+    Compiler* compiler, LLVMBuilderRef builder, const Type* type,
+    LLVMValueRef ptr, const InitializerList* init, TreeMap* local_ctx,
+    TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+    LLVMBasicBlockRef cont_bb) {
+  // Vectors in memory are laid out like arrays of their elements.
+  const Type* elem_ty = NULL;
+  const ArrayType* arr_ty =
+      sema_get_array_type(compiler->sema, type, local_ctx);
+  const VectorType* vec_ty =
+      sema_get_vector_type(compiler->sema, type, local_ctx);
+  if (arr_ty)
+    elem_ty = arr_ty->elem_type;
+  else if (vec_ty)
+    elem_ty = vec_ty->elem_type;
+
+  if (elem_ty) {
+    size_t max_len;
+    size_t* indices =
+        get_array_initializer_indices(compiler, init, local_ctx, &max_len);
+    if (vec_ty) {
+      ASSERT_MSG(
+          max_len <= sema_get_vector_length(compiler->sema, vec_ty, local_ctx),
+          "Excess elements in vector initializer");
     }
-    case EK_AlignOf: {
-      ConstExprResult res = sema_eval_alignof_in_ctx(
-          compiler->sema, (const AlignOf*)expr, local_ctx);
-      assert(res.result_kind == RK_UnsignedLongLong);
-      return LLVMConstInt(llvm_type, res.result.ull, /*IsSigned=*/0);
+    LLVMTypeRef llvm_elem_ty = get_llvm_type(compiler, elem_ty, local_ctx);
+    for (size_t i = 0; i < init->elems.size; ++i) {
+      const InitializerListElem* elem = vector_at(&init->elems, i);
+      if (is_zero_initializer(elem->expr))
+        continue;
+
+      LLVMValueRef offsets[] = {LLVMConstInt(get_llvm_ptr_as_int(compiler),
+                                             indices[i], /*IsSigned=*/0)};
+      LLVMValueRef gep =
+          LLVMBuildGEP2(builder, llvm_elem_ty, ptr, offsets, 1, "");
+      compile_local_initializer(compiler, builder, elem_ty, gep, elem->expr,
+                                local_ctx, local_allocas, break_bb, cont_bb);
     }
-    case EK_UnOp:
-      return compile_unop(compiler, builder, (const UnOp*)expr, local_ctx,
-                          local_allocas, break_bb, cont_bb);
-    case EK_BinOp:
-      return compile_binop(compiler, builder, (const BinOp*)expr, local_ctx,
-                           local_allocas, break_bb, cont_bb);
-    case EK_DeclRef: {
-      const DeclRef* decl = (const DeclRef*)expr;
+    free(indices);
+    return;
+  }
 
-      LLVMValueRef val = NULL;
-      bool is_func = LLVMGetTypeKind(llvm_type) == LLVMFunctionTypeKind;
-      if (is_func && !tree_map_get(local_allocas, decl->name, (void*)&val)) {
-        LLVMValueRef val = LLVMGetNamedFunction(compiler->mod, decl->name);
-        assert(val);
-        return val;
-      }
+  const Type* resolved = sema_resolve_maybe_named_type(compiler->sema, type);
+  if (resolved->vtable->kind == TK_UnionType) {
+    // Only one member of a union can be initialized and it's always at the
+    // start of the union.
+    const UnionType* union_ty = sema_resolve_union_type(
+        compiler->sema, (const UnionType*)resolved);
+    assert(init->elems.size <= 1);
+    if (init->elems.size == 0)
+      return;
 
-      const Type* decl_ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
-      if (decl_ty->vtable->kind == TK_EnumType) {
-        void* enum_val;
-        if (tree_map_get(&compiler->sema->enum_values, decl->name, &enum_val)) {
-          LLVMTypeRef enum_ty =
-              get_llvm_type_of_expr(compiler, expr, local_ctx);
-          return LLVMConstInt(enum_ty, (uintptr_t)enum_val, /*signed=*/1);
-        }
+    const InitializerListElem* elem = vector_at(&init->elems, 0);
+    const Member* member;
+    if (elem->name) {
+      size_t offset;
+      member = union_get_member(union_ty, elem->name, &offset);
+    } else {
+      member = vector_at(union_ty->members, 0);
+    }
+    if (!is_zero_initializer(elem->expr)) {
+      compile_local_initializer(compiler, builder, member->type, ptr,
+                                elem->expr, local_ctx, local_allocas, break_bb,
+                                cont_bb);
+    }
+    return;
+  }
 
-        UNREACHABLE_MSG("Couldn't find value for enum member '%s'", decl->name);
+  const StructType* struct_ty =
+      sema_get_struct_type(compiler->sema, type, local_ctx);
+  assert(struct_ty);
+  struct_ty = sema_resolve_struct_type(compiler->sema, struct_ty);
+  LLVMTypeRef llvm_struct_ty =
+      get_llvm_type(compiler, &struct_ty->type, local_ctx);
+
+  size_t idx = 0;
+  for (size_t i = 0; i < init->elems.size; ++i) {
+    const InitializerListElem* elem = vector_at(&init->elems, i);
+    if (elem->name)
+      struct_get_member(struct_ty, elem->name, &idx);
+    else
+      idx = skip_unnamed_members(struct_ty, idx);
+    ASSERT_MSG(idx < struct_ty->members->size,
+               "Excess elements in struct initializer");
+
+    if (!is_zero_initializer(elem->expr)) {
+      const Member* member = struct_get_nth_member(struct_ty, idx);
+      LLVMValueRef gep = LLVMBuildStructGEP2(
+          builder, llvm_struct_ty, ptr,
+          get_struct_member_field(compiler, struct_ty, idx, local_ctx), "");
+      LValueAccess access;
+      get_struct_member_access(compiler, struct_ty, idx, &access, local_ctx);
+      if (access.storage_ty) {
+        LLVMValueRef val = compile_implicit_cast(
+            compiler, builder, elem->expr, member->type, local_ctx,
+            local_allocas, break_bb, cont_bb);
+        build_bitfield_insert(compiler, builder, &access, val, gep);
+      } else {
+        compile_local_initializer(compiler, builder, member->type, gep,
+                                  elem->expr, local_ctx, local_allocas,
+                                  break_bb, cont_bb);
       }
+    }
+    ++idx;
+  }
+}
 
-      val = compile_lvalue_ptr(compiler, builder, expr, local_ctx,
-                               local_allocas, break_bb, cont_bb);
+// Initialize the char array of `type` at `ptr` from the string `s`. The
+// string is copied from its pooled constant and any remaining tail of the
+// array is zeroed, rather than storing the whole array as one constant.
+static void compile_local_string_initializer(Compiler* compiler,
+                                             LLVMBuilderRef builder,
+                                             const Type* type, LLVMValueRef ptr,
+                                             const StringLiteral* s,
+                                             TreeMap* local_ctx) {
+  const ArrayType* arr_ty =
+      sema_get_array_type(compiler->sema, type, local_ctx);
+  size_t copy_len = strlen(s->val) + 1;
+  size_t len = copy_len;
+  if (arr_ty->size)
+    len = get_constant_array_length(compiler, arr_ty, local_ctx);
+  if (copy_len > len)
+    copy_len = len;
+
+  size_t align = sema_eval_alignof_type(compiler->sema, type, local_ctx);
+  LLVMTypeRef size_ty = get_llvm_ptr_as_int(compiler);
+  LLVMBuildMemCpy(builder, ptr, (unsigned)align,
+                  get_string_literal(compiler, s->val), /*SrcAlign=*/1,
+                  LLVMConstInt(size_ty, copy_len, /*IsSigned=*/0));
+  if (copy_len == len)
+    return;
 
-      if (sema_is_array_type(compiler->sema, decl_ty, local_ctx))
-        return val;
+  LLVMValueRef offsets[] = {LLVMConstInt(size_ty, copy_len, /*IsSigned=*/0)};
+  LLVMValueRef tail =
+      LLVMBuildInBoundsGEP2(builder, LLVMInt8TypeInContext(compiler->ctx),
+                            ptr, offsets, 1, "");
+  LLVMBuildMemSet(builder, tail,
+                  LLVMConstNull(LLVMInt8TypeInContext(compiler->ctx)),
+                  LLVMConstInt(size_ty, len - copy_len, /*IsSigned=*/0),
+                  /*Align=*/1);
+}
 
-      return get_aligned_load(compiler, builder, type, val, "", local_ctx);
-    }
-    case EK_Call: {
-      const Call* call = (const Call*)expr;
-      if (call->base->vtable->kind == EK_DeclRef) {
-        const DeclRef* decl = (const DeclRef*)call->base;
-        if (strcmp(decl->name, "__builtin_trap") == 0)
-          return call_llvm_debugtrap(compiler, builder);
-      }
+// Initialize the object of `type` at `ptr` with `init`. Initializer lists
+// expect the object to already be zeroed.
+static void compile_local_initializer(
+    Compiler* compiler, LLVMBuilderRef builder, const Type* type,
+    LLVMValueRef ptr, const Expr* init, TreeMap* local_ctx,
+    TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+    LLVMBasicBlockRef cont_bb) {
+  if (init->vtable->kind == EK_InitializerList) {
+    compile_local_initializer_list(compiler, builder, type, ptr,
+                                   (const InitializerList*)init, local_ctx,
+                                   local_allocas, break_bb, cont_bb);
+    return;
+  }
 
-      const Type* ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, call->base, local_ctx);
-      const FunctionType* func_ty =
-          sema_get_function(compiler->sema, ty, local_ctx);
-      LLVMTypeRef llvm_func_ty =
-          get_llvm_type(compiler, &func_ty->type, local_ctx);
-      LLVMValueRef llvm_func =
-          compile_expr(compiler, builder, call->base, local_ctx, local_allocas,
-                       break_bb, cont_bb);
-
-      vector llvm_args =
-          compile_call_args(compiler, builder, &call->args, &func_ty->pos_args,
-                            local_ctx, local_allocas, break_bb, cont_bb);
+  if (init->vtable->kind == EK_String &&
+      sema_is_array_type(compiler->sema, type, local_ctx)) {
+    compile_local_string_initializer(compiler, builder, type, ptr,
+                                     (const StringLiteral*)init, local_ctx);
+    return;
+  }
 
-      LLVMValueRef res =
-          LLVMBuildCall2(builder, llvm_func_ty, llvm_func, llvm_args.data,
-                         (unsigned)llvm_args.size, "");
+  if (is_aggregate_type(compiler, type) &&
+      has_lvalue_ptr(compiler, init, local_allocas)) {
+    LLVMValueRef src = compile_lvalue_ptr(compiler, builder, init, local_ctx,
+                                          local_allocas, break_bb, cont_bb);
+    build_aggregate_copy(compiler, builder, type, ptr, src, local_ctx);
+    return;
+  }
 
-      LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
-      LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-      LLVMMetadataRef local_scope = LLVMGetSubprogram(fn);
-      assert(local_scope);
+  LLVMValueRef val = compile_implicit_cast(compiler, builder, init, type,
+                                           local_ctx, local_allocas, break_bb,
+                                           cont_bb);
+  get_aligned_store(compiler, builder, type, val, ptr, local_ctx);
+}
+
+// Initialize a local aggregate at `ptr` of `size` bytes from an initializer
+// list. The object is zeroed with a memset followed by stores for each
+// non-zero element. Large constant initializers are copied from a private
+// global instead.
+static void compile_local_aggregate_initializer(
+    Compiler* compiler, LLVMBuilderRef builder, const Type* type,
+    LLVMValueRef ptr, size_t size, const InitializerList* init,
+    TreeMap* local_ctx, TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+    LLVMBasicBlockRef cont_bb) {
+  size_t align = sema_eval_alignof_type(compiler->sema, type, local_ctx);
+  LLVMValueRef llvm_size =
+      LLVMConstInt(get_llvm_ptr_as_int(compiler), size, /*IsSigned=*/0);
+
+  if (count_initializer_stores(&init->expr) > kMaxLocalInitializerStores &&
+      is_constant_initializer(compiler, &init->expr, type, local_ctx)) {
+    LLVMValueRef val = maybe_compile_constant_implicit_cast(
+        compiler, &init->expr, type, local_ctx);
+    LLVMValueRef glob = LLVMAddGlobal(compiler->mod, LLVMTypeOf(val), "");
+    LLVMSetInitializer(glob, val);
+    LLVMSetGlobalConstant(glob, 1);
+    LLVMSetLinkage(glob, LLVMPrivateLinkage);
+    LLVMSetUnnamedAddress(glob, LLVMGlobalUnnamedAddr);
+    LLVMSetAlignment(glob, (unsigned)align);
+    LLVMBuildMemCpy(builder, ptr, (unsigned)align, glob, (unsigned)align,
+                    llvm_size);
+    return;
+  }
 
-      // TODO: Fill these in with correct values.
-      LLVMMetadataRef debug_loc = LLVMDIBuilderCreateDebugLocation(
-          ctx, (unsigned)source_location_line(&expr->loc),
-          (unsigned)source_location_col(&expr->loc), local_scope,
-          /*InlinedAt=*/NULL);
-      LLVMInstructionSetDebugLoc(res, debug_loc);
+  LLVMBuildMemSet(builder, ptr,
+                  LLVMConstNull(LLVMInt8TypeInContext(compiler->ctx)),
+                  llvm_size, (unsigned)align);
+  compile_local_initializer_list(compiler, builder, type, ptr, init,
+                                 local_ctx, local_allocas, break_bb, cont_bb);
+}
 
-      vector_destroy(&llvm_args);
+// Compile a compound statement. If the statement is an expression statement and
+// `last_expr` is provided, set `last_expr` to the resulting LLVMValueRef that
+// expression compiles to.
+void compile_statement(Compiler* compiler, LLVMBuilderRef builder,
+                       const Statement* stmt, TreeMap* local_ctx,
+                       TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
+                       LLVMBasicBlockRef cont_bb, LLVMValueRef* last_expr) {
+  switch (stmt->vtable->kind) {
+    case SK_ExprStmt: {
+      const Expr* expr = ((const ExprStmt*)stmt)->expr;
+      if (!last_expr &&
+          is_aggregate_assign(compiler, expr, local_ctx, local_allocas)) {
+        // The result is unused, so don't load the copied aggregate back.
+        compile_aggregate_assign(compiler, builder, (const BinOp*)expr,
+                                 local_ctx, local_allocas, break_bb, cont_bb);
+        return;
+      }
 
-      return res;
+      LLVMValueRef val = compile_expr(compiler, builder, expr, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
+      if (last_expr)
+        *last_expr = val;
+      return;
     }
-    case EK_MemberAccess: {
-      const MemberAccess* access = (const MemberAccess*)expr;
-      const StructType* base_ty = sema_get_struct_type_from_member_access(
-          compiler->sema, access, local_ctx);
-      size_t offset;
-      const Member* member = sema_get_struct_member(compiler->sema, base_ty,
-                                                    access->member, &offset);
+    case SK_IfStmt:
+      return compile_if_statement(compiler, builder, (const IfStmt*)stmt,
+                                  local_ctx, local_allocas, break_bb, cont_bb);
+    case SK_WhileStmt:
+      return compile_while_statement(compiler, builder, (const WhileStmt*)stmt,
+                                     local_ctx, local_allocas, break_bb,
+                                     cont_bb);
+    case SK_ForStmt:
+      return compile_for_statement(compiler, builder, (const ForStmt*)stmt,
+                                   local_ctx, local_allocas, break_bb, cont_bb);
+    case SK_ReturnStmt: {
+      const ReturnStmt* ret = (const ReturnStmt*)stmt;
+      if (ret->musttail) {
+        sema_verify_musttail_return(compiler->sema,
+                                    compiler->current_function_type, ret,
+                                    local_ctx);
+      }
+      if (!ret->expr) {
+        LLVMBuildRetVoid(builder);
+        return;
+      }
 
-      LLVMValueRef ptr;
-      if (access->is_arrow) {
-        ptr = compile_expr(compiler, builder, access->base, local_ctx,
+      if (compiler->current_return.kind != AK_Direct) {
+        ASSERT_MSG(!ret->musttail,
+                   "'musttail' calls cannot return aggregates in memory or "
+                   "registers");
+        compile_abi_return(compiler, builder, ret->expr, local_ctx,
                            local_allocas, break_bb, cont_bb);
-        LLVMTypeRef llvm_base_ty =
-            get_llvm_type(compiler, &base_ty->type, local_ctx);
-        LLVMValueRef llvm_offset =
-            LLVMConstInt(LLVMInt32Type(), offset, /*signed=*/0);
-        LLVMValueRef offsets[] = {LLVMConstNull(LLVMInt32Type()), llvm_offset};
-        ptr = LLVMBuildGEP2(builder, llvm_base_ty, ptr, offsets, 2, "");
-      } else {
-        ptr = compile_lvalue_ptr(compiler, builder, expr, local_ctx,
-                                 local_allocas, break_bb, cont_bb);
+        return;
       }
-      return get_aligned_load(compiler, builder, member->type, ptr, "",
-                              local_ctx);
+
+      LLVMValueRef val = compile_expr(compiler, builder, ret->expr, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
+      add_tail_call_candidate(compiler, builder, val, ret->musttail);
+
+      // TODO: There should be an ImplicitCast AST node that we can parser over
+      // rather than doing this here.
+
+      const Type* expr_ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, ret->expr, local_ctx);
+      if (is_void_type(expr_ty))
+        LLVMBuildRetVoid(builder);
+      else
+        LLVMBuildRet(builder, val);
+      return;
     }
-    case EK_Conditional: {
-      const Conditional* conditional = (const Conditional*)expr;
-      return compile_conditional(compiler, builder, conditional, local_ctx,
-                                 local_allocas, break_bb, cont_bb);
+    case SK_ContinueStmt: {
+      LLVMBuildBr(builder, cont_bb);
+      return;
     }
-    case EK_Cast: {
-      const Cast* cast = (const Cast*)expr;
-      return compile_implicit_cast(compiler, builder, cast->base, cast->to,
-                                   local_ctx, local_allocas, break_bb, cont_bb);
+    case SK_BreakStmt: {
+      LLVMBuildBr(builder, break_bb);
+      return;
     }
-    case EK_Index: {
-      LLVMValueRef ptr = compile_lvalue_ptr(compiler, builder, expr, local_ctx,
-                                            local_allocas, break_bb, cont_bb);
-      const Type* ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
-      return get_aligned_load(compiler, builder, ty, ptr, "", local_ctx);
+    case SK_LabelStmt: {
+      const LabelStmt* label_stmt = (const LabelStmt*)stmt;
+      Label* label = get_label(compiler, label_stmt->name);
+      ASSERT_MSG(!label->defined, "%zu:%zu: Redefinition of label '%s'",
+                 source_location_line(&stmt->loc),
+                 source_location_col(&stmt->loc), label_stmt->name);
+      label->defined = true;
+
+      // Fall through into the label.
+      LLVMBasicBlockRef current_bb = LLVMGetInsertBlock(builder);
+      if (!last_instruction_is_terminator(builder))
+        LLVMBuildBr(builder, label->bb);
+      LLVMMoveBasicBlockAfter(label->bb, current_bb);
+      LLVMPositionBuilderAtEnd(builder, label->bb);
+
+      if (label_stmt->stmt) {
+        compile_statement(compiler, builder, label_stmt->stmt, local_ctx,
+                          local_allocas, break_bb, cont_bb, last_expr);
+      }
+      return;
     }
-    case EK_StmtExpr: {
-      const StmtExpr* stmt_expr = (const StmtExpr*)expr;
-      if (!stmt_expr->stmt)
-        return NULL;
+    case SK_GotoStmt: {
+      const GotoStmt* goto_stmt = (const GotoStmt*)stmt;
+      LLVMBuildBr(builder, get_label(compiler, goto_stmt->label)->bb);
+      return;
+    }
+    case SK_IndirectGotoStmt: {
+      const IndirectGotoStmt* goto_stmt = (const IndirectGotoStmt*)stmt;
+      LLVMValueRef target =
+          compile_expr(compiler, builder, goto_stmt->target, local_ctx,
+                       local_allocas, break_bb, cont_bb);
+      LLVMValueRef indirect_goto =
+          LLVMBuildIndirectBr(builder, target, /*NumDests=*/0);
+      LLVMValueRef* storage = vector_append_storage(&compiler->indirect_gotos);
+      *storage = indirect_goto;
+      return;
+    }
+    case SK_CompoundStmt:
+      return compile_compound_statement(
+          compiler, builder, (const CompoundStmt*)stmt, local_ctx,
+          local_allocas, break_bb, cont_bb, /*last_expr=*/NULL);
+    case SK_Declaration: {
+      const Declaration* decl = (const Declaration*)stmt;
+      maybe_add_restrict_local(compiler, decl, local_ctx);
 
-      assert(stmt_expr->stmt->body.size > 0);
-      LLVMValueRef expr = NULL;
-      compile_compound_statement(compiler, builder, stmt_expr->stmt, local_ctx,
-                                 local_allocas, break_bb, cont_bb, &expr);
-      return expr;
+      // The size of an array without one comes from its initializer.
+      LLVMTypeRef llvm_ty = NULL;
+      size_t agg_size = 0;
+      const ArrayType* arr_ty =
+          sema_get_array_type(compiler->sema, decl->type, local_ctx);
+      if (arr_ty && !arr_ty->size) {
+        assert(decl->initializer);
+
+        size_t len;
+        if (decl->initializer->vtable->kind == EK_InitializerList) {
+          size_t* indices = get_array_initializer_indices(
+              compiler, (const InitializerList*)decl->initializer, local_ctx,
+              &len);
+          free(indices);
+        } else {
+          assert(decl->initializer->vtable->kind == EK_String);
+          len = strlen(((const StringLiteral*)decl->initializer)->val) + 1;
+        }
+
+        LLVMTypeRef elem_ty =
+            get_llvm_type(compiler, arr_ty->elem_type, local_ctx);
+        llvm_ty = LLVMArrayType(elem_ty, (unsigned)len);
+        agg_size = sema_eval_sizeof_type(compiler->sema, arr_ty->elem_type,
+                                         local_ctx) *
+                   len;
+      } else {
+        llvm_ty = get_llvm_type(compiler, decl->type, local_ctx);
+      }
+
+      bool has_init_list =
+          decl->initializer &&
+          decl->initializer->vtable->kind == EK_InitializerList;
+      if (!has_init_list &&
+          is_promotable_local(compiler, decl->name, decl->type)) {
+        SSAVariable* var =
+            ssa_create_variable(compiler->ssa, decl->name, llvm_ty);
+        if (decl->initializer) {
+          LLVMValueRef init = compile_implicit_cast(
+              compiler, builder, decl->initializer, decl->type, local_ctx,
+              local_allocas, break_bb, cont_bb);
+          ssa_write_variable(var, LLVMGetInsertBlock(builder), init);
+        }
+
+        tree_map_set(local_allocas, decl->name, var);
+        tree_map_set(local_ctx, decl->name, decl->type);
+        return;
+      }
+
+      LLVMValueRef alloca = build_alloca_at_func_start(
+          compiler, builder, decl->name, decl->type, llvm_ty, local_ctx);
+      start_local_lifetime(compiler, builder, alloca);
+
+      if (has_init_list) {
+        if (!agg_size) {
+          agg_size =
+              sema_eval_sizeof_type(compiler->sema, decl->type, local_ctx);
+        }
+        compile_local_aggregate_initializer(
+            compiler, builder, decl->type, alloca, agg_size,
+            (const InitializerList*)decl->initializer, local_ctx,
+            local_allocas, break_bb, cont_bb);
+      } else if (decl->initializer) {
+        compile_local_initializer(compiler, builder, decl->type, alloca,
+                                  decl->initializer, local_ctx, local_allocas,
+                                  break_bb, cont_bb);
+      }
+
+      // Note this may override allocas and types declared in a higher scope,
+      // but this should be ok since we should've cloned any local contexts
+      // before entering a lower scope.
+      tree_map_set(local_allocas, decl->name, alloca);
+      tree_map_set(local_ctx, decl->name, decl->type);
+
+      return;
+    }
+    case SK_SwitchStmt: {
+      const SwitchStmt* switch_stmt = (const SwitchStmt*)stmt;
+      compile_switch_statement(compiler, builder, switch_stmt, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+      return;
     }
     default:
-      UNREACHABLE_MSG("TODO: Implement compile_expr for this expr %d",
-                      expr->vtable->kind);
+      UNREACHABLE_MSG("TODO: Implement compile_statement for this stmt %d",
+                      stmt->vtable->kind);
   }
 }
 
-void compile_statement(Compiler* compiler, LLVMBuilderRef builder,
-                       const Statement* stmt, TreeMap* local_ctx,
-                       TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                       LLVMBasicBlockRef cont_bb, LLVMValueRef* last_expr);
+LLVMMetadataRef get_di_function_type(Compiler* compiler,
+                                     const FunctionType* func_ty) {
+  vector args;
+  vector_construct(&args, sizeof(LLVMMetadataRef), alignof(LLVMMetadataRef));
 
-void compile_if_statement(Compiler* compiler, LLVMBuilderRef builder,
-                          const IfStmt* stmt, TreeMap* local_ctx,
-                          TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                          LLVMBasicBlockRef cont_bb) {
-  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
-  LLVMValueRef cond = compile_to_bool(compiler, builder, stmt->cond, local_ctx,
-                                      local_allocas, break_bb, cont_bb);
+  for (size_t i = 0; i < func_ty->pos_args.size; ++i) {
+    LLVMMetadataRef* arg_md = vector_append_storage(&args);
+    // TODO: Use the correct type.
+    *arg_md = LLVMDIBuilderCreateUnspecifiedType(
+        compiler->dibuilder, /*Name=*/"TODO", /*NameLen=*/4);
+  }
+
+  LLVMMetadataRef md = LLVMDIBuilderCreateSubroutineType(
+      compiler->dibuilder, compiler->difile, args.data,
+      (unsigned)func_ty->pos_args.size, /*Flags=*/0);
+  vector_destroy(&args);
+  return md;
+}
 
-  assert(LLVMGetTypeKind(LLVMTypeOf(cond)) == LLVMIntegerTypeKind);
-  assert(LLVMGetIntTypeWidth(LLVMTypeOf(cond)) == 1);
+bool function_has_internal_linkage(const FunctionDefinition* f) {
+  return !f->is_extern;
+}
 
-  // Create blocks for the then and else cases. Insert the 'if' block at the
-  // end of the function.
-  LLVMBasicBlockRef ifbb = LLVMAppendBasicBlockInContext(ctx, fn, "if");
-  LLVMBasicBlockRef elsebb = LLVMCreateBasicBlockInContext(ctx, "else");
-  LLVMBasicBlockRef mergebb = LLVMCreateBasicBlockInContext(ctx, "merge");
+bool global_has_internal_linkage(const GlobalVariable* gv) {
+  return gv->initializer && !gv->is_extern;
+}
 
-  LLVMBuildCondBr(builder, cond, ifbb, elsebb);
+static void add_string_attribute(Compiler* compiler, LLVMValueRef func,
+                                 const char* kind, const char* value) {
+  LLVMAttributeRef attr = LLVMCreateStringAttribute(
+      compiler->ctx, kind, (unsigned)strlen(kind), value,
+      (unsigned)strlen(value));
+  LLVMAddAttributeAtIndex(func, LLVMAttributeFunctionIndex, attr);
+}
 
-  // Emit if BB.
-  LLVMPositionBuilderAtEnd(builder, ifbb);
+static void add_target_attributes(Compiler* compiler, LLVMValueRef func) {
+  const TargetOptions* target = compiler->target;
+  add_string_attribute(compiler, func, "target-cpu", target->cpu);
+  if (target->tune_cpu)
+    add_string_attribute(compiler, func, "tune-cpu", target->tune_cpu);
+  if (target->features[0])
+    add_string_attribute(compiler, func, "target-features", target->features);
+}
 
-  if (stmt->body) {
-    TreeMap local_ctx_cpy;
-    TreeMap local_allocas_cpy;
-    string_tree_map_construct(&local_ctx_cpy);
-    string_tree_map_construct(&local_allocas_cpy);
-    tree_map_clone(&local_ctx_cpy, local_ctx);
-    tree_map_clone(&local_allocas_cpy, local_allocas);
+// The backend reads its floating point options from these attributes, so they
+// still apply when functions are only compiled after LTO. LLVM has no C API for
+// the fast-math flags of individual instructions.
+static void add_fast_math_attributes(Compiler* compiler, LLVMValueRef func) {
+  if (!compiler->target->fast_math)
+    return;
 
-    compile_statement(compiler, builder, stmt->body, &local_ctx_cpy,
-                      &local_allocas_cpy, break_bb, cont_bb,
-                      /*last_expr=*/NULL);
+  const char* kinds[] = {"no-infs-fp-math", "no-nans-fp-math",
+                         "no-signed-zeros-fp-math", "approx-func-fp-math",
+                         "no-trapping-math"};
+  for (size_t i = 0; i < 5; ++i)
+    add_string_attribute(compiler, func, kinds[i], "true");
 
-    tree_map_destroy(&local_ctx_cpy);
-    tree_map_destroy(&local_allocas_cpy);
-  }
+  // This also lets the backend fuse any multiply feeding an add.
+  if (compiler->target->fp_contract == FPC_Fast)
+    add_string_attribute(compiler, func, "unsafe-fp-math", "true");
+}
 
-  LLVMBasicBlockRef last_bb = LLVMGetInsertBlock(builder);
-  LLVMValueRef last = LLVMGetLastInstruction(last_bb);
-  bool all_branches_terminate = true;
-  if (!last || !LLVMIsATerminatorInst(last)) {
-    LLVMBuildBr(builder, mergebb);
-    all_branches_terminate = false;
+static void add_enum_attribute(Compiler* compiler, LLVMValueRef func,
+                               LLVMAttributeIndex idx, const char* kind) {
+  LLVMAddAttributeAtIndex(func, idx,
+                          create_enum_attribute(compiler, kind, /*val=*/0));
+}
+
+// `pure` functions only read memory and `const` functions don't access it at
+// all. LLVM 16 expresses this with the `memory` attribute while older versions
+// use `readonly` and `readnone`.
+static void add_memory_attribute(Compiler* compiler, LLVMValueRef func,
+                                 bool reads) {
+  if (!LLVMGetEnumAttributeKindForName("memory", 6)) {
+    const char* kind = "readnone";
+    if (reads)
+      kind = "readonly";
+    add_enum_attribute(compiler, func, LLVMAttributeFunctionIndex, kind);
+    return;
   }
 
-  // Emit potential else BB.
-  LLVMAppendExistingBasicBlock(fn, elsebb);
-  LLVMPositionBuilderAtEnd(builder, elsebb);
-  if (stmt->else_stmt) {
-    {
-      TreeMap local_ctx_cpy;
-      TreeMap local_allocas_cpy;
-      string_tree_map_construct(&local_ctx_cpy);
-      string_tree_map_construct(&local_allocas_cpy);
-      tree_map_clone(&local_ctx_cpy, local_ctx);
-      tree_map_clone(&local_allocas_cpy, local_allocas);
+  // The argument, inaccessible and other memory locations each get two bits
+  // where the low bit allows reads and the high bit allows writes.
+  uint64_t effects = 0;
+  if (reads)
+    effects = 21;  // 0b010101
+  LLVMAddAttributeAtIndex(func, LLVMAttributeFunctionIndex,
+                          create_enum_attribute(compiler, "memory", effects));
+}
 
-      compile_statement(compiler, builder, stmt->else_stmt, local_ctx,
-                        local_allocas, break_bb, cont_bb, /*last_expr=*/NULL);
+// Map the attributes of a function declaration or definition onto `func`. A
+// function can be declared multiple times, so this adds to the attributes of
+// earlier declarations.
+static void add_function_attributes(Compiler* compiler, LLVMValueRef func,
+                                    const char* name,
+                                    const FunctionType* func_ty,
+                                    const DeclAttributes* attrs,
+                                    const TreeMap* local_ctx) {
+  ASSERT_MSG(!attrs->always_inline || !attrs->noinline,
+             "'%s' cannot be both always_inline and noinline", name);
+  ASSERT_MSG(!attrs->hot || !attrs->cold,
+             "'%s' cannot be both hot and cold", name);
+
+  LLVMAttributeIndex fn_idx = LLVMAttributeFunctionIndex;
+  if (attrs->always_inline)
+    add_enum_attribute(compiler, func, fn_idx, "alwaysinline");
+  else if (attrs->inline_)
+    add_enum_attribute(compiler, func, fn_idx, "inlinehint");
+  if (attrs->noinline)
+    add_enum_attribute(compiler, func, fn_idx, "noinline");
+  if (attrs->hot)
+    add_enum_attribute(compiler, func, fn_idx, "hot");
+  if (attrs->cold)
+    add_enum_attribute(compiler, func, fn_idx, "cold");
+  if (attrs->noreturn)
+    add_enum_attribute(compiler, func, fn_idx, "noreturn");
+
+  FunctionABI abi;
+  get_function_abi(compiler, func_ty, local_ctx, &abi);
+  add_abi_attributes(compiler, func, &abi, local_ctx);
+
+  // A value returned through `sret` is written to memory, and arguments
+  // passed `byval` are read from memory.
+  bool has_byval = false;
+  for (size_t i = 0; i < abi.args.size; ++i) {
+    if (((const ABIArgInfo*)vector_at(&abi.args, i))->kind == AK_Indirect)
+      has_byval = true;
+  }
+  if (abi.ret.kind != AK_Indirect) {
+    if (attrs->const_ && !has_byval)
+      add_memory_attribute(compiler, func, /*reads=*/false);
+    else if (attrs->const_ || attrs->pure)
+      add_memory_attribute(compiler, func, /*reads=*/true);
+  }
 
-      tree_map_destroy(&local_ctx_cpy);
-      tree_map_destroy(&local_allocas_cpy);
+  if (attrs->malloc_)
+    add_enum_attribute(compiler, func, LLVMAttributeReturnIndex, "noalias");
+  if (attrs->returns_nonnull)
+    add_enum_attribute(compiler, func, LLVMAttributeReturnIndex, "nonnull");
+
+  if (attrs->nonnull_all || attrs->nonnull_args) {
+    unsigned num_params = LLVMCountParams(func);
+    for (size_t i = 0; i < abi.args.size; ++i) {
+      const ABIArgInfo* info = vector_at(&abi.args, i);
+      if (info->kind != AK_Direct || info->param >= num_params)
+        continue;
+      LLVMTypeRef param_ty = LLVMTypeOf(LLVMGetParam(func, info->param));
+      if (LLVMGetTypeKind(param_ty) != LLVMPointerTypeKind)
+        continue;
+      // Parameter attributes are indexed starting at 1.
+      if (attrs->nonnull_all || (attrs->nonnull_args >> i) & 1)
+        add_enum_attribute(compiler, func, info->param + 1, "nonnull");
+    }
+  }
+  vector_destroy(&abi.args);
+
+  if (attrs->aligned) {
+    ConstExprResult alignment =
+        sema_eval_expr_in_ctx(compiler->sema, attrs->aligned, local_ctx);
+    switch (alignment.result_kind) {
+      case RK_Boolean:
+        UNREACHABLE_MSG("Bool is not acceptable alignment");
+      case RK_Int:
+        assert(alignment.result.i > 0);
+        LLVMSetAlignment(func, (unsigned)alignment.result.i);
+        break;
+      case RK_UnsignedLongLong:
+        LLVMSetAlignment(func, (unsigned)alignment.result.ull);
+        break;
     }
+  }
+}
 
-    LLVMBasicBlockRef last_bb = LLVMGetInsertBlock(builder);
-    LLVMValueRef last = LLVMGetLastInstruction(last_bb);
-    if (!last || !LLVMIsATerminatorInst(last)) {
-      LLVMBuildBr(builder, mergebb);
-      all_branches_terminate = false;
+// Restrict-qualified pointer parameters are noalias. Only the definition of a
+// function decides this since qualifiers on the parameters of other
+// declarations have no meaning. An object accessed through a restrict pointer
+// to const can't be modified by any means while the function runs, so those
+// parameters are also readonly.
+static void add_parameter_attributes(Compiler* compiler, LLVMValueRef func,
+                                     const FunctionType* func_ty,
+                                     const TreeMap* local_ctx) {
+  FunctionABI abi;
+  get_function_abi(compiler, func_ty, local_ctx, &abi);
+  for (size_t i = 0; i < func_ty->pos_args.size; ++i) {
+    const FunctionArg* arg = vector_at(&func_ty->pos_args, i);
+    if (!(arg->type->qualifiers & kRestrictMask) ||
+        !sema_is_pointer_type(compiler->sema, arg->type, local_ctx)) {
+      continue;
     }
-  } else {
-    LLVMBuildBr(builder, mergebb);
-    all_branches_terminate = false;
+
+    // Parameter attributes are indexed starting at 1.
+    unsigned idx = ((const ABIArgInfo*)vector_at(&abi.args, i))->param + 1;
+    add_enum_attribute(compiler, func, idx, "noalias");
+
+    const Type* pointee =
+        sema_get_pointee(compiler->sema, arg->type, local_ctx);
+    if (pointee->qualifiers & kConstMask)
+      add_enum_attribute(compiler, func, idx, "readonly");
   }
+  vector_destroy(&abi.args);
+}
 
-  if (!all_branches_terminate) {
-    // Emit merge BB.
-    LLVMAppendExistingBasicBlock(fn, mergebb);
-    LLVMPositionBuilderAtEnd(builder, mergebb);
-  } else {
-    // For some reason, there's no function for just deleting a BB. The delete
-    // function both removes a block from a function and deletes it.
-    LLVMAppendExistingBasicBlock(fn, mergebb);
-    LLVMDeleteBasicBlock(mergebb);
+// Functions are identified in profiles by name. Internal functions are
+// prefixed with their source file since they can share names across files.
+static char* get_profile_name(Compiler* compiler, const FunctionDefinition* f) {
+  string name;
+  string_construct(&name);
+  if (function_has_internal_linkage(f)) {
+    size_t len;
+    const char* filename = LLVMGetSourceFileName(compiler->mod, &len);
+    string_append_range(&name, filename, len);
+    string_append_char(&name, ':');
   }
+  string_append(&name, f->name);
+  return name.data;
 }
 
-bool last_instruction_is_terminator(LLVMBuilderRef builder) {
-  LLVMBasicBlockRef last_bb = LLVMGetInsertBlock(builder);
-  LLVMValueRef last = LLVMGetLastInstruction(last_bb);
-  return last && LLVMIsATerminatorInst(last);
+// Start counting the profile counters of a function. This must be called with
+// `builder` in the entry block.
+static void begin_function_profile(Compiler* compiler,
+                                   LLVMBuilderRef builder) {
+  compiler->num_profile_counters = 1;  // The entry counter.
+  compiler->profiled_branches.size = 0;
+  if (!compiler->profile->generate_path)
+    return;
+
+  // The number of counters is only known after the function is compiled, so
+  // this placeholder is replaced with the actual counters array then.
+  compiler->profile_counters = LLVMAddGlobal(
+      compiler->mod, LLVMInt64TypeInContext(compiler->ctx), "");
+  increment_profile_counter(compiler, builder, /*idx=*/0);
 }
 
-void compile_for_statement(Compiler* compiler, LLVMBuilderRef builder,
-                           const ForStmt* stmt, TreeMap* local_ctx,
-                           TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                           LLVMBasicBlockRef cont_bb) {
-  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+// Branch weights are 32 bits, so larger counts are scaled down.
+static void set_branch_weights(Compiler* compiler, LLVMValueRef br,
+                               uint64_t taken, uint64_t not_taken) {
+  uint64_t max_count = taken;
+  if (not_taken > max_count)
+    max_count = not_taken;
+  uint64_t scale = max_count / (((uint64_t)1 << 32) - 1) + 1;
+
+  const char* kind = "branch_weights";
+  LLVMTypeRef i32 = LLVMInt32TypeInContext(compiler->ctx);
+  LLVMMetadataRef ops[] = {
+      LLVMMDStringInContext2(compiler->ctx, kind, strlen(kind)),
+      LLVMValueAsMetadata(LLVMConstInt(i32, taken / scale, /*IsSigned=*/0)),
+      LLVMValueAsMetadata(
+          LLVMConstInt(i32, not_taken / scale, /*IsSigned=*/0)),
+  };
+  LLVMMetadataRef weights = LLVMMDNodeInContext2(compiler->ctx, ops, 3);
+  LLVMSetMetadata(br, LLVMGetMDKindIDInContext(compiler->ctx, "prof", 4),
+                  LLVMMetadataAsValue(compiler->ctx, weights));
+}
 
-  // Scope local to the loop.
-  TreeMap local_ctx_cpy;
-  TreeMap local_allocas_cpy;
-  string_tree_map_construct(&local_ctx_cpy);
-  string_tree_map_construct(&local_allocas_cpy);
-  tree_map_clone(&local_ctx_cpy, local_ctx);
-  tree_map_clone(&local_allocas_cpy, local_allocas);
+// Attach the counts of `f` from the profile to `func` and its branches. This
+// does nothing if the function is not in the profile or its number of counters
+// changed, meaning the profile is stale.
+static void apply_function_profile(Compiler* compiler,
+                                   const FunctionDefinition* f,
+                                   LLVMValueRef func) {
+  char* name = get_profile_name(compiler, f);
+  vector* counts = NULL;
+  bool found = tree_map_get(compiler->profile->counts, name, &counts);
+  free(name);
+  if (!found || counts->size != compiler->num_profile_counters)
+    return;
 
-  // Emit the initializer if any.
-  if (stmt->init) {
-    compile_statement(compiler, builder, stmt->init, &local_ctx_cpy,
-                      &local_allocas_cpy, break_bb, cont_bb,
-                      /*last_expr=*/NULL);
+  const char* kind = "function_entry_count";
+  uint64_t entry_count = *(uint64_t*)vector_at(counts, 0);
+  LLVMMetadataRef ops[] = {
+      LLVMMDStringInContext2(compiler->ctx, kind, strlen(kind)),
+      LLVMValueAsMetadata(LLVMConstInt(LLVMInt64TypeInContext(compiler->ctx),
+                                       entry_count, /*IsSigned=*/0)),
+  };
+  LLVMGlobalSetMetadata(func,
+                        LLVMGetMDKindIDInContext(compiler->ctx, "prof", 4),
+                        LLVMMDNodeInContext2(compiler->ctx, ops, 2));
+
+  for (size_t i = 0; i < compiler->profiled_branches.size; ++i) {
+    LLVMValueRef br =
+        *(LLVMValueRef*)vector_at(&compiler->profiled_branches, i);
+    uint64_t total = *(uint64_t*)vector_at(counts, 2 * i + 1);
+    uint64_t taken = *(uint64_t*)vector_at(counts, 2 * i + 2);
+    if (total == 0 || taken > total)
+      continue;
+    set_branch_weights(compiler, br, taken, total - taken);
   }
+}
 
-  LLVMBasicBlockRef for_start =
-      LLVMAppendBasicBlockInContext(ctx, fn, "for_start");
-  LLVMBuildBr(builder, for_start);
-  LLVMPositionBuilderAtEnd(builder, for_start);
+// Finish profiling a function once its body is compiled.
+static void end_function_profile(Compiler* compiler,
+                                 const FunctionDefinition* f,
+                                 LLVMValueRef func) {
+  if (compiler->profile->counts)
+    apply_function_profile(compiler, f, func);
 
-  LLVMBasicBlockRef for_end = LLVMCreateBasicBlockInContext(ctx, "for_end");
-  LLVMBasicBlockRef for_iter = LLVMCreateBasicBlockInContext(ctx, "for_iter");
+  LLVMValueRef placeholder = compiler->profile_counters;
+  if (!placeholder)
+    return;
 
-  // Check the condition if any.
-  if (stmt->cond) {
-    LLVMValueRef cond =
-        compile_to_bool(compiler, builder, stmt->cond, &local_ctx_cpy,
-                        &local_allocas_cpy, break_bb, cont_bb);
-    LLVMBasicBlockRef for_body = LLVMCreateBasicBlockInContext(ctx, "for_body");
-    LLVMBuildCondBr(builder, cond, for_body, for_end);
+  LLVMTypeRef counters_ty =
+      LLVMArrayType(LLVMInt64TypeInContext(compiler->ctx),
+                    (unsigned)compiler->num_profile_counters);
+  LLVMValueRef counters = LLVMAddGlobal(compiler->mod, counters_ty, "__profc");
+  LLVMSetLinkage(counters, LLVMPrivateLinkage);
+  LLVMSetInitializer(counters, LLVMConstNull(counters_ty));
+  LLVMReplaceAllUsesWith(placeholder, counters);
+  LLVMDeleteGlobal(placeholder);
+  compiler->profile_counters = NULL;
+
+  InstrumentedFunction* instrumented =
+      vector_append_storage(&compiler->instrumented_functions);
+  instrumented->name = get_profile_name(compiler, f);
+  instrumented->counters = counters;
+  instrumented->num_counters = compiler->num_profile_counters;
+}
 
-    LLVMAppendExistingBasicBlock(fn, for_body);
-    LLVMPositionBuilderAtEnd(builder, for_body);
-  }
+void compile_function_definition(Compiler* compiler,
+                                 const FunctionDefinition* f) {
+  FunctionType* func_ty = (FunctionType*)(f->type);
 
-  // Now emit the body.
-  if (stmt->body) {
-    compile_statement(compiler, builder, stmt->body, &local_ctx_cpy,
-                      &local_allocas_cpy, for_end, for_iter,
-                      /*last_expr=*/NULL);
-  }
+  TreeMap local_ctx;
+  string_tree_map_construct(&local_ctx);
 
-  // Branch to the iterator.
-  if (!last_instruction_is_terminator(builder))
-    LLVMBuildBr(builder, for_iter);
+  // TODO: Have a global version of `get_llvm_type`. The local_ctx is really
+  // unused here but it's needed as an argument.
+  LLVMTypeRef llvm_func_ty = get_llvm_type(compiler, f->type, &local_ctx);
 
-  LLVMAppendExistingBasicBlock(fn, for_iter);
-  LLVMPositionBuilderAtEnd(builder, for_iter);
+  LLVMValueRef func = get_named_global(compiler, f->name);
+  if (!func)
+    func = LLVMAddFunction(compiler->mod, f->name, llvm_func_ty);
+  assert(LLVMGetTypeKind(LLVMTypeOf(func)) == LLVMPointerTypeKind);
 
-  // Then do the iter.
-  if (stmt->iter) {
-    compile_expr(compiler, builder, stmt->iter, &local_ctx_cpy,
-                 &local_allocas_cpy, break_bb, cont_bb);
-  }
+  if (function_has_internal_linkage(f))
+    LLVMSetLinkage(func, LLVMInternalLinkage);
 
-  // And branch back to the start.
-  if (!last_instruction_is_terminator(builder))
-    LLVMBuildBr(builder, for_start);
+  add_target_attributes(compiler, func);
+  add_fast_math_attributes(compiler, func);
+  add_function_attributes(compiler, func, f->name, func_ty, &f->attrs,
+                          &local_ctx);
+  add_parameter_attributes(compiler, func, func_ty, &local_ctx);
+  compiler->flatten_calls = f->attrs.flatten;
 
-  // End of for loop.
-  LLVMAppendExistingBasicBlock(fn, for_end);
-  LLVMPositionBuilderAtEnd(builder, for_end);
+  // TODO: Fill out the line number and other relevant fields.
+  LLVMMetadataRef subprogram = LLVMDIBuilderCreateFunction(
+      compiler->dibuilder, compiler->difile, f->name, strlen(f->name), f->name,
+      strlen(f->name), compiler->difile, /*LineNo=*/1,
+      get_di_function_type(compiler, func_ty), /*IsLocalToUnit=*/0,
+      /*IsDefinition=*/1, /*ScopeLine=*/0,
+      /*Flags=*/0, /*IsOptimized=*/0);
+  LLVMSetSubprogram(func, subprogram);
+  LLVMDIBuilderFinalizeSubprogram(compiler->dibuilder, subprogram);
 
-  tree_map_destroy(&local_ctx_cpy);
-  tree_map_destroy(&local_allocas_cpy);
-}
+  LLVMBasicBlockRef entry =
+      LLVMAppendBasicBlockInContext(compiler->ctx, func, "entry");
+  LLVMBuilderRef builder = LLVMCreateBuilderInContext(compiler->ctx);
+  compiler->current_function = func;
+  compiler->current_function_type = func_ty;
+  compiler->emit_lifetime_markers = !stmt_contains_label(&f->body->base);
+  compiler->live_stack_size = 0;
+  compiler->max_stack_size = 0;
+  compiler->total_stack_size = 0;
+  LLVMPositionBuilderAtEnd(builder, entry);
+
+  SSABuilder ssa;
+  ssa_builder_construct(&ssa, compiler->ctx);
+  collect_address_taken_locals_in_stmt(&f->body->base, &ssa.address_taken);
+  ssa_seal_block(&ssa, entry);
+  compiler->ssa = &ssa;
 
-void compile_while_statement(Compiler* compiler, LLVMBuilderRef builder,
-                             const WhileStmt* stmt, TreeMap* local_ctx,
-                             TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                             LLVMBasicBlockRef cont_bb) {
-  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
   LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+  // TODO: Fill these in with correct values.
+  LLVMMetadataRef debug_loc = LLVMDIBuilderCreateDebugLocation(
+      ctx, /*Line=*/1, /*Column=*/0, subprogram, /*InlinedAt=*/NULL);
+  LLVMSetCurrentDebugLocation2(builder, debug_loc);
 
-  // Scope local to the loop.
-  TreeMap local_ctx_cpy;
-  TreeMap local_allocas_cpy;
-  string_tree_map_construct(&local_ctx_cpy);
-  string_tree_map_construct(&local_allocas_cpy);
-  tree_map_clone(&local_ctx_cpy, local_ctx);
-  tree_map_clone(&local_allocas_cpy, local_allocas);
+  begin_function_profile(compiler, builder);
 
-  LLVMBasicBlockRef while_start =
-      LLVMAppendBasicBlockInContext(ctx, fn, "while_start");
-  LLVMBuildBr(builder, while_start);
-  LLVMPositionBuilderAtEnd(builder, while_start);
+  TreeMap local_allocas;
+  string_tree_map_construct(&local_allocas);
 
-  LLVMBasicBlockRef while_end = LLVMCreateBasicBlockInContext(ctx, "while_end");
+  FunctionABI abi;
+  get_function_abi(compiler, func_ty, &local_ctx, &abi);
+  compiler->current_return = abi.ret;
 
-  // Check the condition.
-  LLVMValueRef cond =
-      compile_to_bool(compiler, builder, stmt->cond, &local_ctx_cpy,
-                      &local_allocas_cpy, break_bb, cont_bb);
-  LLVMBasicBlockRef while_body =
-      LLVMCreateBasicBlockInContext(ctx, "while_body");
-  LLVMBuildCondBr(builder, cond, while_body, while_end);
+  for (size_t i = 0; i < func_ty->pos_args.size; ++i) {
+    FunctionArg* arg = vector_at(&func_ty->pos_args, i);
+    if (!arg->name)
+      continue;
+
+    const ABIArgInfo* info = vector_at(&abi.args, i);
+    tree_map_set(&local_ctx, arg->name, arg->type);
+
+    // The copy the caller made for `byval` is used as the local.
+    if (info->kind == AK_Indirect) {
+      tree_map_set(&local_allocas, arg->name, LLVMGetParam(func, info->param));
+      continue;
+    }
+
+    if (info->kind == AK_Coerce) {
+      LLVMValueRef alloca = build_abi_temporary(compiler, builder, arg->name,
+                                                arg->type, &local_ctx);
+      LLVMValueRef vals[] = {LLVMGetParam(func, info->param), NULL};
+      if (info->hi)
+        vals[1] = LLVMGetParam(func, info->param + 1);
+      store_eightbytes(compiler, builder, info, vals, alloca, &local_ctx);
+      tree_map_set(&local_allocas, arg->name, alloca);
+      continue;
+    }
+
+    if (info->kind == AK_Ignore) {
+      LLVMValueRef alloca = build_abi_temporary(compiler, builder, arg->name,
+                                                arg->type, &local_ctx);
+      tree_map_set(&local_allocas, arg->name, alloca);
+      continue;
+    }
+
+    LLVMValueRef llvm_arg = LLVMGetParam(func, info->param);
+
+    if (is_promotable_local(compiler, arg->name, arg->type)) {
+      SSAVariable* var = ssa_create_variable(&ssa, arg->name,
+                                             LLVMTypeOf(llvm_arg));
+      ssa_write_variable(var, entry, llvm_arg);
+      tree_map_set(&local_allocas, arg->name, var);
+      continue;
+    }
+
+    // Copy the parameter locally.
+    LLVMValueRef alloca = build_alloca_at_func_start(
+        compiler, builder, arg->name, arg->type,
+        get_llvm_type(compiler, arg->type, &local_ctx), &local_ctx);
+    get_aligned_store(compiler, builder, arg->type, llvm_arg, alloca,
+                      &local_ctx);
+    tree_map_set(&local_allocas, arg->name, alloca);
+  }
+  vector_destroy(&abi.args);
+
+  compiler->function_body = &f->body->base;
+  compile_statement(compiler, builder, &f->body->base, &local_ctx,
+                    &local_allocas, /*break_bb=*/NULL, /*cont_bb=*/NULL,
+                    /*last_expr=*/NULL);
+  compiler->function_body = NULL;
+
+  if (!last_instruction_is_terminator(builder)) {
+    if (is_void_type(func_ty->return_type)) {
+      LLVMBuildRetVoid(builder);
+    } else {
+      call_llvm_debugtrap(compiler, builder);
+      LLVMBuildUnreachable(builder);
+    }
+  }
+
+  finish_labels(compiler);
+  compiler->current_function = NULL;
+  compiler->current_return.kind = AK_Direct;
+
+  ssa_finalize_function(&ssa, func);
+  compiler->ssa = NULL;
+  ssa_builder_destroy(&ssa);
+  compiler->flatten_calls = false;
+
+  add_restrict_scope_metadata(compiler, func, f->name);
+
+  end_function_profile(compiler, f, func);
 
-  LLVMAppendExistingBasicBlock(fn, while_body);
-  LLVMPositionBuilderAtEnd(builder, while_body);
+  finish_tail_calls(compiler, func);
+  compiler->current_function_type = NULL;
 
-  // Now emit the body.
-  if (stmt->body) {
-    compile_statement(compiler, builder, stmt->body, &local_ctx_cpy,
-                      &local_allocas_cpy, while_end, while_start,
-                      /*last_expr=*/NULL);
+  if (compiler->stack_usages) {
+    StackUsage* usage = vector_append_storage(compiler->stack_usages);
+    usage->f = f;
+    usage->max_live_size = compiler->max_stack_size;
+    usage->total_size = compiler->total_stack_size;
   }
 
-  // And branch back to the start.
-  if (!last_instruction_is_terminator(builder))
-    LLVMBuildBr(builder, while_start);
+  tree_map_destroy(&local_ctx);
+  tree_map_destroy(&local_allocas);
 
-  // End of while loop.
-  LLVMAppendExistingBasicBlock(fn, while_end);
-  LLVMPositionBuilderAtEnd(builder, while_end);
+  LLVMDisposeBuilder(builder);
 
-  tree_map_destroy(&local_ctx_cpy);
-  tree_map_destroy(&local_allocas_cpy);
+  if (LLVMVerifyFunction(func, LLVMPrintMessageAction)) {
+    printf("Verify function '%s' failed\n", f->name);
+    LLVMDumpValue(func);
+    __builtin_trap();
+  }
 }
 
-// TODO: This should just be a switch instruction!!!
-void compile_switch_statement(Compiler* compiler, LLVMBuilderRef builder,
-                              const SwitchStmt* stmt, TreeMap* local_ctx,
-                              TreeMap* local_allocas,
-                              LLVMBasicBlockRef break_bb,
-                              LLVMBasicBlockRef cont_bb) {
-  LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
+static LLVMValueRef compile_lvalue_ptr_impl(Compiler* compiler,
+                                            LLVMBuilderRef builder,
+                                            const Expr* expr,
+                                            TreeMap* local_ctx,
+                                            TreeMap* local_allocas,
+                                            LLVMBasicBlockRef break_bb,
+                                            LLVMBasicBlockRef cont_bb) {
+  switch (expr->vtable->kind) {
+    case EK_DeclRef: {
+      const DeclRef* decl = (const DeclRef*)expr;
 
-  LLVMValueRef check = compile_expr(compiler, builder, stmt->cond, local_ctx,
-                                    local_allocas, break_bb, cont_bb);
+      ASSERT_MSG(!get_promoted_local(compiler, expr, local_allocas),
+                 "'%s' is kept in SSA form and has no address", decl->name);
 
-  LLVMBasicBlockRef end_bb = LLVMCreateBasicBlockInContext(ctx, "switch_end");
+      LLVMValueRef val = NULL;
+      tree_map_get(local_allocas, decl->name, (void*)&val);
 
-  LLVMValueRef should_fallthrough = LLVMConstNull(LLVMInt1Type());
+      if (!val)
+        val = get_named_global(compiler, decl->name);
 
-  for (size_t i = 0; i < stmt->cases.size; ++i) {
-    const SwitchCase* switch_case = vector_at(&stmt->cases, i);
+      if (!val) {
+        printf("Couldn't find alloca or global for '%s'\n", decl->name);
+        LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+        LLVMDumpValue(fn);
+        __builtin_trap();
+      }
 
-    LLVMBasicBlockRef case_bb = LLVMAppendBasicBlockInContext(ctx, fn, "case");
-    LLVMBasicBlockRef next_bb = LLVMCreateBasicBlockInContext(ctx, "next");
+      assert(LLVMGetTypeKind(LLVMTypeOf(val)) == LLVMPointerTypeKind);
+      return val;
+    }
+    case EK_MemberAccess: {
+      const MemberAccess* access = (const MemberAccess*)expr;
+      const StructType* base_ty = sema_get_struct_type_from_member_access(
+          compiler->sema, access, local_ctx);
+      size_t offset;
+      sema_get_struct_member(compiler->sema, base_ty, access->member, &offset);
 
-    const Type* common_ty = sema_get_common_arithmetic_type_of_exprs(
-        compiler->sema, stmt->cond, switch_case->cond, local_ctx);
+      LLVMValueRef base_llvm;
+      if (access->is_arrow) {
+        base_llvm = compile_expr(compiler, builder, access->base, local_ctx,
+                                 local_allocas, break_bb, cont_bb);
+      } else {
+        base_llvm =
+            compile_lvalue_ptr(compiler, builder, access->base, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+      }
 
-    LLVMValueRef case_val =
-        compile_implicit_cast(compiler, builder, switch_case->cond, common_ty,
-                              local_ctx, local_allocas, break_bb, cont_bb);
-    LLVMValueRef cond = LLVMBuildICmp(builder, LLVMIntEQ, check, case_val, "");
-    should_fallthrough = LLVMBuildOr(builder, cond, should_fallthrough, "");
-    LLVMBuildCondBr(builder, should_fallthrough, case_bb, next_bb);
+      LLVMTypeRef llvm_base_ty =
+          get_llvm_type(compiler, &base_ty->type, local_ctx);
+      LLVMValueRef llvm_offset = LLVMConstInt(
+          LLVMInt32TypeInContext(compiler->ctx),
+          get_struct_member_field(compiler, base_ty, offset, local_ctx),
+          /*signed=*/0);
+      LLVMValueRef offsets[] = {
+          LLVMConstNull(LLVMInt32TypeInContext(compiler->ctx)), llvm_offset};
+      LLVMValueRef gep =
+          LLVMBuildGEP2(builder, llvm_base_ty, base_llvm, offsets, 2, "");
+      return gep;
+    }
+    case EK_UnOp:
+      return compile_unop_lvalue_ptr(compiler, builder, (const UnOp*)expr,
+                                     local_ctx, local_allocas, break_bb,
+                                     cont_bb);
+    case EK_Cast: {
+      const Cast* cast = (const Cast*)expr;
+      const Type* src_ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
+      const Type* dst_ty = cast->to;
+      LLVMTypeRef llvm_src_ty = get_llvm_type(compiler, src_ty, local_ctx);
+      LLVMTypeRef llvm_dst_ty = get_llvm_type(compiler, dst_ty, local_ctx);
+      if (LLVMGetTypeKind(llvm_src_ty) == LLVMGetTypeKind(llvm_dst_ty))
+        return compile_lvalue_ptr(compiler, builder, cast->base, local_ctx,
+                                  local_allocas, break_bb, cont_bb);
 
-    LLVMPositionBuilderAtEnd(builder, case_bb);
+      UNREACHABLE_MSG("Unhandled lvalue ptr cast from %d to %d",
+                      LLVMGetTypeKind(llvm_src_ty),
+                      LLVMGetTypeKind(llvm_dst_ty));
+    }
+    case EK_Index: {
+      const Index* index = (const Index*)expr;
+      const Expr* base = index->base;
+      const Type* base_ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, base, local_ctx);
 
-    bool last_stmt_terminates = false;
-    for (size_t j = 0; j < switch_case->stmts.size; ++j) {
-      Statement** case_stmt = vector_at(&switch_case->stmts, j);
-      compile_statement(compiler, builder, *case_stmt, local_ctx, local_allocas,
-                        end_bb, cont_bb, /*last_expr=*/NULL);
+      LLVMValueRef idx = compile_expr(compiler, builder, index->idx, local_ctx,
+                                      local_allocas, break_bb, cont_bb);
 
-      if ((last_stmt_terminates = last_instruction_is_terminator(builder)))
-        break;
-    }
+      // Vectors in memory are laid out like arrays of their elements.
+      const VectorType* vec_ty =
+          sema_get_vector_type(compiler->sema, base_ty, local_ctx);
+      if (vec_ty) {
+        LLVMValueRef vec_ptr =
+            compile_lvalue_ptr(compiler, builder, base, local_ctx,
+                               local_allocas, break_bb, cont_bb);
+        LLVMValueRef offsets[] = {idx};
+        LLVMTypeRef llvm_elem_ty =
+            get_llvm_type(compiler, vec_ty->elem_type, local_ctx);
+        return LLVMBuildGEP2(builder, llvm_elem_ty, vec_ptr, offsets, 1,
+                             "idx_vec");
+      }
 
-    if (!last_stmt_terminates)
-      LLVMBuildBr(builder, next_bb);
+      LLVMValueRef base_ptr = compile_expr(compiler, builder, base, local_ctx,
+                                           local_allocas, break_bb, cont_bb);
 
-    LLVMAppendExistingBasicBlock(fn, next_bb);
-    LLVMPositionBuilderAtEnd(builder, next_bb);
-  }
+      assert(LLVMGetTypeKind(LLVMTypeOf(base_ptr)) == LLVMPointerTypeKind);
 
-  // FIXME: This will not work if the default is *not* the last block.
-  if (stmt->default_stmts) {
-    for (size_t i = 0; i < stmt->default_stmts->size; ++i) {
-      Statement** default_stmt = vector_at(stmt->default_stmts, i);
-      compile_statement(compiler, builder, *default_stmt, local_ctx,
-                        local_allocas, end_bb, cont_bb, /*last_expr=*/NULL);
+      if (sema_is_pointer_type(compiler->sema, base_ty, local_ctx)) {
+        LLVMValueRef offsets[] = {idx};
 
-      if (last_instruction_is_terminator(builder))
-        break;
-    }
-  }
+        const Type* pointee_ty =
+            sema_get_pointee(compiler->sema, base_ty, local_ctx);
+        LLVMTypeRef llvm_pointee_ty =
+            get_llvm_type(compiler, pointee_ty, local_ctx);
+        return LLVMBuildGEP2(builder, llvm_pointee_ty, base_ptr, offsets, 1,
+                             "idx_ptr");
+      } else if (sema_is_array_type(compiler->sema, base_ty, local_ctx)) {
+        // TODO: This could probably be consolidated with the branch above.
 
-  if (!last_instruction_is_terminator(builder))
-    LLVMBuildBr(builder, end_bb);
+        LLVMValueRef offsets[] = {idx};
 
-  LLVMAppendExistingBasicBlock(fn, end_bb);
-  LLVMPositionBuilderAtEnd(builder, end_bb);
-}
+        const Type* elem_ty =
+            sema_get_array_type(compiler->sema, base_ty, local_ctx)->elem_type;
 
-// Compile a compound statement. If the body is not empty and the last statement
-// is an expression statement and `last_expr` is provided, set `last_expr` to
-// the resulting LLVMValueRef that expression compiles to.
-void compile_compound_statement(Compiler* compiler, LLVMBuilderRef builder,
-                                const CompoundStmt* compound,
-                                TreeMap* local_ctx, TreeMap* local_allocas,
-                                LLVMBasicBlockRef break_bb,
-                                LLVMBasicBlockRef cont_bb,
-                                LLVMValueRef* last_expr) {
-  TreeMap local_ctx_cpy;
-  TreeMap local_allocas_cpy;
-  string_tree_map_construct(&local_ctx_cpy);
-  string_tree_map_construct(&local_allocas_cpy);
-  tree_map_clone(&local_ctx_cpy, local_ctx);
-  tree_map_clone(&local_allocas_cpy, local_allocas);
+        LLVMTypeRef llvm_elem_ty = get_llvm_type(compiler, elem_ty, local_ctx);
+        return LLVMBuildGEP2(builder, llvm_elem_ty, base_ptr, offsets, 1,
+                             "idx_arr");
+      }
 
-  for (size_t i = 0; i < compound->body.size; ++i) {
-    Statement* stmt = *(Statement**)vector_at(&compound->body, i);
-    compile_statement(compiler, builder, stmt, &local_ctx_cpy,
-                      &local_allocas_cpy, break_bb, cont_bb, last_expr);
-    if (last_instruction_is_terminator(builder))
-      break;
+      UNREACHABLE_MSG("Indexing non-ptr or arr type");
+    }
+    default:
+      UNREACHABLE_MSG("TODO: Handle lvalue for EK %d", expr->vtable->kind);
   }
-
-  tree_map_destroy(&local_ctx_cpy);
-  tree_map_destroy(&local_allocas_cpy);
-  return;
 }
 
-// Compile a compound statement. If the statement is an expression statement and
-// `last_expr` is provided, set `last_expr` to the resulting LLVMValueRef that
-// expression compiles to.
-void compile_statement(Compiler* compiler, LLVMBuilderRef builder,
-                       const Statement* stmt, TreeMap* local_ctx,
-                       TreeMap* local_allocas, LLVMBasicBlockRef break_bb,
-                       LLVMBasicBlockRef cont_bb, LLVMValueRef* last_expr) {
-  switch (stmt->vtable->kind) {
-    case SK_ExprStmt: {
-      LLVMValueRef expr =
-          compile_expr(compiler, builder, ((const ExprStmt*)stmt)->expr,
-                       local_ctx, local_allocas, break_bb, cont_bb);
-      if (last_expr)
-        *last_expr = expr;
-      return;
+// Returns true and sets `local` if `expr` names a RestrictLocal.
+static bool find_restrict_local(const Compiler* compiler, const Expr* expr,
+                                const TreeMap* local_ctx, size_t* local) {
+  if (expr->vtable->kind != EK_DeclRef)
+    return false;
+
+  const Type* decl_type = NULL;
+  if (!tree_map_get(local_ctx, ((const DeclRef*)expr)->name, &decl_type))
+    return false;
+
+  for (size_t i = 0; i < compiler->restrict_locals.size; ++i) {
+    const RestrictLocal* restrict_local =
+        vector_at(&compiler->restrict_locals, i);
+    if (restrict_local->decl_type == decl_type) {
+      *local = i;
+      return true;
     }
-    case SK_IfStmt:
-      return compile_if_statement(compiler, builder, (const IfStmt*)stmt,
-                                  local_ctx, local_allocas, break_bb, cont_bb);
-    case SK_WhileStmt:
-      return compile_while_statement(compiler, builder, (const WhileStmt*)stmt,
-                                     local_ctx, local_allocas, break_bb,
-                                     cont_bb);
-    case SK_ForStmt:
-      return compile_for_statement(compiler, builder, (const ForStmt*)stmt,
-                                   local_ctx, local_allocas, break_bb, cont_bb);
-    case SK_ReturnStmt: {
-      const ReturnStmt* ret = (const ReturnStmt*)stmt;
-      if (!ret->expr) {
-        LLVMBuildRetVoid(builder);
-        return;
-      }
-      LLVMValueRef val = compile_expr(compiler, builder, ret->expr, local_ctx,
-                                      local_allocas, break_bb, cont_bb);
-
-      // TODO: There should be an ImplicitCast AST node that we can parser over
-      // rather than doing this here.
+  }
+  return false;
+}
 
-      const Type* expr_ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, ret->expr, local_ctx);
-      if (is_void_type(expr_ty))
-        LLVMBuildRetVoid(builder);
-      else
-        LLVMBuildRet(builder, val);
-      return;
-    }
-    case SK_ContinueStmt: {
-      LLVMBuildBr(builder, cont_bb);
-      return;
+// Returns true and sets `local` if the lvalue `expr` is accessed through a
+// RestrictLocal, like `p[i]`, `*(p + i)` or `p->member`.
+static bool get_restrict_base(Compiler* compiler, const Expr* expr,
+                              const TreeMap* local_ctx, size_t* local) {
+  switch (expr->vtable->kind) {
+    case EK_Index: {
+      const Expr* base = ((const Index*)expr)->base;
+      const Type* base_ty =
+          sema_get_type_of_expr_in_ctx(compiler->sema, base, local_ctx);
+      if (sema_is_array_type(compiler->sema, base_ty, local_ctx))
+        return get_restrict_base(compiler, base, local_ctx, local);
+      return find_restrict_local(compiler, base, local_ctx, local);
     }
-    case SK_BreakStmt: {
-      LLVMBuildBr(builder, break_bb);
-      return;
+    case EK_MemberAccess: {
+      const MemberAccess* access = (const MemberAccess*)expr;
+      if (access->is_arrow)
+        return find_restrict_local(compiler, access->base, local_ctx, local);
+      return get_restrict_base(compiler, access->base, local_ctx, local);
     }
-    case SK_CompoundStmt:
-      return compile_compound_statement(
-          compiler, builder, (const CompoundStmt*)stmt, local_ctx,
-          local_allocas, break_bb, cont_bb, /*last_expr=*/NULL);
-    case SK_Declaration: {
-      const Declaration* decl = (const Declaration*)stmt;
-
-      LLVMTypeRef llvm_ty = NULL;
-      if (sema_is_array_type(compiler->sema, decl->type, local_ctx)) {
-        const ArrayType* arr_ty =
-            sema_get_array_type(compiler->sema, decl->type, local_ctx);
-        if (!arr_ty->size) {
-          // Get the type from the initializer.
-          assert(decl->initializer);
-
-          if (decl->initializer->vtable->kind == EK_InitializerList) {
-            // Since this is an array, we can just get the first element.
-            const InitializerList* init =
-                (const InitializerList*)decl->initializer;
-
-            assert(init->elems.size > 0);
-            InitializerListElem* first_elem = vector_at(&init->elems, 0);
-            LLVMTypeRef elem_ty =
-                get_llvm_type_of_expr(compiler, first_elem->expr, local_ctx);
-            llvm_ty = LLVMArrayType(elem_ty, (unsigned)init->elems.size);
-          } else {
-            llvm_ty =
-                get_llvm_type_of_expr(compiler, decl->initializer, local_ctx);
-          }
-        }
+    case EK_UnOp: {
+      const UnOp* unop = (const UnOp*)expr;
+      if (unop->op != UOK_Deref)
+        return false;
+
+      const Expr* ptr = unop->subexpr;
+      if (ptr->vtable->kind == EK_BinOp) {
+        const BinOp* binop = (const BinOp*)ptr;
+        if (binop->op == BOK_Sub)
+          return find_restrict_local(compiler, binop->lhs, local_ctx, local);
+        if (binop->op != BOK_Add)
+          return false;
+        return find_restrict_local(compiler, binop->lhs, local_ctx, local) ||
+               find_restrict_local(compiler, binop->rhs, local_ctx, local);
       }
+      return find_restrict_local(compiler, ptr, local_ctx, local);
+    }
+    default:
+      return false;
+  }
+}
 
-      if (!llvm_ty)
-        llvm_ty = get_llvm_type(compiler, decl->type, local_ctx);
+LLVMValueRef compile_lvalue_ptr(Compiler* compiler, LLVMBuilderRef builder,
+                                const Expr* expr, TreeMap* local_ctx,
+                                TreeMap* local_allocas,
+                                LLVMBasicBlockRef break_bb,
+                                LLVMBasicBlockRef cont_bb) {
+  LLVMValueRef ptr =
+      compile_lvalue_ptr_impl(compiler, builder, expr, local_ctx,
+                              local_allocas, break_bb, cont_bb);
+
+  size_t local;
+  if (!compiler->restrict_locals.size ||
+      !get_restrict_base(compiler, expr, local_ctx, &local)) {
+    return ptr;
+  }
 
-      LLVMValueRef alloca = build_alloca_at_func_start(
-          compiler, builder, decl->name, decl->type, local_ctx);
+  // Accesses are found later through the uses of their pointer, so each one
+  // needs a pointer of its own rather than the value of the restrict pointer.
+  if (!LLVMIsAGetElementPtrInst(ptr)) {
+    LLVMValueRef offsets[] = {
+        LLVMConstNull(LLVMInt64TypeInContext(compiler->ctx))};
+    ptr = LLVMBuildGEP2(builder, LLVMInt8TypeInContext(compiler->ctx), ptr,
+                        offsets, 1, "");
+    if (!LLVMIsAGetElementPtrInst(ptr))
+      return ptr;  // This was folded into a constant.
+  }
 
-      if (decl->initializer) {
-        if (decl->initializer->vtable->kind == EK_InitializerList) {
-          const InitializerList* init =
-              (const InitializerList*)decl->initializer;
-
-          size_t agg_size;
-          bool is_array =
-              sema_is_array_type(compiler->sema, decl->type, local_ctx);
-          if (is_array) {
-            const ArrayType* arr_ty =
-                sema_get_array_type(compiler->sema, decl->type, local_ctx);
-            if (arr_ty->size) {
-              agg_size =
-                  sema_eval_sizeof_type(compiler->sema, decl->type, local_ctx);
-            } else {
-              assert(init->elems.size > 0);
-              agg_size = sema_eval_sizeof_type(compiler->sema,
-                                               arr_ty->elem_type, local_ctx) *
-                         init->elems.size;
-            }
-          } else {
-            agg_size =
-                sema_eval_sizeof_type(compiler->sema, decl->type, local_ctx);
-          }
-          LLVMBuildMemSet(
-              builder, alloca, LLVMConstNull(LLVMInt8Type()),
-              LLVMConstInt(LLVMInt32Type(), agg_size, /*IsSigned=*/0),
-              /*Align=*/0);
-
-          for (size_t i = 0; i < init->elems.size; ++i) {
-            const InitializerListElem* elem = vector_at(&init->elems, i);
-            LLVMValueRef val =
-                compile_expr(compiler, builder, elem->expr, local_ctx,
-                             local_allocas, break_bb, cont_bb);
+  RestrictAccess* access = vector_append_storage(&compiler->restrict_accesses);
+  access->ptr = ptr;
+  access->local = local;
+  return ptr;
+}
 
-            // TODO: Handle designated initializer names.
-
-            LLVMValueRef gep;
-            if (is_array) {
-              LLVMValueRef offsets[] = {
-                  LLVMConstNull(LLVMInt32Type()),
-                  LLVMConstInt(LLVMInt32Type(), i, /*IsSigned=*/0),
-              };
-              gep = LLVMBuildGEP2(builder, llvm_ty, alloca, offsets, 2, "");
-            } else {
-              LLVMValueRef offsets[] = {
-                  LLVMConstNull(LLVMInt32Type()),
-                  LLVMConstInt(LLVMInt32Type(), i, /*IsSigned=*/0)};
-              gep = LLVMBuildGEP2(builder, llvm_ty, alloca, offsets, 2, "");
-            }
-            LLVMBuildStore(builder, val, gep);
-          }
-        } else {
-          LLVMValueRef init = compile_implicit_cast(
-              compiler, builder, decl->initializer, decl->type, local_ctx,
-              local_allocas, break_bb, cont_bb);
-          get_aligned_store(compiler, builder, decl->type, init, alloca,
-                            local_ctx);
-        }
-      }
+// Choose the most efficient TLS model that is valid for `gv`, like GCC does.
+// Variables defined in position dependent code or a PIE are in the
+// executable, so their offsets from the thread pointer are known at link time
+// (local-exec).
+// Other variables in the executable or loaded at startup are found through a
+// GOT entry (initial-exec). Shared libraries can be loaded with dlopen, so
+// their variables have to be looked up with `__tls_get_addr`. That lookup is
+// done once per module for variables with internal linkage (local-dynamic).
+static LLVMThreadLocalMode get_tls_model(const Compiler* compiler,
+                                         const GlobalVariable* gv) {
+  TLSModel model = gv->attrs.tls_model;
+  if (model == TLS_Default) {
+    bool is_local = global_has_internal_linkage(gv);
+    if (compiler->target->reloc_model == LLVMRelocPIC &&
+        !compiler->target->pie) {
+      model = is_local ? TLS_LocalDynamic : TLS_GlobalDynamic;
+    } else {
+      model = gv->initializer ? TLS_LocalExec : TLS_InitialExec;
+    }
+    if (model < compiler->target->tls_model)
+      model = compiler->target->tls_model;
+  }
 
-      // Note this may override allocas and types declared in a higher scope,
-      // but this should be ok since we should've cloned any local contexts
-      // before entering a lower scope.
-      tree_map_set(local_allocas, decl->name, alloca);
-      tree_map_set(local_ctx, decl->name, decl->type);
+  switch (model) {
+    case TLS_Default:
+    case TLS_GlobalDynamic:
+      return LLVMGeneralDynamicTLSModel;
+    case TLS_LocalDynamic:
+      return LLVMLocalDynamicTLSModel;
+    case TLS_InitialExec:
+      return LLVMInitialExecTLSModel;
+    case TLS_LocalExec:
+      return LLVMLocalExecTLSModel;
+  }
+}
 
-      return;
-    }
-    case SK_SwitchStmt: {
-      const SwitchStmt* switch_stmt = (const SwitchStmt*)stmt;
-      compile_switch_statement(compiler, builder, switch_stmt, local_ctx,
-                               local_allocas, break_bb, cont_bb);
-      return;
+// Whether an object of `type` is never written, so its definition can be put
+// in read only data. Arrays are as const as their elements.
+static bool is_read_only_object_type(Compiler* compiler, const Type* type) {
+  while (true) {
+    if (type->qualifiers & (kVolatileMask | kAtomicMask))
+      return false;
+    if (type->qualifiers & kConstMask)
+      return true;
+    if (type->vtable->kind == TK_NamedType) {
+      type = sema_resolve_named_type(compiler->sema, (const NamedType*)type);
+    } else if (type->vtable->kind == TK_ArrayType) {
+      type = ((const ArrayType*)type)->elem_type;
+    } else {
+      return false;
     }
-    default:
-      UNREACHABLE_MSG("TODO: Implement compile_statement for this stmt %d",
-                      stmt->vtable->kind);
   }
 }
 
-LLVMMetadataRef get_di_function_type(Compiler* compiler,
-                                     const FunctionType* func_ty) {
-  vector args;
-  vector_construct(&args, sizeof(LLVMMetadataRef), alignof(LLVMMetadataRef));
+void compile_global_variable(Compiler* compiler, const GlobalVariable* gv) {
+  TreeMap dummy_ctx;
+  string_tree_map_construct(&dummy_ctx);
+  LLVMTypeRef ty = get_llvm_type(compiler, gv->type, &dummy_ctx);
 
-  for (size_t i = 0; i < func_ty->pos_args.size; ++i) {
-    LLVMMetadataRef* arg_md = vector_append_storage(&args);
-    // TODO: Use the correct type.
-    *arg_md = LLVMDIBuilderCreateUnspecifiedType(
-        compiler->dibuilder, /*Name=*/"TODO", /*NameLen=*/4);
+  if (gv->type->vtable->kind == TK_FunctionType) {
+    LLVMValueRef func = get_named_global(compiler, gv->name);
+    if (!func) {
+      func = LLVMAddFunction(compiler->mod, gv->name, ty);
+      assert(!gv->initializer &&
+             "If this had an initializer, it would be a function definition.");
+    }
+    add_function_attributes(compiler, func, gv->name,
+                            (const FunctionType*)gv->type, &gv->attrs,
+                            &dummy_ctx);
+    tree_map_destroy(&dummy_ctx);
+    return;
   }
 
-  LLVMMetadataRef md = LLVMDIBuilderCreateSubroutineType(
-      compiler->dibuilder, compiler->difile, args.data,
-      (unsigned)func_ty->pos_args.size, /*Flags=*/0);
-  vector_destroy(&args);
-  return md;
+  LLVMValueRef glob = LLVMAddGlobal(compiler->mod, ty, gv->name);
+  if (gv->initializer) {
+    // TODO: This would be handled much easier if we had a node for implicit
+    // casts.
+    LLVMValueRef val = maybe_compile_constant_implicit_cast(
+        compiler, gv->initializer, gv->type, &dummy_ctx);
+
+    if (LLVMTypeOf(val) != ty) {
+      // Initializers with zero tails and unsized arrays have a different type
+      // than the declared one. Replace the global with one of the right type.
+      // This is done after compiling the initializer since it can refer to
+      // the global itself.
+      LLVMValueRef new_glob = LLVMAddGlobal(compiler->mod, LLVMTypeOf(val), "");
+      LLVMReplaceAllUsesWith(glob, new_glob);
+      LLVMDeleteGlobal(glob);
+      LLVMSetValueName2(new_glob, gv->name, strlen(gv->name));
+      glob = new_glob;
+    }
+
+    LLVMSetInitializer(glob, val);
+    if (is_read_only_object_type(compiler, gv->type))
+      LLVMSetGlobalConstant(glob, 1);
+  }
+
+  if (has_explicit_alignment(gv->type, ty)) {
+    LLVMSetAlignment(glob, (unsigned)sema_eval_alignof_type(
+                               compiler->sema, gv->type, &dummy_ctx));
+  }
+
+  if (global_has_internal_linkage(gv))
+    LLVMSetLinkage(glob, LLVMInternalLinkage);
+
+  if (gv->is_thread_local)
+    LLVMSetThreadLocalMode(glob, get_tls_model(compiler, gv));
+
+  tree_map_destroy(&dummy_ctx);
 }
 
-void compile_function_definition(Compiler* compiler,
+// Declare a function without emitting its body. This is used for functions
+// whose bodies are compiled into another module.
+void declare_function_definition(Compiler* compiler,
                                  const FunctionDefinition* f) {
-  FunctionType* func_ty = (FunctionType*)(f->type);
-
   TreeMap local_ctx;
   string_tree_map_construct(&local_ctx);
-
-  // TODO: Have a global version of `get_llvm_type`. The local_ctx is really
-  // unused here but it's needed as an argument.
   LLVMTypeRef llvm_func_ty = get_llvm_type(compiler, f->type, &local_ctx);
-
   LLVMValueRef func = get_named_global(compiler, f->name);
   if (!func)
     func = LLVMAddFunction(compiler->mod, f->name, llvm_func_ty);
-  assert(LLVMGetTypeKind(LLVMTypeOf(func)) == LLVMPointerTypeKind);
+  const FunctionType* func_ty = (const FunctionType*)f->type;
+  add_function_attributes(compiler, func, f->name, func_ty, &f->attrs,
+                          &local_ctx);
+  add_parameter_attributes(compiler, func, func_ty, &local_ctx);
+  tree_map_destroy(&local_ctx);
+}
 
-  if (!f->is_extern)
-    LLVMSetLinkage(func, LLVMInternalLinkage);
+// Declare a global variable without its initializer. This is used for globals
+// whose definitions are compiled into another module.
+void declare_global_variable(Compiler* compiler, const GlobalVariable* gv) {
+  if (gv->type->vtable->kind == TK_FunctionType) {
+    compile_global_variable(compiler, gv);
+    return;
+  }
 
-  // TODO: Fill out the line number and other relevant fields.
-  LLVMMetadataRef subprogram = LLVMDIBuilderCreateFunction(
-      compiler->dibuilder, compiler->difile, f->name, strlen(f->name), f->name,
-      strlen(f->name), compiler->difile, /*LineNo=*/1,
-      get_di_function_type(compiler, func_ty), /*IsLocalToUnit=*/0,
-      /*IsDefinition=*/1, /*ScopeLine=*/0,
-      /*Flags=*/0, /*IsOptimized=*/0);
-  LLVMSetSubprogram(func, subprogram);
-  LLVMDIBuilderFinalizeSubprogram(compiler->dibuilder, subprogram);
+  TreeMap dummy_ctx;
+  string_tree_map_construct(&dummy_ctx);
+  LLVMTypeRef ty = get_llvm_type(compiler, gv->type, &dummy_ctx);
+  if (!get_named_global(compiler, gv->name)) {
+    LLVMValueRef glob = LLVMAddGlobal(compiler->mod, ty, gv->name);
+    if (gv->is_thread_local)
+      LLVMSetThreadLocalMode(glob, get_tls_model(compiler, gv));
+  }
+  tree_map_destroy(&dummy_ctx);
+}
+
+static LLVMValueRef get_or_add_function(Compiler* compiler, const char* name,
+                                        LLVMTypeRef type) {
+  LLVMValueRef func = LLVMGetNamedFunction(compiler->mod, name);
+  if (!func)
+    func = LLVMAddFunction(compiler->mod, name, type);
+  return func;
+}
+
+// Each run appends a `#profile <version>` line to the profile before its
+// counts. The version changes whenever the counters of a function get a
+// different meaning, such as when more branches are instrumented, so stale
+// profiles are rejected rather than misread.
+static const unsigned long long kProfileVersion = 1;
+
+// Add a destructor which appends the counters of every function instrumented
+// in this module to the profile file. After the version line, each function is
+// written on its own line as its profile name, its number of counters and then
+// the counters.
+static void emit_profile_writer(Compiler* compiler) {
+  LLVMContextRef ctx = compiler->ctx;
+  LLVMTypeRef ptr_ty = get_opaque_ptr(compiler);
+  LLVMTypeRef i32 = LLVMInt32TypeInContext(ctx);
+  LLVMTypeRef i64 = LLVMInt64TypeInContext(ctx);
+
+  LLVMTypeRef two_ptrs[] = {ptr_ty, ptr_ty};
+  LLVMTypeRef fopen_ty = LLVMFunctionType(ptr_ty, two_ptrs, 2, /*IsVarArg=*/0);
+  LLVMTypeRef fprintf_ty = LLVMFunctionType(i32, two_ptrs, 2, /*IsVarArg=*/1);
+  LLVMTypeRef fclose_ty = LLVMFunctionType(i32, two_ptrs, 1, /*IsVarArg=*/0);
+  LLVMValueRef fopen_fn = get_or_add_function(compiler, "fopen", fopen_ty);
+  LLVMValueRef fprintf_fn =
+      get_or_add_function(compiler, "fprintf", fprintf_ty);
+  LLVMValueRef fclose_fn = get_or_add_function(compiler, "fclose", fclose_ty);
+
+  LLVMTypeRef writer_ty = LLVMFunctionType(LLVMVoidTypeInContext(ctx), NULL, 0,
+                                           /*IsVarArg=*/0);
+  LLVMValueRef writer =
+      LLVMAddFunction(compiler->mod, "__prof_write", writer_ty);
+  LLVMSetLinkage(writer, LLVMPrivateLinkage);
+
+  LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(ctx, writer, "entry");
+  LLVMBasicBlockRef write = LLVMAppendBasicBlockInContext(ctx, writer, "write");
+  LLVMBasicBlockRef done = LLVMAppendBasicBlockInContext(ctx, writer, "done");
+  LLVMBuilderRef builder = LLVMCreateBuilderInContext(ctx);
 
-  LLVMBasicBlockRef entry = LLVMAppendBasicBlock(func, "entry");
-  LLVMBuilderRef builder = LLVMCreateBuilder();
   LLVMPositionBuilderAtEnd(builder, entry);
+  LLVMValueRef fopen_args[] = {
+      LLVMBuildGlobalStringPtr(builder, compiler->profile->generate_path, ""),
+      LLVMBuildGlobalStringPtr(builder, "a", ""),
+  };
+  LLVMValueRef file =
+      LLVMBuildCall2(builder, fopen_ty, fopen_fn, fopen_args, 2, "");
+  LLVMBuildCondBr(builder, LLVMBuildIsNull(builder, file, ""), done, write);
+
+  LLVMPositionBuilderAtEnd(builder, write);
+  LLVMValueRef version_args[] = {
+      file,
+      LLVMBuildGlobalStringPtr(builder, "#profile %llu\n", ""),
+      LLVMConstInt(i64, kProfileVersion, /*IsSigned=*/0),
+  };
+  LLVMBuildCall2(builder, fprintf_ty, fprintf_fn, version_args, 3, "");
+  LLVMValueRef header_fmt = LLVMBuildGlobalStringPtr(builder, "%s %llu", "");
+  LLVMValueRef counter_fmt = LLVMBuildGlobalStringPtr(builder, " %llu", "");
+  LLVMValueRef newline = LLVMBuildGlobalStringPtr(builder, "\n", "");
+  for (size_t i = 0; i < compiler->instrumented_functions.size; ++i) {
+    const InstrumentedFunction* f =
+        vector_at(&compiler->instrumented_functions, i);
+    LLVMValueRef header_args[] = {
+        file,
+        header_fmt,
+        LLVMBuildGlobalStringPtr(builder, f->name, ""),
+        LLVMConstInt(i64, f->num_counters, /*IsSigned=*/0),
+    };
+    LLVMBuildCall2(builder, fprintf_ty, fprintf_fn, header_args, 4, "");
+
+    for (size_t j = 0; j < f->num_counters; ++j) {
+      LLVMValueRef offsets[] = {LLVMConstInt(i64, j, /*IsSigned=*/0)};
+      LLVMValueRef ptr =
+          LLVMBuildGEP2(builder, i64, f->counters, offsets, 1, "");
+      LLVMValueRef counter_args[] = {file, counter_fmt,
+                                     LLVMBuildLoad2(builder, i64, ptr, "")};
+      LLVMBuildCall2(builder, fprintf_ty, fprintf_fn, counter_args, 3, "");
+    }
 
-  LLVMContextRef ctx = LLVMGetModuleContext(compiler->mod);
-  // TODO: Fill these in with correct values.
-  LLVMMetadataRef debug_loc = LLVMDIBuilderCreateDebugLocation(
-      ctx, /*Line=*/1, /*Column=*/0, subprogram, /*InlinedAt=*/NULL);
-  LLVMSetCurrentDebugLocation2(builder, debug_loc);
+    LLVMValueRef newline_args[] = {file, newline};
+    LLVMBuildCall2(builder, fprintf_ty, fprintf_fn, newline_args, 2, "");
+  }
+  LLVMValueRef fclose_args[] = {file};
+  LLVMBuildCall2(builder, fclose_ty, fclose_fn, fclose_args, 1, "");
+  LLVMBuildBr(builder, done);
 
-  TreeMap local_allocas;
-  string_tree_map_construct(&local_allocas);
+  LLVMPositionBuilderAtEnd(builder, done);
+  LLVMBuildRetVoid(builder);
+  LLVMDisposeBuilder(builder);
 
-  for (size_t i = 0; i < func_ty->pos_args.size; ++i) {
-    FunctionArg* arg = vector_at(&func_ty->pos_args, i);
-    if (!arg->name)
-      continue;
+  // Run the writer when the program exits.
+  LLVMTypeRef dtor_fields[] = {i32, ptr_ty, ptr_ty};
+  LLVMTypeRef dtor_ty =
+      LLVMStructTypeInContext(ctx, dtor_fields, 3, /*Packed=*/0);
+  LLVMValueRef dtor_vals[] = {LLVMConstInt(i32, 65535, /*IsSigned=*/0), writer,
+                              LLVMConstNull(ptr_ty)};
+  LLVMValueRef dtor[] = {
+      LLVMConstStructInContext(ctx, dtor_vals, 3, /*Packed=*/0)};
+  LLVMValueRef dtors = LLVMAddGlobal(
+      compiler->mod, LLVMArrayType(dtor_ty, 1), "llvm.global_dtors");
+  LLVMSetLinkage(dtors, LLVMAppendingLinkage);
+  LLVMSetInitializer(dtors, LLVMConstArray(dtor_ty, dtor, 1));
+}
 
-    // Copy the parameter locally.
-    LLVMValueRef llvm_arg = LLVMGetParam(func, (unsigned)i);
-    LLVMValueRef alloca = build_alloca_at_func_start(
-        compiler, builder, arg->name, arg->type, &local_ctx);
-    get_aligned_store(compiler, builder, arg->type, llvm_arg, alloca,
-                      &local_ctx);
+// Compile the AST into `compiler->mod`. The function definitions are split
+// round-robin between `num_partitions` modules and only the ones belonging to
+// `partition` get bodies. Global variable definitions always go into the first
+// partition. Every other global is only declared.
+void compile_top_level_nodes(Compiler* compiler, const vector* ast_nodes,
+                             size_t partition, size_t num_partitions) {
+  size_t num_funcs = 0;
+  for (const TopLevelNode** it = vector_begin(ast_nodes);
+       it != vector_end(ast_nodes); ++it) {
+    const TopLevelNode* top_level_decl = *it;
 
-    tree_map_set(&local_ctx, arg->name, arg->type);
-    tree_map_set(&local_allocas, arg->name, alloca);
+    switch (top_level_decl->vtable->kind) {
+      case TLNK_Typedef:
+      case TLNK_StaticAssert:
+      case TLNK_StructDeclaration:
+      case TLNK_EnumDeclaration:
+      case TLNK_UnionDeclaration:
+        break;
+      case TLNK_GlobalVariable: {
+        GlobalVariable* gv = (GlobalVariable*)top_level_decl;
+        if (partition == 0)
+          compile_global_variable(compiler, gv);
+        else
+          declare_global_variable(compiler, gv);
+        break;
+      }
+      case TLNK_FunctionDefinition: {
+        FunctionDefinition* f = (FunctionDefinition*)top_level_decl;
+        if (num_funcs % num_partitions == partition)
+          compile_function_definition(compiler, f);
+        else
+          declare_function_definition(compiler, f);
+        ++num_funcs;
+        break;
+      }
+    }
+
+    if (LLVMVerifyModule(compiler->mod, LLVMPrintMessageAction, NULL)) {
+      printf("Verify module failed\n");
+      LLVMDumpModule(compiler->mod);
+      __builtin_trap();
+    }
   }
 
-  compile_statement(compiler, builder, &f->body->base, &local_ctx,
-                    &local_allocas, /*break_bb=*/NULL, /*cont_bb=*/NULL,
-                    /*last_expr=*/NULL);
+  if (compiler->instrumented_functions.size)
+    emit_profile_writer(compiler);
+}
 
-  if (!last_instruction_is_terminator(builder)) {
-    if (is_void_type(func_ty->return_type)) {
-      LLVMBuildRetVoid(builder);
-    } else {
-      call_llvm_debugtrap(compiler, builder);
-      LLVMBuildUnreachable(builder);
+///
+/// End Compiler Implementation
+///
+
+///
+/// Start Parallel Codegen Implementation
+///
+
+// Append the names of the functions and global variables of `ast_nodes` with
+// internal linkage to `names`.
+static void collect_internal_symbols(const vector* ast_nodes, vector* names) {
+  for (const TopLevelNode** it = vector_begin(ast_nodes);
+       it != vector_end(ast_nodes); ++it) {
+    const TopLevelNode* top_level_decl = *it;
+
+    const char* name = NULL;
+    if (top_level_decl->vtable->kind == TLNK_FunctionDefinition) {
+      const FunctionDefinition* f = (const FunctionDefinition*)top_level_decl;
+      if (function_has_internal_linkage(f))
+        name = f->name;
+    } else if (top_level_decl->vtable->kind == TLNK_GlobalVariable) {
+      const GlobalVariable* gv = (const GlobalVariable*)top_level_decl;
+      if (global_has_internal_linkage(gv))
+        name = gv->name;
+    }
+
+    if (name) {
+      const char** storage = vector_append_storage(names);
+      *storage = name;
     }
   }
+}
 
-  tree_map_destroy(&local_ctx);
-  tree_map_destroy(&local_allocas);
+static LLVMValueRef get_module_symbol(LLVMModuleRef mod, const char* name) {
+  LLVMValueRef val = LLVMGetNamedFunction(mod, name);
+  if (!val)
+    val = LLVMGetNamedGlobal(mod, name);
+  return val;
+}
 
-  LLVMDisposeBuilder(builder);
+// Internal symbols from one partition can be referenced by another, so they
+// are temporarily made hidden external symbols, and so are their declarations
+// in the other partitions. `internal_symbols` holds their names.
+static void export_internal_symbols(LLVMModuleRef mod,
+                                    const vector* internal_symbols) {
+  for (size_t i = 0; i < internal_symbols->size; ++i) {
+    LLVMValueRef val =
+        get_module_symbol(mod, *(const char**)vector_at(internal_symbols, i));
+    if (val) {
+      LLVMSetLinkage(val, LLVMExternalLinkage);
+      LLVMSetVisibility(val, LLVMHiddenVisibility);
+    }
+  }
+}
 
-  if (LLVMVerifyFunction(func, LLVMPrintMessageAction)) {
-    printf("Verify function '%s' failed\n", f->name);
-    LLVMDumpValue(func);
-    __builtin_trap();
+// Undo `export_internal_symbols` on the linked module.
+static void restore_internal_symbols(LLVMModuleRef mod,
+                                     const vector* internal_symbols) {
+  for (size_t i = 0; i < internal_symbols->size; ++i) {
+    LLVMValueRef val =
+        get_module_symbol(mod, *(const char**)vector_at(internal_symbols, i));
+    if (val && !LLVMIsDeclaration(val)) {
+      LLVMSetLinkage(val, LLVMInternalLinkage);
+      LLVMSetVisibility(val, LLVMDefaultVisibility);
+    }
   }
 }
 
-LLVMValueRef compile_lvalue_ptr(Compiler* compiler, LLVMBuilderRef builder,
-                                const Expr* expr, TreeMap* local_ctx,
-                                TreeMap* local_allocas,
-                                LLVMBasicBlockRef break_bb,
-                                LLVMBasicBlockRef cont_bb) {
-  switch (expr->vtable->kind) {
-    case EK_DeclRef: {
-      const DeclRef* decl = (const DeclRef*)expr;
+// Function definitions are split round-robin into one partition per this many
+// of them, with at most kMaxCodegenPartitions partitions. Neither depends on
+// the number of threads, so the output is the same for any -j.
+static const size_t kFunctionsPerCodegenPartition = 4;
+static const size_t kMaxCodegenPartitions = 256;
+
+static size_t get_num_codegen_partitions(const vector* ast_nodes) {
+  size_t num_funcs = 0;
+  for (const TopLevelNode** it = vector_begin(ast_nodes);
+       it != vector_end(ast_nodes); ++it) {
+    if ((*it)->vtable->kind == TLNK_FunctionDefinition)
+      ++num_funcs;
+  }
 
-      LLVMValueRef val = NULL;
-      tree_map_get(local_allocas, decl->name, (void*)&val);
+  size_t num_partitions =
+      (num_funcs + kFunctionsPerCodegenPartition - 1) /
+      kFunctionsPerCodegenPartition;
+  if (num_partitions > kMaxCodegenPartitions)
+    num_partitions = kMaxCodegenPartitions;
+  if (num_partitions == 0)
+    num_partitions = 1;
+  return num_partitions;
+}
 
-      if (!val)
-        val = get_named_global(compiler, decl->name);
+// Set when each partition is emitted as an object by the thread compiling it.
+typedef struct {
+  LLVMTargetRef target;
+  const char* triple;
+  bool function_sections;
+  bool data_sections;
+} ObjectOptions;
 
-      if (!val) {
-        printf("Couldn't find alloca or global for '%s'\n", decl->name);
-        LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-        LLVMDumpValue(fn);
-        __builtin_trap();
-      }
+typedef struct {
+  const vector* ast_nodes;
+  Sema* sema;
+  const char* module_name;
+  LLVMTargetDataRef data_layout;
+  const TargetOptions* target;
+  const ProfileOptions* profile;
+  const ObjectOptions* object_options;
+  const vector* internal_symbols;
+  size_t partition;
+  size_t num_partitions;
+
+  // The object of this partition with `object_options` and its bitcode
+  // otherwise. This is set by the thread compiling it. If emitting the object
+  // fails, this is NULL and `error` is set.
+  LLVMMemoryBufferRef result;
+  char* error;
 
-      assert(LLVMGetTypeKind(LLVMTypeOf(val)) == LLVMPointerTypeKind);
-      return val;
-    }
-    case EK_MemberAccess: {
-      const MemberAccess* access = (const MemberAccess*)expr;
-      const StructType* base_ty = sema_get_struct_type_from_member_access(
-          compiler->sema, access, local_ctx);
-      size_t offset;
-      sema_get_struct_member(compiler->sema, base_ty, access->member, &offset);
+  // vector of StackUsages for the functions of this partition. NULL without
+  // -fstack-usage.
+  vector* stack_usages;
+} CodegenPartition;
 
-      LLVMValueRef base_llvm;
-      if (access->is_arrow) {
-        base_llvm = compile_expr(compiler, builder, access->base, local_ctx,
-                                 local_allocas, break_bb, cont_bb);
-      } else {
-        base_llvm =
-            compile_lvalue_ptr(compiler, builder, access->base, local_ctx,
-                               local_allocas, break_bb, cont_bb);
-      }
+typedef struct {
+  CodegenPartition* partitions;
+  size_t num_partitions;
+  size_t first;
+  size_t stride;
+} CodegenThread;
+
+static void set_symbol_binding(LLVMModuleRef mod, const TargetOptions* target);
+static void assign_unique_sections(LLVMModuleRef mod, bool function_sections,
+                                   bool data_sections, bool pic);
+
+// Each partition is compiled in its own LLVMContext since contexts cannot be
+// shared between threads. The result is handed back as bitcode so it can be
+// read into the context of the final module, or as an object emitted with
+// `target_machine`.
+static void compile_partition(CodegenPartition* partition,
+                              LLVMTargetMachineRef target_machine) {
+  LLVMContextRef ctx = LLVMContextCreate();
+  LLVMModuleRef mod =
+      LLVMModuleCreateWithNameInContext(partition->module_name, ctx);
+  LLVMSetModuleDataLayout(mod, partition->data_layout);
+  LLVMDIBuilderRef dibuilder = LLVMCreateDIBuilder(mod);
+
+  Compiler compiler;
+  compiler_construct(&compiler, mod, partition->sema, dibuilder,
+                     partition->target, partition->profile);
+  compiler.stack_usages = partition->stack_usages;
+  compile_top_level_nodes(&compiler, partition->ast_nodes,
+                          partition->partition, partition->num_partitions);
+  LLVMDIBuilderFinalize(dibuilder);
+
+  export_internal_symbols(mod, partition->internal_symbols);
+  const ObjectOptions* object_options = partition->object_options;
+  if (object_options) {
+    LLVMSetTarget(mod, object_options->triple);
+    set_symbol_binding(mod, partition->target);
+    assign_unique_sections(
+        mod, object_options->function_sections, object_options->data_sections,
+        /*pic=*/partition->target->reloc_model != LLVMRelocStatic);
+    if (LLVMTargetMachineEmitToMemoryBuffer(target_machine, mod,
+                                            LLVMObjectFile, &partition->error,
+                                            &partition->result))
+      partition->result = NULL;
+  } else {
+    partition->result = LLVMWriteBitcodeToMemoryBuffer(mod);
+  }
+
+  compiler_destroy(&compiler);
+  LLVMDisposeDIBuilder(dibuilder);
+  LLVMDisposeModule(mod);
+  LLVMContextDispose(ctx);
+}
 
-      LLVMTypeRef llvm_base_ty =
-          get_llvm_type(compiler, &base_ty->type, local_ctx);
-      LLVMValueRef llvm_offset =
-          LLVMConstInt(LLVMInt32Type(), offset, /*signed=*/0);
-      LLVMValueRef offsets[] = {LLVMConstNull(LLVMInt32Type()), llvm_offset};
-      LLVMValueRef gep =
-          LLVMBuildGEP2(builder, llvm_base_ty, base_llvm, offsets, 2, "");
-      return gep;
-    }
-    case EK_UnOp:
-      return compile_unop_lvalue_ptr(compiler, builder, (const UnOp*)expr,
-                                     local_ctx, local_allocas, break_bb,
-                                     cont_bb);
-    case EK_Cast: {
-      const Cast* cast = (const Cast*)expr;
-      const Type* src_ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, expr, local_ctx);
-      const Type* dst_ty = cast->to;
-      LLVMTypeRef llvm_src_ty = get_llvm_type(compiler, src_ty, local_ctx);
-      LLVMTypeRef llvm_dst_ty = get_llvm_type(compiler, dst_ty, local_ctx);
-      if (LLVMGetTypeKind(llvm_src_ty) == LLVMGetTypeKind(llvm_dst_ty))
-        return compile_lvalue_ptr(compiler, builder, cast->base, local_ctx,
-                                  local_allocas, break_bb, cont_bb);
+// Thread `first` compiles partitions `first`, `first + stride`, ... A target
+// machine can't be used by several threads at once, so each thread emitting
+// objects creates its own.
+static void* run_codegen_thread(void* arg) {
+  CodegenThread* thread = arg;
+  const ObjectOptions* object_options = thread->partitions->object_options;
+  const TargetOptions* target = thread->partitions->target;
+  LLVMTargetMachineRef target_machine = NULL;
+  if (object_options) {
+    target_machine = LLVMCreateTargetMachine(
+        object_options->target, object_options->triple, target->cpu,
+        target->features, LLVMCodeGenLevelNone, target->reloc_model,
+        LLVMCodeModelDefault);
+  }
 
-      UNREACHABLE_MSG("Unhandled lvalue ptr cast from %d to %d",
-                      LLVMGetTypeKind(llvm_src_ty),
-                      LLVMGetTypeKind(llvm_dst_ty));
+  for (size_t i = thread->first; i < thread->num_partitions;
+       i += thread->stride)
+    compile_partition(&thread->partitions[i], target_machine);
+
+  if (target_machine)
+    LLVMDisposeTargetMachine(target_machine);
+  return NULL;
+}
+
+// Compile the AST in partitions on up to `num_threads` threads and return the
+// partitions, which are set in `num_partitions`. The results are in the
+// partitions. If `stack_usages` is given, the StackUsages of all partitions
+// are appended to it in partition order.
+static CodegenPartition* compile_partitions(
+    LLVMModuleRef mod, Sema* sema, const TargetOptions* target,
+    const ProfileOptions* profile, const ObjectOptions* object_options,
+    const vector* ast_nodes, const vector* internal_symbols,
+    size_t num_threads, vector* stack_usages, size_t* num_partitions) {
+  *num_partitions = get_num_codegen_partitions(ast_nodes);
+  if (num_threads > *num_partitions)
+    num_threads = *num_partitions;
+
+  CodegenPartition* partitions =
+      malloc(sizeof(CodegenPartition) * *num_partitions);
+  size_t len;
+  const char* module_name = LLVMGetModuleIdentifier(mod, &len);
+  for (size_t i = 0; i < *num_partitions; ++i) {
+    CodegenPartition* partition = &partitions[i];
+    partition->ast_nodes = ast_nodes;
+    partition->sema = sema;
+    partition->module_name = module_name;
+    partition->data_layout = LLVMGetModuleDataLayout(mod);
+    partition->target = target;
+    partition->profile = profile;
+    partition->object_options = object_options;
+    partition->internal_symbols = internal_symbols;
+    partition->partition = i;
+    partition->num_partitions = *num_partitions;
+    partition->result = NULL;
+    partition->error = NULL;
+    partition->stack_usages = NULL;
+    if (stack_usages) {
+      partition->stack_usages = malloc(sizeof(vector));
+      vector_construct(partition->stack_usages, sizeof(StackUsage),
+                       alignof(StackUsage));
     }
-    case EK_Index: {
-      const Index* index = (const Index*)expr;
-      const Expr* base = index->base;
-      const Type* base_ty =
-          sema_get_type_of_expr_in_ctx(compiler->sema, base, local_ctx);
+  }
 
-      LLVMValueRef idx = compile_expr(compiler, builder, index->idx, local_ctx,
-                                      local_allocas, break_bb, cont_bb);
+  CodegenThread* thread_args = malloc(sizeof(CodegenThread) * num_threads);
+  pthread_t* threads = malloc(sizeof(pthread_t) * num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    thread_args[i].partitions = partitions;
+    thread_args[i].num_partitions = *num_partitions;
+    thread_args[i].first = i;
+    thread_args[i].stride = num_threads;
+    int err =
+        pthread_create(&threads[i], NULL, run_codegen_thread, &thread_args[i]);
+    ASSERT_MSG(err == 0, "Could not create codegen thread %zu", i);
+  }
+  for (size_t i = 0; i < num_threads; ++i) pthread_join(threads[i], NULL);
 
-      LLVMValueRef base_ptr = compile_expr(compiler, builder, base, local_ctx,
-                                           local_allocas, break_bb, cont_bb);
+  for (size_t i = 0; i < *num_partitions; ++i) {
+    if (partitions[i].stack_usages) {
+      for (size_t j = 0; j < partitions[i].stack_usages->size; ++j) {
+        StackUsage* usage = vector_append_storage(stack_usages);
+        *usage = *(StackUsage*)vector_at(partitions[i].stack_usages, j);
+      }
+      vector_destroy(partitions[i].stack_usages);
+      free(partitions[i].stack_usages);
+    }
+  }
 
-      assert(LLVMGetTypeKind(LLVMTypeOf(base_ptr)) == LLVMPointerTypeKind);
+  free(threads);
+  free(thread_args);
+  return partitions;
+}
 
-      if (sema_is_pointer_type(compiler->sema, base_ty, local_ctx)) {
-        LLVMValueRef offsets[] = {idx};
+// Generate IR for the AST on `num_threads` threads and link the results into
+// `mod`. This is used when the output is IR or bitcode for LTO. The AST is
+// always split into the same partitions, which are linked in the same order,
+// so the final module depends neither on the number of threads nor on how
+// they were scheduled. If `stack_usages` is given, the StackUsages of all
+// partitions are appended to it in that order too.
+void compile_top_level_nodes_in_parallel(LLVMModuleRef mod, Sema* sema,
+                                         const TargetOptions* target,
+                                         const ProfileOptions* profile,
+                                         const vector* ast_nodes,
+                                         size_t num_threads,
+                                         vector* stack_usages) {
+  vector internal_symbols;  // vector of const char*.
+  vector_construct(&internal_symbols, sizeof(const char*),
+                   alignof(const char*));
+  collect_internal_symbols(ast_nodes, &internal_symbols);
+
+  size_t num_partitions;
+  CodegenPartition* partitions = compile_partitions(
+      mod, sema, target, profile, /*object_options=*/NULL, ast_nodes,
+      &internal_symbols, num_threads, stack_usages, &num_partitions);
+
+  for (size_t i = 0; i < num_partitions; ++i) {
+    LLVMModuleRef partition;
+    if (LLVMParseBitcodeInContext2(LLVMGetModuleContext(mod),
+                                   partitions[i].result, &partition)) {
+      printf("Reading codegen partition %zu failed\n", i);
+      __builtin_trap();
+    }
+    LLVMDisposeMemoryBuffer(partitions[i].result);
 
-        const Type* pointee_ty =
-            sema_get_pointee(compiler->sema, base_ty, local_ctx);
-        LLVMTypeRef llvm_pointee_ty =
-            get_llvm_type(compiler, pointee_ty, local_ctx);
-        return LLVMBuildGEP2(builder, llvm_pointee_ty, base_ptr, offsets, 1,
-                             "idx_ptr");
-      } else if (sema_is_array_type(compiler->sema, base_ty, local_ctx)) {
-        // TODO: This could probably be consolidated with the branch above.
+    // This takes ownership of `partition`.
+    if (LLVMLinkModules2(mod, partition)) {
+      printf("Linking codegen partition %zu failed\n", i);
+      __builtin_trap();
+    }
+  }
 
-        LLVMValueRef offsets[] = {idx};
+  restore_internal_symbols(mod, &internal_symbols);
 
-        const Type* elem_ty =
-            sema_get_array_type(compiler->sema, base_ty, local_ctx)->elem_type;
+  if (LLVMVerifyModule(mod, LLVMPrintMessageAction, NULL)) {
+    printf("Verify module failed\n");
+    LLVMDumpModule(mod);
+    __builtin_trap();
+  }
 
-        LLVMTypeRef llvm_elem_ty = get_llvm_type(compiler, elem_ty, local_ctx);
-        return LLVMBuildGEP2(builder, llvm_elem_ty, base_ptr, offsets, 1,
-                             "idx_arr");
-      }
+  vector_destroy(&internal_symbols);
+  free(partitions);
+}
 
-      UNREACHABLE_MSG("Indexing non-ptr or arr type");
+// Run the program `argv[0]`, found through PATH, with the NULL terminated
+// `argv` and wait for it to exit. Each argument is quoted for the shell.
+// Returns true if it could not be run or failed.
+static bool run_command(const char** argv) {
+  string command;
+  string_construct(&command);
+  for (size_t i = 0; argv[i]; ++i) {
+    if (i)
+      string_append_char(&command, ' ');
+    string_append_char(&command, '\'');
+    for (const char* c = argv[i]; *c; ++c) {
+      if (*c == '\'')
+        string_append(&command, "'\\''");
+      else
+        string_append_char(&command, *c);
     }
-    default:
-      UNREACHABLE_MSG("TODO: Handle lvalue for EK %d", expr->vtable->kind);
+    string_append_char(&command, '\'');
   }
+
+  bool failed = system(command.data) != 0;
+  if (failed)
+    printf("Running '%s' failed\n", command.data);
+  string_destroy(&command);
+  return failed;
 }
 
-void compile_global_variable(Compiler* compiler, const GlobalVariable* gv) {
-  TreeMap dummy_ctx;
-  string_tree_map_construct(&dummy_ctx);
-  LLVMTypeRef ty = get_llvm_type(compiler, gv->type, &dummy_ctx);
+// Get the path of a temporary file next to `output` ending in `suffix`.
+static void get_temporary_path(string* path, const char* output,
+                               const char* suffix) {
+  string_construct(path);
+  string_append(path, output);
+  string_append(path, suffix);
+}
 
-  if (gv->type->vtable->kind == TK_FunctionType) {
-    if (!get_named_global(compiler, gv->name)) {
-      LLVMAddFunction(compiler->mod, gv->name, ty);
-      assert(!gv->initializer &&
-             "If this had an initializer, it would be a function definition.");
+// Combine the objects of the partitions into `output` with a relocatable link
+// in partition order, so the result is the same on every run. The internal
+// symbols were made hidden globals so the partitions could refer to each
+// other, so they are made local again afterwards. This runs `ld` and `objcopy`
+// from PATH. Returns true on error.
+static bool link_partition_objects(const char* output,
+                                   const CodegenPartition* partitions,
+                                   size_t num_partitions,
+                                   const vector* internal_symbols) {
+  vector paths;  // vector of strings.
+  vector_construct(&paths, sizeof(string), alignof(string));
+  vector argv;  // vector of const char*.
+  vector_construct(&argv, sizeof(const char*), alignof(const char*));
+  const char* ld_args[] = {"ld", "-r", "-o", output};
+  for (size_t i = 0; i < 4; ++i) {
+    const char** arg = vector_append_storage(&argv);
+    *arg = ld_args[i];
+  }
+
+  bool failed = false;
+  for (size_t i = 0; i < num_partitions && !failed; ++i) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".part%zu.o", i);
+    string* path = vector_append_storage(&paths);
+    get_temporary_path(path, output, suffix);
+    const char** arg = vector_append_storage(&argv);
+    *arg = path->data;
+
+    FILE* file = fopen(path->data, "wb");
+    if (!file) {
+      printf("Could not open '%s' for writing\n", path->data);
+      failed = true;
+    } else {
+      LLVMMemoryBufferRef object = partitions[i].result;
+      fwrite(LLVMGetBufferStart(object), 1, LLVMGetBufferSize(object), file);
+      fclose(file);
+    }
+  }
+  const char** end = vector_append_storage(&argv);
+  *end = NULL;
+
+  if (!failed)
+    failed = run_command(argv.data);
+
+  string symbols_path;
+  get_temporary_path(&symbols_path, output, ".internal");
+  if (!failed && internal_symbols->size) {
+    FILE* file = fopen(symbols_path.data, "w");
+    if (!file) {
+      printf("Could not open '%s' for writing\n", symbols_path.data);
+      failed = true;
+    } else {
+      for (size_t i = 0; i < internal_symbols->size; ++i)
+        fprintf(file, "%s\n", *(const char**)vector_at(internal_symbols, i));
+      fclose(file);
+
+      string localize;
+      string_construct(&localize);
+      string_append(&localize, "--localize-symbols=");
+      string_append(&localize, symbols_path.data);
+      const char* objcopy_args[] = {"objcopy", localize.data, output, NULL};
+      failed = run_command(objcopy_args);
+      string_destroy(&localize);
+      remove(symbols_path.data);
     }
-    tree_map_destroy(&dummy_ctx);
-    return;
   }
+  string_destroy(&symbols_path);
 
-  LLVMValueRef glob = LLVMAddGlobal(compiler->mod, ty, gv->name);
-  if (gv->initializer) {
-    // TODO: This would be handled much easier if we had a node for implicit
-    // casts.
-    LLVMValueRef val = maybe_compile_constant_implicit_cast(
-        compiler, gv->initializer, gv->type, &dummy_ctx);
-    LLVMSetInitializer(glob, val);
+  for (size_t i = 0; i < paths.size; ++i) {
+    string* path = vector_at(&paths, i);
+    remove(path->data);
+    string_destroy(path);
+  }
+  vector_destroy(&paths);
+  vector_destroy(&argv);
+  return failed;
+}
+
+// Compile the AST on `num_threads` threads, each of which also emits the
+// objects of its partitions, and combine them into the object `output`.
+// Returns true on error.
+bool emit_object_in_parallel(LLVMModuleRef mod, Sema* sema,
+                             const TargetOptions* target,
+                             const ProfileOptions* profile,
+                             const ObjectOptions* object_options,
+                             const vector* ast_nodes, size_t num_threads,
+                             vector* stack_usages, const char* output) {
+  vector internal_symbols;  // vector of const char*.
+  vector_construct(&internal_symbols, sizeof(const char*),
+                   alignof(const char*));
+  collect_internal_symbols(ast_nodes, &internal_symbols);
+
+  size_t num_partitions;
+  CodegenPartition* partitions = compile_partitions(
+      mod, sema, target, profile, object_options, ast_nodes,
+      &internal_symbols, num_threads, stack_usages, &num_partitions);
+
+  bool failed = false;
+  for (size_t i = 0; i < num_partitions; ++i) {
+    if (!partitions[i].result) {
+      printf("llvm error: %s\n", partitions[i].error);
+      LLVMDisposeMessage(partitions[i].error);
+      failed = true;
+    }
+  }
 
-    if (!gv->is_extern)
-      LLVMSetLinkage(glob, LLVMInternalLinkage);
+  if (!failed) {
+    failed = link_partition_objects(output, partitions, num_partitions,
+                                    &internal_symbols);
   }
 
-  tree_map_destroy(&dummy_ctx);
+  for (size_t i = 0; i < num_partitions; ++i) {
+    if (partitions[i].result)
+      LLVMDisposeMemoryBuffer(partitions[i].result);
+  }
+  vector_destroy(&internal_symbols);
+  free(partitions);
+  return failed;
 }
 
 ///
-/// End Compiler Implementation
+/// End Parallel Codegen Implementation
 ///
 
 const struct Argument kArguments[] = {
     {0, "input_file", "Input file", PM_RequiredPositional},
+    {0, "more_input_files",
+     "More bitcode files to link with the input file when it is bitcode",
+     PM_RemainingPositional},
     {'I', "include", "Include directory", PM_Multiple},
     {'v', "verbose", "Enable verbose output", PM_StoreTrue},
     // TODO: All this compiler does is just compile, so this is unused. It's
@@ -2452,9 +8182,412 @@ const struct Argument kArguments[] = {
     {0, "emit-llvm", "Emit LLVM IR to output instead of object code",
      PM_StoreTrue},
     {0, "ast-dump", "Dump the AST", PM_StoreTrue},
+    {'j', "jobs",
+     "Number of threads to generate code on. Each thread emits an object for "
+     "its functions and the objects are combined with `ld -r`. IR and bitcode "
+     "output is only generated in parallel",
+     PM_Optional},
+    {0, "march", "Processor to generate code for, or `native`", PM_Optional},
+    {0, "mcpu", "Same as -march", PM_Optional},
+    {0, "mtune", "Processor to tune code for, or `native`", PM_Optional},
+    {0, "mattr", "Comma separated target features such as `+avx2,-sse4.2`",
+     PM_Optional},
+    {0, "flto", "Emit bitcode for `full` or `thin` link time optimization",
+     PM_Optional},
+    {0, "fprofile-generate",
+     "Instrument the program to write an execution profile to this file",
+     PM_Optional},
+    {0, "fprofile-use", "Optimize using a profile from -fprofile-generate",
+     PM_Optional},
+    {0, "ftls-model",
+     "Default TLS model: `global-dynamic`, `local-dynamic`, `initial-exec` or "
+     "`local-exec`",
+     PM_Optional},
+    {0, "ffast-math",
+     "Allow floating point optimizations that ignore NaNs, infinities, signed "
+     "zeros and rounding",
+     PM_StoreTrue},
+    {0, "ffp-contract",
+     "Fuse multiplies and adds: `off`, `on` (within expressions) or `fast`",
+     PM_Optional},
+    {0, "fno-math-errno", "Assume math functions do not set errno",
+     PM_StoreTrue},
+    {0, "fno-strict-aliasing",
+     "Assume objects may be accessed through pointers of any type",
+     PM_StoreTrue},
+    {0, "fstack-usage",
+     "Write an estimate of the stack frame size of each function to a .su "
+     "file named after the output. Spills and saved registers are not "
+     "counted",
+     PM_StoreTrue},
+    {0, "fno-pic",
+     "Generate position dependent code, which can only be linked into an "
+     "executable",
+     PM_StoreTrue},
+    {0, "fpie",
+     "Generate position independent code that can only be linked into an "
+     "executable",
+     PM_StoreTrue},
+    {0, "fno-plt",
+     "Call functions from other modules through the GOT instead of the PLT",
+     PM_StoreTrue},
+    {0, "fvisibility",
+     "Default visibility of defined symbols: `default` or `hidden`",
+     PM_Optional},
+    {0, "ffunction-sections",
+     "Place each function in its own section for the linker to garbage "
+     "collect",
+     PM_StoreTrue},
+    {0, "fdata-sections",
+     "Place each global variable in its own section for the linker to garbage "
+     "collect",
+     PM_StoreTrue},
 };
 const size_t kNumArguments = sizeof(kArguments) / sizeof(struct Argument);
 
+// The processor code is generated for when neither -march nor -mcpu is given.
+// This is the baseline every x86-64 machine supports, so objects built on one
+// machine can run on any other.
+static const char* kDefaultTargetCPU = "x86-64";
+
+// Inputs ending in `.bc` are bitcode files, usually produced with -flto. These
+// are linked together and optimized as one module rather than compiled.
+static bool is_bitcode_file(const char* filename) {
+  size_t len = strlen(filename);
+  return len >= 3 && strcmp(&filename[len - 3], ".bc") == 0;
+}
+
+// Link the bitcode file `filename` into `mod`. Returns true on error.
+static bool link_bitcode_file(LLVMModuleRef mod, const char* filename) {
+  char* error;
+  LLVMMemoryBufferRef buffer;
+  if (LLVMCreateMemoryBufferWithContentsOfFile(filename, &buffer, &error)) {
+    printf("llvm error: %s\n", error);
+    LLVMDisposeMessage(error);
+    return true;
+  }
+
+  LLVMModuleRef other;
+  bool failed =
+      LLVMParseBitcodeInContext2(LLVMGetModuleContext(mod), buffer, &other);
+  LLVMDisposeMemoryBuffer(buffer);
+  if (failed) {
+    printf("Reading bitcode file '%s' failed\n", filename);
+    return true;
+  }
+
+  // This takes ownership of `other`.
+  if (LLVMLinkModules2(mod, other)) {
+    printf("Linking bitcode file '%s' failed\n", filename);
+    return true;
+  }
+  return false;
+}
+
+// Run the new pass manager pipeline described by `passes` on `mod`. Returns
+// true on error.
+static bool run_passes(LLVMModuleRef mod, const char* passes,
+                       LLVMTargetMachineRef target_machine) {
+  LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+  LLVMErrorRef err = LLVMRunPasses(mod, passes, target_machine, options);
+  LLVMDisposePassBuilderOptions(options);
+  if (!err)
+    return false;
+
+  char* msg = LLVMGetErrorMessage(err);
+  printf("llvm error: %s\n", msg);
+  LLVMDisposeErrorMessage(msg);
+  return true;
+}
+
+// Returns the value of an optional argument or NULL if it wasn't provided.
+static const char* get_string_argument(const TreeMap* parsed_args,
+                                       const char* name) {
+  struct ParsedArgument* arg;
+  if (!tree_map_get(parsed_args, name, &arg))
+    return NULL;
+  return arg->value;
+}
+
+// Write the frame sizes found with -fstack-usage to the output path with its
+// extension replaced by `.su`. Each line has the form GCC uses, with an extra
+// qualifier: `file:line:col:function<TAB>bytes<TAB>static,estimated`.
+//
+// The sizes are estimated from the allocas of the frontend. They leave out
+// spills, saved registers and the return address. Locals with disjoint
+// lifetimes only share stack slots if the backend runs its stack coloring
+// pass, which it skips when generating code without optimizations. So the
+// max live size is only accurate when `stack_coloring` is set, and the total
+// size is reported otherwise. Returns true on error.
+static bool write_stack_usage(const char* output, const vector* usages,
+                              bool stack_coloring) {
+  size_t len = strlen(output);
+  for (size_t i = len; i > 0; --i) {
+    if (output[i - 1] == '/')
+      break;
+    if (output[i - 1] == '.') {
+      len = i - 1;
+      break;
+    }
+  }
+
+  string path;
+  string_construct(&path);
+  string_append_range(&path, output, len);
+  string_append(&path, ".su");
+
+  FILE* file = fopen(path.data, "w");
+  if (!file) {
+    printf("Could not open '%s' for writing\n", path.data);
+    string_destroy(&path);
+    return true;
+  }
+
+  for (size_t i = 0; i < usages->size; ++i) {
+    const StackUsage* usage = vector_at(usages, i);
+    const SourceLocation* loc = &usage->f->node.loc;
+    size_t size = stack_coloring ? usage->max_live_size : usage->total_size;
+    fprintf(file, "%s:%zu:%zu:%s\t%zu\tstatic,estimated\n",
+            source_location_filename(loc), source_location_line(loc),
+            source_location_col(loc), usage->f->name, size);
+  }
+
+  fclose(file);
+  string_destroy(&path);
+  return false;
+}
+
+// Whether the constant `c` refers to the address of a global or a label, and so
+// needs a relocation when it's written to an object file.
+static bool constant_needs_relocation(LLVMValueRef c) {
+  if (LLVMIsAGlobalValue(c) || LLVMIsABlockAddress(c))
+    return true;
+  int num_operands = LLVMGetNumOperands(c);
+  for (int i = 0; i < num_operands; ++i) {
+    if (constant_needs_relocation(LLVMGetOperand(c, (unsigned)i)))
+      return true;
+  }
+  return false;
+}
+
+// Get the prefix of the section a global variable definition would be placed
+// in by default. The backend infers the kind of a section from these names.
+// Read only data with relocations goes in .data.rel.ro with `pic` since the
+// dynamic loader may have to write to it. Position dependent code has all its
+// relocations resolved by the static linker.
+static const char* get_data_section_prefix(LLVMValueRef gv, bool pic) {
+  LLVMValueRef init = LLVMGetInitializer(gv);
+  if (LLVMIsThreadLocal(gv))
+    return LLVMIsNull(init) ? ".tbss." : ".tdata.";
+  if (LLVMIsGlobalConstant(gv)) {
+    return pic && constant_needs_relocation(init) ? ".data.rel.ro."
+                                                  : ".rodata.";
+  }
+  return LLVMIsNull(init) ? ".bss." : ".data.";
+}
+
+static void set_unique_section(LLVMValueRef global, const char* prefix) {
+  size_t len;
+  const char* name = LLVMGetValueName2(global, &len);
+
+  string section;
+  string_construct(&section);
+  string_append(&section, prefix);
+  string_append_range(&section, name, len);
+  LLVMSetSection(global, section.data);
+  string_destroy(&section);
+}
+
+// Put each function definition with -ffunction-sections and each global
+// variable definition with -fdata-sections in its own section, named after
+// the symbol like GCC does. A linker run with --gc-sections can then drop the
+// functions and data nothing refers to. Definitions that already have a
+// section are left alone, and so are the unnamed_addr constants of string
+// literals since those are in mergeable sections the linker deduplicates.
+static void assign_unique_sections(LLVMModuleRef mod, bool function_sections,
+                                   bool data_sections, bool pic) {
+  if (function_sections) {
+    for (LLVMValueRef f = LLVMGetFirstFunction(mod); f;
+         f = LLVMGetNextFunction(f)) {
+      const char* section = LLVMGetSection(f);
+      if (!LLVMIsDeclaration(f) && !(section && *section))
+        set_unique_section(f, ".text.");
+    }
+  }
+
+  if (data_sections) {
+    for (LLVMValueRef gv = LLVMGetFirstGlobal(mod); gv;
+         gv = LLVMGetNextGlobal(gv)) {
+      const char* section = LLVMGetSection(gv);
+      if (LLVMIsDeclaration(gv) || (section && *section))
+        continue;
+      if (LLVMGetUnnamedAddress(gv) == LLVMGlobalUnnamedAddr &&
+          LLVMIsGlobalConstant(gv))
+        continue;
+      set_unique_section(gv, get_data_section_prefix(gv, pic));
+    }
+  }
+}
+
+// Set how the symbols of `mod` bind across modules. Symbols defined in an
+// executable built with -fno-pic or -fpie can't be preempted, so they get
+// protected visibility, and hidden visibility with -fvisibility=hidden. Both
+// make LLVM treat the symbols as `dso_local`, so they're accessed directly
+// rather than through the GOT or PLT. The C API has no other way of setting
+// `dso_local`. With -fno-plt, functions declared here are marked `nonlazybind`
+// so calls to them load the address from the GOT rather than a PLT stub.
+static void set_symbol_binding(LLVMModuleRef mod,
+                               const TargetOptions* target) {
+  bool is_executable = target->reloc_model != LLVMRelocPIC || target->pie;
+  LLVMVisibility visibility = LLVMDefaultVisibility;
+  if (target->hidden_visibility)
+    visibility = LLVMHiddenVisibility;
+  else if (is_executable)
+    visibility = LLVMProtectedVisibility;
+
+  LLVMContextRef ctx = LLVMGetModuleContext(mod);
+  unsigned nonlazybind =
+      LLVMGetEnumAttributeKindForName("nonlazybind", strlen("nonlazybind"));
+  for (LLVMValueRef f = LLVMGetFirstFunction(mod); f;
+       f = LLVMGetNextFunction(f)) {
+    if (LLVMIsDeclaration(f)) {
+      if (target->no_plt && !LLVMGetIntrinsicID(f)) {
+        LLVMAddAttributeAtIndex(
+            f, LLVMAttributeFunctionIndex,
+            LLVMCreateEnumAttribute(ctx, nonlazybind, /*val=*/0));
+      }
+    } else if (LLVMGetLinkage(f) == LLVMExternalLinkage &&
+               LLVMGetVisibility(f) == LLVMDefaultVisibility) {
+      LLVMSetVisibility(f, visibility);
+    }
+  }
+
+  for (LLVMValueRef gv = LLVMGetFirstGlobal(mod); gv;
+       gv = LLVMGetNextGlobal(gv)) {
+    if (!LLVMIsDeclaration(gv) &&
+        LLVMGetLinkage(gv) == LLVMExternalLinkage &&
+        LLVMGetVisibility(gv) == LLVMDefaultVisibility)
+      LLVMSetVisibility(gv, visibility);
+  }
+}
+
+// Read the next number on the current line of a profile into `val`. Returns
+// false if the line ends or the next token is not a number.
+static bool read_profile_number(FILE* file, unsigned long long* val) {
+  int c = getc(file);
+  while (c == ' ')
+    c = getc(file);
+  ungetc(c, file);
+  if (c == EOF || !isdigit(c))
+    return false;
+  return fscanf(file, "%llu", val) == 1;
+}
+
+// Read a profile written by a program built with -fprofile-generate into
+// `counts`. Each run appends its counts, so the counts of a function are summed
+// across runs. Every run must have written the current version and each line
+// must hold exactly the number of counters it says. Returns true on error.
+static bool read_profile(const char* filename, TreeMap* counts) {
+  FILE* file = fopen(filename, "r");
+  if (!file) {
+    printf("Could not open profile '%s'\n", filename);
+    return true;
+  }
+
+  char name[1024];
+  size_t line = 0;
+  bool has_version = false;
+  bool failed = false;
+  vector line_counts;  // vector of uint64_t.
+  vector_construct(&line_counts, sizeof(uint64_t), alignof(uint64_t));
+  while (!failed && fscanf(file, "%1023s", name) == 1) {
+    ++line;
+    unsigned long long num;
+    bool has_num = read_profile_number(file, &num);
+    if (strlen(name) == sizeof(name) - 1) {
+      printf("Profile name too long on line %zu of profile '%s'\n", line,
+             filename);
+      failed = true;
+    } else if (strcmp(name, "#profile") == 0) {
+      if (!has_num || num != kProfileVersion) {
+        printf("Profile '%s' has an unsupported version on line %zu\n",
+               filename, line);
+        failed = true;
+      }
+      has_version = true;
+    } else if (!has_version) {
+      printf("Profile '%s' is missing its version\n", filename);
+      failed = true;
+    } else if (!has_num) {
+      printf("Missing counter count for '%s' in profile '%s'\n", name,
+             filename);
+      failed = true;
+    } else {
+      // Counts are only checked against the expected number once the whole
+      // line is read, so a bad count can't cause a huge allocation.
+      line_counts.size = 0;
+      unsigned long long count;
+      while (read_profile_number(file, &count)) {
+        uint64_t* storage = vector_append_storage(&line_counts);
+        *storage = count;
+      }
+      if (line_counts.size != num) {
+        printf("Malformed counts for '%s' in profile '%s'\n", name,
+               filename);
+        failed = true;
+      }
+    }
+
+    // Every line has to end after its numbers.
+    int c = getc(file);
+    while (c == ' ')
+      c = getc(file);
+    if (!failed && c != '\n' && c != EOF) {
+      printf("Unexpected data on line %zu of profile '%s'\n", line, filename);
+      failed = true;
+    }
+    if (failed || strcmp(name, "#profile") == 0)
+      continue;
+
+    vector* func_counts = NULL;
+    if (!tree_map_get(counts, name, &func_counts)) {
+      func_counts = malloc(sizeof(vector));
+      vector_construct(func_counts, sizeof(uint64_t), alignof(uint64_t));
+      tree_map_set(counts, name, func_counts);
+    }
+
+    // The function changed between runs, so only the newest counts apply.
+    if (func_counts->size != line_counts.size) {
+      vector_destroy(func_counts);
+      vector_construct(func_counts, sizeof(uint64_t), alignof(uint64_t));
+      for (size_t i = 0; i < line_counts.size; ++i) {
+        uint64_t* count = vector_append_storage(func_counts);
+        *count = 0;
+      }
+    }
+
+    for (size_t i = 0; i < line_counts.size; ++i) {
+      *(uint64_t*)vector_at(func_counts, i) +=
+          *(uint64_t*)vector_at(&line_counts, i);
+    }
+  }
+
+  if (!failed && !feof(file)) {
+    printf("Could not read profile '%s'\n", filename);
+    failed = true;
+  }
+
+  vector_destroy(&line_counts);
+  fclose(file);
+  return failed;
+}
+
+static void destroy_profile_counts_callback(const void* key, void* value,
+                                            void* arg) {
+  vector_destroy(value);
+  free(value);
+}
+
 static void destroy_ast_nodes(vector* ast_nodes) {
   for (size_t i = 0; i < ast_nodes->size; ++i) {
     TopLevelNode* node = *(TopLevelNode**)vector_at(ast_nodes, i);
@@ -2497,10 +8630,29 @@ int main(int argc, char** argv) {
              "No input file provided");
   const char* input_filename = input_arg->value;
 
+  // When the inputs are bitcode files, this is the link step of LTO. All the
+  // inputs are linked together, optimized as a whole and emitted as one object.
+  struct ParsedArgument* more_inputs_arg = NULL;
+  tree_map_get(&parsed_args, "more_input_files", &more_inputs_arg);
+  assert(more_inputs_arg && more_inputs_arg->kind == PAK_StringVector);
+  const vector* more_inputs = more_inputs_arg->value;
+
+  bool is_lto_link = is_bitcode_file(input_filename);
+  for (size_t i = 0; i < more_inputs->size; ++i) {
+    const char* filename = *(const char**)vector_at(more_inputs, i);
+    ASSERT_MSG(is_lto_link && is_bitcode_file(filename),
+               "Only bitcode files can be given as multiple inputs");
+  }
+
+  const char* lto_mode = get_string_argument(&parsed_args, "flto");
+  ASSERT_MSG(!lto_mode || strcmp(lto_mode, "full") == 0 ||
+                 strcmp(lto_mode, "thin") == 0,
+             "Unknown LTO mode '%s'", lto_mode);
+
   // Parsing + compiling
   vector ast_nodes;
   vector_construct(&ast_nodes, sizeof(TopLevelNode*), alignof(TopLevelNode*));
-  {
+  if (!is_lto_link) {
     FileInputStream* file_input = malloc(sizeof(FileInputStream));
     file_input_stream_construct(file_input, input_filename);
     PreprocessorInputStream pp;
@@ -2597,7 +8749,6 @@ int main(int argc, char** argv) {
 
   // LLVM Initialization
   LLVMModuleRef mod = LLVMModuleCreateWithName(input_filename);
-  LLVMDIBuilderRef dibuilder = LLVMCreateDIBuilder(mod);
 
   LLVMInitializeX86TargetInfo();
   LLVMInitializeX86Target();
@@ -2616,79 +8767,253 @@ int main(int argc, char** argv) {
     return -1;
   }
 
-  char* cpu = LLVMGetHostCPUName();
-  char* features = LLVMGetHostCPUFeatures();
+  // -mcpu is the same as -march on x86, but -march takes precedence if both
+  // are given. `native` selects the processor and features of this machine.
+  char* host_cpu = LLVMGetHostCPUName();
+  char* host_features = LLVMGetHostCPUFeatures();
+  const char* cpu = get_string_argument(&parsed_args, "march");
+  if (!cpu)
+    cpu = get_string_argument(&parsed_args, "mcpu");
+  if (!cpu)
+    cpu = kDefaultTargetCPU;
+
+  string features;
+  string_construct(&features);
+  if (strcmp(cpu, "native") == 0) {
+    cpu = host_cpu;
+    string_append(&features, host_features);
+  }
+
+  const char* mattr = get_string_argument(&parsed_args, "mattr");
+  if (mattr) {
+    if (features.size)
+      string_append_char(&features, ',');
+    string_append(&features, mattr);
+  }
+
+  const char* tune_cpu = get_string_argument(&parsed_args, "mtune");
+  if (tune_cpu && strcmp(tune_cpu, "native") == 0)
+    tune_cpu = host_cpu;
+
+  TargetOptions target_options;
+  target_options.cpu = cpu;
+  target_options.tune_cpu = tune_cpu;
+  target_options.features = features.data;
+  struct ParsedArgument* no_pic;
+  struct ParsedArgument* pie;
+  struct ParsedArgument* no_plt;
+  target_options.reloc_model = LLVMRelocPIC;
+  target_options.pie = false;
+  if (tree_map_get(&parsed_args, "fno-pic", &no_pic) && no_pic->stored_value)
+    target_options.reloc_model = LLVMRelocStatic;
+  else if (tree_map_get(&parsed_args, "fpie", &pie) && pie->stored_value)
+    target_options.pie = true;
+  target_options.no_plt =
+      tree_map_get(&parsed_args, "fno-plt", &no_plt) && no_plt->stored_value;
+  target_options.hidden_visibility = false;
+  const char* visibility = get_string_argument(&parsed_args, "fvisibility");
+  if (visibility) {
+    ASSERT_MSG(strcmp(visibility, "default") == 0 ||
+                   strcmp(visibility, "hidden") == 0,
+               "Unknown visibility '%s'", visibility);
+    target_options.hidden_visibility = strcmp(visibility, "hidden") == 0;
+  }
+
+  target_options.tls_model = TLS_Default;
+  const char* tls_model = get_string_argument(&parsed_args, "ftls-model");
+  if (tls_model) {
+    bool known = tls_model_from_name(tls_model, &target_options.tls_model);
+    ASSERT_MSG(known, "Unknown TLS model '%s'", tls_model);
+  }
+
+  // -ffast-math implies -ffp-contract=fast and -fno-math-errno.
+  struct ParsedArgument* fast_math;
+  target_options.fast_math = tree_map_get(&parsed_args, "ffast-math",
+                                          &fast_math) &&
+                             fast_math->stored_value;
+  struct ParsedArgument* no_math_errno;
+  target_options.math_errno =
+      !target_options.fast_math &&
+      !(tree_map_get(&parsed_args, "fno-math-errno", &no_math_errno) &&
+        no_math_errno->stored_value);
+  struct ParsedArgument* no_strict_aliasing;
+  target_options.strict_aliasing =
+      !(tree_map_get(&parsed_args, "fno-strict-aliasing",
+                     &no_strict_aliasing) &&
+        no_strict_aliasing->stored_value);
+  target_options.fp_contract = FPC_On;
+  if (target_options.fast_math)
+    target_options.fp_contract = FPC_Fast;
+  const char* fp_contract = get_string_argument(&parsed_args, "ffp-contract");
+  if (fp_contract) {
+    if (strcmp(fp_contract, "off") == 0)
+      target_options.fp_contract = FPC_Off;
+    else if (strcmp(fp_contract, "on") == 0)
+      target_options.fp_contract = FPC_On;
+    else if (strcmp(fp_contract, "fast") == 0)
+      target_options.fp_contract = FPC_Fast;
+    else
+      UNREACHABLE_MSG("Unknown -ffp-contract value '%s'", fp_contract);
+  }
+
+  ProfileOptions profile_options;
+  profile_options.generate_path =
+      get_string_argument(&parsed_args, "fprofile-generate");
+  profile_options.counts = NULL;
+  TreeMap profile_counts;
+  string_tree_map_construct(&profile_counts);
+  const char* profile_use_path =
+      get_string_argument(&parsed_args, "fprofile-use");
+  ASSERT_MSG(!profile_use_path || !profile_options.generate_path,
+             "-fprofile-generate and -fprofile-use are mutually exclusive");
+  if (profile_use_path) {
+    if (read_profile(profile_use_path, &profile_counts))
+      return -1;
+    profile_options.counts = &profile_counts;
+  }
 
-  LLVMTargetMachineRef target_machine = LLVMCreateTargetMachine(
-      target, triple, cpu, features, LLVMCodeGenLevelNone, LLVMRelocPIC,
-      LLVMCodeModelDefault);
+  // Only the LTO link step optimizes, so only it needs an optimizing backend.
+  LLVMCodeGenOptLevel opt_level =
+      is_lto_link ? LLVMCodeGenLevelDefault : LLVMCodeGenLevelNone;
+  LLVMTargetMachineRef target_machine =
+      LLVMCreateTargetMachine(target, triple, cpu, features.data, opt_level,
+                              target_options.reloc_model,
+                              LLVMCodeModelDefault);
 
+  LLVMSetTarget(mod, triple);
   LLVMDisposeMessage(triple);
-  LLVMDisposeMessage(cpu);
-  LLVMDisposeMessage(features);
 
   LLVMTargetDataRef data_layout = LLVMCreateTargetDataLayout(target_machine);
   LLVMSetModuleDataLayout(mod, data_layout);
 
-  Compiler compiler;
-  compiler_construct(&compiler, mod, &sema, dibuilder);
-
   const char* output = "out.obj";
   struct ParsedArgument* output_arg;
   if (tree_map_get(&parsed_args, "output", &output_arg))
     output = output_arg->value;
 
-  // Compile the AST.
-  for (const TopLevelNode** it = vector_begin(&ast_nodes);
-       it != vector_end(&ast_nodes); ++it) {
-    const TopLevelNode* top_level_decl = *it;
+  // Any -j, even -j 1, uses the partitioned codegen so the output does not
+  // depend on the number of threads. Objects are then emitted by the threads
+  // too, while IR and bitcode for LTO are linked into `mod`.
+  size_t num_jobs = 0;
+  const char* jobs = get_string_argument(&parsed_args, "jobs");
+  if (jobs) {
+    char* end;
+    num_jobs = strtoul(jobs, &end, 10);
+    ASSERT_MSG(isdigit(*jobs) && !*end && num_jobs >= 1,
+               "Invalid number of jobs '%s'", jobs);
+  }
 
-    switch (top_level_decl->vtable->kind) {
-      case TLNK_Typedef:
-      case TLNK_StaticAssert:
-      case TLNK_StructDeclaration:
-      case TLNK_EnumDeclaration:
-      case TLNK_UnionDeclaration:
-        break;
-      case TLNK_GlobalVariable: {
-        GlobalVariable* gv = (GlobalVariable*)top_level_decl;
-        compile_global_variable(&compiler, gv);
-        break;
-      }
-      case TLNK_FunctionDefinition: {
-        FunctionDefinition* f = (FunctionDefinition*)top_level_decl;
-        compile_function_definition(&compiler, f);
-        break;
-      }
-    }
+  struct ParsedArgument* stack_usage_arg;
+  bool stack_usage = tree_map_get(&parsed_args, "fstack-usage",
+                                  &stack_usage_arg) &&
+                     stack_usage_arg->stored_value;
+  vector stack_usages;  // vector of StackUsages.
+  vector_construct(&stack_usages, sizeof(StackUsage), alignof(StackUsage));
+  vector* stack_usages_out = NULL;
+  if (stack_usage)
+    stack_usages_out = &stack_usages;
+
+  struct ParsedArgument* emit_llvm_arg;
+  bool emit_llvm = tree_map_get(&parsed_args, "emit-llvm", &emit_llvm_arg) &&
+                   emit_llvm_arg->stored_value;
+  bool emit_object_in_threads = num_jobs && !emit_llvm && !lto_mode;
+  struct ParsedArgument* function_sections;
+  bool has_function_sections =
+      tree_map_get(&parsed_args, "ffunction-sections", &function_sections) &&
+      function_sections->stored_value;
+  struct ParsedArgument* data_sections;
+  bool has_data_sections =
+      tree_map_get(&parsed_args, "fdata-sections", &data_sections) &&
+      data_sections->stored_value;
 
-    if (LLVMVerifyModule(mod, LLVMPrintMessageAction, NULL)) {
-      printf("Verify module failed\n");
-      LLVMDumpModule(mod);
-      __builtin_trap();
+  int ret_code = 0;
+  if (is_lto_link) {
+    bool failed = link_bitcode_file(mod, input_filename);
+    for (size_t i = 0; i < more_inputs->size && !failed; ++i) {
+      failed =
+          link_bitcode_file(mod, *(const char**)vector_at(more_inputs, i));
     }
+    if (failed || run_passes(mod, "lto<O2>", target_machine))
+      ret_code = -1;
+  } else if (emit_object_in_threads) {
+    ObjectOptions object_options;
+    object_options.target = target;
+    object_options.triple = LLVMGetTarget(mod);
+    object_options.function_sections = has_function_sections;
+    object_options.data_sections = has_data_sections;
+    if (emit_object_in_parallel(mod, &sema, &target_options, &profile_options,
+                                &object_options, &ast_nodes, num_jobs,
+                                stack_usages_out, output))
+      ret_code = -1;
+  } else if (num_jobs) {
+    // Compile the AST.
+    compile_top_level_nodes_in_parallel(
+        mod, &sema, &target_options, &profile_options, &ast_nodes, num_jobs,
+        stack_usages_out);
+  } else {
+    LLVMDIBuilderRef dibuilder = LLVMCreateDIBuilder(mod);
+    Compiler compiler;
+    compiler_construct(&compiler, mod, &sema, dibuilder, &target_options,
+                       &profile_options);
+    compiler.stack_usages = stack_usages_out;
+    compile_top_level_nodes(&compiler, &ast_nodes, /*partition=*/0,
+                            /*num_partitions=*/1);
+    LLVMDIBuilderFinalize(dibuilder);
+    compiler_destroy(&compiler);
+    LLVMDisposeDIBuilder(dibuilder);
   }
 
-  LLVMDIBuilderFinalize(dibuilder);
+  if (!is_lto_link)
+    set_symbol_binding(mod, &target_options);
 
-  struct ParsedArgument* emit_llvm;
-  int ret_code = 0;
+  // With -flto, each file gets the per-module part of the LTO pipeline here.
+  // The rest runs in the link step once all the modules are visible.
+  if (lto_mode && !is_lto_link) {
+    const char* passes = strcmp(lto_mode, "thin") == 0
+                             ? "thinlto-pre-link<O2>"
+                             : "lto-pre-link<O2>";
+    if (run_passes(mod, passes, target_machine))
+      ret_code = -1;
+  }
+
+  // Sections are only assigned to code about to be emitted. Bitcode written for
+  // LTO gets them in the link step instead, after it's been optimized.
+  if (!lto_mode || is_lto_link) {
+    assign_unique_sections(
+        mod, has_function_sections, has_data_sections,
+        /*pic=*/target_options.reloc_model != LLVMRelocStatic);
+  }
 
-  if (tree_map_get(&parsed_args, "emit-llvm", &emit_llvm) &&
-      emit_llvm->stored_value) {
+  if (ret_code != 0 || emit_object_in_threads) {
+    // The error was already reported, or the object was already written.
+  } else if (emit_llvm) {
     if (LLVMPrintModuleToFile(mod, output, &error)) {
       printf("llvm error: %s\n", error);
       LLVMDisposeMessage(error);
       ret_code = -1;
     }
+  } else if (lto_mode && !is_lto_link) {
+    if (LLVMWriteBitcodeToFile(mod, output)) {
+      printf("Writing bitcode to '%s' failed\n", output);
+      ret_code = -1;
+    }
   } else if (LLVMTargetMachineEmitToFile(target_machine, mod, output,
                                          LLVMObjectFile, &error)) {
+    printf("llvm error: %s\n", error);
+    LLVMDisposeMessage(error);
     ret_code = -1;
   }
 
+  // Functions compiled for LTO get their code generated with optimizations
+  // in the link step, where the backend colors stack slots.
+  if (ret_code == 0 && stack_usage &&
+      write_stack_usage(output, &stack_usages,
+                        /*stack_coloring=*/lto_mode != NULL))
+    ret_code = -1;
+  vector_destroy(&stack_usages);
+
   destroy_ast_nodes(&ast_nodes);
 
-  compiler_destroy(&compiler);
   sema_destroy(&sema);
   vector_destroy(&include_dir_paths);
   destroy_parsed_args(&parsed_args);
@@ -2696,12 +9021,11 @@ int main(int argc, char** argv) {
   LLVMDisposeModule(mod);
   LLVMDisposeTargetData(data_layout);
   LLVMDisposeTargetMachine(target_machine);
-  LLVMDisposeDIBuilder(dibuilder);
-
-  if (ret_code != 0) {
-    printf("llvm error: %s\n", error);
-    LLVMDisposeMessage(error);
-  }
+  string_destroy(&features);
+  tree_map_iterate(&profile_counts, destroy_profile_counts_callback, NULL);
+  tree_map_destroy(&profile_counts);
+  LLVMDisposeMessage(host_cpu);
+  LLVMDisposeMessage(host_features);
 
   return ret_code;
 }
@@ -36,6 +36,28 @@ void cast_destroy(Expr* expr) {
   free(cast->to);
 }
 
+static void convert_vector_destroy(Expr* expr);
+
+static const ExprVtable ConvertVectorVtable = {
+    .kind = EK_ConvertVector,
+    .dtor = convert_vector_destroy,
+};
+
+void convert_vector_construct(ConvertVector* convert, Expr* base, Type* to,
+                              const SourceLocation* loc) {
+  expr_construct(&convert->expr, &ConvertVectorVtable, loc);
+  convert->base = base;
+  convert->to = to;
+}
+
+void convert_vector_destroy(Expr* expr) {
+  ConvertVector* convert = (ConvertVector*)expr;
+  expr_destroy(convert->base);
+  free(convert->base);
+  type_destroy(convert->to);
+  free(convert->to);
+}
+
 static void sizeof_destroy(Expr* expr);
 
 static const ExprVtable SizeOfVtable = {
@@ -227,6 +249,28 @@ void int_destroy(Expr* expr) {
   type_destroy(&i->type.type);
 }
 
+static void float_destroy(Expr* expr);
+
+static const ExprVtable FloatVtable = {
+    .kind = EK_Float,
+    .dtor = float_destroy,
+};
+
+void float_construct(Float* f, const char* val, size_t len,
+                     BuiltinTypeKind kind, const SourceLocation* loc) {
+  expr_construct(&f->expr, &FloatVtable, loc);
+  f->val = malloc(sizeof(char) * (len + 1));
+  memcpy(f->val, val, len);
+  f->val[len] = 0;
+  builtin_type_construct(&f->type, kind);
+}
+
+void float_destroy(Expr* expr) {
+  Float* f = (Float*)expr;
+  free(f->val);
+  type_destroy(&f->type.type);
+}
+
 static void string_literal_destroy(Expr* expr);
 
 static const ExprVtable StringLiteralVtable = {
@@ -266,6 +310,10 @@ void initializer_list_destroy(Expr* expr) {
     InitializerListElem* elem = vector_at(&init->elems, i);
     if (elem->name)
       free(elem->name);
+    if (elem->index) {
+      expr_destroy(elem->index);
+      free(elem->index);
+    }
     expr_destroy(elem->expr);
     free(elem->expr);
   }
@@ -376,3 +424,18 @@ void stmt_expr_destroy(Expr* expr) {
   statement_destroy(&se->stmt->base);
   free(se->stmt);
 }
+
+static void addr_of_label_destroy(Expr* expr);
+
+static const ExprVtable AddrOfLabelVtable = {
+    .kind = EK_AddrOfLabel,
+    .dtor = addr_of_label_destroy,
+};
+
+void addr_of_label_construct(AddrOfLabel* addr, const char* label,
+                             const SourceLocation* loc) {
+  expr_construct(&addr->expr, &AddrOfLabelVtable, loc);
+  addr->label = strdup(label);
+}
+
+void addr_of_label_destroy(Expr* expr) { free(((AddrOfLabel*)expr)->label); }
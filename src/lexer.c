@@ -146,6 +146,66 @@ static char handle_escape_char(int c) {
   }
 }
 
+static bool is_hex_digit(int c) {
+  return isdigit(c) || ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F');
+}
+
+static void lex_digits(Lexer* lexer, string* chars, bool is_hex) {
+  while (true) {
+    int c = lexer_peek_char(lexer);
+    if (!isdigit(c) && !(is_hex && is_hex_digit(c)))
+      return;
+    string_append_char(chars, (char)lexer_get_char(lexer));
+  }
+}
+
+// Lex the rest of a number whose first character is already in `tok`. Numbers
+// with a fraction or an exponent are floating point literals. The exponent of
+// a hexadecimal float starts with `p` since `e` is a hex digit.
+static void lex_number(Lexer* lexer, Token* tok) {
+  tok->kind = TK_IntLiteral;
+
+  bool is_hex = false;
+  if (lexer_peek_char(lexer) == 'x' || lexer_peek_char(lexer) == 'X') {
+    string_append_char(&tok->chars, (char)lexer_get_char(lexer));
+    is_hex = true;
+  }
+  lex_digits(lexer, &tok->chars, is_hex);
+
+  bool is_float = tok->chars.data[0] == '.';
+  if (!is_float && lexer_peek_then_consume_char(lexer, '.')) {
+    string_append_char(&tok->chars, '.');
+    lex_digits(lexer, &tok->chars, is_hex);
+    is_float = true;
+  }
+
+  int exponent = is_hex ? 'p' : 'e';
+  if (tolower(lexer_peek_char(lexer)) == exponent) {
+    string_append_char(&tok->chars, (char)lexer_get_char(lexer));
+    if (lexer_peek_char(lexer) == '+' || lexer_peek_char(lexer) == '-')
+      string_append_char(&tok->chars, (char)lexer_get_char(lexer));
+    lex_digits(lexer, &tok->chars, /*is_hex=*/false);
+    is_float = true;
+  }
+
+  if (is_float) {
+    tok->kind = TK_FloatLiteral;
+    int suffix = tolower(lexer_peek_char(lexer));
+    if (suffix == 'f' || suffix == 'l')
+      string_append_char(&tok->chars, (char)lexer_get_char(lexer));
+    return;
+  }
+
+  if (lexer_peek_char(lexer) == 'u')
+    string_append_char(&tok->chars, (char)lexer_get_char(lexer));
+
+  if (lexer_peek_char(lexer) == 'l') {
+    string_append_char(&tok->chars, (char)lexer_get_char(lexer));
+    if (lexer_peek_char(lexer) == 'l')
+      string_append_char(&tok->chars, (char)lexer_get_char(lexer));
+  }
+}
+
 Token lex(Lexer* lexer) {
   Token tok;
   token_construct(&tok);
@@ -190,6 +250,12 @@ Token lex(Lexer* lexer) {
         continue;
       }
 
+      if (lexer_peek_then_consume_char(lexer, '=')) {
+        string_append_char(&tok.chars, '=');
+        tok.kind = TK_DivAssign;
+        return tok;
+      }
+
       // Normal division.
       tok.kind = TK_Div;
       return tok;
@@ -201,6 +267,12 @@ Token lex(Lexer* lexer) {
   source_location_construct(&tok.loc, lexer->line_, lexer->col_,
                             lexer->input_name);
 
+  // Floating point literals like `.5`.
+  if (c == '.' && isdigit(lexer_peek_char(lexer))) {
+    lex_number(lexer, &tok);
+    return tok;
+  }
+
   // Handle elipsis.
   if (c == '.') {
     if (lexer_peek_then_consume_char(lexer, '.')) {
@@ -245,6 +317,16 @@ Token lex(Lexer* lexer) {
     return tok;
   }
 
+  if (c == '*') {
+    if (lexer_peek_then_consume_char(lexer, '=')) {
+      string_append_char(&tok.chars, '=');
+      tok.kind = TK_MulAssign;
+    } else {
+      tok.kind = TK_Star;
+    }
+    return tok;
+  }
+
   if (c == '!') {
     if (lexer_peek_then_consume_char(lexer, '=')) {
       tok.kind = TK_Ne;
@@ -391,9 +473,6 @@ Token lex(Lexer* lexer) {
     case ']':
       tok.kind = TK_RSquareBrace;
       return tok;
-    case '*':
-      tok.kind = TK_Star;
-      return tok;
     case ';':
       tok.kind = TK_Semicolon;
       return tok;
@@ -414,33 +493,9 @@ Token lex(Lexer* lexer) {
       return tok;
   }
 
-  // Integers
+  // Numbers
   if (isdigit(c)) {
-    tok.kind = TK_IntLiteral;
-
-    if (lexer_peek_char(lexer) == 'x' || lexer_peek_char(lexer) == 'X') {
-      string_append_char(&tok.chars, (char)lexer_get_char(lexer));
-      while (true) {
-        char c = (char)lexer_peek_char(lexer);
-        if (isdigit(c) || ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F'))
-          string_append_char(&tok.chars, (char)lexer_get_char(lexer));
-        else
-          break;
-      }
-    } else {
-      for (; isdigit(lexer_peek_char(lexer));)
-        string_append_char(&tok.chars, (char)lexer_get_char(lexer));
-    }
-
-    if (lexer_peek_char(lexer) == 'u')
-      string_append_char(&tok.chars, (char)lexer_get_char(lexer));
-
-    if (lexer_peek_char(lexer) == 'l') {
-      string_append_char(&tok.chars, (char)lexer_get_char(lexer));
-      if (lexer_peek_char(lexer) == 'l')
-        string_append_char(&tok.chars, (char)lexer_get_char(lexer));
-    }
-
+    lex_number(lexer, &tok);
     return tok;
   }
 
@@ -480,11 +535,14 @@ Token lex(Lexer* lexer) {
   } else if (string_equals(&tok.chars, "restrict") ||
              string_equals(&tok.chars, "__restrict")) {
     tok.kind = TK_Restrict;
+  } else if (string_equals(&tok.chars, "_Atomic")) {
+    tok.kind = TK_Atomic;
   } else if (string_equals(&tok.chars, "enum")) {
     tok.kind = TK_Enum;
   } else if (string_equals(&tok.chars, "union")) {
     tok.kind = TK_Union;
-  } else if (string_equals(&tok.chars, "alignas")) {
+  } else if (string_equals(&tok.chars, "alignas") ||
+             string_equals(&tok.chars, "_Alignas")) {
     tok.kind = TK_Alignas;
   } else if (string_equals(&tok.chars, "__attribute__")) {
     tok.kind = TK_Attribute;
@@ -494,6 +552,7 @@ Token lex(Lexer* lexer) {
              string_equals(&tok.chars, "asm")) {
     tok.kind = TK_Asm;
   } else if (string_equals(&tok.chars, "__inline") ||
+             string_equals(&tok.chars, "__inline__") ||
              string_equals(&tok.chars, "inline")) {
     tok.kind = TK_Inline;
   } else if (string_equals(&tok.chars, "pragma")) {
@@ -510,7 +569,9 @@ Token lex(Lexer* lexer) {
     tok.kind = TK_StaticAssert;
   } else if (string_equals(&tok.chars, "sizeof")) {
     tok.kind = TK_SizeOf;
-  } else if (string_equals(&tok.chars, "alignof")) {
+  } else if (string_equals(&tok.chars, "alignof") ||
+             string_equals(&tok.chars, "_Alignof") ||
+             string_equals(&tok.chars, "__alignof__")) {
     tok.kind = TK_AlignOf;
   } else if (string_equals(&tok.chars, "if")) {
     tok.kind = TK_If;
@@ -526,6 +587,8 @@ Token lex(Lexer* lexer) {
     tok.kind = TK_Break;
   } else if (string_equals(&tok.chars, "continue")) {
     tok.kind = TK_Continue;
+  } else if (string_equals(&tok.chars, "goto")) {
+    tok.kind = TK_Goto;
   } else if (string_equals(&tok.chars, "case")) {
     tok.kind = TK_Case;
   } else if (string_equals(&tok.chars, "default")) {
@@ -538,7 +601,9 @@ Token lex(Lexer* lexer) {
     tok.kind = TK_Auto;
   } else if (string_equals(&tok.chars, "register")) {
     tok.kind = TK_Register;
-  } else if (string_equals(&tok.chars, "thread_local")) {
+  } else if (string_equals(&tok.chars, "thread_local") ||
+             string_equals(&tok.chars, "_Thread_local") ||
+             string_equals(&tok.chars, "__thread")) {
     tok.kind = TK_ThreadLocal;
   } else if (string_equals(&tok.chars, "__PRETTY_FUNCTION__")) {
     tok.kind = TK_PrettyFunction;
@@ -17,6 +17,7 @@ void parser_construct(Parser* parser, InputStream* input,
                       const char* input_name) {
   lexer_construct(&parser->lexer, input, input_name);
   parser->has_lookahead = false;
+  parser->has_second_lookahead = false;
   string_tree_map_construct(&parser->typedef_types);
 }
 
@@ -24,6 +25,8 @@ void parser_destroy(Parser* parser) {
   lexer_destroy(&parser->lexer);
   if (parser->has_lookahead)
     token_destroy(&parser->lookahead);
+  if (parser->has_second_lookahead)
+    token_destroy(&parser->second_lookahead);
   tree_map_destroy(&parser->typedef_types);
 }
 
@@ -44,8 +47,14 @@ static void expect_token(const Token* tok, TokenKind expected) {
 
 Token parser_pop_token(Parser* parser) {
   if (parser->has_lookahead) {
-    parser->has_lookahead = false;
-    return parser->lookahead;
+    Token tok = parser->lookahead;
+    if (parser->has_second_lookahead) {
+      parser->lookahead = parser->second_lookahead;
+      parser->has_second_lookahead = false;
+    } else {
+      parser->has_lookahead = false;
+    }
+    return tok;
   }
   return lex(&parser->lexer);
 }
@@ -58,6 +67,15 @@ const Token* parser_peek_token(Parser* parser) {
   return &parser->lookahead;
 }
 
+const Token* parser_peek_second_token(Parser* parser) {
+  parser_peek_token(parser);
+  if (!parser->has_second_lookahead) {
+    parser->second_lookahead = lex(&parser->lexer);
+    parser->has_second_lookahead = true;
+  }
+  return &parser->second_lookahead;
+}
+
 bool next_token_is(Parser* parser, TokenKind kind) {
   return parser_peek_token(parser)->kind == kind;
 }
@@ -103,6 +121,10 @@ Qualifiers parse_maybe_qualifiers(Parser* parser, bool* found) {
         quals |= kRestrictMask;
         parser_skip_next_token(parser);
         continue;
+      case TK_Atomic:
+        quals |= kAtomicMask;
+        parser_skip_next_token(parser);
+        continue;
       default:
         if (found)
           *found = false;
@@ -134,7 +156,8 @@ Type* maybe_parse_pointers_and_qualifiers(Parser* parser, Type* base,
 bool is_token_type_token(const Parser* parser, const Token* tok) {
   bool is_type = is_builtin_type_token(tok->kind) ||
                  is_qualifier_token(tok->kind) || tok->kind == TK_Enum ||
-                 tok->kind == TK_Struct || tok->kind == TK_Union;
+                 tok->kind == TK_Struct || tok->kind == TK_Union ||
+                 tok->kind == TK_Alignas;
 
   // Need to check for typedefs
   if (!is_type && tok->kind == TK_Identifier)
@@ -143,8 +166,34 @@ bool is_token_type_token(const Parser* parser, const Token* tok) {
   return is_type;
 }
 
+// An `alignas` given with a struct or union definition replaces any `aligned`
+// attribute of the definition.
+static void set_alignas(Type* type, Expr* alignas_) {
+  if (type->align) {
+    expr_destroy(type->align);
+    free(type->align);
+  }
+  type->align = alignas_;
+}
+
+// `alignas` and the `aligned` attribute of a declaration apply to the declared
+// object rather than the type named by the specifiers. The specifiers leave
+// both in `attrs`, and they are moved onto the declared type here, so
+// `alignas(64) long counters[8]` aligns the array without padding out each
+// element. Functions keep `aligned` in their attributes.
+static void apply_declaration_alignment(Type* declared,
+                                        DeclAttributes* attrs) {
+  if (!attrs || !attrs->aligned ||
+      declared->vtable->kind == TK_FunctionType) {
+    return;
+  }
+  set_alignas(declared, attrs->aligned);
+  attrs->aligned = NULL;
+}
+
 static Type* parse_type_for_declaration_impl(Parser* parser, char** name,
                                              FoundStorageClasses* storage,
+                                             DeclAttributes* attrs,
                                              Type* base_type) {
   Type* type = maybe_parse_pointers_and_qualifiers(parser, base_type,
                                                    /*type_usage_addr=*/NULL);
@@ -170,7 +219,7 @@ static Type* parse_type_for_declaration_impl(Parser* parser, char** name,
   bool found_attr = next_token_is(parser, TK_Attribute);
 
   for (; parser_peek_token(parser)->kind == TK_Attribute;)
-    parser_consume_attribute(parser);
+    parser_parse_attribute(parser, attrs);
 
   if (found_attr) {
     assert(parser_peek_token(parser)->kind == TK_Semicolon ||
@@ -178,26 +227,42 @@ static Type* parse_type_for_declaration_impl(Parser* parser, char** name,
            parser_peek_token(parser)->kind == TK_Assign);
   }
 
+  apply_declaration_alignment(ret, attrs);
+
   return ret;
 }
 
 Type* parse_type_for_declaration(Parser* parser, char** name,
                                  FoundStorageClasses* storage) {
-  // TODO: Handle inlines?
-  Type* type = parse_specifiers_and_qualifiers_and_storage(
-      parser, storage, /*found_inline=*/NULL);
-  return parse_type_for_declaration_impl(parser, name, storage, type);
+  DeclAttributes attrs;
+  decl_attributes_construct(&attrs);
+  Type* type =
+      parse_specifiers_and_qualifiers_and_storage(parser, storage, &attrs);
+  type = parse_type_for_declaration_impl(parser, name, storage, &attrs, type);
+  decl_attributes_destroy(&attrs);
+  return type;
 }
 
-// TODO: Don't handle attributes for now. Just consume them.
-void parser_consume_attribute(Parser* parser) {
-  parser_consume_token(parser, TK_Attribute);
-  parser_consume_token(parser, TK_LPar);
-  parser_consume_token(parser, TK_LPar);
+// https://gcc.gnu.org/onlinedocs/gcc/Attribute-Syntax.html
+//
+// You may optionally specify attribute names with ‘__’ preceding and following
+// the name.
+static bool attribute_name_is(const char* name, const char* expected) {
+  size_t len = strlen(name);
+  if (len > 4 && strncmp(name, "__", 2) == 0 &&
+      strcmp(&name[len - 2], "__") == 0) {
+    return len - 4 == strlen(expected) &&
+           strncmp(&name[2], expected, len - 4) == 0;
+  }
+  return strcmp(name, expected) == 0;
+}
 
-  // This is a cheeky way of just consuming the whole attribute.
+// Consume the arguments of an attribute up to and including the right
+// parenthesis closing them.
+static void skip_attribute_arguments(Parser* parser) {
+  // This is a cheeky way of just consuming the whole argument list.
   // Consume tokens until we match the opening left parenthesis.
-  int par_count = 2;
+  int par_count = 1;
   for (; par_count;) {
     Token tok = parser_pop_token(parser);
 
@@ -211,6 +276,130 @@ void parser_consume_attribute(Parser* parser) {
   }
 }
 
+// The arguments of `nonnull` are the 1-based indices of pointer parameters.
+static void parse_nonnull_arguments(Parser* parser, DeclAttributes* attrs) {
+  while (!next_token_is(parser, TK_RPar)) {
+    Token tok = parser_pop_token(parser);
+    if (tok.kind == TK_IntLiteral) {
+      unsigned long long idx = strtoull(tok.chars.data, NULL, 0);
+      ASSERT_MSG(idx >= 1 && idx <= 64,
+                 "%zu:%zu: Unsupported nonnull argument index '%s'",
+                 source_location_line(&tok.loc), source_location_col(&tok.loc),
+                 tok.chars.data);
+      attrs->nonnull_args |= (uint64_t)1 << (idx - 1);
+    } else {
+      expect_token(&tok, TK_Comma);
+    }
+    token_destroy(&tok);
+  }
+  parser_consume_token(parser, TK_RPar);
+}
+
+// The argument of `tls_model` is a string naming the model.
+static void parse_tls_model_argument(Parser* parser, DeclAttributes* attrs) {
+  Expr* arg = parse_expr(parser);
+  ASSERT_MSG(arg->vtable->kind == EK_String,
+             "%zu:%zu: tls_model expects a string argument",
+             source_location_line(&arg->loc), source_location_col(&arg->loc));
+  const char* model = ((StringLiteral*)arg)->val;
+  bool known = tls_model_from_name(model, &attrs->tls_model);
+  ASSERT_MSG(known, "%zu:%zu: Unknown tls_model '%s'",
+             source_location_line(&arg->loc), source_location_col(&arg->loc),
+             model);
+  expr_destroy(arg);
+  free(arg);
+  parser_consume_token(parser, TK_RPar);
+}
+
+static void set_attribute_flag(DeclAttributes* attrs, const char* name) {
+  if (attribute_name_is(name, "always_inline")) {
+    attrs->always_inline = 1;
+  } else if (attribute_name_is(name, "noinline")) {
+    attrs->noinline = 1;
+  } else if (attribute_name_is(name, "hot")) {
+    attrs->hot = 1;
+  } else if (attribute_name_is(name, "cold")) {
+    attrs->cold = 1;
+  } else if (attribute_name_is(name, "flatten")) {
+    attrs->flatten = 1;
+  } else if (attribute_name_is(name, "pure")) {
+    attrs->pure = 1;
+  } else if (attribute_name_is(name, "const")) {
+    attrs->const_ = 1;
+  } else if (attribute_name_is(name, "noreturn")) {
+    attrs->noreturn = 1;
+  } else if (attribute_name_is(name, "malloc")) {
+    attrs->malloc_ = 1;
+  } else if (attribute_name_is(name, "returns_nonnull")) {
+    attrs->returns_nonnull = 1;
+  } else if (attribute_name_is(name, "nonnull")) {
+    attrs->nonnull_all = 1;
+  } else if (attribute_name_is(name, "packed")) {
+    attrs->packed = 1;
+  } else if (attribute_name_is(name, "musttail")) {
+    attrs->musttail = 1;
+  }
+}
+
+void parser_parse_attribute(Parser* parser, DeclAttributes* attrs) {
+  parser_consume_token(parser, TK_Attribute);
+  parser_consume_token(parser, TK_LPar);
+  parser_consume_token(parser, TK_LPar);
+
+  while (!next_token_is(parser, TK_RPar)) {
+    if (next_token_is(parser, TK_Comma)) {
+      parser_consume_token(parser, TK_Comma);
+      continue;
+    }
+
+    // Attribute names can also be keywords like `const`.
+    Token name = parser_pop_token(parser);
+    bool has_args = next_token_is(parser, TK_LPar);
+    if (has_args)
+      parser_consume_token(parser, TK_LPar);
+
+    if (!attrs) {
+      if (has_args)
+        skip_attribute_arguments(parser);
+    } else if (has_args && attribute_name_is(name.chars.data, "aligned")) {
+      if (attrs->aligned) {
+        expr_destroy(attrs->aligned);
+        free(attrs->aligned);
+      }
+      attrs->aligned = parse_expr(parser);
+      parser_consume_token(parser, TK_RPar);
+    } else if (has_args &&
+               attribute_name_is(name.chars.data, "vector_size")) {
+      assert(!attrs->vector_size && "Duplicate vector_size attribute");
+      attrs->vector_size = parse_expr(parser);
+      parser_consume_token(parser, TK_RPar);
+    } else if (has_args &&
+               attribute_name_is(name.chars.data, "ext_vector_type")) {
+      assert(!attrs->ext_vector_type && "Duplicate ext_vector_type attribute");
+      attrs->ext_vector_type = parse_expr(parser);
+      parser_consume_token(parser, TK_RPar);
+    } else if (has_args && attribute_name_is(name.chars.data, "nonnull")) {
+      parse_nonnull_arguments(parser, attrs);
+    } else if (has_args &&
+               attribute_name_is(name.chars.data, "tls_model")) {
+      parse_tls_model_argument(parser, attrs);
+    } else {
+      if (has_args)
+        skip_attribute_arguments(parser);
+      set_attribute_flag(attrs, name.chars.data);
+    }
+
+    token_destroy(&name);
+  }
+
+  parser_consume_token(parser, TK_RPar);
+  parser_consume_token(parser, TK_RPar);
+}
+
+void parser_consume_attribute(Parser* parser) {
+  parser_parse_attribute(parser, /*attrs=*/NULL);
+}
+
 void parser_consume_asm_label(Parser* parser) {
   parser_consume_token(parser, TK_Asm);
   parser_consume_token(parser, TK_LPar);
@@ -257,15 +446,24 @@ void parser_consume_pragma(Parser* parser) {
   }
 }
 
+// https://gcc.gnu.org/onlinedocs/gcc/Common-Type-Attributes.html
+//
+// Attributes of a struct or union may appear right after the `struct` or
+// `union` keyword or right after the closing brace of its members. These are
+// parsed into `attrs`.
 static void parse_struct_or_union_name_and_members_impl(Parser* parser,
                                                         char** name,
                                                         vector** members,
-                                                        bool is_struct) {
+                                                        bool is_struct,
+                                                        DeclAttributes* attrs) {
   assert(name);
   assert(members);
 
   parser_consume_token(parser, is_struct ? TK_Struct : TK_Union);
 
+  for (; next_token_is(parser, TK_Attribute);)
+    parser_parse_attribute(parser, attrs);
+
   const Token* peek = parser_peek_token(parser);
   if (peek->kind == TK_Identifier) {
     *name = strdup(peek->chars.data);
@@ -292,12 +490,14 @@ static void parse_struct_or_union_name_and_members_impl(Parser* parser,
     char* member_name = NULL;
     Type* member_ty =
         parse_type_for_declaration(parser, &member_name, /*storage=*/NULL);
-    assert(member_name);
 
+    // Only bitfields can be unnamed.
     Expr* bitfield = NULL;
     if (next_token_is(parser, TK_Colon)) {
       parser_consume_token(parser, TK_Colon);
       bitfield = parse_expr(parser);
+    } else {
+      assert(member_name);
     }
 
     Member* member = vector_append_storage(*members);
@@ -313,37 +513,60 @@ static void parse_struct_or_union_name_and_members_impl(Parser* parser,
   }
 
   parser_consume_token(parser, TK_RCurlyBrace);
+
+  for (; next_token_is(parser, TK_Attribute);)
+    parser_parse_attribute(parser, attrs);
 }
 
 void parse_struct_name_and_members(Parser* parser, char** name,
                                    vector** members) {
   parse_struct_or_union_name_and_members_impl(parser, name, members,
-                                              /*is_struct=*/true);
+                                              /*is_struct=*/true,
+                                              /*attrs=*/NULL);
 }
 
 void parse_union_name_and_members(Parser* parser, char** name,
                                   vector** members) {
   parse_struct_or_union_name_and_members_impl(parser, name, members,
-                                              /*is_struct=*/false);
+                                              /*is_struct=*/false,
+                                              /*attrs=*/NULL);
+}
+
+// Give the type of a struct or union the `packed` and `aligned` attributes
+// found while parsing it.
+static void apply_record_attributes(Type* type, bool* packed,
+                                    DeclAttributes* attrs) {
+  *packed = attrs->packed;
+  type->align = attrs->aligned;
+  attrs->aligned = NULL;
+  decl_attributes_destroy(attrs);
 }
 
 StructType* parse_struct_type(Parser* parser) {
   char* name = NULL;
   vector* members = NULL;
-  parse_struct_name_and_members(parser, &name, &members);
+  DeclAttributes attrs;
+  decl_attributes_construct(&attrs);
+  parse_struct_or_union_name_and_members_impl(parser, &name, &members,
+                                              /*is_struct=*/true, &attrs);
 
   StructType* struct_ty = malloc(sizeof(StructType));
   struct_type_construct(struct_ty, name, members);
+  apply_record_attributes(&struct_ty->type, &struct_ty->packed, &attrs);
   return struct_ty;
 }
 
 UnionType* parse_union_type(Parser* parser) {
   char* name = NULL;
   vector* members = NULL;
-  parse_union_name_and_members(parser, &name, &members);
+  DeclAttributes attrs;
+  decl_attributes_construct(&attrs);
+  parse_struct_or_union_name_and_members_impl(parser, &name, &members,
+                                              /*is_struct=*/false, &attrs);
 
   UnionType* union_ty = malloc(sizeof(UnionType));
   union_type_construct(union_ty, name, members);
+  apply_record_attributes(&union_ty->type, &union_ty->packed, &attrs);
   return union_ty;
 }
 
@@ -428,20 +651,18 @@ struct TypeSpecifier {
 
 Type* parse_specifiers_and_qualifiers_and_storage(Parser* parser,
                                                   FoundStorageClasses* storage,
-                                                  bool* found_inline) {
+                                                  DeclAttributes* attrs) {
   Qualifiers quals = 0;
 
   struct TypeSpecifier spec = {};
 
-  if (found_inline)
-    *found_inline = false;
-
   StructType* struct_ty;
   EnumType* enum_ty;
   UnionType* union_ty;
   bool should_stop = false;
   char* name;
   Expr* alignas_ = NULL;
+  Type* atomic_ty = NULL;
   for (; !should_stop;) {
     bool consume_next_token = true;
     const Token* peek = parser_peek_token(parser);
@@ -533,6 +754,19 @@ Type* parse_specifiers_and_qualifiers_and_storage(Parser* parser,
       case TK_Restrict:
         quals |= kRestrictMask;
         break;
+      case TK_Atomic:
+        // `_Atomic` immediately followed by a parenthesis is the `_Atomic(T)`
+        // type specifier. Otherwise, it's a qualifier.
+        parser_consume_token(parser, TK_Atomic);
+        consume_next_token = false;
+        quals |= kAtomicMask;
+        if (next_token_is(parser, TK_LPar)) {
+          assert(!atomic_ty);
+          parser_consume_token(parser, TK_LPar);
+          atomic_ty = parse_type(parser);
+          parser_consume_token(parser, TK_RPar);
+        }
+        break;
       case TK_Extern:
         if (storage)
           storage->extern_ = 1;
@@ -542,8 +776,12 @@ Type* parse_specifiers_and_qualifiers_and_storage(Parser* parser,
           storage->static_ = 1;
         break;
       case TK_Inline:
-        if (found_inline)
-          *found_inline = true;
+        if (attrs)
+          attrs->inline_ = 1;
+        break;
+      case TK_Attribute:
+        parser_parse_attribute(parser, attrs);
+        consume_next_token = false;
         break;
       case TK_Auto:
         if (storage)
@@ -577,6 +815,17 @@ Type* parse_specifiers_and_qualifiers_and_storage(Parser* parser,
       parser_skip_next_token(parser);
   }
 
+  // In a declaration, `alignas` belongs to the declared object. It is applied
+  // once the declarator is known.
+  if (alignas_ && attrs) {
+    if (attrs->aligned) {
+      expr_destroy(attrs->aligned);
+      free(attrs->aligned);
+    }
+    attrs->aligned = alignas_;
+    alignas_ = NULL;
+  }
+
   if (spec.named_) {
     NamedType* nt = create_named_type(name);
     nt->type.qualifiers = quals;
@@ -585,9 +834,16 @@ Type* parse_specifiers_and_qualifiers_and_storage(Parser* parser,
     return &nt->type;
   }
 
+  if (atomic_ty) {
+    atomic_ty->qualifiers |= quals;
+    atomic_ty->align = alignas_;
+    return atomic_ty;
+  }
+
   if (spec.struct_) {
     struct_ty->type.qualifiers = quals;
-    struct_ty->type.align = alignas_;
+    if (alignas_)
+      set_alignas(&struct_ty->type, alignas_);
     return &struct_ty->type;
   }
 
@@ -599,7 +855,8 @@ Type* parse_specifiers_and_qualifiers_and_storage(Parser* parser,
 
   if (spec.union_) {
     union_ty->type.qualifiers = quals;
-    union_ty->type.align = alignas_;
+    if (alignas_)
+      set_alignas(&union_ty->type, alignas_);
     return &union_ty->type;
   }
 
@@ -932,6 +1189,22 @@ Expr* parse_primary_expr(Parser* parser) {
     return &pf->expr;
   }
 
+  // __builtin_convertvector takes a type as its second argument, so it can't be
+  // parsed like a normal call.
+  if (tok->kind == TK_Identifier &&
+      strcmp(tok->chars.data, "__builtin_convertvector") == 0) {
+    parser_consume_token(parser, TK_Identifier);
+    parser_consume_token(parser, TK_LPar);
+    Expr* base = parse_assignment_expr(parser);
+    parser_consume_token(parser, TK_Comma);
+    Type* to = parse_type(parser);
+    parser_consume_token(parser, TK_RPar);
+
+    ConvertVector* convert = malloc(sizeof(ConvertVector));
+    convert_vector_construct(convert, base, to, &loc);
+    return &convert->expr;
+  }
+
   if (tok->kind == TK_Identifier) {
     DeclRef* ref = malloc(sizeof(DeclRef));
     declref_construct(ref, tok->chars.data, &loc);
@@ -955,6 +1228,24 @@ Expr* parse_primary_expr(Parser* parser) {
     return &i->expr;
   }
 
+  if (tok->kind == TK_FloatLiteral) {
+    size_t len = tok->chars.size;
+    BuiltinTypeKind kind = BTK_Double;
+    char suffix = tok->chars.data[len - 1];
+    if (suffix == 'f' || suffix == 'F') {
+      kind = BTK_Float;
+      --len;
+    } else if (suffix == 'l' || suffix == 'L') {
+      kind = BTK_LongDouble;
+      --len;
+    }
+
+    Float* f = malloc(sizeof(Float));
+    float_construct(f, tok->chars.data, len, kind, &loc);
+    parser_consume_token(parser, TK_FloatLiteral);
+    return &f->expr;
+  }
+
   if (tok->kind == TK_StringLiteral) {
     size_t size = tok->chars.size;
     assert(size >= 2 &&
@@ -1013,6 +1304,7 @@ Expr* parse_primary_expr(Parser* parser) {
 
     for (; !next_token_is(parser, TK_RCurlyBrace);) {
       char* name = NULL;
+      Expr* index = NULL;
 
       if (next_token_is(parser, TK_Dot)) {
         // Designated initializer.
@@ -1023,6 +1315,12 @@ Expr* parse_primary_expr(Parser* parser) {
 
         parser_consume_token(parser, TK_Identifier);
         parser_consume_token(parser, TK_Assign);
+      } else if (next_token_is(parser, TK_LSquareBrace)) {
+        // Array designator.
+        parser_consume_token(parser, TK_LSquareBrace);
+        index = parse_expr(parser);
+        parser_consume_token(parser, TK_RSquareBrace);
+        parser_consume_token(parser, TK_Assign);
       }
 
       // TODO: Should this be just `parse_expr`? Using `parse_expr` may consume
@@ -1030,6 +1328,7 @@ Expr* parse_primary_expr(Parser* parser) {
       Expr* expr = parse_assignment_expr(parser);
       InitializerListElem* elem = vector_append_storage(&elems);
       elem->name = name;
+      elem->index = index;
       elem->expr = expr;
 
       // Consume optional `,`.
@@ -1173,6 +1472,20 @@ Expr* parse_postfix_expr(Parser* parser) {
   return parse_postfix_expr_with_primary(parser, expr);
 }
 
+// GCC's labels as values: "&&" <identifier>
+static Expr* parse_addr_of_label(Parser* parser) {
+  SourceLocation loc = peek_token_source_loc(parser);
+  parser_consume_token(parser, TK_LogicalAnd);
+
+  Token label = parser_pop_token(parser);
+  expect_token(&label, TK_Identifier);
+
+  AddrOfLabel* addr = malloc(sizeof(AddrOfLabel));
+  addr_of_label_construct(addr, label.chars.data, &loc);
+  token_destroy(&label);
+  return &addr->expr;
+}
+
 //
 // <unary_epr> = <postfix_expr>
 //             | ("++" | "--") <unary_expr>
@@ -1214,6 +1527,8 @@ Expr* parse_unary_expr(Parser* parser) {
       return parse_sizeof(parser);
     case TK_AlignOf:
       return parse_alignof(parser);
+    case TK_LogicalAnd:
+      return parse_addr_of_label(parser);
     default:
       return parse_postfix_expr(parser);
   }
@@ -1621,6 +1936,9 @@ Expr* parse_assignment_expr(Parser* parser) {
     case TK_DivAssign:
       op = BOK_DivAssign;
       break;
+    case TK_ModAssign:
+      op = BOK_ModAssign;
+      break;
     case TK_AddAssign:
       op = BOK_AddAssign;
       break;
@@ -1717,7 +2035,31 @@ TopLevelNode* parse_typedef(Parser* parser) {
   Typedef* td = malloc(sizeof(Typedef));
   typedef_construct(td, &loc);
 
-  td->type = parse_type_for_declaration(parser, &td->name, /*storage=*/NULL);
+  DeclAttributes attrs;
+  decl_attributes_construct(&attrs);
+  Type* type = parse_specifiers_and_qualifiers_and_storage(
+      parser, /*storage=*/NULL, &attrs);
+  td->type = parse_type_for_declaration_impl(parser, &td->name,
+                                             /*storage=*/NULL, &attrs, type);
+
+  // Vector types can only be declared through typedefs. The attribute applies
+  // to the whole declared type which becomes the vector element type.
+  if (attrs.vector_size || attrs.ext_vector_type) {
+    assert(!(attrs.vector_size && attrs.ext_vector_type) &&
+           "A type cannot be both a vector_size and ext_vector_type vector");
+    VectorType* vec = malloc(sizeof(VectorType));
+    if (attrs.vector_size) {
+      vector_type_construct(vec, td->type, attrs.vector_size,
+                            /*is_ext_vector=*/false);
+      attrs.vector_size = NULL;
+    } else {
+      vector_type_construct(vec, td->type, attrs.ext_vector_type,
+                            /*is_ext_vector=*/true);
+      attrs.ext_vector_type = NULL;
+    }
+    td->type = &vec->type;
+  }
+  decl_attributes_destroy(&attrs);
 
   // We don't care about the value.
   assert(!parser_has_named_type(parser, td->name) && "Duplicate named typedef");
@@ -1833,6 +2175,28 @@ static Statement* parse_statement_impl(Parser* parser) {
     return &while_stmt->base;
   }
 
+  // https://clang.llvm.org/docs/AttributeReference.html#musttail
+  //
+  // Attributes before a statement. Only `musttail` on a return statement is
+  // used, other statement attributes are dropped.
+  if (peek->kind == TK_Attribute) {
+    DeclAttributes attrs;
+    decl_attributes_construct(&attrs);
+    for (; next_token_is(parser, TK_Attribute);)
+      parser_parse_attribute(parser, &attrs);
+    bool musttail = attrs.musttail;
+    decl_attributes_destroy(&attrs);
+
+    Statement* stmt = parse_statement_impl(parser);
+    if (musttail) {
+      ASSERT_MSG(stmt->vtable->kind == SK_ReturnStmt,
+                 "%zu:%zu: 'musttail' only applies to return statements",
+                 source_location_line(&loc), source_location_col(&loc));
+      ((ReturnStmt*)stmt)->musttail = true;
+    }
+    return stmt;
+  }
+
   if (peek->kind == TK_Return) {
     parser_consume_token(parser, TK_Return);
 
@@ -1946,6 +2310,45 @@ static Statement* parse_statement_impl(Parser* parser) {
     return &cnt->base;
   }
 
+  if (peek->kind == TK_Goto) {
+    parser_consume_token(parser, TK_Goto);
+
+    if (next_token_is(parser, TK_Star)) {
+      parser_consume_token(parser, TK_Star);
+      Expr* target = parse_expr(parser);
+      parser_consume_token(parser, TK_Semicolon);
+
+      IndirectGotoStmt* goto_stmt = malloc(sizeof(IndirectGotoStmt));
+      indirect_goto_stmt_construct(goto_stmt, target, &loc);
+      return &goto_stmt->base;
+    }
+
+    Token label = parser_pop_token(parser);
+    expect_token(&label, TK_Identifier);
+    parser_consume_token(parser, TK_Semicolon);
+
+    GotoStmt* goto_stmt = malloc(sizeof(GotoStmt));
+    goto_stmt_construct(goto_stmt, label.chars.data, &loc);
+    token_destroy(&label);
+    return &goto_stmt->base;
+  }
+
+  if (peek->kind == TK_Identifier &&
+      parser_peek_second_token(parser)->kind == TK_Colon) {
+    Token label = parser_pop_token(parser);
+    parser_consume_token(parser, TK_Colon);
+
+    // A label can also end a block.
+    Statement* stmt = NULL;
+    if (!next_token_is(parser, TK_RCurlyBrace))
+      stmt = parse_statement(parser);
+
+    LabelStmt* label_stmt = malloc(sizeof(LabelStmt));
+    label_stmt_construct(label_stmt, label.chars.data, stmt, &loc);
+    token_destroy(&label);
+    return &label_stmt->base;
+  }
+
   if (peek->kind == TK_Break) {
     parser_consume_token(parser, TK_Break);
     parser_consume_token(parser, TK_Semicolon);
@@ -2043,17 +2446,20 @@ TopLevelNode* parse_top_level_type_decl(Parser* parser) {
 
   const Token* peek = parser_peek_token(parser);
   assert(is_token_type_token(parser, peek) ||
-         is_storage_class_specifier_token(peek->kind));
+         is_storage_class_specifier_token(peek->kind) ||
+         peek->kind == TK_Inline || peek->kind == TK_Attribute);
 
   FoundStorageClasses storage = {};
-  // TODO: Handle inlines?
-  Type* type = parse_specifiers_and_qualifiers_and_storage(
-      parser, &storage, /*found_inline=*/NULL);
+  DeclAttributes attrs;
+  decl_attributes_construct(&attrs);
+  Type* type =
+      parse_specifiers_and_qualifiers_and_storage(parser, &storage, &attrs);
 
   // If the next token is a semicolon, then we know for a fact this is a tagged
   // type declaration.
   if (next_token_is(parser, TK_Semicolon)) {
     parser_skip_next_token(parser);
+    decl_attributes_destroy(&attrs);
     switch (type->vtable->kind) {
       case TK_UnionType: {
         UnionDeclaration* decl = malloc(sizeof(UnionDeclaration));
@@ -2079,7 +2485,8 @@ TopLevelNode* parse_top_level_type_decl(Parser* parser) {
   // Otherwise, continue parsing as if this were a type for a variable
   // declaration.
   char* name = NULL;
-  type = parse_type_for_declaration_impl(parser, &name, &storage, type);
+  type = parse_type_for_declaration_impl(parser, &name, &storage, &attrs,
+                                         type);
   assert(name);
 
   const Token* tok = parser_peek_token(parser);
@@ -2097,6 +2504,8 @@ TopLevelNode* parse_top_level_type_decl(Parser* parser) {
     if (storage.static_)
       func_def->is_extern = false;
 
+    func_def->attrs = attrs;
+
     free(name);
 
     return &func_def->node;
@@ -2111,6 +2520,8 @@ TopLevelNode* parse_top_level_type_decl(Parser* parser) {
   if (storage.thread_local_)
     gv->is_thread_local = true;
 
+  gv->attrs = attrs;
+
   if (next_token_is(parser, TK_Assign)) {
     parser_consume_token(parser, TK_Assign);
     Expr* init = parse_expr(parser);
@@ -2195,7 +2606,8 @@ TopLevelNode* parse_top_level_decl(Parser* parser) {
       break;
     default:
       if (is_token_type_token(parser, token) ||
-          is_storage_class_specifier_token(token->kind)) {
+          is_storage_class_specifier_token(token->kind) ||
+          token->kind == TK_Inline || token->kind == TK_Attribute) {
         node = parse_top_level_type_decl(parser);
       }
   }
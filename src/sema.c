@@ -7,6 +7,138 @@
 #include "type.h"
 #include "vector.h"
 
+static Type* create_builtin(BuiltinTypeKind kind) {
+  return &create_builtin_type(kind)->type;
+}
+
+static Type* create_void_pointer(bool is_const) {
+  Type* pointee = create_builtin(BTK_Void);
+  if (is_const)
+    type_set_const(pointee);
+  return &create_pointer_to(pointee)->type;
+}
+
+// Declare the builtin function `name`. This takes ownership of all the types.
+static void add_builtin_function(Sema* sema, const char* name, Type* ret_ty,
+                                 Type** arg_tys, size_t num_args,
+                                 bool has_var_args) {
+  vector args;
+  vector_construct(&args, sizeof(FunctionArg), alignof(FunctionArg));
+  for (size_t i = 0; i < num_args; ++i) {
+    FunctionArg* arg = vector_append_storage(&args);
+    arg->name = NULL;
+    arg->type = arg_tys[i];
+  }
+
+  FunctionType* func_ty = malloc(sizeof(FunctionType));
+  function_type_construct(func_ty, ret_ty, args);
+  func_ty->has_var_args = has_var_args;
+
+  SourceLocation dummy_loc;
+  source_location_construct(&dummy_loc, /*line=*/0, /*col=*/0,
+                            /*filename=*/"");
+  GlobalVariable* builtin = malloc(sizeof(GlobalVariable));
+  global_variable_construct(builtin, name, &func_ty->type, &dummy_loc);
+
+  GlobalVariable** storage = vector_append_storage(&sema->builtins);
+  *storage = builtin;
+  sema_handle_global_variable(sema, builtin);
+}
+
+// These are the builtins handled specially in codegen. Their signatures match
+// the ones clang and gcc document.
+static void add_builtin_functions(Sema* sema) {
+  add_builtin_function(sema, "__builtin_trap", create_builtin(BTK_Void),
+                       /*arg_tys=*/NULL, 0, /*has_var_args=*/false);
+  add_builtin_function(sema, "__builtin_unreachable", create_builtin(BTK_Void),
+                       /*arg_tys=*/NULL, 0, /*has_var_args=*/false);
+
+  {
+    Type* arg_tys[] = {create_builtin(BTK_Long), create_builtin(BTK_Long)};
+    add_builtin_function(sema, "__builtin_expect", create_builtin(BTK_Long),
+                         arg_tys, 2, /*has_var_args=*/false);
+  }
+
+  {
+    // The optional arguments are the read/write flag and the locality.
+    Type* arg_tys[] = {create_void_pointer(/*is_const=*/true)};
+    add_builtin_function(sema, "__builtin_prefetch", create_builtin(BTK_Void),
+                         arg_tys, 1, /*has_var_args=*/true);
+  }
+
+  {
+    // The optional argument is the offset from the alignment.
+    Type* arg_tys[] = {create_void_pointer(/*is_const=*/true),
+                       create_builtin(BTK_UnsignedLong)};
+    add_builtin_function(sema, "__builtin_assume_aligned",
+                         create_void_pointer(/*is_const=*/false), arg_tys, 2,
+                         /*has_var_args=*/true);
+  }
+
+  {
+    Type* arg_tys[] = {create_void_pointer(/*is_const=*/false),
+                       create_void_pointer(/*is_const=*/true),
+                       create_builtin(BTK_UnsignedLong)};
+    add_builtin_function(sema, "__builtin_memcpy",
+                         create_void_pointer(/*is_const=*/false), arg_tys, 3,
+                         /*has_var_args=*/false);
+  }
+
+  {
+    Type* arg_tys[] = {create_void_pointer(/*is_const=*/false),
+                       create_builtin(BTK_Int),
+                       create_builtin(BTK_UnsignedLong)};
+    add_builtin_function(sema, "__builtin_memset",
+                         create_void_pointer(/*is_const=*/false), arg_tys, 3,
+                         /*has_var_args=*/false);
+  }
+
+  {
+    // Each bit counting builtin has an `int`, `long` and `long long` variant.
+    const char* names[] = {
+        "__builtin_ctz",      "__builtin_ctzl",      "__builtin_ctzll",
+        "__builtin_clz",      "__builtin_clzl",      "__builtin_clzll",
+        "__builtin_popcount", "__builtin_popcountl", "__builtin_popcountll"};
+    BuiltinTypeKind kinds[] = {BTK_UnsignedInt, BTK_UnsignedLong,
+                               BTK_UnsignedLongLong};
+    for (size_t i = 0; i < 9; ++i) {
+      Type* arg_tys[] = {create_builtin(kinds[i % 3])};
+      add_builtin_function(sema, names[i], create_builtin(BTK_Int), arg_tys, 1,
+                           /*has_var_args=*/false);
+    }
+  }
+
+  {
+    BuiltinTypeKind kinds[] = {BTK_UnsignedShort, BTK_UnsignedInt,
+                               BTK_UnsignedLong};
+    const char* names[] = {"__builtin_bswap16", "__builtin_bswap32",
+                           "__builtin_bswap64"};
+    for (size_t i = 0; i < 3; ++i) {
+      Type* arg_tys[] = {create_builtin(kinds[i])};
+      add_builtin_function(sema, names[i], create_builtin(kinds[i]), arg_tys,
+                           1, /*has_var_args=*/false);
+    }
+  }
+
+  {
+    // These are lowered to intrinsics rather than libm calls. The square roots
+    // only are with -fno-math-errno since a negative argument sets errno.
+    const char* names[] = {"__builtin_sqrt", "__builtin_sqrtf",
+                           "__builtin_fabs", "__builtin_fabsf"};
+    BuiltinTypeKind kinds[] = {BTK_Double, BTK_Float};
+    for (size_t i = 0; i < 4; ++i) {
+      Type* arg_tys[] = {create_builtin(kinds[i % 2])};
+      add_builtin_function(sema, names[i], create_builtin(kinds[i % 2]),
+                           arg_tys, 1, /*has_var_args=*/false);
+    }
+  }
+}
+
+static void add_memory_order(Sema* sema, const char* name, MemoryOrder order) {
+  tree_map_set(&sema->enum_values, name, (void*)(intptr_t)order);
+  tree_map_set(&sema->enum_names, name, &sema->memory_order_ty);
+}
+
 void sema_construct(Sema* sema) {
   string_tree_map_construct(&sema->typedef_types);
   string_tree_map_construct(&sema->struct_types);
@@ -37,28 +169,43 @@ void sema_construct(Sema* sema) {
     type_set_const(&chars->type);
     pointer_type_construct(&sema->str_ty, &chars->type);
   }
-
   {
-    BuiltinType* ret_ty = malloc(sizeof(BuiltinType));
-    builtin_type_construct(ret_ty, BTK_Void);
+    BuiltinType* void_ty = create_builtin_type(BTK_Void);
+    pointer_type_construct(&sema->void_ptr_ty, &void_ty->type);
+  }
 
-    vector args;
-    vector_construct(&args, sizeof(FunctionArg), alignof(FunctionArg));
+  // These are predefined macros in GCC and Clang. They're declared here as
+  // enum constants since the compiler does not preprocess its input.
+  enum_type_construct(&sema->memory_order_ty, /*name=*/NULL,
+                      /*members=*/NULL);
+  add_memory_order(sema, "__ATOMIC_RELAXED", MO_Relaxed);
+  add_memory_order(sema, "__ATOMIC_CONSUME", MO_Consume);
+  add_memory_order(sema, "__ATOMIC_ACQUIRE", MO_Acquire);
+  add_memory_order(sema, "__ATOMIC_RELEASE", MO_Release);
+  add_memory_order(sema, "__ATOMIC_ACQ_REL", MO_AcqRel);
+  add_memory_order(sema, "__ATOMIC_SEQ_CST", MO_SeqCst);
+
+  vector_construct(&sema->builtins, sizeof(GlobalVariable*),
+                   alignof(GlobalVariable*));
+  add_builtin_functions(sema);
 
-    FunctionType* builtin_trap_type = malloc(sizeof(FunctionType));
-    function_type_construct(builtin_trap_type, &ret_ty->type, args);
+  vector_construct(&sema->address_of_storage, sizeof(NonOwningPointerType*),
+                   alignof(NonOwningPointerType*));
+  pthread_mutex_init(&sema->address_of_storage_lock, NULL);
 
-    SourceLocation dummy_loc;
-    source_location_construct(&dummy_loc, /*line=*/0, /*col=*/0,
-                              /*filename=*/"");
-    global_variable_construct(&sema->builtin_trap, "__builtin_trap",
-                              &builtin_trap_type->type, &dummy_loc);
+  vector_construct(&sema->vector_type_storage, sizeof(VectorType*),
+                   alignof(VectorType*));
+  pthread_mutex_init(&sema->vector_type_storage_lock, NULL);
 
-    sema_handle_global_variable(sema, &sema->builtin_trap);
-  }
+  pointer_tree_map_construct(&sema->struct_layouts);
+  pthread_mutex_init(&sema->struct_layouts_lock, NULL);
+}
 
-  vector_construct(&sema->address_of_storage, sizeof(NonOwningPointerType*),
-                   alignof(NonOwningPointerType*));
+static void destroy_struct_layout_callback(const void* key, void* value,
+                                           void* arg) {
+  StructLayout* layout = value;
+  free(layout->members);
+  free(layout);
 }
 
 void sema_destroy(Sema* sema) {
@@ -74,13 +221,34 @@ void sema_destroy(Sema* sema) {
   // any members that need cleanup.
 
   type_destroy(&sema->str_ty.type);
+  type_destroy(&sema->void_ptr_ty.type);
+  type_destroy(&sema->memory_order_ty.type);
 
-  top_level_node_destroy(&sema->builtin_trap.node);
+  for (size_t i = 0; i < sema->builtins.size; ++i) {
+    GlobalVariable* builtin = *(GlobalVariable**)vector_at(&sema->builtins, i);
+    top_level_node_destroy(&builtin->node);
+    free(builtin);
+  }
+  vector_destroy(&sema->builtins);
 
   NonOwningPointerType** start = vector_begin(&sema->address_of_storage);
   NonOwningPointerType** end = vector_end(&sema->address_of_storage);
   for (NonOwningPointerType** it = start; it != end; ++it) free(*it);
   vector_destroy(&sema->address_of_storage);
+  pthread_mutex_destroy(&sema->address_of_storage_lock);
+
+  for (size_t i = 0; i < sema->vector_type_storage.size; ++i) {
+    VectorType* vec = *(VectorType**)vector_at(&sema->vector_type_storage, i);
+    type_destroy(&vec->type);
+    free(vec);
+  }
+  vector_destroy(&sema->vector_type_storage);
+  pthread_mutex_destroy(&sema->vector_type_storage_lock);
+
+  tree_map_iterate(&sema->struct_layouts, destroy_struct_layout_callback,
+                   NULL);
+  tree_map_destroy(&sema->struct_layouts);
+  pthread_mutex_destroy(&sema->struct_layouts_lock);
 }
 
 const BuiltinType* sema_get_integral_type_for_enum(const Sema* sema,
@@ -90,6 +258,152 @@ const BuiltinType* sema_get_integral_type_for_enum(const Sema* sema,
   return &sema->bt_Int;
 }
 
+static const char* kAtomicOpNames[] = {"add", "sub", "and",
+                                       "or",  "xor", "nand"};
+
+// Parse the first `len` characters of `str` as an operation name.
+static bool parse_atomic_op(const char* str, size_t len, AtomicOp* op) {
+  for (size_t i = 0; i < sizeof(kAtomicOpNames) / sizeof(kAtomicOpNames[0]);
+       ++i) {
+    if (strlen(kAtomicOpNames[i]) == len &&
+        strncmp(str, kAtomicOpNames[i], len) == 0) {
+      *op = (AtomicOp)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Parse the `<op>_fetch` and `<op>_and_fetch` suffixes.
+static bool parse_atomic_op_fetch(const char* str, const char* suffix,
+                                  AtomicOp* op) {
+  size_t len = strlen(str);
+  size_t suffix_len = strlen(suffix);
+  if (len <= suffix_len || strcmp(&str[len - suffix_len], suffix) != 0)
+    return false;
+  return parse_atomic_op(str, len - suffix_len, op);
+}
+
+// https://gcc.gnu.org/onlinedocs/gcc/_005f_005fatomic-Builtins.html
+// https://gcc.gnu.org/onlinedocs/gcc/_005f_005fsync-Builtins.html
+// https://clang.llvm.org/docs/LanguageExtensions.html#c11-atomic-builtins
+//
+// The GCC generic forms which take the value through a pointer, like
+// `__atomic_load`, are not supported.
+bool sema_get_atomic_builtin(const char* name, AtomicBuiltin* builtin) {
+  memset(builtin, 0, sizeof(AtomicBuiltin));
+  builtin->order = MO_SeqCst;
+
+  const char* rest;
+  bool is_c11 = false;
+  if (strncmp(name, "__atomic_", 9) == 0) {
+    rest = &name[9];
+    builtin->has_memory_order = true;
+  } else if (strncmp(name, "__c11_atomic_", 13) == 0) {
+    rest = &name[13];
+    builtin->has_memory_order = true;
+    is_c11 = true;
+  } else if (strncmp(name, "__sync_", 7) == 0) {
+    rest = &name[7];
+  } else {
+    return false;
+  }
+
+  if (builtin->has_memory_order) {
+    if (strcmp(rest, is_c11 ? "load" : "load_n") == 0) {
+      builtin->kind = ABK_Load;
+      builtin->num_args = 1;
+    } else if (strcmp(rest, is_c11 ? "store" : "store_n") == 0) {
+      builtin->kind = ABK_Store;
+      builtin->num_args = 2;
+    } else if (strcmp(rest, is_c11 ? "exchange" : "exchange_n") == 0) {
+      builtin->kind = ABK_Exchange;
+      builtin->num_args = 2;
+    } else if (!is_c11 && strcmp(rest, "compare_exchange_n") == 0) {
+      builtin->kind = ABK_CompareExchange;
+      builtin->num_args = 4;
+      builtin->has_weak_arg = true;
+    } else if (is_c11 && strcmp(rest, "compare_exchange_strong") == 0) {
+      builtin->kind = ABK_CompareExchange;
+      builtin->num_args = 3;
+    } else if (is_c11 && strcmp(rest, "compare_exchange_weak") == 0) {
+      builtin->kind = ABK_CompareExchange;
+      builtin->num_args = 3;
+      builtin->is_weak = true;
+    } else if (strncmp(rest, "fetch_", 6) == 0 &&
+               parse_atomic_op(&rest[6], strlen(&rest[6]), &builtin->op)) {
+      builtin->kind = ABK_FetchOp;
+      builtin->num_args = 2;
+    } else if (!is_c11 && parse_atomic_op_fetch(rest, "_fetch", &builtin->op)) {
+      builtin->kind = ABK_OpFetch;
+      builtin->num_args = 2;
+    } else if (strcmp(rest, "thread_fence") == 0) {
+      builtin->kind = ABK_ThreadFence;
+    } else if (strcmp(rest, "signal_fence") == 0) {
+      builtin->kind = ABK_SignalFence;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  if (strncmp(rest, "fetch_and_", 10) == 0 &&
+      parse_atomic_op(&rest[10], strlen(&rest[10]), &builtin->op)) {
+    builtin->kind = ABK_FetchOp;
+    builtin->num_args = 2;
+  } else if (parse_atomic_op_fetch(rest, "_and_fetch", &builtin->op)) {
+    builtin->kind = ABK_OpFetch;
+    builtin->num_args = 2;
+  } else if (strcmp(rest, "val_compare_and_swap") == 0) {
+    builtin->kind = ABK_ValCompareAndSwap;
+    builtin->num_args = 3;
+  } else if (strcmp(rest, "bool_compare_and_swap") == 0) {
+    builtin->kind = ABK_BoolCompareAndSwap;
+    builtin->num_args = 3;
+  } else if (strcmp(rest, "lock_test_and_set") == 0) {
+    // This is only an acquire barrier.
+    builtin->kind = ABK_Exchange;
+    builtin->num_args = 2;
+    builtin->order = MO_Acquire;
+  } else if (strcmp(rest, "lock_release") == 0) {
+    // This stores 0 with release semantics.
+    builtin->kind = ABK_Store;
+    builtin->num_args = 1;
+    builtin->order = MO_Release;
+  } else if (strcmp(rest, "synchronize") == 0) {
+    builtin->kind = ABK_ThreadFence;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static const Type* sema_get_atomic_builtin_type(Sema* sema, const Call* call,
+                                                const AtomicBuiltin* builtin,
+                                                const TreeMap* local_ctx) {
+  switch (builtin->kind) {
+    case ABK_Store:
+    case ABK_ThreadFence:
+    case ABK_SignalFence:
+      return &sema->bt_Void.type;
+    case ABK_CompareExchange:
+    case ABK_BoolCompareAndSwap:
+      return &sema->bt_Bool.type;
+    case ABK_Load:
+    case ABK_Exchange:
+    case ABK_ValCompareAndSwap:
+    case ABK_FetchOp:
+    case ABK_OpFetch: {
+      ASSERT_MSG(call->args.size, "Atomic builtin expects a pointer argument");
+      const Expr* ptr = *(const Expr**)vector_at(&call->args, 0);
+      const Type* ptr_ty = sema_get_type_of_expr_in_ctx(sema, ptr, local_ctx);
+      ASSERT_MSG(sema_is_pointer_type(sema, ptr_ty, local_ctx),
+                 "Atomic builtin expects a pointer argument");
+      return sema_get_pointee(sema, ptr_ty, local_ctx);
+    }
+  }
+}
+
 uint64_t result_to_u64(const ConstExprResult* res) {
   switch (res->result_kind) {
     case RK_Boolean:
@@ -206,6 +520,96 @@ const StructType* sema_get_struct_type(const Sema* sema, const Type* type,
   return NULL;
 }
 
+bool sema_is_vector_type(const Sema* sema, const Type* type,
+                         const TreeMap* local_ctx) {
+  type = sema_resolve_maybe_named_type(sema, type);
+  return type->vtable->kind == TK_VectorType;
+}
+
+const VectorType* sema_get_vector_type(const Sema* sema, const Type* type,
+                                       const TreeMap* local_ctx) {
+  type = sema_resolve_maybe_named_type(sema, type);
+  if (type->vtable->kind == TK_VectorType)
+    return (const VectorType*)type;
+  return NULL;
+}
+
+size_t sema_get_vector_length(Sema* sema, const VectorType* vec,
+                              const TreeMap* local_ctx) {
+  ConstExprResult res = sema_eval_expr_in_ctx(sema, vec->size, local_ctx);
+  size_t size = (size_t)result_to_u64(&res);
+  if (vec->is_ext_vector)
+    return size;
+
+  size_t elem_size = sema_eval_sizeof_type(sema, vec->elem_type, local_ctx);
+  ASSERT_MSG(size % elem_size == 0,
+             "Vector size %zu is not a multiple of its element size %zu", size,
+             elem_size);
+  return size / elem_size;
+}
+
+const VectorType* sema_get_vector_type_of(Sema* sema, BuiltinTypeKind kind,
+                                          size_t len) {
+  pthread_mutex_lock(&sema->vector_type_storage_lock);
+
+  VectorType* res = NULL;
+  for (size_t i = 0; i < sema->vector_type_storage.size && !res; ++i) {
+    VectorType* vec = *(VectorType**)vector_at(&sema->vector_type_storage, i);
+    if (((const BuiltinType*)vec->elem_type)->kind == kind &&
+        ((const Int*)vec->size)->val == len)
+      res = vec;
+  }
+
+  if (!res) {
+    SourceLocation dummy_loc;
+    source_location_construct(&dummy_loc, /*line=*/0, /*col=*/0,
+                              /*filename=*/"");
+    Int* size = malloc(sizeof(Int));
+    int_construct(size, len, BTK_Int, &dummy_loc);
+
+    res = malloc(sizeof(VectorType));
+    vector_type_construct(res, create_builtin(kind), &size->expr,
+                          /*is_ext_vector=*/true);
+
+    VectorType** storage = vector_append_storage(&sema->vector_type_storage);
+    *storage = res;
+  }
+
+  pthread_mutex_unlock(&sema->vector_type_storage_lock);
+  return res;
+}
+
+// Vector comparisons produce a vector of signed integers with the same width
+// as the operand elements where each element is either 0 or -1.
+static const Type* sema_get_vector_comparison_type(Sema* sema,
+                                                   const VectorType* vec,
+                                                   const TreeMap* local_ctx) {
+  BuiltinTypeKind kind;
+  switch (sema_eval_sizeof_type(sema, vec->elem_type, local_ctx)) {
+    case 1:
+      kind = BTK_SignedChar;
+      break;
+    case 2:
+      kind = BTK_Short;
+      break;
+    case 4:
+      kind = BTK_Int;
+      break;
+    case 8:
+      kind = BTK_Long;
+      break;
+    default:
+      UNREACHABLE_MSG("Unhandled vector element size");
+  }
+
+  const Type* elem_ty = sema_resolve_maybe_named_type(sema, vec->elem_type);
+  if (is_builtin_type(elem_ty, kind))
+    return &vec->type;
+
+  size_t len = sema_get_vector_length(sema, vec, local_ctx);
+  return &sema_get_vector_type_of(sema, kind, len)->type;
+}
+
 // TODO: Pass fewer args around.
 bool sema_is_pointer_to(const Sema* sema, const Type* type, TypeKind kind,
                         const TreeMap* local_ctx) {
@@ -383,6 +787,19 @@ bool sema_types_are_compatible_impl(Sema* sema, const Type* lhs,
       }
       break;
     }
+    case TK_VectorType: {
+      const VectorType* lhs_vec = (const VectorType*)lhs;
+      const VectorType* rhs_vec = (const VectorType*)rhs;
+      if (!sema_types_are_compatible_impl(sema, lhs_vec->elem_type,
+                                          rhs_vec->elem_type, ignore_quals,
+                                          local_ctx))
+        return false;
+
+      if (sema_get_vector_length(sema, lhs_vec, local_ctx) !=
+          sema_get_vector_length(sema, rhs_vec, local_ctx))
+        return false;
+      break;
+    }
     case TK_NamedType:
     case TK_ReplacementSentinelType:
       UNREACHABLE_MSG("This type should not be handled here: %d",
@@ -608,6 +1025,19 @@ void sema_add_typedef_type(Sema* sema, const char* name, Type* type) {
   } else if (type->vtable->kind == TK_UnionType) {
     UnionType* union_ty = (UnionType*)type;
     sema_handle_union_declaration_impl(sema, union_ty);
+  } else if (type->vtable->kind == TK_VectorType) {
+    const VectorType* vec = (const VectorType*)type;
+    const Type* elem_ty = sema_resolve_maybe_named_type(sema, vec->elem_type);
+    ASSERT_MSG(
+        elem_ty->vtable->kind == TK_BuiltinType && !is_void_type(elem_ty),
+        "Vector '%s' must have an integral or floating point element type",
+        name);
+
+    TreeMap dummy_ctx;
+    string_tree_map_construct(&dummy_ctx);
+    ASSERT_MSG(sema_get_vector_length(sema, vec, &dummy_ctx),
+               "Vector '%s' must have at least one element", name);
+    tree_map_destroy(&dummy_ctx);
   }
 
   switch (type->vtable->kind) {
@@ -618,6 +1048,7 @@ void sema_add_typedef_type(Sema* sema, const char* name, Type* type) {
     case TK_EnumType:  // TODO: Handle enum values.
     case TK_PointerType:
     case TK_ArrayType:
+    case TK_VectorType:
       tree_map_set(&sema->typedef_types, name, type);
       break;
     case TK_NamedType: {
@@ -656,11 +1087,16 @@ const Type* sema_get_type_of_unop_expr(Sema* sema, const UnOp* expr,
     case UOK_AddrOf: {
       const Type* sub_type =
           sema_get_type_of_expr_in_ctx(sema, expr->subexpr, local_ctx);
-      NonOwningPointerType** ptr =
+      NonOwningPointerType* ptr = malloc(sizeof(NonOwningPointerType));
+      non_owning_pointer_type_construct(ptr, sub_type);
+
+      pthread_mutex_lock(&sema->address_of_storage_lock);
+      NonOwningPointerType** storage =
           vector_append_storage(&sema->address_of_storage);
-      *ptr = malloc(sizeof(NonOwningPointerType));
-      non_owning_pointer_type_construct(*ptr, sub_type);
-      return (Type*)(*ptr);
+      *storage = ptr;
+      pthread_mutex_unlock(&sema->address_of_storage_lock);
+
+      return (Type*)ptr;
     }
     case UOK_Deref: {
       const Type* sub_type =
@@ -684,6 +1120,11 @@ bool sema_is_unsigned_integral_type(const Sema* sema, const Type* type) {
   return is_unsigned_integral_type(type);
 }
 
+bool sema_is_floating_point_type(const Sema* sema, const Type* type) {
+  type = sema_resolve_maybe_named_type(sema, type);
+  return is_floating_point_type(type);
+}
+
 const Type* sema_get_corresponding_unsigned_type(const Sema* sema,
                                                  const BuiltinType* bt) {
   if (is_unsigned_integral_type(&bt->type))
@@ -715,11 +1156,32 @@ const Type* sema_get_common_arithmetic_type(Sema* sema, const Type* lhs_ty,
   if (rhs_ty->vtable->kind == TK_NamedType)
     rhs_ty = sema_resolve_named_type(sema, (const NamedType*)rhs_ty);
 
+  // Operations with a vector operand are done on each element, so a scalar
+  // operand is splat to the vector type.
+  if (lhs_ty->vtable->kind == TK_VectorType)
+    return lhs_ty;
+  if (rhs_ty->vtable->kind == TK_VectorType)
+    return rhs_ty;
+
   // If the types are the same, that type is the common type.
   if (sema_types_are_compatible_ignore_quals(sema, lhs_ty, rhs_ty, local_ctx))
     return lhs_ty;
 
-  // TODO: Handle non-integral types also.
+  // If either operand has a floating type, the other operand is converted to
+  // the floating type with the greater rank.
+  bool lhs_is_fp = is_floating_point_type(lhs_ty);
+  bool rhs_is_fp = is_floating_point_type(rhs_ty);
+  if (lhs_is_fp && rhs_is_fp) {
+    if (get_floating_point_rank((const BuiltinType*)lhs_ty) >=
+        get_floating_point_rank((const BuiltinType*)rhs_ty))
+      return lhs_ty;
+    return rhs_ty;
+  }
+  if (lhs_is_fp)
+    return lhs_ty;
+  if (rhs_is_fp)
+    return rhs_ty;
+
   assert(is_integral_type(lhs_ty) && is_integral_type(rhs_ty));
 
   const BuiltinType* lhs_bt = (const BuiltinType*)lhs_ty;
@@ -795,7 +1257,14 @@ const Type* sema_get_result_type_of_binop_expr(Sema* sema, const BinOp* expr,
     case BOK_Lt:
     case BOK_Gt:
     case BOK_Le:
-    case BOK_Ge:
+    case BOK_Ge: {
+      const VectorType* vec = sema_get_vector_type(sema, lhs_ty, local_ctx);
+      if (!vec)
+        vec = sema_get_vector_type(sema, rhs_ty, local_ctx);
+      if (vec)
+        return sema_get_vector_comparison_type(sema, vec, local_ctx);
+      return &sema->bt_Bool.type;
+    }
     case BOK_LogicalOr:
     case BOK_LogicalAnd:
       return &sema->bt_Bool.type;
@@ -879,11 +1348,15 @@ const Type* sema_get_type_of_expr_in_ctx(Sema* sema, const Expr* expr,
     case EK_String:
     case EK_PrettyFunction:
       return &sema->str_ty.type;
+    case EK_AddrOfLabel:
+      return &sema->void_ptr_ty.type;
     case EK_SizeOf:
     case EK_AlignOf:
       return sema_resolve_named_type_from_name(sema, "size_t");
     case EK_Int:
       return &((const Int*)expr)->type.type;
+    case EK_Float:
+      return &((const Float*)expr)->type.type;
     case EK_Bool:
       return &sema->bt_Bool.type;
     case EK_Char:
@@ -922,6 +1395,36 @@ const Type* sema_get_type_of_expr_in_ctx(Sema* sema, const Expr* expr,
                                                 local_ctx);
     case EK_Call: {
       const Call* call = (const Call*)expr;
+      AtomicBuiltin atomic;
+      if (call->base->vtable->kind == EK_DeclRef &&
+          sema_get_atomic_builtin(((const DeclRef*)call->base)->name,
+                                  &atomic)) {
+        return sema_get_atomic_builtin_type(sema, call, &atomic, local_ctx);
+      }
+
+      if (call->base->vtable->kind == EK_DeclRef &&
+          strcmp(((const DeclRef*)call->base)->name,
+                 "__builtin_shufflevector") == 0) {
+        ASSERT_MSG(call->args.size >= 3,
+                   "__builtin_shufflevector expects 2 vectors and at least "
+                   "one index");
+        const Expr* first = *(const Expr**)vector_at(&call->args, 0);
+        const VectorType* vec = sema_get_vector_type(
+            sema, sema_get_type_of_expr_in_ctx(sema, first, local_ctx),
+            local_ctx);
+        ASSERT_MSG(vec, "__builtin_shufflevector expects vector arguments");
+
+        size_t len = call->args.size - 2;
+        if (sema_get_vector_length(sema, vec, local_ctx) == len)
+          return &vec->type;
+
+        const Type* elem_ty =
+            sema_resolve_maybe_named_type(sema, vec->elem_type);
+        return &sema_get_vector_type_of(
+                    sema, ((const BuiltinType*)elem_ty)->kind, len)
+                    ->type;
+      }
+
       const Type* ty =
           sema_get_type_of_expr_in_ctx(sema, call->base, local_ctx);
       assert(sema_is_function_or_function_ptr(sema, ty, local_ctx));
@@ -931,6 +1434,10 @@ const Type* sema_get_type_of_expr_in_ctx(Sema* sema, const Expr* expr,
       const Cast* cast = (const Cast*)expr;
       return cast->to;
     }
+    case EK_ConvertVector: {
+      const ConvertVector* convert = (const ConvertVector*)expr;
+      return convert->to;
+    }
     case EK_MemberAccess: {
       const MemberAccess* access = (const MemberAccess*)expr;
       const StructType* base_ty =
@@ -956,8 +1463,12 @@ const Type* sema_get_type_of_expr_in_ctx(Sema* sema, const Expr* expr,
       if (base_ty->vtable->kind == TK_ArrayType)
         return sema_get_array_type(sema, base_ty, local_ctx)->elem_type;
 
+      if (base_ty->vtable->kind == TK_VectorType)
+        return ((const VectorType*)base_ty)->elem_type;
+
       UNREACHABLE_MSG(
-          "Attempting to index a type that isn't a pointer or array: %d",
+          "Attempting to index a type that isn't a pointer, array, or vector: "
+          "%d",
           base_ty->vtable->kind);
     }
     case EK_StmtExpr: {
@@ -1097,21 +1608,31 @@ size_t sema_eval_alignof_members(Sema* sema, const vector* members,
   return max_align;
 }
 
+// Evaluate the argument of `alignas` or `aligned(N)`.
+static size_t sema_eval_alignment(Sema* sema, const Expr* align,
+                                  const TreeMap* local_ctx) {
+  ConstExprResult alignment = sema_eval_expr_in_ctx(sema, align, local_ctx);
+  switch (alignment.result_kind) {
+    case RK_Boolean:
+      UNREACHABLE_MSG("Bool is not acceptable alignment");
+    case RK_Int:
+      assert(alignment.result.i > 0);
+      return (size_t)alignment.result.i;
+    case RK_UnsignedLongLong:
+      return alignment.result.ull;
+  }
+}
+
+static size_t max_size(size_t a, size_t b) { return a > b ? a : b; }
+
 size_t sema_eval_alignof_type(Sema* sema, const Type* type,
                               const TreeMap* local_ctx) {
-  if (type->align) {
-    ConstExprResult alignment =
-        sema_eval_expr_in_ctx(sema, type->align, local_ctx);
-    switch (alignment.result_kind) {
-      case RK_Boolean:
-        UNREACHABLE_MSG("Bool is not acceptable alignment");
-      case RK_Int:
-        assert(alignment.result.i > 0);
-        return (size_t)alignment.result.i;
-      case RK_UnsignedLongLong:
-        return alignment.result.ull;
-    }
-  }
+  // The alignment given to a struct or union can only increase its natural
+  // alignment, so those are handled below.
+  bool is_record = type->vtable->kind == TK_StructType ||
+                   type->vtable->kind == TK_UnionType;
+  if (type->align && !is_record)
+    return sema_eval_alignment(sema, type->align, local_ctx);
 
   switch (type->vtable->kind) {
     case TK_BuiltinType:
@@ -1132,44 +1653,139 @@ size_t sema_eval_alignof_type(Sema* sema, const Type* type,
           sema_get_integral_type_for_enum(sema, (const EnumType*)type));
     case TK_ArrayType:
       return sema_eval_alignof_array(sema, (const ArrayType*)type, local_ctx);
+    case TK_VectorType:
+      return sema_eval_sizeof_vector(sema, (const VectorType*)type, local_ctx);
     case TK_FunctionType:
       UNREACHABLE_MSG("Cannot take alignof function type!");
     case TK_StructType: {
-      const StructType* struct_ty =
-          sema_resolve_struct_type(sema, (const StructType*)type);
-      return sema_eval_alignof_members(sema, struct_ty->members, local_ctx);
+      const StructLayout* layout =
+          sema_get_struct_layout(sema, (const StructType*)type, local_ctx);
+      if (type->align) {
+        return max_size(layout->align,
+                        sema_eval_alignment(sema, type->align, local_ctx));
+      }
+      return layout->align;
     }
     case TK_UnionType: {
       const UnionType* union_ty =
           sema_resolve_union_type(sema, (const UnionType*)type);
-      return sema_eval_alignof_members(sema, union_ty->members, local_ctx);
+      size_t align = 1;
+      if (!union_ty->packed)
+        align = sema_eval_alignof_members(sema, union_ty->members, local_ctx);
+      if (union_ty->type.align) {
+        align = max_size(
+            align, sema_eval_alignment(sema, union_ty->type.align, local_ctx));
+      }
+      if (type->align) {
+        align =
+            max_size(align, sema_eval_alignment(sema, type->align, local_ctx));
+      }
+      return align;
     }
     case TK_ReplacementSentinelType:
       UNREACHABLE_MSG("Replacement sentinel type should not be used");
   }
 }
 
-size_t sema_eval_sizeof_struct_type(Sema* sema, const StructType* type,
-                                    const TreeMap* local_ctx) {
-  type = sema_resolve_struct_type(sema, type);
-  ASSERT_MSG(type->members, "Taking sizeof incomplete struct type '%s'",
-             type->name);
+static const size_t kCharBit = 8;
 
-  size_t size = 0;
-  size_t max_align = 0;
+static void compute_struct_layout(Sema* sema, const StructType* type,
+                                  StructLayout* layout,
+                                  const TreeMap* local_ctx) {
+  layout->members = calloc(type->members->size, sizeof(MemberLayout));
+
+  // Members are placed bit by bit so bitfields can share bytes.
+  size_t bits = 0;
+  size_t max_align = 1;
   for (size_t i = 0; i < type->members->size; ++i) {
-    // TODO: Account for bitfields.
     const Member* member = vector_at(type->members, i);
-    const Type* member_ty = member->type;
-    size_t align = sema_eval_alignof_type(sema, member_ty, local_ctx);
-    if (align > max_align)
-      max_align = align;
-    if (size % align != 0)
-      size = align_up(size, align);
-    size += sema_eval_sizeof_type(sema, member_ty, local_ctx);
+    MemberLayout* member_layout = &layout->members[i];
+    size_t size = sema_eval_sizeof_type(sema, member->type, local_ctx);
+    size_t natural_align =
+        sema_eval_alignof_type(sema, member->type, local_ctx);
+    size_t align = natural_align;
+    if (type->packed)
+      align = 1;
+
+    if (!member->bitfield) {
+      size_t offset = align_up(align_up(bits, kCharBit) / kCharBit, align);
+      member_layout->offset = offset;
+      bits = (offset + size) * kCharBit;
+      max_align = max_size(max_align, align);
+      continue;
+    }
+
+    ConstExprResult width_res =
+        sema_eval_expr_in_ctx(sema, member->bitfield, local_ctx);
+    size_t width = (size_t)result_to_u64(&width_res);
+    ASSERT_MSG(width <= size * kCharBit,
+               "Bitfield width %zu exceeds the width of its type", width);
+
+    // A bitfield is placed in the next storage unit of its type if it would
+    // otherwise straddle the end of the current one. A zero width bitfield
+    // always starts a new unit.
+    size_t unit_bits = natural_align * kCharBit;
+    if (width == 0 ||
+        (!type->packed && bits % unit_bits + width > unit_bits)) {
+      bits = align_up(bits, unit_bits);
+    }
+
+    member_layout->is_bitfield = true;
+    member_layout->offset = bits / kCharBit;
+    member_layout->bit_offset = bits % kCharBit;
+    member_layout->bit_width = width;
+    bits += width;
+
+    // Unnamed bitfields are only padding and don't affect the alignment of
+    // the struct.
+    if (member->name)
+      max_align = max_size(max_align, align);
   }
-  size = align_up(size, max_align);
-  return size;
+
+  if (type->type.align) {
+    size_t explicit_align =
+        sema_eval_alignment(sema, type->type.align, local_ctx);
+    max_align = max_size(max_align, explicit_align);
+  }
+
+  layout->align = max_align;
+  layout->size = align_up(align_up(bits, kCharBit) / kCharBit, max_align);
+}
+
+const StructLayout* sema_get_struct_layout(Sema* sema, const StructType* type,
+                                           const TreeMap* local_ctx) {
+  type = sema_resolve_struct_type(sema, type);
+  ASSERT_MSG(type->members, "Taking layout of incomplete struct type '%s'",
+             type->name);
+
+  void* found;
+  pthread_mutex_lock(&sema->struct_layouts_lock);
+  bool cached = tree_map_get(&sema->struct_layouts, type, &found);
+  pthread_mutex_unlock(&sema->struct_layouts_lock);
+  if (cached)
+    return found;
+
+  // The lock is not held while computing the layout since that recurses into
+  // the layouts of member structs. If another codegen thread got here first,
+  // its layout is kept.
+  StructLayout* layout = malloc(sizeof(StructLayout));
+  compute_struct_layout(sema, type, layout, local_ctx);
+
+  pthread_mutex_lock(&sema->struct_layouts_lock);
+  if (tree_map_get(&sema->struct_layouts, type, &found)) {
+    destroy_struct_layout_callback(type, layout, NULL);
+    layout = found;
+  } else {
+    tree_map_set(&sema->struct_layouts, type, layout);
+  }
+  pthread_mutex_unlock(&sema->struct_layouts_lock);
+  return layout;
+}
+
+size_t sema_eval_sizeof_struct_type(Sema* sema, const StructType* type,
+                                    const TreeMap* local_ctx) {
+  const StructLayout* layout = sema_get_struct_layout(sema, type, local_ctx);
+  return layout->size;
 }
 
 const Member* sema_get_largest_union_member(Sema* sema, const UnionType* type,
@@ -1216,6 +1832,17 @@ size_t sema_eval_sizeof_array(Sema* sema, const ArrayType* arr,
   }
 }
 
+// Vectors are padded to the next power of 2 and aligned to their size.
+size_t sema_eval_sizeof_vector(Sema* sema, const VectorType* vec,
+                               const TreeMap* local_ctx) {
+  size_t elem_size = sema_eval_sizeof_type(sema, vec->elem_type, local_ctx);
+  size_t size = elem_size * sema_get_vector_length(sema, vec, local_ctx);
+  size_t padded = 1;
+  while (padded < size)
+    padded = padded << 1;
+  return padded;
+}
+
 size_t sema_eval_sizeof_type(Sema* sema, const Type* type,
                              const TreeMap* local_ctx) {
   switch (type->vtable->kind) {
@@ -1238,6 +1865,8 @@ size_t sema_eval_sizeof_type(Sema* sema, const Type* type,
           sema_get_integral_type_for_enum(sema, (const EnumType*)type));
     case TK_ArrayType:
       return sema_eval_sizeof_array(sema, (const ArrayType*)type, local_ctx);
+    case TK_VectorType:
+      return sema_eval_sizeof_vector(sema, (const VectorType*)type, local_ctx);
     case TK_FunctionType:
       UNREACHABLE_MSG("Cannot take sizeof function type!");
     case TK_StructType:
@@ -1317,6 +1946,19 @@ size_t sema_eval_alignof_array(Sema* sema, const ArrayType* arr,
   return sema_eval_alignof_type(sema, arr->elem_type, local_ctx);
 }
 
+// If the operands have different result kinds, convert both of them to
+// unsigned long long. For example, this handles `8 * sizeof(long)`.
+static void promote_constexpr_result_types(ConstExprResult* lhs,
+                                           ConstExprResult* rhs) {
+  if (lhs->result_kind == rhs->result_kind)
+    return;
+
+  lhs->result.ull = result_to_u64(lhs);
+  lhs->result_kind = RK_UnsignedLongLong;
+  rhs->result.ull = result_to_u64(rhs);
+  rhs->result_kind = RK_UnsignedLongLong;
+}
+
 ConstExprResult sema_eval_binop_in_ctx(Sema* sema, const BinOp* expr,
                                        const TreeMap* local_ctx) {
   ConstExprResult lhs = sema_eval_expr_in_ctx(sema, expr->lhs, local_ctx);
@@ -1345,8 +1987,24 @@ ConstExprResult sema_eval_binop_in_ctx(Sema* sema, const BinOp* expr,
       }
       return res;
     }
+    case BOK_Mul: {
+      promote_constexpr_result_types(&lhs, &rhs);
+      ConstExprResult res;
+      res.result_kind = lhs.result_kind;
+      switch (lhs.result_kind) {
+        case RK_Boolean:
+          UNREACHABLE_MSG("Multiplying bools");
+        case RK_Int:
+          res.result.i = lhs.result.i * rhs.result.i;
+          break;
+        case RK_UnsignedLongLong:
+          res.result.ull = lhs.result.ull * rhs.result.ull;
+          break;
+      }
+      return res;
+    }
     case BOK_Div: {
-      assert(lhs.result_kind == rhs.result_kind);
+      promote_constexpr_result_types(&lhs, &rhs);
       ConstExprResult res;
       res.result_kind = lhs.result_kind;
       switch (lhs.result_kind) {
@@ -1558,3 +2216,38 @@ void sema_verify_static_assert_condition(Sema* sema, const Expr* cond,
                   source_location_line(&cond->loc),
                   source_location_col(&cond->loc));
 }
+
+void sema_verify_musttail_return(Sema* sema, const FunctionType* caller,
+                                 const ReturnStmt* ret,
+                                 const TreeMap* local_ctx) {
+  size_t line = source_location_line(&ret->base.loc);
+  size_t col = source_location_col(&ret->base.loc);
+  ASSERT_MSG(ret->expr && ret->expr->vtable->kind == EK_Call,
+             "%zu:%zu: 'musttail' requires a call as the returned expression",
+             line, col);
+
+  const Call* call = (const Call*)ret->expr;
+  const FunctionType* callee = sema_get_function(
+      sema, sema_get_type_of_expr_in_ctx(sema, call->base, local_ctx),
+      local_ctx);
+
+  ASSERT_MSG(sema_types_are_compatible(sema, caller->return_type,
+                                       callee->return_type, local_ctx),
+             "%zu:%zu: 'musttail' callee must return the same type as the "
+             "caller",
+             line, col);
+  ASSERT_MSG(caller->pos_args.size == callee->pos_args.size &&
+                 caller->has_var_args == callee->has_var_args,
+             "%zu:%zu: 'musttail' callee must take the same number of "
+             "parameters as the caller",
+             line, col);
+  for (size_t i = 0; i < caller->pos_args.size; ++i) {
+    const FunctionArg* caller_arg = vector_at(&caller->pos_args, i);
+    const FunctionArg* callee_arg = vector_at(&callee->pos_args, i);
+    ASSERT_MSG(sema_types_are_compatible_ignore_quals(
+                   sema, caller_arg->type, callee_arg->type, local_ctx),
+               "%zu:%zu: 'musttail' callee parameter %zu does not match the "
+               "caller",
+               line, col, i + 1);
+  }
+}
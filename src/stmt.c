@@ -62,6 +62,63 @@ void break_stmt_construct(BreakStmt* stmt, const SourceLocation* loc) {
   statement_construct(&stmt->base, &BreakStmtVtable, loc);
 }
 
+static void label_stmt_destroy(Statement*);
+
+static const StatementVtable LabelStmtVtable = {
+    .kind = SK_LabelStmt,
+    .dtor = label_stmt_destroy,
+};
+
+void label_stmt_construct(LabelStmt* stmt, const char* name, Statement* body,
+                          const SourceLocation* loc) {
+  statement_construct(&stmt->base, &LabelStmtVtable, loc);
+  stmt->name = strdup(name);
+  stmt->stmt = body;
+}
+
+void label_stmt_destroy(Statement* stmt) {
+  LabelStmt* label_stmt = (LabelStmt*)stmt;
+  free(label_stmt->name);
+  if (label_stmt->stmt) {
+    statement_destroy(label_stmt->stmt);
+    free(label_stmt->stmt);
+  }
+}
+
+static void goto_stmt_destroy(Statement*);
+
+static const StatementVtable GotoStmtVtable = {
+    .kind = SK_GotoStmt,
+    .dtor = goto_stmt_destroy,
+};
+
+void goto_stmt_construct(GotoStmt* stmt, const char* label,
+                         const SourceLocation* loc) {
+  statement_construct(&stmt->base, &GotoStmtVtable, loc);
+  stmt->label = strdup(label);
+}
+
+void goto_stmt_destroy(Statement* stmt) { free(((GotoStmt*)stmt)->label); }
+
+static void indirect_goto_stmt_destroy(Statement*);
+
+static const StatementVtable IndirectGotoStmtVtable = {
+    .kind = SK_IndirectGotoStmt,
+    .dtor = indirect_goto_stmt_destroy,
+};
+
+void indirect_goto_stmt_construct(IndirectGotoStmt* stmt, Expr* target,
+                                  const SourceLocation* loc) {
+  statement_construct(&stmt->base, &IndirectGotoStmtVtable, loc);
+  stmt->target = target;
+}
+
+void indirect_goto_stmt_destroy(Statement* stmt) {
+  IndirectGotoStmt* goto_stmt = (IndirectGotoStmt*)stmt;
+  expr_destroy(goto_stmt->target);
+  free(goto_stmt->target);
+}
+
 static void if_stmt_destroy(Statement*);
 
 static const StatementVtable IfStmtVtable = {
@@ -242,6 +299,7 @@ void return_stmt_construct(ReturnStmt* stmt, Expr* expr,
                            const SourceLocation* loc) {
   statement_construct(&stmt->base, &ReturnStmtVtable, loc);
   stmt->expr = expr;
+  stmt->musttail = false;
 }
 
 void return_stmt_destroy(Statement* stmt) {
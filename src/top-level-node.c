@@ -17,6 +17,40 @@ void top_level_node_construct(TopLevelNode* node,
 
 void top_level_node_destroy(TopLevelNode* node) { node->vtable->dtor(node); }
 
+bool tls_model_from_name(const char* name, TLSModel* model) {
+  if (strcmp(name, "global-dynamic") == 0) {
+    *model = TLS_GlobalDynamic;
+  } else if (strcmp(name, "local-dynamic") == 0) {
+    *model = TLS_LocalDynamic;
+  } else if (strcmp(name, "initial-exec") == 0) {
+    *model = TLS_InitialExec;
+  } else if (strcmp(name, "local-exec") == 0) {
+    *model = TLS_LocalExec;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void decl_attributes_construct(DeclAttributes* attrs) {
+  memset(attrs, 0, sizeof(DeclAttributes));
+}
+
+void decl_attributes_destroy(DeclAttributes* attrs) {
+  if (attrs->aligned) {
+    expr_destroy(attrs->aligned);
+    free(attrs->aligned);
+  }
+  if (attrs->vector_size) {
+    expr_destroy(attrs->vector_size);
+    free(attrs->vector_size);
+  }
+  if (attrs->ext_vector_type) {
+    expr_destroy(attrs->ext_vector_type);
+    free(attrs->ext_vector_type);
+  }
+}
+
 static void typedef_destroy(TopLevelNode*);
 
 static const TopLevelNodeVtable TypedefVtable = {
@@ -76,6 +110,7 @@ void global_variable_construct(GlobalVariable* gv, const char* name, Type* type,
   gv->initializer = NULL;
   gv->is_extern = true;
   gv->is_thread_local = false;
+  decl_attributes_construct(&gv->attrs);
 }
 
 void global_variable_destroy(TopLevelNode* node) {
@@ -87,6 +122,7 @@ void global_variable_destroy(TopLevelNode* node) {
     expr_destroy(gv->initializer);
     free(gv->initializer);
   }
+  decl_attributes_destroy(&gv->attrs);
 }
 
 static void struct_declaration_destroy(TopLevelNode*);
@@ -185,6 +221,7 @@ void function_definition_construct(FunctionDefinition* f, const char* name,
   f->type = type;
   f->body = body;
   f->is_extern = true;
+  decl_attributes_construct(&f->attrs);
 }
 
 void function_definition_destroy(TopLevelNode* node) {
@@ -195,4 +232,5 @@ void function_definition_destroy(TopLevelNode* node) {
 
   statement_destroy(&f->body->base);
   free(f->body);
+  decl_attributes_destroy(&f->attrs);
 }
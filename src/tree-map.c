@@ -1,6 +1,7 @@
 #include "tree-map.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -149,6 +150,28 @@ void string_tree_map_construct(TreeMap* map) {
                      string_tree_map_key_dtor);
 }
 
+// Pointers returned by malloc tend to increase which would degrade the tree
+// into a linked list. Scramble them first with Fibonacci hashing. Multiplying
+// by an odd constant is a bijection so distinct keys never compare equal.
+static uintptr_t scramble_pointer(const void* ptr) {
+  const uintptr_t kGoldenRatio = ((uintptr_t)0x9e3779b9 << 32) | 0x7f4a7c15;
+  return (uintptr_t)ptr * kGoldenRatio;
+}
+
+static int pointer_tree_map_cmp(const void* lhs, const void* rhs) {
+  uintptr_t l = scramble_pointer(lhs);
+  uintptr_t r = scramble_pointer(rhs);
+  if (l < r)
+    return -1;
+  if (l > r)
+    return 1;
+  return 0;
+}
+
+void pointer_tree_map_construct(TreeMap* map) {
+  tree_map_construct(map, pointer_tree_map_cmp, /*ctor=*/NULL, /*dtor=*/NULL);
+}
+
 ///
 /// Start Tree Map Tests
 ///
@@ -259,12 +282,34 @@ static void TestTreeMapCloneEmpty() {
   tree_map_destroy(&m2);
 }
 
+static void TestPointerTreeMap() {
+  TreeMap m;
+  pointer_tree_map_construct(&m);
+
+  int a;
+  int b;
+  const char* val = "val";
+  const char* val2 = "val2";
+  tree_map_set(&m, &a, (char*)val);
+  tree_map_set(&m, &b, (char*)val2);
+
+  void* res = NULL;
+  assert(tree_map_get(&m, &a, &res));
+  assert(res == val);
+  assert(tree_map_get(&m, &b, &res));
+  assert(res == val2);
+  assert(!tree_map_get(&m, val, &res));
+
+  tree_map_destroy(&m);
+}
+
 void RunTreeMapTests() {
   TestTreeMapConstruction();
   TestTreeMapInsertion();
   TestTreeMapOverrideKeyValue();
   TestTreeMapClone();
   TestTreeMapCloneEmpty();
+  TestPointerTreeMap();
 }
 
 ///
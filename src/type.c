@@ -102,6 +102,38 @@ bool is_integral_type(const Type* type) {
   }
 }
 
+bool is_floating_point_type(const Type* type) {
+  if (type->vtable->kind != TK_BuiltinType)
+    return false;
+
+  switch (((const BuiltinType*)type)->kind) {
+    case BTK_Float:
+    case BTK_Double:
+    case BTK_LongDouble:
+    case BTK_Float128:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Real floating types in increasing order of range and precision.
+unsigned get_floating_point_rank(const BuiltinType* bt) {
+  assert(is_floating_point_type(&bt->type));
+
+  switch (bt->kind) {
+    case BTK_Float:
+      return 0;
+    case BTK_Double:
+      return 1;
+    case BTK_LongDouble:
+    case BTK_Float128:
+      return 2;
+    default:
+      UNREACHABLE_MSG("Unhandled builtin type kind %d", bt->kind);
+  }
+}
+
 unsigned get_integral_rank(const BuiltinType* bt) {
   assert(is_integral_type(&bt->type));
 
@@ -214,7 +246,7 @@ const Member* struct_get_member(const StructType* st, const char* name,
 
   for (size_t i = 0; i < st->members->size; ++i) {
     const Member* member = vector_at(st->members, i);
-    if (strcmp(member->name, name) == 0) {
+    if (member->name && strcmp(member->name, name) == 0) {
       if (offset)
         *offset = i;
       return member;
@@ -288,7 +320,7 @@ const Member* union_get_member(const UnionType* ut, const char* name,
 
   for (size_t i = 0; i < ut->members->size; ++i) {
     const Member* member = vector_at(ut->members, i);
-    if (strcmp(member->name, name) == 0) {
+    if (member->name && strcmp(member->name, name) == 0) {
       if (offset)
         *offset = i;
       return member;
@@ -422,6 +454,30 @@ void array_type_destroy(Type* type) {
   }
 }
 
+static void vector_type_destroy(Type*);
+
+static const TypeVtable VectorTypeVtable = {
+    .kind = TK_VectorType,
+    .dtor = vector_type_destroy,
+    .dump = NULL,
+};
+
+void vector_type_construct(VectorType* vec, Type* elem_type, struct Expr* size,
+                           bool is_ext_vector) {
+  type_construct(&vec->type, &VectorTypeVtable);
+  vec->elem_type = elem_type;
+  vec->size = size;
+  vec->is_ext_vector = is_ext_vector;
+}
+
+void vector_type_destroy(Type* type) {
+  VectorType* vec = (VectorType*)type;
+  type_destroy(vec->elem_type);
+  free(vec->elem_type);
+  expr_destroy(vec->size);
+  free(vec->size);
+}
+
 static void pointer_type_destroy(Type*);
 static void pointer_type_dump(const Type*);
 
@@ -10,25 +10,562 @@ STAGE3_BIN = BUILD_DIR / "c.stage3"
 
 
 class TestCompiler:
-    def invoke(self, filename):
-        obj = str(BUILD_DIR / Path(f"{filename}.o").name)
-        res = subprocess.run([str(self.bin), filename, "-o", obj], capture_output=True)
+    def build_path(self, name):
+        """A path in BUILD_DIR for a file only the running test writes."""
+        return BUILD_DIR / f"{type(self).__name__}.{self._testMethodName}.{name}"
+
+    def invoke(self, filename, *args, link_args=()):
+        obj = str(self.build_path(Path(f"{filename}.o").name))
+        exe = str(self.build_path("a.out"))
+        res = subprocess.run(
+            [str(self.bin), filename, "-o", obj, *args], capture_output=True
+        )
         self.assertEqual(res.returncode, 0, res.args)
 
         res = subprocess.run(
-            [os.environ.get("CC", "clang"), obj, "-o", str(BUILD_DIR / "a.out")],
+            [
+                os.environ.get("CC", "clang"),
+                obj,
+                "-o",
+                exe,
+                *link_args,
+            ],
             capture_output=True,
         )
         self.assertEqual(res.returncode, 0)
 
-        res = subprocess.run([str(BUILD_DIR / "a.out")], capture_output=True)
+        res = subprocess.run([exe], capture_output=True)
         self.assertEqual(res.returncode, 0)
 
         return res.stdout.decode("utf-8")
 
+    def emit_llvm(self, filename, *args):
+        ir = str(self.build_path(Path(f"{filename}.ll").name))
+        res = subprocess.run(
+            [str(self.bin), filename, "-o", ir, "--emit-llvm", *args],
+            capture_output=True,
+        )
+        self.assertEqual(res.returncode, 0, res.args)
+        return Path(ir).read_text()
+
     def test_hello_world(self):
         self.assertEqual(self.invoke("tests/hello_world.c"), "hello world\n")
 
+    def test_ssa_locals(self):
+        self.assertEqual(self.invoke("tests/ssa_locals.c"), "27 4 3\n")
+
+    def test_constant_initializers(self):
+        self.assertEqual(
+            self.invoke("tests/constant_initializers.c"),
+            "1 3 0 0\n-1 2 0\n7 8 0 9\n0 0\nhi 0\n0 5 origin\n2 a 4 0\n7\n",
+        )
+
+    def test_negative_constants(self):
+        self.assertEqual(
+            self.invoke("tests/negative_constants.c"),
+            "-1 -2 -3 18446744073709551615\n-1 1 0\n-5 -6 -7 8\n-1 -2 -3\n",
+        )
+
+    def test_aggregate_copies(self):
+        self.assertEqual(
+            self.invoke("tests/aggregate_copies.c"),
+            "1 5 5 3\n2 4 5 1\n10 80 9 1\nabc hey 0 7\n",
+        )
+
+    def test_target_cpu_flags(self):
+        self.assertEqual(
+            self.invoke(
+                "tests/hello_world.c", "-march=x86-64", "-mtune=generic", "-mattr=+sse2"
+            ),
+            "hello world\n",
+        )
+
+        # Functions get the default CPU and no tuning or features otherwise.
+        contents = self.emit_llvm("tests/hello_world.c")
+        self.assertIn('"target-cpu"="x86-64"', contents)
+        self.assertNotIn('"tune-cpu"', contents)
+        self.assertNotIn('"target-features"', contents)
+
+        contents = self.emit_llvm(
+            "tests/hello_world.c",
+            "-march=haswell",
+            "-mtune=skylake",
+            "-mattr=+avx2,-sse4a",
+        )
+        self.assertIn('"target-cpu"="haswell"', contents)
+        self.assertIn('"tune-cpu"="skylake"', contents)
+        self.assertIn('"target-features"="+avx2,-sse4a"', contents)
+
+        # -march takes precedence over -mcpu.
+        contents = self.emit_llvm("tests/hello_world.c", "-mcpu=znver2")
+        self.assertIn('"target-cpu"="znver2"', contents)
+        contents = self.emit_llvm(
+            "tests/hello_world.c", "-mcpu=znver2", "-march=haswell"
+        )
+        self.assertIn('"target-cpu"="haswell"', contents)
+
+    def test_lto(self):
+        bitcode_files = []
+        for name, mode in (("lto_main", "full"), ("lto_helper", "thin")):
+            bitcode = str(self.build_path(f"{name}.bc"))
+            res = subprocess.run(
+                [str(self.bin), f"tests/{name}.c", "-o", bitcode, f"-flto={mode}"],
+                capture_output=True,
+            )
+            self.assertEqual(res.returncode, 0, res.args)
+            bitcode_files.append(bitcode)
+
+        self.assertEqual(self.invoke(*bitcode_files), "49 130 1\n")
+
+    def test_pgo(self):
+        profile = self.build_path("pgo.profdata")
+        profile.unlink(missing_ok=True)
+        self.assertEqual(
+            self.invoke("tests/pgo.c", f"-fprofile-generate={profile}"),
+            "45 45 10 3\n25 25 50 11\n",
+        )
+        self.assertTrue(profile.read_text().startswith("#profile 1\n"))
+
+        contents = self.emit_llvm("tests/pgo.c", f"-fprofile-use={profile}")
+        self.assertIn('!"function_entry_count", i64 100', contents)
+        for taken, not_taken in (
+            (10, 90),  # if
+            (45, 45),  # ?:
+            (25, 75),  # case 0
+            (25, 50),  # case 1
+            (9, 91),  # &&
+            (95, 5),  # ||
+        ):
+            self.assertIn(
+                f'!"branch_weights", i32 {taken}, i32 {not_taken}', contents
+            )
+
+        # Profiles of another version or with malformed lines are rejected.
+        bad_profile = self.build_path("bad.profdata")
+        for text in (
+            "main 1 5\n",
+            "#profile 0\nmain 1 5\n",
+            "#profile 1\nmain 2 5\n",
+            "#profile 1\nmain 1 5 x\n",
+            "#profile 1\nmain 1 -5\n",
+        ):
+            bad_profile.write_text(text)
+            res = subprocess.run(
+                [
+                    str(self.bin),
+                    "tests/pgo.c",
+                    "-o",
+                    str(self.build_path("bad.ll")),
+                    "--emit-llvm",
+                    f"-fprofile-use={bad_profile}",
+                ],
+                capture_output=True,
+            )
+            self.assertNotEqual(res.returncode, 0, text)
+
+    def test_function_attributes(self):
+        self.assertEqual(
+            self.invoke("tests/function_attributes.c"), "reported\n15 15\n"
+        )
+
+        contents = self.emit_llvm("tests/function_attributes.c")
+        for attr in ("inlinehint", "alwaysinline", "noinline", "cold", "hot"):
+            self.assertIn(attr, contents)
+        self.assertIn("declare void @exit(i32) #", contents)
+        self.assertIn("@first(ptr nonnull %0)", contents)
+        self.assertIn("noalias nonnull ptr @make_ints", contents)
+        self.assertIn("align 32", contents)
+
+    def test_restrict(self):
+        self.assertEqual(self.invoke("tests/saxpy.c"), "4496000500\n")
+
+        contents = self.emit_llvm("tests/saxpy.c")
+        self.assertIn("@saxpy(i32 %0, i32 %1, ptr %2, ptr %3)", contents)
+        self.assertIn(
+            "@saxpy_restrict(i32 %0, i32 %1, ptr noalias readonly %2, ptr noalias %3)",
+            contents,
+        )
+        self.assertIn("!alias.scope", contents)
+        self.assertIn("!noalias", contents)
+
+    def test_builtins(self):
+        self.assertEqual(
+            self.invoke("tests/builtins.c"),
+            "37 8 1 -1 0\n3 31 40 23\n8 13 40\n3412 78563412 807060504030201\n",
+        )
+
+        contents = self.emit_llvm("tests/builtins.c")
+        for intrinsic in (
+            "llvm.expect.i64",
+            "llvm.prefetch.p0",
+            "llvm.assume",
+            "llvm.memcpy",
+            "llvm.memset",
+            "llvm.cttz.i64",
+            "llvm.ctlz.i32",
+            "llvm.ctpop.i64",
+            "llvm.bswap.i16",
+        ):
+            self.assertIn(intrinsic, contents)
+        self.assertIn("unreachable", contents)
+
+    def test_vector_extensions(self):
+        self.assertEqual(
+            self.invoke("tests/vector_extensions.c"),
+            "113 -226 339 452\n0 -1 2 30 16\n4 1 110\n-1 -3 255 2\n1 -2 4 4.5\n"
+            "16 16 32\n",
+        )
+
+        contents = self.emit_llvm("tests/vector_extensions.c")
+        self.assertIn("define internal <4 x i32> @madd(<4 x i32> %0", contents)
+        self.assertIn("<4 x i32> zeroinitializer", contents)
+        self.assertIn("icmp sgt <4 x i32>", contents)
+        self.assertIn("sext <4 x i1>", contents)
+        self.assertIn("extractelement <8 x i32>", contents)
+        self.assertIn("sext <4 x i16>", contents)
+        self.assertIn("bitcast <4 x i16>", contents)
+        self.assertIn("fptosi <4 x float>", contents)
+        self.assertIn("sitofp <4 x i32>", contents)
+
+    def test_atomics(self):
+        self.assertEqual(
+            self.invoke("tests/atomics.c"),
+            "10 11 12\n0 7 7\n12 6 -3\n0 0 1 0 42 43\n8 6 11\n4 5.00 6.00\n",
+        )
+
+        contents = self.emit_llvm("tests/atomics.c")
+        self.assertIn("atomicrmw add ptr %0, i32 1 monotonic", contents)
+        self.assertIn("cmpxchg ptr %0, i32 %2, i32 %1 acq_rel acquire", contents)
+        self.assertIn("atomicrmw nand", contents)
+        self.assertIn("atomicrmw xchg", contents)
+        self.assertIn("fence seq_cst", contents)
+        self.assertIn('fence syncscope("singlethread") acquire', contents)
+        self.assertIn("store atomic i32 0, ptr %", contents)
+        self.assertIn("load atomic i32, ptr @counter seq_cst", contents)
+        self.assertIn("atomicrmw or ptr @total, i64 8 seq_cst", contents)
+        self.assertIn("mul i32 %", contents)
+        self.assertIn("cmpxchg ptr @counter, i32 %", contents)
+        self.assertIn("cmpxchg ptr @average, i64 %", contents)
+        self.assertNotIn("store atomic i32 %", contents)
+
+    def test_thread_local(self):
+        self.assertEqual(
+            self.invoke("tests/thread_local.c"), "3 6 103\n5 10 105\n3 6 103\n"
+        )
+
+        contents = self.emit_llvm("tests/thread_local.c")
+        self.assertIn("@hits = thread_local global i32 0", contents)
+        self.assertIn("@local_hits = internal thread_local(localdynamic)", contents)
+        self.assertIn("@initial = thread_local(initialexec) global i64 100", contents)
+        self.assertIn("@errno_like = external thread_local global i32", contents)
+
+        contents = self.emit_llvm("tests/thread_local.c", "-ftls-model=local-exec")
+        self.assertIn("@hits = thread_local(localexec)", contents)
+        self.assertIn("@local_hits = internal thread_local(localexec)", contents)
+        self.assertIn("@initial = thread_local(initialexec)", contents)
+
+    def test_computed_goto(self):
+        self.assertEqual(self.invoke("tests/computed_goto.c"), "385 385\n111 0\n")
+
+        contents = self.emit_llvm("tests/computed_goto.c")
+        self.assertIn("blockaddress(@run_threaded, %op_push)", contents)
+        self.assertIn("indirectbr ptr", contents)
+        self.assertIn("br label %done", contents)
+
+    def test_floating_point(self):
+        expected = (
+            "10.290000 7.500000 0.500000\n1.500 0.000\n"
+            "3 0.750000 -3 4000000000 1.500000\n0 1 0 1 1\n"
+            "0.5005 5.0 -4.000000\n1.5 16.5 1\n1 16 16.0 -7.0 9.0\n"
+            "-5 200 0.50\n"
+        )
+        # Linking libm is not needed once sqrt is lowered to an intrinsic.
+        for args in (("-fno-math-errno",), ("-fno-math-errno", "-ffp-contract=off")):
+            self.assertEqual(self.invoke("tests/floating_point.c", *args), expected)
+
+        contents = self.emit_llvm("tests/floating_point.c")
+        self.assertIn("call double @llvm.fmuladd.f64(", contents)
+        self.assertIn("call <4 x float> @llvm.fmuladd.v4f32(", contents)
+        self.assertIn("call double @sqrt(", contents)
+        self.assertIn("fcmp une double", contents)
+        self.assertIn("fptosi <4 x float>", contents)
+        self.assertIn("sitofp <4 x i32>", contents)
+        self.assertIn("sitofp <2 x i64>", contents)
+        self.assertIn("i32 -5, i32 200, double %", contents)
+        self.assertNotIn("unsafe-fp-math", contents)
+
+        contents = self.emit_llvm("tests/floating_point.c", "-ffp-contract=off")
+        self.assertNotIn("fmuladd", contents)
+        self.assertIn("fmul <4 x float>", contents)
+
+        contents = self.emit_llvm("tests/floating_point.c", "-ffast-math")
+        self.assertIn("call double @llvm.sqrt.f64(", contents)
+        self.assertIn('"no-nans-fp-math"="true"', contents)
+        self.assertIn('"unsafe-fp-math"="true"', contents)
+
+    def test_bitfields(self):
+        self.assertEqual(
+            self.invoke("tests/bitfields.c"),
+            "16 4 7 64 128\n8 1 64\n1 5 -3 1234567890 7 -100\n"
+            "1 1 -16 370370367000 200 1\n-4 5 1\n1 2 3 a 0 15 b\n6512 1\n7 0\n",
+        )
+
+        contents = self.emit_llvm("tests/bitfields.c")
+        self.assertIn(
+            "%Flags = type <{ [2 x i8], [6 x i8], [5 x i8], i8, [2 x i8] }>",
+            contents,
+        )
+        self.assertIn("%Record = type <{ i16, [1 x i8], i8 }>", contents)
+        self.assertIn("%Line = type <{ i32, [60 x i8] }>", contents)
+        self.assertIn('@kDefault = internal global %Flags <{ [2 x i8] c"', contents)
+        self.assertIn("load i32, ptr %4, align 1", contents)
+        self.assertIn("alloca %Flags, align 8", contents)
+        self.assertIn("load i40", contents)
+        self.assertIn("ashr i16", contents)
+
+    def test_alignment(self):
+        self.assertEqual(
+            self.invoke("tests/alignment.c"),
+            "4000000 64 64\n0 0 0 32\n0 0 5\n32 16 16\n",
+        )
+
+        contents = self.emit_llvm("tests/alignment.c")
+        self.assertIn("%Counter = type <{ i64, [56 x i8] }>", contents)
+        self.assertIn("@counters = internal global [4 x %Counter]", contents)
+        self.assertIn(
+            "@shared_counters = internal global [4 x i64] zeroinitializer, align 64",
+            contents,
+        )
+        self.assertIn("@flag = internal global i32 1, align 32", contents)
+        self.assertIn("alloca [3 x i8], align 128", contents)
+        self.assertIn("alloca i32, align 64", contents)
+
+    def test_tail_calls(self):
+        self.assertEqual(self.invoke("tests/tail_calls.c"), "1 1\n7 12\n")
+
+        contents = self.emit_llvm("tests/tail_calls.c")
+        self.assertIn("tail call i32 @is_even(i32 %", contents)
+        self.assertIn("tail call i32 @is_odd(i32 %", contents)
+        self.assertIn("tail call i64 %3(ptr %0, i64 %1)", contents)
+        self.assertIn("= call i32 @sum(ptr %values, i32 4)", contents)
+
+    def test_lifetimes(self):
+        stack_usage = self.build_path("lifetimes.c.su")
+        stack_usage.unlink(missing_ok=True)
+        self.assertEqual(
+            self.invoke("tests/lifetimes.c", "-fstack-usage"),
+            "-2048 -2048 -1536 6432\n",
+        )
+        # Code generated without optimizations gives every local its own slot.
+        self.assertEqual(
+            stack_usage.read_text(),
+            "tests/lifetimes.c:3:1:fill\t0\tstatic,estimated\n"
+            "tests/lifetimes.c:14:1:branches\t8192\tstatic,estimated\n"
+            "tests/lifetimes.c:27:1:loop\t1024\tstatic,estimated\n"
+            "tests/lifetimes.c:38:1:with_label\t64\tstatic,estimated\n"
+            "tests/lifetimes.c:49:1:main\t0\tstatic,estimated\n",
+        )
+
+        # The LTO link step colors stack slots, so locals with disjoint
+        # lifetimes share space.
+        bitcode = self.build_path("lifetimes.bc")
+        res = subprocess.run(
+            [
+                str(self.bin),
+                "tests/lifetimes.c",
+                "-o",
+                str(bitcode),
+                "-flto=full",
+                "-fstack-usage",
+            ],
+            capture_output=True,
+        )
+        self.assertEqual(res.returncode, 0, res.args)
+        self.assertIn(
+            "tests/lifetimes.c:14:1:branches\t4096\tstatic,estimated\n",
+            self.build_path("lifetimes.su").read_text(),
+        )
+
+        contents = self.emit_llvm("tests/lifetimes.c")
+        self.assertIn("call void @llvm.lifetime.start.p0(i64 4096, ptr %a)", contents)
+        self.assertIn("call void @llvm.lifetime.end.p0(i64 4096, ptr %b)", contents)
+        self.assertIn(
+            "call void @llvm.lifetime.end.p0(i64 1024, ptr %scratch)", contents
+        )
+        self.assertNotIn("ptr %buf)", contents)
+
+    def test_string_pool(self):
+        self.assertEqual(
+            self.invoke("tests/string_pool.c"),
+            "value 1\nvalue 2\nvalue 3\n1 1 1\nAlpha alpha name main\n1\n5\n",
+        )
+
+        contents = self.emit_llvm("tests/string_pool.c")
+        self.assertEqual(contents.count('c"value %d\\0A\\00"'), 1)
+        self.assertEqual(contents.count('constant [6 x i8] c"alpha\\00"'), 1)
+        self.assertEqual(contents.count('c"main\\00"'), 1)
+        self.assertIn(
+            '@.str = private unnamed_addr constant [10 x i8] c"value %d\\0A\\00"',
+            contents,
+        )
+
+        # Local char arrays copy the pooled string and zero the rest.
+        self.assertEqual(contents.count('c"hello\\00"'), 1)
+        self.assertIn("(ptr align 1 %big, ptr align 1 @.str", contents)
+        self.assertIn("call void @llvm.memset", contents)
+        self.assertIn("i8 0, i64 4090, i1 false)", contents)
+        self.assertNotIn("store [4096 x i8]", contents)
+
+    def test_sections(self):
+        flags = ("-ffunction-sections", "-fdata-sections")
+        self.assertEqual(self.invoke("tests/sections.c", *flags), "5 10 4\ndone\n")
+
+        contents = self.emit_llvm("tests/sections.c", *flags)
+        self.assertIn('@counter = global i32 3, section ".data.counter"', contents)
+        self.assertIn('@zeroed = global i32 0, section ".bss.zeroed"', contents)
+        self.assertIn('section ".tdata.per_thread"', contents)
+        self.assertIn('section ".tbss.per_thread_zero"', contents)
+        self.assertIn('@bump(i32 %0) #0 section ".text.bump"', contents)
+        self.assertIn('@.str = private unnamed_addr constant [10 x i8] c"%d', contents)
+        self.assertNotIn('section "', self.emit_llvm("tests/sections.c"))
+
+        # Read only data with relocations may be written by the dynamic loader,
+        # unless the code is position dependent.
+        self.assertIn('section ".data.rel.ro.kLimitPtr"', contents)
+        contents = self.emit_llvm("tests/sections.c", *flags, "-fno-pic")
+        self.assertIn('section ".rodata.kLimitPtr"', contents)
+        self.assertIn('section ".rodata.kLimit"', contents)
+
+        # Unreferenced functions and data are dropped by a --gc-sections link.
+        self.invoke("tests/sections.c", *flags, link_args=["-Wl,--gc-sections"])
+        res = subprocess.run(
+            ["nm", str(self.build_path("a.out"))], capture_output=True
+        )
+        symbols = res.stdout.decode("utf-8")
+        self.assertIn("counter", symbols)
+        self.assertNotIn("unused_helper", symbols)
+        self.assertNotIn("unused_table", symbols)
+
+    def test_symbol_binding(self):
+        self.assertEqual(
+            self.invoke("tests/symbol_binding.c", "-fno-pic", link_args=["-no-pie"]),
+            "12 2\n",
+        )
+        self.assertEqual(
+            self.invoke("tests/symbol_binding.c", "-fpie", "-fno-plt"), "12 2\n"
+        )
+
+        contents = self.emit_llvm("tests/symbol_binding.c")
+        self.assertIn("@counter = global i32 3", contents)
+        self.assertIn("define i32 @helper(", contents)
+
+        # Definitions in an executable can not be preempted.
+        contents = self.emit_llvm("tests/symbol_binding.c", "-fpie")
+        self.assertIn("@counter = protected global i32 3", contents)
+        self.assertIn("@per_thread = protected thread_local(localexec)", contents)
+        self.assertIn("define protected i32 @helper(", contents)
+        self.assertIn("define internal i32 @add_counter(", contents)
+        self.assertIn("declare i32 @printf(ptr, ...)\n", contents)
+
+        contents = self.emit_llvm(
+            "tests/symbol_binding.c", "-fvisibility=hidden", "-fno-plt"
+        )
+        self.assertIn("@counter = hidden global i32 3", contents)
+        self.assertIn("define hidden i32 @helper(", contents)
+        self.assertIn("declare i32 @printf(ptr, ...) #0", contents)
+        self.assertIn("attributes #0 = { nonlazybind }", contents)
+
+    def test_abi(self):
+        self.assertEqual(
+            self.invoke("tests/abi.c"),
+            "3 2 -14 -2 1.2.3.4\nabc\n3 5 2 4 6\n2.25 15 30\n139 3f800000\n",
+        )
+
+        # Small aggregates are split into eightbytes passed in registers.
+        contents = self.emit_llvm("tests/abi.c")
+        self.assertIn("declare i64 @div(i32, i32)", contents)
+        self.assertIn("declare { i64, i64 } @ldiv(i64, i64)", contents)
+        self.assertIn("declare ptr @inet_ntoa(i32)", contents)
+        self.assertIn("define i24 @make_bytes(i32 %0)", contents)
+        self.assertIn("define { double, double } @add_vec2(double %0,", contents)
+        self.assertIn(
+            "define { <2 x float>, float } @scale_vec3f(<2 x float> %0, float %1,",
+            contents,
+        )
+        self.assertIn("define double @sum_mixed(i64 %0, double %1)", contents)
+        self.assertIn("define i32 @float_bits(float %0)", contents)
+
+        # Larger ones are passed in memory, as are those that run out of
+        # registers.
+        self.assertIn("@make_big(ptr sret({ i64, i64, i64 }) align 8 %0,", contents)
+        self.assertIn("@sum_big(ptr byval({ i64, i64, i64 }) align 8 %0)", contents)
+        self.assertIn("i64 %5, ptr byval({ i32, i32 }) align 8 %6, i64 %7)", contents)
+
+    def test_tbaa(self):
+        self.assertEqual(self.invoke("tests/tbaa.c"), "1 1 2\n")
+        self.assertEqual(
+            self.invoke("tests/tbaa.c", "-fno-strict-aliasing"), "1 1 2\n"
+        )
+
+        contents = self.emit_llvm("tests/tbaa.c")
+        self.assertIn('!{!"omnipotent char", ', contents)
+        self.assertIn('!{!"int", ', contents)
+        self.assertIn('!{!"Point", ', contents)
+
+        # The optimizer uses these to fold the reloads of distinct objects.
+        contents = self.emit_llvm("tests/tbaa.c", "-flto=full")
+        functions = contents.split("define ")
+        self.assertIn("ret i32 1,", functions[1])
+        self.assertIn("ret i32 1,", functions[2])
+        self.assertIn("load i32", functions[3])
+
+        contents = self.emit_llvm("tests/tbaa.c", "-flto=full", "-fno-strict-aliasing")
+        self.assertNotIn("!tbaa", contents)
+        self.assertIn("load i32", contents.split("define ")[1])
+
+    def test_parallel_codegen(self):
+        self.assertEqual(self.invoke("tests/ssa_locals.c", "-j", "3"), "27 4 3\n")
+        self.assertEqual(
+            self.invoke("tests/parallel_codegen.c", "-j", "4"),
+            "bump: 3\nsquare: 25\nsum: 55\nfib: 55\nzero one two\n",
+        )
+
+        # The output must not depend on the number of threads or how they were
+        # scheduled.
+        expected = self.emit_llvm("tests/parallel_codegen.c", "-j", "1")
+        for _ in range(3):
+            for jobs in ("2", "3", "8"):
+                self.assertEqual(
+                    self.emit_llvm("tests/parallel_codegen.c", "-j", jobs), expected
+                )
+
+        # Each thread emits objects which are combined in the same order. The
+        # statics referenced across partitions stay local symbols.
+        objects = []
+        for jobs in ("1", "3"):
+            obj = self.build_path(f"parallel_codegen.{jobs}.o")
+            res = subprocess.run(
+                [str(self.bin), "tests/parallel_codegen.c", "-o", obj, "-j", jobs],
+                capture_output=True,
+            )
+            self.assertEqual(res.returncode, 0, res.args)
+            objects.append(obj.read_bytes())
+        self.assertEqual(objects[0], objects[1])
+
+        res = subprocess.run(["nm", str(obj)], capture_output=True)
+        symbols = res.stdout.decode("utf-8")
+        self.assertIn(" t fib\n", symbols)
+        self.assertIn(" t bump\n", symbols)
+        self.assertIn(" T main\n", symbols)
+
+        for jobs in ("0", "-2", "4x", ""):
+            res = subprocess.run(
+                [str(self.bin), "tests/parallel_codegen.c", "-o", obj, "-j", jobs],
+                capture_output=True,
+            )
+            self.assertNotEqual(res.returncode, 0, res.args)
+            self.assertIn(b"Invalid number of jobs", res.stderr)
+
 
 class TestStage1Compiler(unittest.TestCase, TestCompiler):
     def setUp(self):
@@ -0,0 +1,122 @@
+int printf(const char*, ...);
+
+// These come from libc, so they check the calling convention against the
+// system compiler.
+typedef struct {
+  int quot;
+  int rem;
+} div_t;
+
+typedef struct {
+  long quot;
+  long rem;
+} ldiv_t;
+
+struct in_addr {
+  unsigned s_addr;
+};
+
+div_t div(int, int);
+ldiv_t ldiv(long, long);
+char* inet_ntoa(struct in_addr);
+
+typedef struct {
+  char x;
+  char y;
+  char z;
+} Bytes;
+
+typedef struct {
+  double x;
+  double y;
+} Vec2;
+
+typedef struct {
+  float x;
+  float y;
+  float z;
+} Vec3f;
+
+typedef struct {
+  int i;
+  double d;
+} Mixed;
+
+typedef struct {
+  long a;
+  long b;
+  long c;
+} Big;
+
+typedef struct {
+  int a;
+  int b;
+} Pair;
+
+typedef union {
+  int i;
+  float f;
+} Bits;
+
+Bytes make_bytes(int x) {
+  Bytes b = {x, x + 1, x + 2};
+  return b;
+}
+
+Vec2 add_vec2(Vec2 a, Vec2 b) {
+  Vec2 res = {a.x + b.x, a.y + b.y};
+  return res;
+}
+
+Vec3f scale_vec3f(Vec3f v, float s) {
+  Vec3f res = {v.x * s, v.y * s, v.z * s};
+  return res;
+}
+
+double sum_mixed(Mixed m) { return m.i + m.d; }
+
+Big make_big(long a) {
+  Big b = {a, a * 2, a * 3};
+  return b;
+}
+
+long sum_big(Big b) { return b.a + b.b + b.c; }
+
+// The last pair no longer fits in registers and goes on the stack.
+long sum_pairs(Pair a, Pair b, Pair c, Pair d, Pair e, Pair f, Pair g,
+               long x) {
+  return a.a + b.b + c.a + d.b + e.a + f.b + g.a + g.b + x;
+}
+
+Bits float_bits(float f) {
+  Bits b;
+  *(float*)&b = f;
+  return b;
+}
+
+int main() {
+  div_t d = div(17, 5);
+  ldiv_t ld = ldiv(-100, 7);
+  struct in_addr addr = {0x04030201};
+  printf("%d %d %ld %ld %s\n", d.quot, d.rem, ld.quot, ld.rem,
+         inet_ntoa(addr));
+
+  Bytes b = make_bytes(97);
+  printf("%c%c%c\n", b.x, b.y, b.z);
+
+  Vec2 v = {1.5, 2.5};
+  Vec2 sum = add_vec2(v, v);
+  Vec3f f = {1, 2, 3};
+  Vec3f scaled = scale_vec3f(f, 2);
+  printf("%g %g %g %g %g\n", sum.x, sum.y, scaled.x, scaled.y, scaled.z);
+
+  Mixed m = {2, 0.25};
+  Big big = make_big(5);
+  printf("%g %ld %ld\n", sum_mixed(m), big.c, sum_big(big));
+
+  Pair p = {1, 2};
+  Pair last = {10, 20};
+  Bits bits = float_bits(1);
+  printf("%ld %x\n", sum_pairs(p, p, p, p, p, p, last, 100), *(int*)&bits);
+  return 0;
+}
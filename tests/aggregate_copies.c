@@ -0,0 +1,41 @@
+int printf(const char*, ...);
+
+struct Point {
+  int x;
+  int y;
+};
+
+struct Line {
+  struct Point start;
+  struct Point end;
+  const char* name;
+};
+
+union Value {
+  int i;
+  char c;
+};
+
+int main() {
+  struct Point p = {1, 2};
+  struct Point q = p;
+  q.y = 5;
+
+  struct Line line = {.end = {3, 4}, .start = q};
+  struct Line copy;
+  copy = line;
+  copy.start = p;
+
+  int table[] = {10, 20, 30, 40, 50, 60, 70, 80};
+  int sparse[6] = {[4] = 9, 1};
+  char word[8] = "abc";
+  char greeting[] = "hey";
+  union Value v = {7};
+
+  printf("%d %d %d %d\n", q.x, q.y, line.start.y, line.end.x);
+  printf("%d %d %d %d\n", copy.start.y, copy.end.y, line.start.y,
+         !copy.name);
+  printf("%d %d %d %d\n", table[0], table[7], sparse[4], sparse[5]);
+  printf("%s %s %d %d\n", word, greeting, word[7], *(int*)&v);
+  return 0;
+}
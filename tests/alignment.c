@@ -0,0 +1,59 @@
+typedef unsigned long size_t;
+typedef unsigned long pthread_t;
+
+int printf(const char*, ...);
+int pthread_create(pthread_t*, const void*, void* (*)(void*), void*);
+int pthread_join(pthread_t, void**);
+
+// Each thread bumps its own counter. Keeping the counters on separate cache
+// lines avoids false sharing between the threads.
+struct Counter {
+  alignas(64) long value;
+};
+
+struct Mixed {
+  char c;
+  alignas(16) int v;
+  short s;
+};
+
+typedef int aligned_int __attribute__((aligned(16)));
+
+static struct Counter counters[4] = {{0}};
+alignas(64) static long shared_counters[4] = {0};
+static int flag __attribute__((aligned(32))) = 1;
+
+static void* work(void* arg) {
+  struct Counter* counter = arg;
+  for (int i = 0; i < 1000000; ++i)
+    counter->value += 1;
+  return arg;
+}
+
+int main() {
+  pthread_t threads[4];
+  for (int i = 0; i < 4; ++i)
+    pthread_create(&threads[i], (void*)0, work, &counters[i]);
+  for (int i = 0; i < 4; ++i)
+    pthread_join(threads[i], (void**)0);
+
+  long total = 0;
+  for (int i = 0; i < 4; ++i)
+    total += counters[i].value;
+  printf("%ld %zu %zu\n", total, sizeof(struct Counter),
+         (size_t)&counters[1] - (size_t)&counters[0]);
+
+  printf("%d %d %d %zu\n", (int)((size_t)counters % 64),
+         (int)((size_t)shared_counters % 64), (int)((size_t)&flag % 32),
+         sizeof(shared_counters));
+
+  alignas(128) char buf[3];
+  int local __attribute__((aligned(64))) = 5;
+  int* p = &local;
+  buf[0] = 1;
+  printf("%d %d %d\n", (int)((size_t)buf % 128), (int)((size_t)p % 64), *p);
+
+  printf("%zu %zu %zu\n", sizeof(struct Mixed), alignof(struct Mixed),
+         alignof(aligned_int));
+  return 0;
+}
@@ -0,0 +1,71 @@
+int printf(const char*, ...);
+
+static _Atomic int counter = 0;
+static _Atomic(long) total = 5;
+static _Atomic double average = 1.5;
+
+static int next_ticket(int* ticket) {
+  return __atomic_fetch_add(ticket, 1, __ATOMIC_RELAXED);
+}
+
+static int try_claim(int* owner, int id) {
+  int expected = 0;
+  if (__atomic_compare_exchange_n(owner, &expected, id, /*weak=*/0,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return 0;
+  // The current owner is written back on failure.
+  return expected;
+}
+
+int main() {
+  int ticket = 10;
+  int first = next_ticket(&ticket);
+  int second = next_ticket(&ticket);
+  printf("%d %d %d\n", first, second,
+         __atomic_load_n(&ticket, __ATOMIC_ACQUIRE));
+
+  int owner = 0;
+  int claimed = try_claim(&owner, 7);
+  int contended = try_claim(&owner, 9);
+  printf("%d %d %d\n", claimed, contended, owner);
+
+  unsigned flags = 12;
+  unsigned old_flags = __sync_fetch_and_or(&flags, 3);
+  unsigned new_flags = __sync_and_and_fetch(&flags, 6);
+  unsigned nand = __atomic_nand_fetch(&flags, 3, __ATOMIC_SEQ_CST);
+  printf("%u %u %d\n", old_flags, new_flags, (int)nand);
+
+  int lock = 0;
+  int was_locked = __sync_lock_test_and_set(&lock, 1);
+  int swapped = __sync_bool_compare_and_swap(&lock, 0, 2);
+  int seen = __sync_val_compare_and_swap(&lock, 1, 3);
+  __sync_lock_release(&lock);
+  __atomic_store_n(&ticket, 42, __ATOMIC_RELEASE);
+  int prev = __atomic_exchange_n(&ticket, 43, __ATOMIC_SEQ_CST);
+  printf("%d %d %d %d %d %d\n", was_locked, swapped, seen, lock, prev, ticket);
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  __atomic_signal_fence(__ATOMIC_ACQUIRE);
+  __sync_synchronize();
+
+  counter = 3;
+  counter += 4;
+  ++counter;
+  int post = counter--;
+  total -= 2;
+  total |= 8;
+  __c11_atomic_fetch_sub(&counter, 1, __ATOMIC_RELAXED);
+  printf("%d %d %ld\n", post, __c11_atomic_load(&counter, __ATOMIC_SEQ_CST),
+         total);
+
+  // These have no atomicrmw instruction and need a compare-exchange loop.
+  counter *= 3;
+  counter <<= 1;
+  counter /= 4;
+  counter %= 5;
+  average += 1;
+  average *= 2;
+  double before = average++;
+  printf("%d %.2f %.2f\n", counter, before, average);
+  return 0;
+}
@@ -0,0 +1,89 @@
+typedef unsigned long size_t;
+
+int printf(const char*, ...);
+
+struct Flags {
+  unsigned ready : 1;
+  unsigned mode : 3;
+  int delta : 5;
+  unsigned : 0;
+  unsigned long long stamp : 40;
+  unsigned char tag;
+  unsigned : 4;
+  int tail : 12;
+};
+
+struct Record {
+  unsigned short id;
+  unsigned kind : 4;
+  unsigned level : 4;
+  char code;
+} __attribute__((packed));
+
+struct __attribute__((packed)) Entry {
+  char c;
+  int value;
+  unsigned short count : 9;
+};
+
+struct Line {
+  int x;
+} __attribute__((aligned(64)));
+
+typedef struct {
+  struct Line line;
+  char pad;
+} Lines;
+
+static struct Flags kDefault = {1, 5, -3, 1234567890, 7, -100};
+static struct Record kRecords[] = {{1, 2, 3, 'a'}, {.code = 'b', .level = 15}};
+
+static int sum_entries(struct Entry* entries, int n) {
+  int total = 0;
+  for (int i = 0; i < n; ++i)
+    total += entries[i].value + entries[i].count;
+  return total;
+}
+
+int main() {
+  printf("%zu %zu %zu %zu %zu\n", sizeof(struct Flags), sizeof(struct Record),
+         sizeof(struct Entry), sizeof(struct Line), sizeof(Lines));
+  printf("%zu %zu %zu\n", alignof(struct Flags), alignof(struct Entry),
+         alignof(struct Line));
+
+  printf("%u %u %d %llu %u %d\n", kDefault.ready, kDefault.mode,
+         kDefault.delta, kDefault.stamp, kDefault.tag, kDefault.tail);
+
+  struct Flags f = {0, 7, 15};
+  f.delta = f.delta + 1;
+  f.mode += 2;
+  f.ready = 3;
+  ++f.tail;
+  f.stamp = kDefault.stamp * 300;
+  f.tag = 200;
+  printf("%u %u %d %llu %u %d\n", f.ready, f.mode, f.delta, f.stamp, f.tag,
+         f.tail);
+
+  struct Flags* p = &f;
+  p->delta -= 20;
+  p->mode = p->mode | 4;
+  printf("%d %u %u\n", p->delta, p->mode, p->ready);
+
+  printf("%u %u %u %c %u %u %c\n", kRecords[0].id, kRecords[0].kind,
+         kRecords[0].level, kRecords[0].code, kRecords[1].kind,
+         kRecords[1].level, kRecords[1].code);
+
+  struct Entry entries[3];
+  for (int i = 0; i < 3; ++i) {
+    entries[i].c = 'x';
+    entries[i].value = 1000 * (i + 1);
+    entries[i].count = 511 + i;
+  }
+  printf("%d %u\n", sum_entries(entries, 3), entries[2].count);
+
+  Lines lines;
+  lines.line.x = 7;
+  lines.pad = 1;
+  printf("%d %d\n", lines.line.x, (int)((size_t)&lines.line % 64));
+  return 0;
+}
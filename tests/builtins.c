@@ -0,0 +1,52 @@
+typedef unsigned long size_t;
+
+int printf(const char*, ...);
+
+static int sum(const int* values, int n) {
+  const int* aligned = __builtin_assume_aligned(values, 4);
+  const char* bytes = __builtin_assume_aligned((const char*)values + 1, 4, 1);
+  int total = 0;
+  for (int i = 0; i < n; ++i) {
+    __builtin_prefetch(&aligned[i + 8]);
+    __builtin_prefetch(&aligned[i + 16], 0, 1);
+    total += aligned[i];
+  }
+  return total + (bytes[-1] == values[0]);
+}
+
+static int sign(int x) {
+  if (__builtin_expect(x > 0, 1))
+    return 1;
+  if (__builtin_expect(x < 0, 0))
+    return -1;
+  if (x == 0)
+    return 0;
+  __builtin_unreachable();
+}
+
+int main() {
+  int values[32];
+  __builtin_memset(values, 0, sizeof(values));
+  for (int i = 0; i < 8; ++i)
+    values[i] = i + 1;
+
+  int copy[8];
+  __builtin_memcpy(copy, values, sizeof(copy));
+
+  printf("%d %d %d %d %d\n", sum(values, 8), copy[7], sign(5), sign(-5),
+         sign(0));
+
+  // Integer literal suffixes are ignored so the 64 bit values are built here.
+  unsigned long bit40 = 1;
+  bit40 = bit40 << 40;
+  unsigned long word = 0x01020304;
+  word = (word << 32) | 0x05060708;
+
+  printf("%d %d %d %d\n", __builtin_ctz(8), __builtin_clz(1),
+         __builtin_ctzll(bit40), __builtin_clzl(bit40));
+  printf("%d %d %d\n", __builtin_popcount(255), __builtin_popcountl(word),
+         __builtin_popcountll(bit40 - 1));
+  printf("%x %x %lx\n", __builtin_bswap16(0x1234),
+         __builtin_bswap32(0x12345678), __builtin_bswap64(word));
+  return 0;
+}
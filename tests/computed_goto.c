@@ -0,0 +1,145 @@
+int printf(const char*, ...);
+
+// A small stack machine run by both a switch loop and direct threading.
+enum Opcode {
+  OP_PUSH,
+  OP_ADD,
+  OP_MUL,
+  OP_DUP,
+  OP_OVER,
+  OP_SWAP,
+  OP_DEC,
+  OP_JNZ,
+  OP_JMP,
+  OP_HALT
+};
+
+// Sums the squares of 1 through 10. The stack holds the counter and the sum.
+static const int kProgram[] = {
+    OP_PUSH, 10, OP_PUSH, 0,  OP_OVER, OP_DUP, OP_MUL,  OP_ADD,  OP_SWAP,
+    OP_DEC,  OP_DUP, OP_JNZ, 16, OP_SWAP, OP_HALT, 0, OP_SWAP, OP_JMP, 4,
+};
+
+static int run_switch(const int* code) {
+  int stack[16];
+  int sp = 0;
+  int pc = 0;
+  while (1) {
+    switch ((enum Opcode)code[pc++]) {
+      case OP_PUSH:
+        stack[sp++] = code[pc++];
+        break;
+      case OP_ADD:
+        sp = sp - 1;
+        stack[sp - 1] += stack[sp];
+        break;
+      case OP_MUL:
+        sp = sp - 1;
+        stack[sp - 1] = stack[sp - 1] * stack[sp];
+        break;
+      case OP_DUP:
+        stack[sp] = stack[sp - 1];
+        ++sp;
+        break;
+      case OP_OVER:
+        stack[sp] = stack[sp - 2];
+        ++sp;
+        break;
+      case OP_SWAP: {
+        int tmp = stack[sp - 1];
+        stack[sp - 1] = stack[sp - 2];
+        stack[sp - 2] = tmp;
+        break;
+      }
+      case OP_DEC:
+        stack[sp - 1] = stack[sp - 1] - 1;
+        break;
+      case OP_JNZ:
+        sp = sp - 1;
+        if (stack[sp])
+          pc = code[pc];
+        else
+          ++pc;
+        break;
+      case OP_JMP:
+        pc = code[pc];
+        break;
+      case OP_HALT:
+        return stack[sp - 1];
+    }
+  }
+}
+
+static int run_threaded(const int* code) {
+  void* dispatch[] = {&&op_push, &&op_add, &&op_mul, &&op_dup, &&op_over,
+                      &&op_swap, &&op_dec, &&op_jnz, &&op_jmp, &&op_halt};
+  int stack[16];
+  int sp = 0;
+  int pc = 0;
+  goto *dispatch[code[pc++]];
+
+op_push:
+  stack[sp++] = code[pc++];
+  goto *dispatch[code[pc++]];
+op_add:
+  sp = sp - 1;
+  stack[sp - 1] += stack[sp];
+  goto *dispatch[code[pc++]];
+op_mul:
+  sp = sp - 1;
+  stack[sp - 1] = stack[sp - 1] * stack[sp];
+  goto *dispatch[code[pc++]];
+op_dup:
+  stack[sp] = stack[sp - 1];
+  ++sp;
+  goto *dispatch[code[pc++]];
+op_over:
+  stack[sp] = stack[sp - 2];
+  ++sp;
+  goto *dispatch[code[pc++]];
+op_swap: {
+  int tmp = stack[sp - 1];
+  stack[sp - 1] = stack[sp - 2];
+  stack[sp - 2] = tmp;
+}
+  goto *dispatch[code[pc++]];
+op_dec:
+  stack[sp - 1] = stack[sp - 1] - 1;
+  goto *dispatch[code[pc++]];
+op_jnz:
+  sp = sp - 1;
+  if (stack[sp]) {
+    pc = code[pc];
+  } else {
+    ++pc;
+  }
+  goto *dispatch[code[pc++]];
+op_jmp:
+  pc = code[pc];
+  goto *dispatch[code[pc++]];
+op_halt:
+  return stack[sp - 1];
+}
+
+// Plain gotos jumping both forwards and backwards.
+static int collatz_steps(int n) {
+  int steps = 0;
+loop:
+  if (n == 1)
+    goto done;
+  ++steps;
+  if (n % 2 == 0) {
+    n = n / 2;
+    goto loop;
+  }
+  n = 3 * n + 1;
+  goto loop;
+done:
+  return steps;
+}
+
+int main() {
+  printf("%d %d\n", run_switch(kProgram), run_threaded(kProgram));
+  printf("%d %d\n", collatz_steps(27), collatz_steps(1));
+  return 0;
+}
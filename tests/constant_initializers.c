@@ -0,0 +1,29 @@
+int printf(const char *, ...);
+
+struct Point {
+  int x;
+  int y;
+  const char *name;
+};
+
+unsigned char bytes[16] = {1, 2, 3};
+int negs[4] = {-1, 2};
+int sparse[1000] = {[10] = 7, 8, [999] = 9};
+int zeros[64] = {0};
+char greeting[8] = "hi";
+struct Point origin = {.y = 5, .name = "origin"};
+struct Point points[12] = {{1, 2, "a"}, [3] = {.x = 4}};
+int *ptrs[2] = {0, sparse};
+
+int main() {
+  printf("%d %d %d %d\n", bytes[0], bytes[2], bytes[3], bytes[15]);
+  printf("%d %d %d\n", negs[0], negs[1], negs[3]);
+  printf("%d %d %d %d\n", sparse[10], sparse[11], sparse[12], sparse[999]);
+  printf("%d %d\n", zeros[0], zeros[63]);
+  printf("%s %d\n", greeting, greeting[7]);
+  printf("%d %d %s\n", origin.x, origin.y, origin.name);
+  printf("%d %s %d %d\n", points[0].y, points[0].name, points[3].x,
+         points[11].x);
+  printf("%d\n", ptrs[1][10]);
+  return 0;
+}
@@ -0,0 +1,75 @@
+int printf(const char*, ...);
+double sqrt(double);
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef double v2df __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef long v2di __attribute__((vector_size(16)));
+
+static const double kScale = 2.5;
+static double kTable[] = {1, -0.5, 2e-1, 0x1.8p1};
+static float kHalf = .5f;
+
+struct Point {
+  double x;
+  float y;
+};
+
+static double dot(const double* a, const double* b, int n) {
+  double sum = 0;
+  for (int i = 0; i < n; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+static float lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+static v4sf madd(v4sf a, v4sf b, v4sf c) { return a * b + c; }
+
+static double norm(struct Point p) { return sqrt(p.x * p.x + p.y * p.y); }
+
+int main() {
+  printf("%f %f %f\n", dot(kTable, kTable, 4), kScale * kTable[3], kHalf);
+  printf("%.3f %.3f\n", lerp(1, 3, 0.25f), lerp(-2.0f, 2.0f, kHalf));
+
+  // Conversions between integer and floating types.
+  int i = 7;
+  i *= 0.5;
+  double d = i / 2;
+  d -= 0.25;
+  long l = -3.9;
+  unsigned u = 4000000000.0;
+  printf("%d %f %ld %u %f\n", i, d, l, u, i > 2 ? 1.5 : i);
+
+  // Comparisons with a NaN are false except for !=.
+  double zero = 0;
+  double nan = zero / zero;
+  printf("%d %d %d %d %d\n", nan == nan, nan != nan, nan < 1, 1.0 <= 1,
+         -0.0 == 0.0);
+
+  float f = 1e-3f;
+  f++;
+  f /= 2;
+  struct Point p = {3, 4};
+  printf("%.4f %.1f %f\n", f, norm(p), -p.y);
+
+  v4sf a = {1, 2, 3, 4};
+  v4sf half = {0.5f, 0.5f, 0.5f, 0.5f};
+  v4sf r = madd(a, a, half);
+  printf("%.1f %.1f %d\n", r[0], r[3], (int)(a[1] > 1.5f));
+
+  // Element wise conversions between float and integer vectors.
+  v4si ints = __builtin_convertvector(r, v4si);
+  v4sf floats = __builtin_convertvector(ints, v4sf);
+  v2di longs = {-7, 9};
+  v2df doubles = __builtin_convertvector(longs, v2df);
+  printf("%d %d %.1f %.1f %.1f\n", ints[0], ints[3], floats[3], doubles[0],
+         doubles[1]);
+
+  // Variadic arguments get the default argument promotions. Floats become
+  // doubles and integers narrower than int become ints.
+  short narrow = -5;
+  unsigned char byte = 200;
+  printf("%d %d %.2f\n", narrow, byte, f);
+  return 0;
+}
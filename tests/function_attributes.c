@@ -0,0 +1,43 @@
+typedef unsigned long size_t;
+
+int printf(const char*, ...);
+void* malloc(size_t);
+void free(void*);
+void exit(int) __attribute__((__noreturn__));
+
+static inline int add(int a, int b) { return a + b; }
+
+__attribute__((always_inline)) static inline int twice(int x) {
+  return add(x, x);
+}
+
+__attribute__((noinline, cold)) static void report(const char* msg) {
+  printf("%s\n", msg);
+}
+
+__attribute__((const)) static int square(int x) { return x * x; }
+
+__attribute__((pure, nonnull(1))) static int first(const int* p) {
+  return p[0];
+}
+
+__attribute__((malloc, returns_nonnull)) static int* make_ints(int n) {
+  int* p = malloc(sizeof(int) * (size_t)n);
+  if (!p)
+    exit(1);
+  return p;
+}
+
+__attribute__((hot, flatten, aligned(32))) static int compute(int x) {
+  return twice(x) + square(x);
+}
+
+int main() {
+  int* p = make_ints(2);
+  p[0] = compute(3);
+  p[1] = first(p);
+  report("reported");
+  printf("%d %d\n", p[0], p[1]);
+  free(p);
+  return 0;
+}
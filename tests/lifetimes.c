@@ -0,0 +1,52 @@
+int printf(const char*, ...);
+
+static int fill(char* buf, int n, int seed) {
+  int total = 0;
+  for (int i = 0; i < n; ++i) {
+    buf[i] = (char)(seed + i);
+    total += buf[i];
+  }
+  return total;
+}
+
+// The buffers of the two branches are never live at the same time, so they
+// can share one stack slot.
+static int branches(int which) {
+  int total = 0;
+  if (which) {
+    char a[4096];
+    total = fill(a, 4096, 1);
+  } else {
+    char b[4096];
+    total = fill(b, 4096, 2);
+  }
+  return total;
+}
+
+// Each iteration gets a fresh buffer whose lifetime ends with the iteration.
+static int loop(int n) {
+  int total = 0;
+  for (int i = 0; i < n; ++i) {
+    char scratch[1024];
+    total += fill(scratch, 1024, i);
+    if (i == 2)
+      break;
+  }
+  return total;
+}
+
+static int with_label(int n) {
+  int total = 0;
+again: {
+  char buf[64];
+  total += fill(buf, 64, n);
+}
+  if (--n > 0)
+    goto again;
+  return total;
+}
+
+int main() {
+  printf("%d %d %d %d\n", branches(1), branches(0), loop(10), with_label(3));
+  return 0;
+}
@@ -0,0 +1,9 @@
+static int offset() { return 100; }
+
+int square(int x) { return x * x; }
+
+int sum_of_squares(int n) {
+  int sum = 0;
+  for (int i = 1; i <= n; ++i) sum += square(i);
+  return sum + offset();
+}
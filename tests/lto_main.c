@@ -0,0 +1,13 @@
+int printf(const char*, ...);
+
+int square(int x);
+int sum_of_squares(int n);
+
+// Both files have an internal function with this name. They must stay
+// distinct after the files are linked.
+static int offset() { return 1; }
+
+int main() {
+  printf("%d %d %d\n", square(7), sum_of_squares(4), offset());
+  return 0;
+}
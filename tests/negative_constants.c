@@ -0,0 +1,26 @@
+int printf(const char*, ...);
+
+// Negative int constants widened to a larger type must be sign extended.
+long lg = -1;
+long long llg = -2;
+short sh = -3;
+unsigned long ul = -1;
+long arr[3] = {-1, 1};
+long long larr[2] = {-5, -6};
+short sarr[2] = {-7, 8};
+
+struct S {
+  int i;
+  long l;
+  long long ll;
+};
+
+struct S s = {-1, -2, -3};
+
+int main() {
+  printf("%ld %lld %d %lu\n", lg, llg, (int)sh, ul);
+  printf("%ld %ld %ld\n", arr[0], arr[1], arr[2]);
+  printf("%lld %lld %d %d\n", larr[0], larr[1], (int)sarr[0], (int)sarr[1]);
+  printf("%d %ld %lld\n", s.i, s.l, s.ll);
+  return 0;
+}
@@ -0,0 +1,39 @@
+int printf(const char*, ...);
+
+static int counter = 0;
+static const char* names[] = {"zero", "one", "two"};
+int total = 10;
+
+static int bump(int by) {
+  counter += by;
+  return counter;
+}
+
+static const char* name_of(int i) { return names[i % 3]; }
+
+int square(int x) { return x * x; }
+
+int sum_to(int n) {
+  int res = 0;
+  for (int i = 1; i <= n; ++i) res += i;
+  return res;
+}
+
+void report(const char* label, int value) {
+  printf("%s: %d\n", label, value);
+}
+
+static int fib(int n) {
+  if (n < 2)
+    return n;
+  return fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+  report("bump", bump(3));
+  report("square", square(bump(2)));
+  report("sum", sum_to(total));
+  report("fib", fib(10));
+  printf("%s %s %s\n", name_of(0), name_of(4), name_of(counter));
+  return 0;
+}
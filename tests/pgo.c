@@ -0,0 +1,48 @@
+int printf(const char*, ...);
+
+static int classify(int x) {
+  if (x % 10 == 0)
+    return 2;
+  return x > 50 ? 1 : 0;
+}
+
+static int bucket(int x) {
+  switch (x % 4) {
+    case 0:
+      return 0;
+    case 1:
+      return 1;
+    default:
+      return 2;
+  }
+}
+
+static int edges(int x) {
+  int res = 0;
+  if (x > 90 && x % 2 == 0)
+    res += 1;
+  if (x < 5 || x > 97)
+    res += 1;
+  return res;
+}
+
+int main() {
+  int counts[3] = {0, 0, 0};
+  for (int i = 0; i < 100; ++i)
+    counts[classify(i)] += 1;
+
+  int loops = 0;
+  while (loops < 3)
+    ++loops;
+
+  printf("%d %d %d %d\n", counts[0], counts[1], counts[2], loops);
+
+  int buckets[3] = {0, 0, 0};
+  int num_edges = 0;
+  for (int i = 0; i < 100; ++i) {
+    buckets[bucket(i)] += 1;
+    num_edges += edges(i);
+  }
+  printf("%d %d %d %d\n", buckets[0], buckets[1], buckets[2], num_edges);
+  return 0;
+}
@@ -0,0 +1,46 @@
+// A saxpy-style kernel with and without restrict. The restrict versions get
+// noalias parameters or scoped alias metadata so the vectorizer can skip the
+// runtime overlap checks the plain version needs. This uses ints since
+// floating point arithmetic is not supported yet.
+int printf(const char*, ...);
+
+__attribute__((noinline)) void saxpy(int n, int a, const int* x, int* y) {
+  for (int i = 0; i < n; ++i)
+    y[i] = a * x[i] + y[i];
+}
+
+__attribute__((noinline)) void saxpy_restrict(int n, int a,
+                                              const int* restrict x,
+                                              int* restrict y) {
+  for (int i = 0; i < n; ++i)
+    y[i] = a * x[i] + y[i];
+}
+
+__attribute__((noinline)) void saxpy_restrict_locals(int n, int a, int* xs,
+                                                     int* ys) {
+  const int* restrict x = xs;
+  int* restrict y = ys;
+  for (int i = 0; i < n; ++i)
+    y[i] = a * x[i] + y[i];
+}
+
+int main() {
+  int x[1000];
+  int y[1000];
+  for (int i = 0; i < 1000; ++i) {
+    x[i] = i;
+    y[i] = 1000 - i;
+  }
+
+  for (int iter = 0; iter < 1000; ++iter) {
+    saxpy(1000, 3, x, y);
+    saxpy_restrict(1000, 3, x, y);
+    saxpy_restrict_locals(1000, 3, x, y);
+  }
+
+  long sum = 0;
+  for (int i = 0; i < 1000; ++i)
+    sum += y[i];
+  printf("%ld\n", sum);
+  return 0;
+}
@@ -0,0 +1,25 @@
+int printf(const char*, ...);
+
+int counter = 3;
+int zeroed = 0;
+const int kLimit = 10;
+const int* const kLimitPtr = &kLimit;
+_Thread_local int per_thread = 4;
+_Thread_local int per_thread_zero = 0;
+int unused_table[4] = {1, 2, 3, 4};
+
+int unused_helper(int x) {
+  return x * unused_table[x & 3];
+}
+
+static int bump(int x) {
+  counter += x;
+  return counter;
+}
+
+int main() {
+  per_thread += per_thread_zero + zeroed;
+  printf("%d %d %d\n", bump(2), *kLimitPtr, per_thread);
+  printf("%s\n", "done");
+  return 0;
+}
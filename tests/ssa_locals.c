@@ -0,0 +1,33 @@
+int printf(const char *, ...);
+
+int sum_skipping_multiples_of_3(int n) {
+  int s = 0;
+  for (int i = 0; i < n; ++i) {
+    if (i % 3 == 0)
+      continue;
+    s += i;
+  }
+  return s;
+}
+
+int count_until(int limit) {
+  int j = 0;
+  while (j < 10) {
+    j++;
+    if (j == limit)
+      break;
+  }
+  return j;
+}
+
+int set_through_ptr(int x) {
+  int *p = &x;
+  *p = 3;
+  return x;
+}
+
+int main() {
+  printf("%d %d %d\n", sum_skipping_multiples_of_3(10), count_until(4),
+         set_through_ptr(1));
+  return 0;
+}
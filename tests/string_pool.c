@@ -0,0 +1,36 @@
+int printf(const char*, ...);
+
+static const char* kGreeting = "value %d\n";
+static const char* kNames[] = {"alpha", "beta", "alpha"};
+
+static void log_value(int v) {
+  printf("value %d\n", v);
+}
+
+static const char* name() {
+  return __PRETTY_FUNCTION__;
+}
+
+static int padded_length() {
+  char big[4096] = "hello";
+  int len = 0;
+  for (int i = 0; i < 4096; ++i)
+    len += big[i] != 0;
+  return len;
+}
+
+int main() {
+  char buf[] = "alpha";
+  buf[0] = 'A';
+
+  log_value(1);
+  printf("value %d\n", 2);
+  printf(kGreeting, 3);
+
+  printf("%d %d %d\n", kNames[0] == kNames[2], kNames[0] == "alpha",
+         kGreeting == "value %d\n");
+  printf("%s %s %s %s\n", buf, kNames[0], name(), __PRETTY_FUNCTION__);
+  printf("%d\n", __PRETTY_FUNCTION__ == __PRETTY_FUNCTION__);
+  printf("%d\n", padded_length());
+  return 0;
+}
@@ -0,0 +1,18 @@
+int printf(const char*, ...);
+
+int counter = 3;
+_Thread_local int per_thread = 2;
+
+static int add_counter(int x) {
+  return x + counter;
+}
+
+int helper(int x) {
+  return add_counter(x) * 2;
+}
+
+int main() {
+  counter = counter + per_thread;
+  printf("%d %d\n", helper(1), per_thread);
+  return 0;
+}
@@ -0,0 +1,62 @@
+int printf(const char*, ...);
+
+// Each call below is in tail position. Running a few million levels deep only
+// works if the calls reuse the frame of their caller.
+static int is_even(unsigned n);
+
+static int is_odd(unsigned n) {
+  if (n == 0)
+    return 0;
+  return is_even(n - 1);
+}
+
+static int is_even(unsigned n) {
+  if (n == 0)
+    return 1;
+  __attribute__((musttail)) return is_odd(n - 1);
+}
+
+// A continuation-passing interpreter dispatching through a table of handlers.
+typedef long (*Handler)(const int* pc, long acc);
+
+static long op_add(const int* pc, long acc);
+static long op_dec(const int* pc, long acc);
+static long op_halt(const int* pc, long acc);
+
+static Handler kHandlers[] = {op_add, op_dec, op_halt};
+
+static long dispatch(const int* pc, long acc) {
+  __attribute__((musttail)) return kHandlers[*pc](pc, acc);
+}
+
+static long op_add(const int* pc, long acc) {
+  __attribute__((musttail)) return dispatch(pc + 2, acc + pc[1]);
+}
+
+static long op_dec(const int* pc, long acc) {
+  if (acc <= 7)
+    return dispatch(pc + 1, acc);
+  return dispatch(pc, acc - 1);
+}
+
+static long op_halt(const int* pc, long acc) { return acc; }
+
+static int sum(const int* values, int n) {
+  int total = 0;
+  for (int i = 0; i < n; ++i)
+    total += values[i];
+  return total;
+}
+
+// The callee may read the local array, so this call cannot reuse the frame.
+static int sum_local(int n) {
+  int values[4] = {n, n, n, n};
+  return sum(values, 4);
+}
+
+int main() {
+  int program[] = {0, 3000000, 1, 2};
+  printf("%d %d\n", is_even(5000000), is_odd(5000001));
+  printf("%ld %d\n", dispatch(program, 0), sum_local(3));
+  return 0;
+}
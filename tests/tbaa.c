@@ -0,0 +1,36 @@
+int printf(const char*, ...);
+
+struct Point {
+  int x;
+  int y;
+};
+
+// An int and a float can not be the same object, so this returns 1.
+int store_float(int* i, float* f) {
+  *i = 1;
+  *f = 2;
+  return *i;
+}
+
+// Neither can two members at different offsets.
+int store_member(struct Point* p, struct Point* q) {
+  p->x = 1;
+  q->y = 2;
+  return p->x;
+}
+
+// Characters may alias anything, so this reloads the int.
+int store_char(int* i, char* c) {
+  *i = 1;
+  *c = 2;
+  return *i;
+}
+
+int main() {
+  int i;
+  float f;
+  struct Point p;
+  printf("%d %d %d\n", store_float(&i, &f), store_member(&p, &p),
+         store_char(&i, (char*)&i));
+  return 0;
+}
@@ -0,0 +1,36 @@
+int printf(const char*, ...);
+
+typedef unsigned long pthread_t;
+int pthread_create(pthread_t*, const void*, void* (*)(void*), void*);
+int pthread_join(pthread_t, void**);
+
+thread_local int hits = 0;
+static _Thread_local int local_hits = 0;
+__thread long initial
+    __attribute__((tls_model("initial-exec"))) = 100;
+extern thread_local int errno_like;
+
+static void* count(void* arg) {
+  int n = *(int*)arg;
+  for (int i = 0; i < n; ++i) {
+    ++hits;
+    local_hits += 2;
+  }
+  initial += hits;
+  printf("%d %d %ld\n", hits, local_hits, initial);
+  return arg;
+}
+
+int main() {
+  int n = 3;
+  count(&n);
+
+  // The new thread starts with fresh copies of every variable.
+  pthread_t thread;
+  int m = 5;
+  pthread_create(&thread, (void*)0, count, &m);
+  pthread_join(thread, (void**)0);
+
+  printf("%d %d %ld\n", hits, local_hits, initial);
+  return 0;
+}
@@ -0,0 +1,52 @@
+typedef unsigned long size_t;
+
+int printf(const char*, ...);
+
+typedef int v4si __attribute__((vector_size(16)));
+typedef short v4hi __attribute__((vector_size(8)));
+typedef unsigned char v8qi __attribute__((vector_size(8)));
+typedef float v4f __attribute__((vector_size(16)));
+typedef int int3 __attribute__((ext_vector_type(3)));
+typedef int int8 __attribute__((ext_vector_type(8)));
+
+static const v4si kBias = {100, 200, 300, 400};
+
+static v4si madd(v4si a, v4si b, int scale) { return a * scale + b; }
+
+static int sum8(int8 v) {
+  int total = 0;
+  for (int i = 0; i < 8; ++i)
+    total += v[i];
+  return total;
+}
+
+int main() {
+  v4si a = {1, 2, 3, 4};
+  v4si b = {10, 20, 30, 40};
+  v4si c = madd(a, b, 3) + kBias;
+  c[1] = -c[1];
+  printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+
+  v4si mask = a > 2;
+  v4si sel = (b & mask) | (a & ~mask);
+  v4si shifted = (b >> 1) - a;
+  printf("%d %d %d %d %d\n", mask[0], mask[3], sel[1], sel[2], shifted[3]);
+
+  v4si rev = __builtin_shufflevector(a, b, 3, 2, 1, 0);
+  int8 wide = __builtin_shufflevector(a, b, 0, 1, 2, 3, 4, 5, 6, 7);
+  printf("%d %d %d\n", rev[0], rev[3], sum8(wide));
+
+  v4hi h = {-1, 2, -3, 4};
+  v4si w = __builtin_convertvector(h, v4si);
+  v8qi bytes = (v8qi)h;
+  printf("%d %d %d %d\n", w[0], w[2], (int)bytes[0], (int)bytes[2]);
+
+  v4f fv = {1.5f, -2.5f, 3.0f, 4.75f};
+  v4si truncated = __builtin_convertvector(fv, v4si);
+  v4f back = __builtin_convertvector(a, v4f);
+  printf("%d %d %d %.1f\n", truncated[0], truncated[1], truncated[3],
+         back[3] + 0.5f);
+
+  printf("%zu %zu %zu\n", sizeof(v4si), sizeof(int3), sizeof(int8));
+  return 0;
+}